@@ -0,0 +1,1426 @@
+// Headless benchmarks for the portable stock core
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "stock.h"
+#include "stock_platform.h"
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Monotonic clock in nanoseconds
+static double NowNs(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+// Start a new peak resident set measurement (Linux only; elsewhere the peak
+// covers the whole run, which is why the suite runs the sizes smallest first)
+static void ResetPeakMemory(void)
+{
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file == NULL) return;
+    
+    fputs("5", file);
+    fclose(file);
+#endif
+}
+
+// Peak resident set in KB since ResetPeakMemory
+static long PeakMemoryKb(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file != NULL)
+    {
+        char line[128];
+        long peak = -1;
+        
+        while (peak < 0 && fgets(line, sizeof(line), file) != NULL)
+        {
+            if (strncmp(line, "VmHWM:", 6) == 0) peak = strtol(line + 6, NULL, 10);
+        }
+        fclose(file);
+        if (peak >= 0) return peak;
+    }
+#endif
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Small deterministic PRNG so runs are comparable
+static unsigned NextRandom(unsigned* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void FillInventory(StockManager* manager, int count)
+{
+    char name[64];
+    char category[32];
+    
+    ReserveStockItems(manager, count);
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "Product %d", i);
+        snprintf(category, sizeof(category), "Category %d", i % 40);
+        AddStockItem(manager, name, category, i % 100);
+    }
+}
+
+// FindStockItem latency should stay flat as the inventory grows
+static void BenchFind(int count, int lookups)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    char name[64];
+    unsigned seed = 12345;
+    int found = 0;
+    
+    double start = NowNs();
+    for (int i = 0; i < lookups; i++)
+    {
+        snprintf(name, sizeof(name), "Product %d", (int)(NextRandom(&seed) % (unsigned)count));
+        if (FindStockItem(&manager, name) >= 0) found++;
+    }
+    double elapsed = NowNs() - start;
+    
+    printf("find       items=%-9d lookups=%-8d ns/lookup=%8.1f found=%d\n",
+           count, lookups, elapsed / lookups, found);
+    
+    FreeStockManager(&manager);
+}
+
+// RemoveStockItemById cost should not depend on the inventory size
+static void BenchRemove(int count, int removals)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    if (removals > count) removals = count;
+    unsigned seed = 777;
+    int removed = 0;
+    
+    double start = NowNs();
+    for (int i = 0; i < removals; i++)
+    {
+        int index = (int)(NextRandom(&seed) % (unsigned)manager.itemCount);
+        if (RemoveStockItemById(&manager, StockItemAt(&manager, index)->id)) removed++;
+    }
+    double elapsed = NowNs() - start;
+    
+    printf("remove     items=%-9d removals=%-7d ns/remove=%8.1f removed=%d\n",
+           count, removals, elapsed / removals, removed);
+    
+    FreeStockManager(&manager);
+}
+
+// Multi-key sort (category, name, stock desc); the second call hits the cache
+static void BenchSort(int count)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    StockSortKey keys[3] = {
+        { STOCK_SORT_CATEGORY, 0 },
+        { STOCK_SORT_NAME, 0 },
+        { STOCK_SORT_STOCK, 1 }
+    };
+    
+    double start = NowNs();
+    SortStockItemsBy(&manager, keys, 3);
+    double sorted = NowNs();
+    SortStockItemsBy(&manager, keys, 3);
+    double cached = NowNs();
+    
+    printf("sort       items=%-9d ms/sort=%9.2f ns/cached=%8.1f\n",
+           count, (sorted - start) / 1e6, cached - sorted);
+    
+    FreeStockManager(&manager);
+}
+
+// Substring search through the trigram index against the plain scan it replaces
+static int ScanSearch(StockManager* manager, const char* term)
+{
+    int matches = 0;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        StockItem* item = GetStockItem(manager, i);
+        if (strstr(item->name, term) != NULL ||
+            strstr(GetStockItemCategory(manager, item), term) != NULL) matches++;
+    }
+    
+    return matches;
+}
+
+static void BenchSearch(int count, int queries)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    StockItem* results = (StockItem*)malloc((size_t)count * sizeof(StockItem));
+    char term[32];
+    unsigned seed = 4242;
+    int agree = 1;
+    
+    // The first search builds the index
+    double start = NowNs();
+    int resultCount = 0;
+    SearchStockItems(&manager, "Product 1", results, &resultCount);
+    double built = NowNs();
+    
+    double indexedNs = 0;
+    double foldedNs = 0;
+    double scanNs = 0;
+    for (int q = 0; q < queries; q++)
+    {
+        snprintf(term, sizeof(term), "%d", 100 + (int)(NextRandom(&seed) % (unsigned)(count - 100)));
+        
+        double before = NowNs();
+        SearchStockItems(&manager, term, results, &resultCount);
+        double middle = NowNs();
+        int scanned = ScanSearch(&manager, term);
+        double after = NowNs();
+        int exactCount = resultCount;
+        SearchStockItemsMode(&manager, term, STOCK_SEARCH_FOLDED, results, &resultCount);
+        double folded = NowNs();
+        
+        indexedNs += middle - before;
+        scanNs += after - middle;
+        foldedNs += folded - after;
+        if (resultCount != exactCount) agree = 0;
+        if (scanned != exactCount) agree = 0;
+    }
+    
+    // Keep the index current through renames, then search again
+    double editStart = NowNs();
+    for (int i = 0; i < count / 10; i++)
+    {
+        StockItem* item = GetStockItem(&manager, i);
+        snprintf(term, sizeof(term), "Renamed %d", i);
+        UpdateStockItem(&manager, i, term, GetStockItemCategory(&manager, item), item->stock);
+    }
+    double edited = NowNs();
+    SearchStockItems(&manager, "Renamed 1", results, &resultCount);
+    if (resultCount != ScanSearch(&manager, "Renamed 1")) agree = 0;
+    
+    printf("search     items=%-9d ms/build=%8.2f us/indexed=%8.2f us/folded=%8.2f us/scan=%10.2f ns/rename=%7.1f agree=%d\n",
+           count, (built - start) / 1e6, indexedNs / queries / 1e3, foldedNs / queries / 1e3, scanNs / queries / 1e3,
+           (edited - editStart) / (count / 10), agree);
+    
+    free(results);
+    FreeStockManager(&manager);
+}
+
+// Throughput of one pass over the packed name column per scan kernel, against
+// strstr over each item's name
+static void BenchScan(int count, int passes)
+{
+    static const char* kernelNames[] = { "scalar", "sse2", "avx2" };
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    StockItem* results = (StockItem*)malloc((size_t)count * sizeof(StockItem));
+    const char* term = "Product 4242x";    // Long enough to verify, never matches
+    int resultCount = 0;
+    double nameBytes = 0;
+    
+    for (int i = 0; i < count; i++)
+    {
+        nameBytes += (double)strlen(GetStockItem(&manager, i)->name) + 1;
+    }
+    
+    double start = NowNs();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (strstr(StockItemAt(&manager, i)->name, term) != NULL) resultCount++;
+        }
+    }
+    double loopNs = (NowNs() - start) / passes;
+    
+    printf("scan       items=%-9d MB=%7.1f loop GB/s=%6.2f", count, nameBytes / 1e6, nameBytes / loopNs);
+    
+    int best = SetStockScanKernel(STOCK_SCAN_AUTO);
+    for (int kernel = STOCK_SCAN_SCALAR; kernel <= best; kernel++)
+    {
+        SetStockScanKernel(kernel);
+        SearchStockItemsMode(&manager, term, STOCK_SEARCH_SCAN, results, &resultCount);
+        
+        start = NowNs();
+        for (int pass = 0; pass < passes; pass++)
+        {
+            SearchStockItemsMode(&manager, term, STOCK_SEARCH_SCAN, results, &resultCount);
+        }
+        double scanNs = (NowNs() - start) / passes;
+        
+        printf(" %s GB/s=%6.2f", kernelNames[kernel], nameBytes / scanNs);
+    }
+    printf("\n");
+    
+    SetStockScanKernel(STOCK_SCAN_AUTO);
+    free(results);
+    FreeStockManager(&manager);
+}
+
+// Quantity filters per kernel against the array-of-structs loop they replace;
+// every kernel's index list is checked against the loop's
+static void BenchQuantityFilter(int count, int passes)
+{
+    static const char* kernelNames[] = { "scalar", "sse2", "avx2" };
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    int* expected = (int*)malloc((size_t)count * sizeof(int));
+    int* indices = (int*)malloc((size_t)count * sizeof(int));
+    int thresholds[40];
+    int expectedCount = 0;
+    int agree = 1;
+    
+    for (int code = 0; code < 40; code++) thresholds[code] = code % 20;
+    
+    double start = NowNs();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        expectedCount = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const StockItem* item = StockItemAt(&manager, i);
+            if (item->stock >= 10 && item->stock <= 30) expected[expectedCount++] = i;
+        }
+    }
+    double loopNs = (NowNs() - start) / passes;
+    
+    printf("quantity   items=%-9d hits=%-8d loop us=%8.1f", count, expectedCount, loopNs / 1e3);
+    
+    int best = SetStockScanKernel(STOCK_SCAN_AUTO);
+    for (int kernel = STOCK_SCAN_SCALAR; kernel <= best; kernel++)
+    {
+        SetStockScanKernel(kernel);
+        GetStockItemsInRange(&manager, 10, 30, indices, count);
+        
+        start = NowNs();
+        int found = 0;
+        for (int pass = 0; pass < passes; pass++)
+        {
+            found = GetStockItemsInRange(&manager, 10, 30, indices, count);
+        }
+        double rangeNs = (NowNs() - start) / passes;
+        
+        if (found != expectedCount || memcmp(indices, expected, (size_t)found * sizeof(int)) != 0) agree = 0;
+        
+        // Per-category thresholds against a scalar check of the same rule
+        int low = GetLowStockItemsByCategory(&manager, thresholds, 40, indices, count);
+        int checked = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const StockItem* item = StockItemAt(&manager, i);
+            if (item->stock <= thresholds[item->categoryId] && (checked >= low || indices[checked++] != i)) agree = 0;
+        }
+        if (checked != low) agree = 0;
+        
+        printf(" %s us=%8.1f", kernelNames[kernel], rangeNs / 1e3);
+    }
+    printf(" agree=%d\n", agree);
+    
+    SetStockScanKernel(STOCK_SCAN_AUTO);
+    free(expected);
+    free(indices);
+    FreeStockManager(&manager);
+}
+
+// Ordered index against the column filter: counting and short lists stay
+// O(log n + k) while a filter touches every item
+static void BenchQuantityIndex(int count, int queries)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    int* indices = (int*)malloc((size_t)count * sizeof(int));
+    unsigned state = 12345;
+    int agree = 1;
+    
+    for (int i = 0; i < count; i += 7) SetStockReorderLevel(&manager, i, 15);
+    
+    double start = NowNs();
+    CountStockItemsAtOrBelow(&manager, 0);
+    double buildNs = NowNs() - start;
+    
+    start = NowNs();
+    for (int q = 0; q < queries; q++)
+    {
+        CountStockItemsAtOrBelow(&manager, (int)(NextRandom(&state) % 100));
+    }
+    double countNs = (NowNs() - start) / queries;
+    
+    start = NowNs();
+    for (int q = 0; q < queries; q++)
+    {
+        GetStockItemsInRange(&manager, 0, (int)(NextRandom(&state) % 100), NULL, 0);
+    }
+    double filterNs = (NowNs() - start) / queries;
+    
+    for (int threshold = 0; threshold < 100; threshold += 9)
+    {
+        if (CountStockItemsAtOrBelow(&manager, threshold) != GetStockItemsInRange(&manager, 0, threshold, NULL, 0)) agree = 0;
+    }
+    
+    start = NowNs();
+    for (int q = 0; q < queries; q++)
+    {
+        GetLowestStockItems(&manager, 10, indices);
+        GetHighestStockItems(&manager, 10, indices);
+    }
+    double topNs = (NowNs() - start) / queries / 2;
+    
+    // Every edit keeps the index current: one remove and one insert per tree
+    start = NowNs();
+    for (int q = 0; q < queries; q++)
+    {
+        int index = (int)(NextRandom(&state) % (unsigned)count);
+        StockItem* item = GetStockItem(&manager, index);
+        AdjustStockItem(&manager, index, item->stock > 50 ? -7 : 7);
+    }
+    double adjustNs = (NowNs() - start) / queries;
+    
+    int reorder = GetStockItemsToReorder(&manager, indices, count);
+    for (int i = 0; i < reorder; i++)
+    {
+        const StockItem* item = GetStockItem(&manager, indices[i]);
+        if (item->stock > item->reorderLevel) agree = 0;
+    }
+    
+    printf("ordered    items=%-9d build ms=%7.1f count us=%6.2f filter us=%8.1f top10 us=%6.2f adjust us=%5.2f agree=%d\n",
+           count, buildNs / 1e6, countNs / 1e3, filterNs / 1e3, topNs / 1e3, adjustNs / 1e3, agree);
+    
+    free(indices);
+    FreeStockManager(&manager);
+}
+
+// One page of results against copying every match: paging through the index
+// views touches only the page, the copying queries move 272-byte items
+static void BenchPaging(int count, int queries)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    StockItem* results = (StockItem*)malloc((size_t)count * sizeof(StockItem));
+    int* all = (int*)malloc((size_t)count * sizeof(int));
+    int page[50];
+    int resultCount = 0;
+    int agree = 1;
+    
+    // "Product 1" matches about a tenth of the items
+    double start = NowNs();
+    for (int q = 0; q < queries; q++) SearchStockItems(&manager, "Product 1", results, &resultCount);
+    double searchCopyNs = (NowNs() - start) / queries;
+    
+    start = NowNs();
+    for (int q = 0; q < queries; q++) SearchStockItemIndices(&manager, "Product 1", STOCK_SEARCH_EXACT, 0, page, 50);
+    double searchPageNs = (NowNs() - start) / queries;
+    
+    int matches = SearchStockItemIndices(&manager, "Product 1", STOCK_SEARCH_EXACT, 0, all, count);
+    int got = SearchStockItemIndices(&manager, "Product 1", STOCK_SEARCH_EXACT, matches / 2, page, 50);
+    if (matches != resultCount || memcmp(page, all + matches / 2, (size_t)got * sizeof(int)) != 0) agree = 0;
+    
+    start = NowNs();
+    for (int q = 0; q < queries; q++) GetLowStockItems(&manager, 20, results, &resultCount);
+    double lowCopyNs = (NowNs() - start) / queries;
+    
+    start = NowNs();
+    for (int q = 0; q < queries; q++) GetLowStockItemIndices(&manager, 20, resultCount / 2, page, 50);
+    double lowPageNs = (NowNs() - start) / queries;
+    
+    got = GetLowStockItemIndices(&manager, 20, resultCount / 2, page, 50);
+    for (int i = 0; i < got; i++)
+    {
+        if (StockItemAt(&manager, page[i])->id != results[resultCount / 2 + i].id) agree = 0;
+    }
+    
+    printf("paging     items=%-9d search all us=%9.1f page us=%8.1f  low all us=%9.1f mid-page us=%6.2f agree=%d\n",
+           count, searchCopyNs / 1e3, searchPageNs / 1e3, lowCopyNs / 1e3, lowPageNs / 1e3, agree);
+    
+    free(results);
+    free(all);
+    FreeStockManager(&manager);
+}
+
+// List refresh after one edit: formatting every row (what re-inserting all
+// rows costs before any UI work) against the rows of one screen
+static void BenchRowModel(int count, int edits)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    StockRowModel rows;
+    InitStockRowModel(&rows, &manager);
+    TakeStockRowUpdate(&rows, NULL, NULL);
+    
+    volatile size_t textBytes = 0;     // Keeps the text reads from being optimized out
+    double start = NowNs();
+    for (int row = 0; row < count; row++)
+    {
+        for (int column = 0; column < STOCK_COLUMN_COUNT; column++) textBytes += strlen(GetStockRowText(&rows, row, column));
+    }
+    double allNs = NowNs() - start;
+    
+    unsigned state = 99;
+    int redrawn = 0;
+    start = NowNs();
+    for (int e = 0; e < edits; e++)
+    {
+        int index = (int)(NextRandom(&state) % (unsigned)count);
+        int first, last;
+        
+        AdjustStockItem(&manager, index, 1);
+        TakeStockRowUpdate(&rows, &first, &last);
+        redrawn += last - first + 1;
+        
+        // The view asks for the 40 rows on screen
+        int top = index - index % 40;
+        HintStockRows(&rows, top, top + 39);
+        for (int row = top; row < top + 40 && row < count; row++)
+        {
+            for (int column = 0; column < STOCK_COLUMN_COUNT; column++) textBytes += strlen(GetStockRowText(&rows, row, column));
+        }
+    }
+    double editNs = (NowNs() - start) / edits;
+    
+    printf("rows       items=%-9d all rows ms=%8.2f edit+screen us=%6.2f redrawn/edit=%.1f\n",
+           count, allNs / 1e6, editNs / 1e3, (double)redrawn / edits);
+    
+    FreeStockRowModel(&rows);
+    FreeStockManager(&manager);
+}
+
+static void CountChanges(StockManager* manager, const StockChange* changes, int count, void* context)
+{
+    (void)manager;
+    (void)changes;
+    ((int*)context)[0]++;
+    ((int*)context)[1] += count;
+}
+
+// Cost of publishing changes, and how much batching coalesces: batches of 100
+// edits over a small working set of items
+static void BenchChangeEvents(int count, int edits)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    unsigned state = 17;
+    double start = NowNs();
+    for (int e = 0; e < edits; e++) AdjustStockItem(&manager, (int)(NextRandom(&state) % (unsigned)count), 1);
+    double plainNs = (NowNs() - start) / edits;
+    
+    int received[2] = { 0, 0 };     // Deliveries, changes
+    int handle = SubscribeStockChanges(&manager, CountChanges, received);
+    
+    start = NowNs();
+    for (int e = 0; e < edits; e++) AdjustStockItem(&manager, (int)(NextRandom(&state) % (unsigned)count), 1);
+    double immediateNs = (NowNs() - start) / edits;
+    
+    received[0] = received[1] = 0;
+    start = NowNs();
+    for (int e = 0; e < edits; e += 100)
+    {
+        int base = (int)(NextRandom(&state) % (unsigned)count);
+        BeginStockBatch(&manager);
+        for (int i = 0; i < 100; i++) AdjustStockItem(&manager, (base + (int)(NextRandom(&state) % 20)) % count, 1);
+        EndStockBatch(&manager);
+    }
+    double batchedNs = (NowNs() - start) / edits;
+    
+    printf("events     items=%-9d edit ns: none=%6.1f immediate=%6.1f batched=%6.1f changes/batch=%.1f of 100\n",
+           count, plainNs, immediateNs, batchedNs, (double)received[1] / received[0]);
+    
+    UnsubscribeStockChanges(&manager, handle);
+    FreeStockManager(&manager);
+}
+
+// Screen redraws with an edit now and then: wide text converted on every
+// redraw against text served from the display cache
+static void BenchDisplayCache(int count, int redraws)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    StockWideChar wide[MAX_NAME_LENGTH];
+    char quantity[12];
+    volatile size_t units = 0;          // Keeps the conversions from being optimized out
+    unsigned state = 5;
+    int top = 0;
+    
+    double start = NowNs();
+    for (int r = 0; r < redraws; r++)
+    {
+        // Mostly small scrolls, now and then a jump
+        top += (int)(NextRandom(&state) % 5) - 2;
+        if (NextRandom(&state) % 50 == 0) top = (int)(NextRandom(&state) % (unsigned)count);
+        if (top < 0) top = 0;
+        if (top > count - 40) top = count > 40 ? count - 40 : 0;
+        
+        for (int row = top; row < top + 40 && row < count; row++)
+        {
+            StockItem* item = GetStockItem(&manager, row);
+            snprintf(quantity, sizeof(quantity), "%d", item->stock);
+            units += WidenStockText(item->name, wide, MAX_NAME_LENGTH);
+            units += WidenStockText(GetStockItemCategory(&manager, item), wide, MAX_NAME_LENGTH);
+            units += WidenStockText(quantity, wide, MAX_NAME_LENGTH);
+        }
+    }
+    double convertNs = (NowNs() - start) / redraws;
+    
+    state = 5;
+    top = 0;
+    start = NowNs();
+    for (int r = 0; r < redraws; r++)
+    {
+        top += (int)(NextRandom(&state) % 5) - 2;
+        if (NextRandom(&state) % 50 == 0) top = (int)(NextRandom(&state) % (unsigned)count);
+        if (top < 0) top = 0;
+        if (top > count - 40) top = count > 40 ? count - 40 : 0;
+        if (r % 10 == 0) AdjustStockItem(&manager, top, 1);
+        
+        for (int row = top; row < top + 40 && row < count; row++)
+        {
+            StockDisplayText text;
+            GetStockDisplayText(&manager, row, &text);
+            units += text.name[0] + text.category[0] + text.quantity[0];
+        }
+    }
+    double cachedNs = (NowNs() - start) / redraws;
+    
+    StockDisplayStats stats;
+    GetStockDisplayStats(&manager, &stats);
+    printf("display    items=%-9d convert us=%6.2f cached us=%6.2f hit rate=%5.1f%% conversions/redraw=%.1f\n",
+           count, convertNs / 1e3, cachedNs / 1e3,
+           100.0 * stats.hits / (stats.hits + stats.misses), (double)stats.conversions / redraws);
+    
+    FreeStockManager(&manager);
+}
+
+static long FileSize(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) return -1;
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+// Size and save/load time of the legacy v1 layout against the compact v2 one
+static void BenchFileFormats(int count)
+{
+    static const char* files[2] = { "bench_stock_v1.dat", "bench_stock_v2.dat" };
+    static const int formats[2] = { STOCK_FILE_FORMAT_V1, STOCK_FILE_FORMAT_V2 };
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    for (int f = 0; f < 2; f++)
+    {
+        double start = NowNs();
+        SaveStockToFileFormat(&manager, files[f], formats[f]);
+        double saved = NowNs();
+        
+        StockManager loaded;
+        InitStockManager(&loaded);
+        int ok = LoadStockFromFile(&loaded, files[f]) && loaded.itemCount == count;
+        double elapsed = NowNs() - saved;
+        
+        printf("file v%d    items=%-9d bytes=%-10ld bytes/item=%6.1f ms/save=%8.2f ms/load=%8.2f ok=%d\n",
+               formats[f], count, FileSize(files[f]), (double)FileSize(files[f]) / count,
+               (saved - start) / 1e6, elapsed / 1e6, ok);
+        
+        FreeStockManager(&loaded);
+        remove(files[f]);
+    }
+    
+    FreeStockManager(&manager);
+}
+
+// Time to first screen: load and read the first rows, eager versus mapped
+static void BenchStartup(int count, int rows)
+{
+    static const char* file = "bench_stock_startup.dat";
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    SaveStockToFile(&manager, file);
+    
+    for (int mapped = 0; mapped < 2; mapped++)
+    {
+        StockManager loaded;
+        InitStockManager(&loaded);
+        
+        double start = NowNs();
+        int ok = mapped ? LoadStockFromFileMapped(&loaded, file) : LoadStockFromFile(&loaded, file);
+        long checksum = 0;
+        for (int i = 0; i < rows && i < loaded.itemCount; i++)
+        {
+            checksum += GetStockItem(&loaded, i)->stock;
+        }
+        double elapsed = NowNs() - start;
+        
+        // Every item must survive the round trip, decoded lazily or not
+        ok = ok && loaded.itemCount == count && EnsureStockResident(&loaded);
+        for (int i = 0; ok && i < count; i++)
+        {
+            StockItem* expected = GetStockItem(&manager, i);
+            StockItem* actual = GetStockItem(&loaded, i);
+            
+            ok = actual->id == expected->id && actual->stock == expected->stock &&
+                 strcmp(actual->name, expected->name) == 0 &&
+                 strcmp(GetStockItemCategory(&loaded, actual), GetStockItemCategory(&manager, expected)) == 0;
+        }
+        ok = ok && FindStockItemById(&loaded, count / 2) == count / 2 - 1 && FindStockItem(&loaded, "Product 7") == 7;
+        
+        printf("startup %-6s items=%-9d ms/first %d rows=%8.3f checksum=%ld ok=%d\n",
+               mapped ? "mapped" : "full", count, rows, elapsed / 1e6, checksum, ok);
+        
+        FreeStockManager(&loaded);
+    }
+    
+    remove(file);
+    FreeStockManager(&manager);
+}
+
+// Cost of persisting small edits: journal group commits against rewriting the
+// snapshot, then the replay on the next start
+static void BenchJournal(int count, int edits)
+{
+    static const char* snapshot = "bench_stock_journal.dat";
+    static const char* journal = "bench_stock_journal.log";
+    
+    remove(journal);
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    double start = NowNs();
+    SaveStockToFile(&manager, snapshot);
+    double saved = NowNs();
+    
+    int ok = OpenStockJournal(&manager, snapshot, journal);
+    unsigned state = 12345;
+    
+    double edited = NowNs();
+    for (int i = 0; i < edits; i++)
+    {
+        int index = (int)(NextRandom(&state) % (unsigned)count);
+        if (i % 16 == 0)
+            ok = UpdateStockItem(&manager, index, GetStockItem(&manager, index)->name, "Moved", 1) && ok;
+        else
+            ok = AdjustStockItem(&manager, index, i % 2 ? 1 : -GetStockItem(&manager, index)->stock) && ok;
+    }
+    RemoveStockItem(&manager, 0);
+    ok = FlushStockJournal(&manager) && ok;
+    double committed = NowNs();
+    long journalBytes = FileSize(journal);
+    
+    // Restart: snapshot plus journal replay must reproduce the edited inventory
+    StockManager restarted;
+    InitStockManager(&restarted);
+    double replayStart = NowNs();
+    ok = LoadStockFromFileMapped(&restarted, snapshot) && OpenStockJournal(&restarted, snapshot, journal) && ok;
+    double replayed = NowNs();
+    
+    ok = ok && restarted.itemCount == manager.itemCount;
+    for (int i = 0; ok && i < manager.itemCount; i++)
+    {
+        StockItem* expected = GetStockItem(&manager, i);
+        StockItem* actual = GetStockItemById(&restarted, expected->id);
+        
+        ok = actual != NULL && actual->stock == expected->stock &&
+             strcmp(GetStockItemCategory(&restarted, actual), GetStockItemCategory(&manager, expected)) == 0;
+    }
+    
+    printf("journal    items=%-9d edits=%-7d ns/edit=%9.1f bytes/edit=%5.1f ms/full save=%8.2f ms/replay=%8.2f ok=%d\n",
+           count, edits, (committed - edited) / edits, (double)journalBytes / edits,
+           (saved - start) / 1e6, (replayed - replayStart) / 1e6, ok);
+    
+    FreeStockManager(&restarted);
+    FreeStockManager(&manager);
+    remove(snapshot);
+    remove(journal);
+}
+
+// Incremental v1 saves should cost in proportion to the changed items, not the inventory
+static void BenchIncrementalSave(int count)
+{
+    static const char* file = "bench_stock_incremental.dat";
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    double start = NowNs();
+    int ok = SaveStockIncremental(&manager, file);
+    printf("incr save  items=%-9d full save ms=%8.2f\n", count, (NowNs() - start) / 1e6);
+    
+    unsigned state = 777;
+    for (int changes = 10; changes <= 100000 && changes <= count / 4; changes *= 10)
+    {
+        // Mostly quantity changes, with some removals and additions mixed in
+        for (int i = 0; i < changes; i++)
+        {
+            int index = (int)(NextRandom(&state) % (unsigned)manager.itemCount);
+            if (i % 10 == 1)
+                RemoveStockItem(&manager, index);
+            else if (i % 10 == 2)
+                AddStockItem(&manager, "Added product", "Category 1", i);
+            else
+                AdjustStockItem(&manager, index, 1);
+        }
+        
+        start = NowNs();
+        ok = SaveStockIncremental(&manager, file) && ok;
+        double elapsed = NowNs() - start;
+        
+        printf("incr save  items=%-9d changes=%-7d ms/save=%8.3f us/change=%8.2f\n",
+               count, changes, elapsed / 1e6, elapsed / 1e3 / changes);
+    }
+    
+    // The patched file must match the inventory record for record
+    StockManager loaded;
+    InitStockManager(&loaded);
+    ok = LoadStockFromFile(&loaded, file) && loaded.itemCount == manager.itemCount && ok;
+    for (int i = 0; ok && i < manager.itemCount; i++)
+    {
+        StockItem* expected = GetStockItem(&manager, i);
+        StockItem* actual = GetStockItem(&loaded, i);
+        
+        ok = actual->id == expected->id && actual->stock == expected->stock && strcmp(actual->name, expected->name) == 0;
+    }
+    printf("incr save  items=%-9d file size ok=%d round trip ok=%d\n", count,
+           FileSize(file) == (long)(8 + (long long)manager.itemCount * 392), ok);
+    
+    FreeStockManager(&loaded);
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+static int g_savesWritten = 0;
+
+static void CountSave(int result, void* context)
+{
+    (void)result;
+    (void)context;
+    g_savesWritten++;   // Read after StopStockSaver, which joins the saver thread
+}
+
+// Caller-side cost of a background save against a synchronous one, and how a
+// burst of requests coalesces (check.c covers the saver's correctness)
+static void BenchBackgroundSave(int count)
+{
+    static const char* file = "bench_stock_async.dat";
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    double start = NowNs();
+    int ok = SaveStockToFile(&manager, file);
+    double saved = NowNs();
+    
+    ok = StartStockSaver(&manager, CountSave, NULL) && ok;
+    g_savesWritten = 0;
+    
+    double requested = NowNs();
+    ok = RequestStockSave(&manager, file) && ok;
+    double returned = NowNs();
+    
+    // A burst of requests while the first one is written collapses into one more write
+    for (int i = 0; i < 8; i++)
+    {
+        AdjustStockItem(&manager, i, 1);
+        ok = RequestStockSave(&manager, file) && ok;
+    }
+    ok = WaitStockSave(&manager) && ok;
+    StopStockSaver(&manager);
+    
+    printf("async save items=%-9d ms/sync save=%8.2f ms/caller=%8.2f writes/9 requests=%d ok=%d\n",
+           count, (saved - start) / 1e6, (returned - requested) / 1e6, g_savesWritten, ok);
+    
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+// Spreadsheet import of a generated CSV file, against adding the same rows one call at a time
+static void BenchImport(int count)
+{
+    static const char* file = "bench_stock_import.csv";
+    FILE* out = fopen(file, "wb");
+    if (out == NULL) return;
+    
+    fprintf(out, "name,quantity,category,reorder level\n");
+    for (int i = 0; i < count; i++)
+    {
+        // Every tenth row has a quoted category with a delimiter in it
+        if (i % 10 == 0)
+            fprintf(out, "Product %d,%d,\"Category %d, bulk\",%d\n", i, i % 100, i % 40, i % 7);
+        else
+            fprintf(out, "Product %d,%d,Category %d,\n", i, i % 100, i % 40);
+    }
+    long size = ftell(out);
+    fclose(out);
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    StockImportResult result;
+    
+    double start = NowNs();
+    ImportStockFromFile(&manager, file, NULL, &result);
+    double importNs = NowNs() - start;
+    FreeStockManager(&manager);
+    
+    InitStockManager(&manager);
+    start = NowNs();
+    FillInventory(&manager, count);
+    double addNs = NowNs() - start;
+    FreeStockManager(&manager);
+    
+    printf("import     items=%-9d ms=%8.2f Mrows/s=%5.2f MB/s=%6.1f imported=%d (AddStockItem loop ms=%8.2f)\n",
+           count, importNs / 1e6, result.imported / (importNs / 1e3), size / (importNs / 1e3),
+           result.imported, addNs / 1e6);
+    remove(file);
+}
+
+// Export throughput; the largest run writes every item four times over
+static void BenchExport(int count, int repeat)
+{
+    static const char* file = "bench_stock_export.out";
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    int rows = count * repeat;
+    int* indices = (int*)malloc((size_t)rows * sizeof(int));
+    if (indices == NULL)
+    {
+        FreeStockManager(&manager);
+        return;
+    }
+    for (int i = 0; i < rows; i++) indices[i] = i % count;
+    
+    static const char* names[2] = { "csv", "jsonl" };
+    for (int format = STOCK_EXPORT_CSV; format <= STOCK_EXPORT_JSONL; format++)
+    {
+        double start = NowNs();
+        ExportStockToFile(&manager, file, format, indices, rows);
+        double ns = NowNs() - start;
+        
+        long size = FileSize(file);
+        printf("export     rows=%-10d %-5s ms=%8.2f Mrows/s=%5.2f MB/s=%6.1f\n",
+               rows, names[format], ns / 1e6, rows / (ns / 1e3), size / (ns / 1e3));
+        remove(file);
+    }
+    
+    free(indices);
+    FreeStockManager(&manager);
+}
+
+// Quantity edits, renames, then removals or (once half the items are gone) adds in turn
+static double MixedEdits(StockManager* manager, int count, int edits)
+{
+    unsigned state = 31;
+    double start = NowNs();
+    
+    for (int e = 0; e < edits; e++)
+    {
+        int index = (int)(NextRandom(&state) % (unsigned)manager->itemCount);
+        if (e % 3 == 0)
+            AdjustStockItem(manager, index, 1);
+        else if (e % 3 == 1)
+            UpdateStockItem(manager, index, "Renamed product", "Renamed", 7);
+        else if (manager->itemCount > count / 2)
+            RemoveStockItem(manager, index);
+        else
+            AddStockItem(manager, "Added product", "Added", 3);
+    }
+    return (NowNs() - start) / edits;
+}
+
+// Undo log cost: time and bytes per step for single edits, undo and redo
+// latency, and rolling a bulk insert of `count` items back by checkpoint
+static void BenchUndo(int count, int edits)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    double plainNs = MixedEdits(&manager, count, edits);
+    FreeStockManager(&manager);
+    
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    EnableStockUndo(&manager, STOCK_UNDO_DEFAULT_BYTES);
+    double loggedNs = MixedEdits(&manager, count, edits);
+    
+    StockUndoStats stats;
+    GetStockUndoStats(&manager, &stats);
+    int steps = stats.undoSteps;
+    double bytesPerStep = (double)stats.undoBytes / steps;
+    
+    double start = NowNs();
+    while (UndoStockChange(&manager));
+    double undoNs = (NowNs() - start) / steps;
+    
+    start = NowNs();
+    while (RedoStockChange(&manager));
+    double redoNs = (NowNs() - start) / steps;
+    GetStockUndoStats(&manager, &stats);
+    size_t allocated = stats.allocatedBytes;
+    
+    // A bulk insert as large as the inventory, undone in one step
+    char name[64];
+    MarkStockCheckpoint(&manager, "bulk");
+    BeginStockBulkInsert(&manager, count);
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "Bulk %d", i);
+        AddStockItem(&manager, name, "Bulk", i % 100);
+    }
+    EndStockBulkInsert(&manager);
+    
+    size_t before = stats.undoBytes;
+    GetStockUndoStats(&manager, &stats);
+    size_t bulkBytes = stats.undoBytes - before;
+    
+    start = NowNs();
+    RollbackStockCheckpoint(&manager, "bulk");
+    double rollbackNs = NowNs() - start;
+    
+    printf("undo       items=%-9d edit ns: plain=%6.1f logged=%6.1f bytes/step=%5.1f undo ns=%7.1f redo ns=%7.1f "
+           "log KB=%6.1f bulk insert bytes=%zu rollback ms=%7.2f\n",
+           count, plainNs, loggedNs, bytesPerStep, undoNs, redoNs, allocated / 1024.0, bulkBytes, rollbackNs / 1e6);
+    FreeStockManager(&manager);
+}
+
+typedef struct {
+    StockViews* views;
+    volatile unsigned long long* stop;
+    int expectedCount;
+    long long expectedTotal;
+    long long reads;
+    long long items;
+    long long inconsistent;     // Versions with the wrong count or total, or an older version than before
+} ViewReader;
+
+// Sum each version's quantities; the writer only makes changes that keep the
+// count and the total
+static void ReadStockViews(void* context)
+{
+    ViewReader* state = (ViewReader*)context;
+    int reader = OpenStockReader(state->views);
+    unsigned long long lastVersion = 0;
+    
+    while (reader >= 0 && !LoadStockCounter(state->stop))
+    {
+        const StockView* view = BeginStockRead(state->views, reader);
+        int count = GetStockViewCount(view);
+        long long total = 0;
+        
+        for (int i = 0; i < count; i++) total += GetStockViewItem(view, i)->stock;
+        if (count != state->expectedCount || total != state->expectedTotal || GetStockViewVersion(view) < lastVersion)
+            state->inconsistent++;
+        
+        lastVersion = GetStockViewVersion(view);
+        EndStockRead(state->views, reader);
+        state->reads++;
+        state->items += count;
+    }
+    CloseStockReader(state->views, reader);
+}
+
+// Cost of publishing a version per edit, and reader threads summing whole
+// versions while the owner moves stock between items (one batch per move)
+static void BenchViews(int count, int edits, int readerCount)
+{
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    unsigned state = 7;
+    double start = NowNs();
+    for (int e = 0; e < edits; e++) AdjustStockItem(&manager, (int)(NextRandom(&state) % (unsigned)count), 1);
+    double plainNs = (NowNs() - start) / edits;
+    
+    start = NowNs();
+    StockViews* views = EnableStockViews(&manager);
+    double firstMs = (NowNs() - start) / 1e6;
+    
+    start = NowNs();
+    for (int e = 0; e < edits; e++) AdjustStockItem(&manager, (int)(NextRandom(&state) % (unsigned)count), 1);
+    double publishNs = (NowNs() - start) / edits;
+    
+    long long total = 0;
+    for (int i = 0; i < count; i++) total += GetStockItem(&manager, i)->stock;
+    
+    volatile unsigned long long stop = 0;
+    ViewReader readers[8];
+    StockThread* threads[8];
+    for (int r = 0; r < readerCount; r++)
+    {
+        readers[r].views = views;
+        readers[r].stop = &stop;
+        readers[r].expectedCount = count;
+        readers[r].expectedTotal = total;
+        readers[r].reads = readers[r].items = readers[r].inconsistent = 0;
+        threads[r] = StartStockThread(ReadStockViews, &readers[r]);
+    }
+    
+    start = NowNs();
+    for (int e = 0; e < edits; e++)
+    {
+        int from = (int)(NextRandom(&state) % (unsigned)count);
+        int to = (int)(NextRandom(&state) % (unsigned)count);
+        
+        BeginStockBatch(&manager);
+        if (AdjustStockItem(&manager, from, -1)) AdjustStockItem(&manager, to, 1);
+        EndStockBatch(&manager);
+    }
+    double contendedNs = (NowNs() - start) / edits;
+    
+    StoreStockCounter(&stop, 1);
+    long long reads = 0, items = 0, inconsistent = 0;
+    for (int r = 0; r < readerCount; r++)
+    {
+        JoinStockThread(threads[r]);
+        reads += readers[r].reads;
+        items += readers[r].items;
+        inconsistent += readers[r].inconsistent;
+    }
+    double seconds = contendedNs * edits / 1e9;
+    
+    printf("views      items=%-9d readers=%d first publish ms=%7.2f edit ns: plain=%6.1f published=%8.1f with readers=%8.1f "
+           "reads/s=%8.0f Mitems/s=%7.1f inconsistent=%lld\n",
+           count, readerCount, firstMs, plainNs, publishNs, contendedNs, reads / seconds, items / seconds / 1e6, inconsistent);
+    FreeStockManager(&manager);
+}
+
+// Sharded scans across 1-16 query threads against the serial path
+static void BenchParallel(int count, int passes)
+{
+    static const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    FillInventory(&manager, count);
+    
+    StockItem* results = (StockItem*)malloc((size_t)count * sizeof(StockItem));
+    int* expected = (int*)malloc((size_t)count * sizeof(int));
+    int* indices = (int*)malloc((size_t)count * sizeof(int));
+    const char* term = "Product 4242x";
+    int thresholds[40];
+    int resultCount = 0;
+    int expectedCount = 0;
+    int agree = 1;
+    double serialNs[3] = { 0, 0, 0 };
+    
+    for (int code = 0; code < 40; code++) thresholds[code] = code % 20;
+    
+    printf("parallel   items=%-9d processors=%d\n", count, CountStockProcessors());
+    for (int t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); t++)
+    {
+        int threads = SetStockQueryThreads(&manager, threadCounts[t]);
+        double ns[3];
+        
+        SearchStockItemsMode(&manager, term, STOCK_SEARCH_SCAN, results, &resultCount);
+        double start = NowNs();
+        for (int pass = 0; pass < passes; pass++) SearchStockItemsMode(&manager, term, STOCK_SEARCH_SCAN, results, &resultCount);
+        ns[0] = (NowNs() - start) / passes;
+        
+        GetStockItemsInRange(&manager, 10, 30, indices, count);
+        start = NowNs();
+        int found = 0;
+        for (int pass = 0; pass < passes; pass++) found = GetStockItemsInRange(&manager, 10, 30, indices, count);
+        ns[1] = (NowNs() - start) / passes;
+        
+        if (t == 0)
+        {
+            memcpy(expected, indices, (size_t)found * sizeof(int));
+            expectedCount = found;
+        }
+        else if (found != expectedCount || memcmp(indices, expected, (size_t)found * sizeof(int)) != 0)
+        {
+            agree = 0;
+        }
+        
+        GetLowStockItemsByCategory(&manager, thresholds, 40, indices, count);
+        start = NowNs();
+        for (int pass = 0; pass < passes; pass++) GetLowStockItemsByCategory(&manager, thresholds, 40, indices, count);
+        ns[2] = (NowNs() - start) / passes;
+        
+        if (t == 0) memcpy(serialNs, ns, sizeof(ns));
+        printf("parallel   items=%-9d threads=%-2d search us=%9.1f (x%5.2f) range us=%8.1f (x%5.2f) low us=%8.1f (x%5.2f)\n",
+               count, threads, ns[0] / 1e3, serialNs[0] / ns[0], ns[1] / 1e3, serialNs[1] / ns[1], ns[2] / 1e3, serialNs[2] / ns[2]);
+    }
+    printf("parallel   items=%-9d agree=%d\n", count, agree);
+    
+    free(results);
+    free(expected);
+    free(indices);
+    FreeStockManager(&manager);
+}
+
+// Regression suite: the core operations on inventories from 1K items up to
+// maxItems, one CSV row per operation and size. ns_per_item divides the time
+// by the items the calls handled: one per add, lookup or removal, the whole
+// inventory per search, low-stock query, sort, save or load. peak_rss_kb is the
+// peak resident set during the row's calls (the whole run outside Linux).
+static double StartSuiteRow(void)
+{
+    ResetPeakMemory();
+    return NowNs();
+}
+
+static void PrintSuiteRow(const char* operation, int items, int calls, double handled, double start)
+{
+    double elapsed = NowNs() - start;
+    
+    printf("%s,%d,%d,%.3f,%.1f,%.3f,%ld\n", operation, items, calls, elapsed / 1e6, elapsed / calls, elapsed / handled, PeakMemoryKb());
+    fflush(stdout);
+}
+
+static void RunBenchSuite(int maxItems)
+{
+    static const char* file = "bench_suite.dat";
+    StockItem matches[64];
+    
+    printf("operation,items,calls,total_ms,ns_per_call,ns_per_item,peak_rss_kb\n");
+    for (long long size = 1000; size <= maxItems; size *= 10)
+    {
+        int count = (int)size;
+        int lookups = 100000;
+        int queries = count >= 1000000 ? 20 : 200;
+        int removals = count / 10 < 100000 ? count / 10 : 100000;
+        StockItem* low = (StockItem*)malloc((size_t)(count / 100 + 1) * sizeof(StockItem));
+        unsigned seed = 12345;
+        char name[64];
+        char category[32];
+        int resultCount = 0;
+        
+        StockManager manager;
+        InitStockManager(&manager);
+        
+        double start = StartSuiteRow();
+        for (int i = 0; i < count; i++)
+        {
+            snprintf(name, sizeof(name), "Product %d", i);
+            snprintf(category, sizeof(category), "Category %d", i % 40);
+            AddStockItem(&manager, name, category, i % 100);
+        }
+        PrintSuiteRow("add", count, count, count, start);
+        
+        start = StartSuiteRow();
+        for (int i = 0; i < lookups; i++)
+        {
+            snprintf(name, sizeof(name), "Product %d", (int)(NextRandom(&seed) % (unsigned)count));
+            FindStockItem(&manager, name);
+        }
+        PrintSuiteRow("find", count, lookups, lookups, start);
+        
+        // Terms of at least count / 10 match exactly one product. The first
+        // search builds the search columns and the trigram index.
+        for (int q = 0; q <= queries; q++)
+        {
+            if (q < 2) start = StartSuiteRow();
+            snprintf(name, sizeof(name), "Product %d", count / 10 + (int)(NextRandom(&seed) % (unsigned)(count - count / 10)));
+            SearchStockItems(&manager, name, matches, &resultCount);
+            if (q == 0) PrintSuiteRow("search_first", count, 1, count, start);
+        }
+        PrintSuiteRow("search", count, queries, (double)queries * count, start);
+        
+        // Threshold 0: one product in 100. The first query builds the quantity index.
+        for (int q = 0; q <= queries; q++)
+        {
+            if (q < 2) start = StartSuiteRow();
+            GetLowStockItems(&manager, 0, low, &resultCount);
+            if (q == 0) PrintSuiteRow("low_first", count, 1, count, start);
+        }
+        PrintSuiteRow("low", count, queries, (double)queries * count, start);
+        
+        start = StartSuiteRow();
+        SortStockItems(&manager, 0);
+        PrintSuiteRow("sort", count, 1, count, start);
+        
+        start = StartSuiteRow();
+        SaveStockToFile(&manager, file);
+        PrintSuiteRow("save", count, 1, count, start);
+        FreeStockManager(&manager);
+        
+        InitStockManager(&manager);
+        start = StartSuiteRow();
+        LoadStockFromFile(&manager, file);
+        PrintSuiteRow("load", count, 1, count, start);
+        
+        start = StartSuiteRow();
+        for (int i = 0; i < removals; i++)
+        {
+            RemoveStockItem(&manager, (int)(NextRandom(&seed) % (unsigned)manager.itemCount));
+        }
+        PrintSuiteRow("remove", count, removals, removals, start);
+        
+        FreeStockManager(&manager);
+        remove(file);
+        free(low);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    // `stock_bench suite [maxItems]`: the regression suite as CSV
+    if (argc > 1 && strcmp(argv[1], "suite") == 0)
+    {
+        RunBenchSuite(argc > 2 ? atoi(argv[2]) : 10000000);
+        return 0;
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchFind(count, 200000);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchRemove(count, count / 2);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchSort(count);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchSearch(count, 200);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchScan(count, count >= 100000 ? 10 : 200);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchQuantityFilter(count, count >= 100000 ? 20 : 500);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchQuantityIndex(count, count >= 100000 ? 200 : 2000);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchPaging(count, count >= 100000 ? 10 : 200);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchRowModel(count, 2000);
+        BenchDisplayCache(count, 5000);
+        BenchChangeEvents(count, 100000);
+    }
+    
+    BenchFileFormats(1000000);
+    
+    BenchIncrementalSave(100000);
+    BenchIncrementalSave(1000000);
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchStartup(count, 50);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchJournal(count, 20000);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchBackgroundSave(count);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchImport(count);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchExport(count, 1);
+    }
+    BenchExport(1000000, 4);
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchUndo(count, 20000);
+    }
+    
+    for (int count = 1000; count <= 1000000; count *= 10)
+    {
+        BenchViews(count, 20000, 4);
+    }
+    
+    for (int count = 10000; count <= 1000000; count *= 10)
+    {
+        BenchParallel(count, count >= 1000000 ? 10 : 100);
+    }
+    
+    return 0;
+}
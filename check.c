@@ -0,0 +1,2538 @@
+// Headless correctness checks for the portable stock core; exits nonzero if any fails
+#include "stock.h"
+#include "stock_platform.h"
+#include "stock_scan.h"
+#include <sys/stat.h>
+#include <utime.h>
+
+static int g_checks = 0;
+static int g_failures = 0;
+
+#define CHECK(condition) CheckResult((condition) != 0, #condition, __FILE__, __LINE__)
+
+static int CheckResult(int passed, const char* condition, const char* file, int line)
+{
+    g_checks++;
+    if (!passed)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+        g_failures++;
+    }
+    return passed;
+}
+
+static unsigned NextCheckRandom(unsigned* state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// Whether two inventories hold the same items under the same ids, in any order
+static int SameInventory(StockManager* expected, StockManager* actual)
+{
+    if (expected->itemCount != actual->itemCount) return 0;
+    
+    for (int i = 0; i < expected->itemCount; i++)
+    {
+        const StockItem* item = GetStockItem(expected, i);
+        const StockItem* other = GetStockItem(actual, FindStockItemById(actual, item->id));
+        
+        if (other == NULL || strcmp(item->name, other->name) != 0 || item->stock != other->stock ||
+            item->reorderLevel != other->reorderLevel ||
+            strcmp(GetStockItemCategory(expected, item), GetStockItemCategory(actual, other)) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Edits journaled on top of a snapshot survive a restart, whatever the ids
+// look like: here they sit far above the item count
+static void CheckJournalRestart(int mapped)
+{
+    static const char* snapshot = "check_restart.dat";
+    static const char* journal = "check_restart.journal";
+    char name[32];
+    
+    remove(snapshot);
+    remove(journal);
+    
+    StockManager manager;
+    InitStockManager(&manager);
+    for (int i = 1; i <= 10000; i++)
+    {
+        snprintf(name, sizeof(name), "P%d", i);
+        AddStockItem(&manager, name, i % 2 ? "Odd" : "Even", i % 50);
+    }
+    for (int id = 1; id <= 9990; id++) RemoveStockItemById(&manager, id);
+    CHECK(manager.itemCount == 10);
+    CHECK(SaveStockToFile(&manager, snapshot));
+    CHECK(OpenStockJournal(&manager, snapshot, journal));
+    
+    CHECK(AddStockItem(&manager, "NEWITEM", "New", 777));
+    int index = FindStockItemById(&manager, 9999);
+    CHECK(AdjustStockItem(&manager, index, 1049 - GetStockItem(&manager, index)->stock));
+    CHECK(SetStockReorderLevel(&manager, FindStockItemById(&manager, 9995), 12));
+    CHECK(UpdateStockItem(&manager, FindStockItemById(&manager, 9993), "Renamed", "Even", 5));
+    CHECK(RemoveStockItemById(&manager, 9991));
+    CloseStockJournal(&manager);
+    
+    StockManager restarted;
+    InitStockManager(&restarted);
+    CHECK(mapped ? LoadStockFromFileMapped(&restarted, snapshot) : LoadStockFromFile(&restarted, snapshot));
+    CHECK(OpenStockJournal(&restarted, snapshot, journal));
+    CHECK(SameInventory(&manager, &restarted));
+    
+    // New items never reuse a live id
+    CHECK(AddStockItem(&restarted, "Later", "New", 1));
+    CHECK(GetStockItem(&restarted, restarted.itemCount - 1)->id > 10001);
+    
+    CloseStockJournal(&restarted);
+    FreeStockManager(&restarted);
+    FreeStockManager(&manager);
+    remove(snapshot);
+    remove(journal);
+}
+
+// Renames keep the name index in step with the items, and a rejected rename
+// leaves the item as it was
+static void CheckRenames(void)
+{
+    char name[32];
+    StockManager manager;
+    InitStockManager(&manager);
+    SetStockUniqueNames(&manager, 1);
+    
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), "Item %d", i);
+        AddStockItem(&manager, name, "Tools", i);
+    }
+    for (int i = 0; i < 1000; i += 3)
+    {
+        snprintf(name, sizeof(name), "Renamed %d", i);
+        CHECK(UpdateStockItem(&manager, i, name, "Parts", i + 1));
+    }
+    
+    int consistent = 1;
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), i % 3 == 0 ? "Renamed %d" : "Item %d", i);
+        if (FindStockItem(&manager, name) != i) consistent = 0;
+        snprintf(name, sizeof(name), i % 3 == 0 ? "Item %d" : "Renamed %d", i);
+        if (FindStockItem(&manager, name) >= 0) consistent = 0;
+    }
+    CHECK(consistent);
+    
+    CHECK(!UpdateStockItem(&manager, 1, "Renamed 0", "Other", 99));
+    CHECK(strcmp(GetStockItem(&manager, 1)->name, "Item 1") == 0);
+    CHECK(GetStockItem(&manager, 1)->stock == 1);
+    CHECK(strcmp(GetStockItemCategory(&manager, GetStockItem(&manager, 1)), "Tools") == 0);
+    CHECK(FindStockItem(&manager, "Item 1") == 1);
+    
+    FreeStockManager(&manager);
+}
+
+// Names and categories that need quoting or escaping
+static const char* const g_awkwardItems[][2] = {
+    { "Plain", "Tools" },
+    { "Say \"hi\"", "Quotes \"q\"" },
+    { "\"", "" },
+    { "Line one\nline two", "Multi\r\nline" },
+    { "  padded  ", " edge" },
+    { "a,b,c", "x,y" },
+    { "tab\tinside", "\tlead" },
+    { "\xC3\x87" "ay barda\xC4\x9F\xC4\xB1 \xE2\x98\x95", "Mutfak" },
+    { "bad \xFF\xFE byte", "" },
+};
+
+#define AWKWARD_ITEMS ((int)(sizeof(g_awkwardItems) / sizeof(g_awkwardItems[0])))
+
+static void FillAwkwardItems(StockManager* manager)
+{
+    for (int i = 0; i < AWKWARD_ITEMS; i++)
+    {
+        AddStockItem(manager, g_awkwardItems[i][0], g_awkwardItems[i][1], i * 7);
+        SetStockReorderLevel(manager, i, i % 3);
+    }
+}
+
+// A CSV export reads back as the same inventory
+static void CheckCsvRoundTrip(void)
+{
+    static const char* file = "check_export.csv";
+    StockManager manager, imported;
+    StockImportResult result;
+    
+    InitStockManager(&manager);
+    InitStockManager(&imported);
+    FillAwkwardItems(&manager);
+    
+    CHECK(ExportStockToFile(&manager, file, STOCK_EXPORT_CSV, NULL, 0));
+    CHECK(ImportStockFromFile(&imported, file, NULL, &result));
+    CHECK(result.rows == AWKWARD_ITEMS && result.imported == AWKWARD_ITEMS && result.rejected == 0);
+    CHECK(SameInventory(&manager, &imported));
+    
+    FreeStockManager(&imported);
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+// JSON Lines escapes control characters and replaces bytes of invalid UTF-8
+static void CheckJsonExport(void)
+{
+    static const char* file = "check_export.jsonl";
+    static const char expected[] =
+        "{\"id\":1,\"name\":\"Plain\",\"quantity\":0,\"category\":\"Tools\",\"reorderLevel\":0}\n"
+        "{\"id\":2,\"name\":\"Say \\\"hi\\\"\",\"quantity\":7,\"category\":\"Quotes \\\"q\\\"\",\"reorderLevel\":1}\n"
+        "{\"id\":3,\"name\":\"\\\"\",\"quantity\":14,\"category\":\"\",\"reorderLevel\":2}\n"
+        "{\"id\":4,\"name\":\"Line one\\nline two\",\"quantity\":21,\"category\":\"Multi\\r\\nline\",\"reorderLevel\":0}\n"
+        "{\"id\":5,\"name\":\"  padded  \",\"quantity\":28,\"category\":\" edge\",\"reorderLevel\":1}\n"
+        "{\"id\":6,\"name\":\"a,b,c\",\"quantity\":35,\"category\":\"x,y\",\"reorderLevel\":2}\n"
+        "{\"id\":7,\"name\":\"tab\\tinside\",\"quantity\":42,\"category\":\"\\tlead\",\"reorderLevel\":0}\n"
+        "{\"id\":8,\"name\":\"\xC3\x87" "ay barda\xC4\x9F\xC4\xB1 \xE2\x98\x95\",\"quantity\":49,\"category\":\"Mutfak\",\"reorderLevel\":1}\n"
+        "{\"id\":9,\"name\":\"bad \\ufffd\\ufffd byte\",\"quantity\":56,\"category\":\"\",\"reorderLevel\":2}\n";
+    char text[sizeof(expected) + 64];
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    FillAwkwardItems(&manager);
+    CHECK(ExportStockToFile(&manager, file, STOCK_EXPORT_JSONL, NULL, 0));
+    
+    size_t length = 0;
+    FILE* input = fopen(file, "rb");
+    if (CHECK(input != NULL))
+    {
+        length = fread(text, 1, sizeof(text), input);
+        fclose(input);
+    }
+    CHECK(length == sizeof(expected) - 1 && memcmp(text, expected, length) == 0);
+    
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+// Name pieces that share many trigrams, so index lookups return lots of candidates
+static const char* const g_namePieces[] = {
+    "ab", "abc", "bca", "cab", "Bolt", "bolt", "NUT", " ", "x",
+    "\xC3\x87" "ay", "\xC3\xA7" "ay", "Stra\xC3\x9F" "e", "\xC4\xB0", "\xC4\xB1", "-12",
+};
+static const char* const g_searchCategories[] = { "Tools", "cabinet", "", "Bolts & nuts" };
+
+#define NAME_PIECES ((int)(sizeof(g_namePieces) / sizeof(g_namePieces[0])))
+#define SEARCH_CHECK_ITEMS 8000     // More than the edits and bulk insert below can add
+
+static void MakeSearchName(unsigned* seed, char* name, size_t size)
+{
+    int pieces = 1 + (int)(NextCheckRandom(seed) % 4);
+    
+    name[0] = '\0';
+    for (int p = 0; p < pieces; p++)
+    {
+        size_t used = strlen(name);
+        snprintf(name + used, size - used, "%s", g_namePieces[NextCheckRandom(seed) % NAME_PIECES]);
+    }
+}
+
+// Random adds, renames and removes
+static void ChurnSearchItems(StockManager* manager, unsigned* seed, int edits)
+{
+    char name[64];
+    
+    for (int e = 0; e < edits; e++)
+    {
+        unsigned action = NextCheckRandom(seed) % 4;
+        int index = manager->itemCount > 0 ? (int)(NextCheckRandom(seed) % (unsigned)manager->itemCount) : -1;
+        const char* category = g_searchCategories[NextCheckRandom(seed) % 4];
+        
+        MakeSearchName(seed, name, sizeof(name));
+        if (action == 0 && index >= 0)
+            RemoveStockItem(manager, index);
+        else if (action == 1 && index >= 0)
+            UpdateStockItem(manager, index, name, category, 1);
+        else
+            AddStockItem(manager, name, category, 1);
+    }
+}
+
+// Items in index order whose name or category contains `term`, by a plain loop
+static int PlainSearch(StockManager* manager, const char* term, int folded, int* indices)
+{
+    char pattern[MAX_NAME_LENGTH];
+    char name[MAX_NAME_LENGTH];
+    char category[MAX_CATEGORY_LENGTH];
+    int count = 0;
+    
+    if (folded)
+        FoldStockText(term, pattern, sizeof(pattern));
+    else
+        snprintf(pattern, sizeof(pattern), "%s", term);
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        const StockItem* item = GetStockItem(manager, i);
+        const char* itemName = item->name;
+        const char* itemCategory = GetStockItemCategory(manager, item);
+        
+        if (folded)
+        {
+            FoldStockText(itemName, name, sizeof(name));
+            FoldStockText(itemCategory, category, sizeof(category));
+            itemName = name;
+            itemCategory = category;
+        }
+        if (strstr(itemName, pattern) != NULL || strstr(itemCategory, pattern) != NULL) indices[count++] = i;
+    }
+    return count;
+}
+
+// The indexed search and the column scan both return what the plain loop finds
+static int SearchAgrees(StockManager* manager, const char* term, int mode, int* found, int* expected)
+{
+    int expectedCount = PlainSearch(manager, term, mode == STOCK_SEARCH_FOLDED, expected);
+    
+    for (int scan = 0; scan <= STOCK_SEARCH_SCAN; scan += STOCK_SEARCH_SCAN)
+    {
+        int count = SearchStockItemIndices(manager, term, mode | scan, 0, found, manager->itemCount);
+        if (count != expectedCount || memcmp(found, expected, (size_t)count * sizeof(int)) != 0)
+        {
+            fprintf(stderr, "search for \"%s\" (mode %#x): %d matches, expected %d\n", term, mode | scan, count, expectedCount);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Substrings of live names (cut anywhere, even inside a UTF-8 sequence) and a few fixed terms
+static int SearchTermsAgree(StockManager* manager, unsigned* seed, int mode, int* found, int* expected)
+{
+    static const char* const fixed[] = { "", "a", "ab", "abc", "cab", "zzz", "Bolt", "bolt", "nuts", "Tools", "\xC3\x87" "ay" };
+    char term[16];
+    int agree = 1;
+    
+    for (int t = 0; t < (int)(sizeof(fixed) / sizeof(fixed[0])) && agree; t++)
+    {
+        agree = SearchAgrees(manager, fixed[t], mode, found, expected);
+    }
+    for (int t = 0; t < 200 && agree && manager->itemCount > 0; t++)
+    {
+        const char* name = GetStockItem(manager, (int)(NextCheckRandom(seed) % (unsigned)manager->itemCount))->name;
+        size_t length = strlen(name);
+        size_t start = NextCheckRandom(seed) % length;
+        size_t take = 1 + NextCheckRandom(seed) % 7;
+        
+        if (take > length - start) take = length - start;
+        memcpy(term, name + start, take);
+        term[take] = '\0';
+        agree = SearchAgrees(manager, term, mode, found, expected);
+    }
+    return agree;
+}
+
+// The trigram index keeps answering like a plain substring loop through
+// edits and bulk inserts, for exact and folded terms
+static void CheckSearchIndex(int mode)
+{
+    char name[64];
+    unsigned seed = 11;
+    StockManager manager;
+    InitStockManager(&manager);
+    
+    ChurnSearchItems(&manager, &seed, 3000);
+    int* found = (int*)malloc(SEARCH_CHECK_ITEMS * sizeof(int));
+    int* expected = (int*)malloc(SEARCH_CHECK_ITEMS * sizeof(int));
+    if (!CHECK(found != NULL && expected != NULL)) return;
+    
+    CHECK(SearchTermsAgree(&manager, &seed, mode, found, expected));
+    
+    ChurnSearchItems(&manager, &seed, 2000);
+    CHECK(SearchTermsAgree(&manager, &seed, mode, found, expected));
+    
+    CHECK(BeginStockBulkInsert(&manager, 1000));
+    for (int i = 0; i < 1000; i++)
+    {
+        MakeSearchName(&seed, name, sizeof(name));
+        AddStockItem(&manager, name, g_searchCategories[i % 4], i);
+    }
+    EndStockBulkInsert(&manager);
+    CHECK(SearchTermsAgree(&manager, &seed, mode, found, expected));
+    
+    free(found);
+    free(expected);
+    FreeStockManager(&manager);
+}
+
+// Folded terms ignore case and diacritics, and all Turkish I forms meet
+static void CheckFoldedSearch(void)
+{
+    static const char* const names[] = {
+        "\xC3\x87" "ay Barda\xC4\x9F\xC4\xB1",     // Çay Bardağı
+        "\xC4\xB0STANBUL",                          // İSTANBUL
+        "\xC4\xB1stanbul",                          // ıstanbul
+        "Stra\xC3\x9F" "e",                         // Straße
+        "na\xC3\xAFve \xC3\x89" "COLE",             // naïve ÉCOLE
+        "Plain",
+    };
+    int found[8];
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    for (int i = 0; i < 6; i++) AddStockItem(&manager, names[i], "Misc", 1);
+    
+    CHECK(SearchStockItemIndices(&manager, "CAY BARDAGI", STOCK_SEARCH_FOLDED, 0, found, 8) == 1 && found[0] == 0);
+    CHECK(SearchStockItemIndices(&manager, "istanbul", STOCK_SEARCH_FOLDED, 0, found, 8) == 2 && found[0] == 1 && found[1] == 2);
+    CHECK(SearchStockItemIndices(&manager, "\xC4\xB0stanbul", STOCK_SEARCH_FOLDED, 0, found, 8) == 2);
+    CHECK(SearchStockItemIndices(&manager, "strasse", STOCK_SEARCH_FOLDED, 0, found, 8) == 1 && found[0] == 3);
+    CHECK(SearchStockItemIndices(&manager, "naive ecole", STOCK_SEARCH_FOLDED, 0, found, 8) == 1 && found[0] == 4);
+    CHECK(SearchStockItemIndices(&manager, "istanbul", STOCK_SEARCH_EXACT, 0, found, 8) == 0);
+    
+    FreeStockManager(&manager);
+}
+
+// First occurrence by plain comparison, as FindStockText reports it
+static size_t PlainFindText(const char* text, size_t length, const char* term, size_t termLength)
+{
+    for (size_t i = 0; termLength <= length && i <= length - termLength; i++)
+    {
+        if (memcmp(text + i, term, termLength) == 0) return i;
+    }
+    return termLength == 0 ? 0 : length;
+}
+
+// Every scan kernel the processor has agrees with plain loops, at every length
+// and alignment around the vector widths
+static void CheckScanKernels(void)
+{
+    static const int kernels[] = { STOCK_SCAN_SCALAR, STOCK_SCAN_SSE2, STOCK_SCAN_AVX2 };
+    static const char alphabet[] = { 'a', 'b', 'c', '\0', '\xC3' };
+    char text[160];
+    char term[8];
+    int values[200], keys[200], thresholds[4] = { 0, 5, -1, 0x7FFFFFFF };
+    int found[200 + STOCK_FILTER_SLACK];
+    
+    for (int k = 0; k < 3; k++)
+    {
+        if (SetStockScanKernel(kernels[k]) != kernels[k]) continue;
+        
+        unsigned seed = 5;
+        int textAgree = 1, rangeAgree = 1, thresholdAgree = 1;
+        
+        for (int round = 0; round < 4000 && textAgree; round++)
+        {
+            size_t offset = NextCheckRandom(&seed) % 32;
+            size_t length = NextCheckRandom(&seed) % (sizeof(text) - 32);
+            size_t termLength = NextCheckRandom(&seed) % sizeof(term);
+            
+            for (size_t i = 0; i < length; i++) text[offset + i] = alphabet[NextCheckRandom(&seed) % 3 + (round & 1) * 2];
+            for (size_t i = 0; i < termLength; i++) term[i] = alphabet[NextCheckRandom(&seed) % 3];
+            
+            textAgree = FindStockText(text + offset, length, term, termLength) ==
+                        PlainFindText(text + offset, length, term, termLength);
+        }
+        
+        for (int round = 0; round < 2000 && rangeAgree && thresholdAgree; round++)
+        {
+            int count = (int)(NextCheckRandom(&seed) % 200);
+            int low = (int)(NextCheckRandom(&seed) % 12) - 2;
+            int high = round % 50 == 0 ? 0x7FFFFFFF : low + (int)(NextCheckRandom(&seed) % 8) - 2;
+            
+            for (int i = 0; i < count; i++)
+            {
+                values[i] = round % 7 == 0 && i % 5 == 0 ? (int)0x80000000 : (int)(NextCheckRandom(&seed) % 12) - 1;
+                keys[i] = (int)(NextCheckRandom(&seed) % 4);
+            }
+            
+            int stored = FilterStockRange(values, count, low, high, found);
+            int expected = 0;
+            for (int i = 0; i < count; i++)
+            {
+                if (values[i] < low || values[i] > high) continue;
+                if (expected >= stored || found[expected] != i) rangeAgree = 0;
+                expected++;
+            }
+            if (stored != expected) rangeAgree = 0;
+            
+            stored = FilterStockThresholds(values, keys, thresholds, count, found);
+            expected = 0;
+            for (int i = 0; i < count; i++)
+            {
+                if (values[i] > thresholds[keys[i]]) continue;
+                if (expected >= stored || found[expected] != i) thresholdAgree = 0;
+                expected++;
+            }
+            if (stored != expected) thresholdAgree = 0;
+        }
+        
+        if (!textAgree || !rangeAgree || !thresholdAgree) fprintf(stderr, "scan kernel %d disagrees\n", kernels[k]);
+        CHECK(textAgree);
+        CHECK(rangeAgree);
+        CHECK(thresholdAgree);
+    }
+    SetStockScanKernel(STOCK_SCAN_AUTO);
+}
+
+// Whether a quantity filter lists exactly the matching slots, in order; without
+// a threshold table it filters on low <= stock <= high
+static int QuantityFilterAgrees(StockManager* manager, int low, int high, const int* thresholds, int thresholdCount, int* found)
+{
+    int count = thresholds != NULL ? GetLowStockItemsByCategory(manager, thresholds, thresholdCount, found, manager->itemCount)
+                                   : GetStockItemsInRange(manager, low, high, found, manager->itemCount);
+    int expected = 0;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        const StockItem* item = GetStockItem(manager, i);
+        int passes = thresholds != NULL ? item->categoryId < thresholdCount && item->stock <= thresholds[item->categoryId]
+                                        : item->stock >= low && item->stock <= high;
+        
+        if (!passes) continue;
+        if (expected >= count || found[expected] != i) return 0;
+        expected++;
+    }
+    return expected == count;
+}
+
+// Quantity filters at the edges: empty inventories, every item count up to a
+// few vectors on each kernel, full-width and inverted ranges, short threshold
+// tables, and result lists shorter than the match count
+static void CheckQuantityFilters(void)
+{
+    static const int kernels[] = { STOCK_SCAN_SCALAR, STOCK_SCAN_SSE2, STOCK_SCAN_AVX2 };
+    int found[40];
+    int thresholds[8] = { 0 };
+    char name[32];
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    CHECK(GetStockItemsInRange(&manager, (int)0x80000000, 0x7FFFFFFF, found, 40) == 0);
+    CHECK(GetLowStockItemsByCategory(&manager, thresholds, 8, found, 40) == 0);
+    CHECK(GetStockItemsInCategory(&manager, 0, found, 40) == 0);
+    FreeStockManager(&manager);
+    
+    for (int k = 0; k < 3; k++)
+    {
+        if (SetStockScanKernel(kernels[k]) != kernels[k]) continue;
+        
+        int agree = 1;
+        InitStockManager(&manager);
+        for (int count = 1; count <= 40 && agree; count++)
+        {
+            int i = count - 1;
+            snprintf(name, sizeof(name), "Item %d", i);
+            AddStockItem(&manager, name, i % 2 ? "Odd" : "Even", i % 3 == 0 ? 0x7FFFFFFF : i % 5);
+            
+            int odd = FindStockCategory(&manager, "Odd");
+            int even = FindStockCategory(&manager, "Even");
+            thresholds[even] = 2;
+            if (odd >= 0) thresholds[odd] = 0x7FFFFFFF;
+            
+            agree = QuantityFilterAgrees(&manager, (int)0x80000000, 0x7FFFFFFF, NULL, 0, found) &&
+                    QuantityFilterAgrees(&manager, 0x7FFFFFFF, 0x7FFFFFFF, NULL, 0, found) &&
+                    QuantityFilterAgrees(&manager, 1, 3, NULL, 0, found) &&
+                    GetStockItemsInRange(&manager, 3, 2, found, 40) == 0 &&
+                    QuantityFilterAgrees(&manager, 0, 0, thresholds, 8, found) &&
+                    QuantityFilterAgrees(&manager, 0, 0, thresholds, even + 1, found);
+        }
+        if (!agree) fprintf(stderr, "quantity filters on kernel %d disagree\n", kernels[k]);
+        CHECK(agree);
+        
+        // Swap-removes, quantity and category changes reach the columns
+        CHECK(RemoveStockItem(&manager, 0) && AdjustStockItem(&manager, 5, 1));
+        CHECK(UpdateStockItem(&manager, 8, "Item 8", "Odd", 0x7FFFFFFF));
+        CHECK(QuantityFilterAgrees(&manager, 0x7FFFFFFF, 0x7FFFFFFF, NULL, 0, found));
+        CHECK(QuantityFilterAgrees(&manager, 0, 0, thresholds, 8, found));
+        FreeStockManager(&manager);
+    }
+    SetStockScanKernel(STOCK_SCAN_AUTO);
+    
+    // Short result lists get the first matches and the full count
+    InitStockManager(&manager);
+    for (int i = 0; i < 20; i++)
+    {
+        snprintf(name, sizeof(name), "Item %d", i);
+        AddStockItem(&manager, name, "Tools", i);
+    }
+    for (int i = 0; i < 40; i++) found[i] = -1;
+    CHECK(GetStockItemsInRange(&manager, 5, 0x7FFFFFFF, found, 3) == 15);
+    CHECK(found[0] == 5 && found[1] == 6 && found[2] == 7 && found[3] == -1);
+    CHECK(GetStockItemsInRange(&manager, 0, 0x7FFFFFFF, NULL, 0) == 20);
+    CHECK(GetStockItemsInCategory(&manager, FindStockCategory(&manager, "Tools"), NULL, 0) == 20);
+    CHECK(GetStockItemsInCategory(&manager, -1, found, 40) == 0);
+    
+    // Threshold tables that are missing, empty or stop short of a category
+    thresholds[FindStockCategory(&manager, "Tools")] = 4;
+    CHECK(GetLowStockItemsByCategory(&manager, NULL, 8, found, 40) == 0);
+    CHECK(GetLowStockItemsByCategory(&manager, thresholds, -1, found, 40) == 0);
+    CHECK(GetLowStockItemsByCategory(&manager, thresholds, 0, found, 40) == 0);
+    CHECK(GetLowStockItemsByCategory(&manager, thresholds, FindStockCategory(&manager, "Tools") + 1, found, 40) == 5);
+    FreeStockManager(&manager);
+}
+
+// GetLowStockItems lists items in item order; the visitor lists them lowest stock first
+static void CheckLowStockOrder(void)
+{
+    static const int stocks[] = { 9, 3, 0, 12, 3, 1 };
+    StockItem results[6];
+    int indices[6];
+    int count = 0;
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    for (int i = 0; i < 6; i++) AddStockItem(&manager, i % 2 ? "Odd" : "Even", "Misc", stocks[i]);
+    
+    CHECK(GetLowStockItems(&manager, 3, results, &count) && count == 4);
+    CHECK(results[0].id == 2 && results[1].id == 3 && results[2].id == 5 && results[3].id == 6);
+    CHECK(GetLowStockItemIndices(&manager, 3, 0, indices, 6) == 4);
+    CHECK(indices[0] == 2 && indices[1] == 5 && indices[2] == 1 && indices[3] == 4);
+    
+    FreeStockManager(&manager);
+}
+
+typedef struct {
+    long long key;          // Stock, or stock minus reorder level
+    int id;
+    int index;
+} QuantityEntry;
+
+static int CompareQuantityEntries(const void* a, const void* b)
+{
+    const QuantityEntry* x = (const QuantityEntry*)a;
+    const QuantityEntry* y = (const QuantityEntry*)b;
+    
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+// The items in the order of the quantity index: (stock or shortfall, id)
+static void SortQuantities(StockManager* manager, int shortfall, QuantityEntry* entries)
+{
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        const StockItem* item = GetStockItem(manager, i);
+        
+        entries[i].key = shortfall ? (long long)item->stock - item->reorderLevel : item->stock;
+        entries[i].id = item->id;
+        entries[i].index = i;
+    }
+    qsort(entries, manager->itemCount, sizeof(QuantityEntry), CompareQuantityEntries);
+}
+
+static int QuantityDisagrees(const char* query, int argument)
+{
+    fprintf(stderr, "%s(%d) disagrees with the sorted items\n", query, argument);
+    return 0;
+}
+
+// Counts, pages, ranges, both ends and the reorder list all match sorting the items
+static int QuantityQueriesAgree(StockManager* manager, QuantityEntry* sorted, int* found)
+{
+    int n = manager->itemCount;
+    SortQuantities(manager, 0, sorted);
+    
+    for (int threshold = -1; threshold <= 25; threshold += 3)
+    {
+        int expected = 0;
+        while (expected < n && sorted[expected].key <= threshold) expected++;
+        if (CountStockItemsAtOrBelow(manager, threshold) != expected) return QuantityDisagrees("CountStockItemsAtOrBelow", threshold);
+        
+        // Pages of 7 put together give the whole list
+        for (int offset = 0; offset < expected + 7; offset += 7)
+        {
+            int page = GetLowStockItemIndices(manager, threshold, offset, found, 7);
+            int want = expected - offset < 0 ? 0 : expected - offset > 7 ? 7 : expected - offset;
+            
+            if (page != want) return QuantityDisagrees("GetLowStockItemIndices", threshold);
+            for (int i = 0; i < page; i++)
+            {
+                if (found[i] != sorted[offset + i].index) return QuantityDisagrees("GetLowStockItemIndices", threshold);
+            }
+        }
+    }
+    
+    // Only the first maxIndices of a range are stored, but all are counted
+    for (int low = 0; low <= 20; low += 5)
+    {
+        int first = 0, count = 0;
+        while (first < n && sorted[first].key < low) first++;
+        while (first + count < n && sorted[first + count].key <= low + 4) count++;
+        
+        if (GetStockItemsByQuantity(manager, low, low + 4, found, 10) != count) return QuantityDisagrees("GetStockItemsByQuantity", low);
+        for (int i = 0; i < count && i < 10; i++)
+        {
+            if (found[i] != sorted[first + i].index) return QuantityDisagrees("GetStockItemsByQuantity", low);
+        }
+    }
+    
+    int ends = n < 25 ? n : 25;
+    if (GetLowestStockItems(manager, 25, found) != ends) return QuantityDisagrees("GetLowestStockItems", 25);
+    for (int i = 0; i < ends; i++)
+    {
+        if (found[i] != sorted[i].index) return QuantityDisagrees("GetLowestStockItems", 25);
+    }
+    if (GetHighestStockItems(manager, 25, found) != ends) return QuantityDisagrees("GetHighestStockItems", 25);
+    for (int i = 0; i < ends; i++)
+    {
+        if (found[i] != sorted[n - 1 - i].index) return QuantityDisagrees("GetHighestStockItems", 25);
+    }
+    
+    SortQuantities(manager, 1, sorted);
+    int shortCount = 0;
+    while (shortCount < n && sorted[shortCount].key <= 0) shortCount++;
+    if (GetStockItemsToReorder(manager, found, n) != shortCount) return QuantityDisagrees("GetStockItemsToReorder", n);
+    for (int i = 0; i < shortCount; i++)
+    {
+        if (found[i] != sorted[i].index) return QuantityDisagrees("GetStockItemsToReorder", n);
+    }
+    
+    return 1;
+}
+
+// Random quantity changes, reorder levels, removes and adds
+static void ChurnQuantities(StockManager* manager, unsigned* seed, int edits)
+{
+    char name[32];
+    
+    for (int e = 0; e < edits; e++)
+    {
+        unsigned action = NextCheckRandom(seed) % 5;
+        int index = (int)(NextCheckRandom(seed) % (unsigned)manager->itemCount);
+        int amount = (int)(NextCheckRandom(seed) % 21);
+        StockItem* item = GetStockItem(manager, index);
+        
+        if (action == 0)
+            AdjustStockItem(manager, index, amount / 3 - 3);
+        else if (action == 1)
+            SetStockReorderLevel(manager, index, amount / 2);
+        else if (action == 2)
+            RemoveStockItem(manager, index);
+        else if (action == 3)
+            UpdateStockItem(manager, index, item->name, GetStockItemCategory(manager, item), amount);
+        else
+        {
+            snprintf(name, sizeof(name), "Q%d", e);
+            AddStockItem(manager, name, "Misc", amount);
+        }
+    }
+}
+
+// The ordered quantity index stays in step with every kind of edit
+static void CheckQuantityIndex(void)
+{
+    unsigned seed = 3;
+    StockManager manager;
+    InitStockManager(&manager);
+    
+    for (int i = 0; i < 2000; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Stocked %d", i);
+        AddStockItem(&manager, name, "Misc", (int)(NextCheckRandom(&seed) % 21));
+    }
+    
+    // Room for the 2000 items plus every add the edits can make
+    QuantityEntry* sorted = (QuantityEntry*)malloc(4000 * sizeof(QuantityEntry));
+    int* found = (int*)malloc(4000 * sizeof(int));
+    if (!CHECK(sorted != NULL && found != NULL)) return;
+    
+    CHECK(QuantityQueriesAgree(&manager, sorted, found));
+    for (int round = 0; round < 4; round++)
+    {
+        ChurnQuantities(&manager, &seed, 500);
+        CHECK(QuantityQueriesAgree(&manager, sorted, found));
+    }
+    
+    free(sorted);
+    free(found);
+    FreeStockManager(&manager);
+}
+
+typedef struct {
+    int* indices;
+    int count;
+    int stopAfter;          // The visitor asks to stop after this many (0: never)
+} PageCollector;
+
+static int CollectPage(StockManager* manager, int index, void* context)
+{
+    PageCollector* page = (PageCollector*)context;
+    
+    (void)manager;
+    page->indices[page->count++] = index;
+    return page->count != page->stopAfter;
+}
+
+// Every (offset, limit) page is the matching slice of the full list, and a
+// visitor that stops early gets no more matches
+static int PagesAgree(StockManager* manager, const char* term, int threshold, const int* full, int fullCount, int* page)
+{
+    const int offsets[] = { 0, 1, 5, 17, fullCount - 1, fullCount, fullCount + 3 };
+    const int limits[] = { 0, 1, 3, 50 };
+    
+    for (int o = 0; o < 7; o++)
+    {
+        for (int l = 0; l < 4; l++)
+        {
+            int offset = offsets[o] < 0 ? 0 : offsets[o];
+            int expected = fullCount - offset < 0 ? 0 : fullCount - offset;
+            if (limits[l] > 0 && expected > limits[l]) expected = limits[l];
+            
+            for (int stopAfter = 0; stopAfter <= 2; stopAfter += 2)
+            {
+                PageCollector collector = { page, 0, stopAfter };
+                int want = stopAfter > 0 && expected > stopAfter ? stopAfter : expected;
+                int delivered = term != NULL ?
+                    VisitSearchResults(manager, term, STOCK_SEARCH_EXACT, offset, limits[l], CollectPage, &collector) :
+                    VisitLowStockItems(manager, threshold, offset, limits[l], CollectPage, &collector);
+                
+                if (delivered != want || collector.count != want || memcmp(page, full + offset, (size_t)want * sizeof(int)) != 0)
+                {
+                    fprintf(stderr, "page of \"%s\"/%d at offset %d, limit %d, stop after %d: %d delivered, expected %d\n",
+                            term != NULL ? term : "", threshold, offset, limits[l], stopAfter, delivered, want);
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+// Paged visitors and the copying wrappers slice the same lists as a full query
+static void CheckVisitorPaging(void)
+{
+    static const char* const terms[] = { "abc", "Bolt", "cab", "b", "zzz" };
+    unsigned seed = 23;
+    StockManager manager;
+    InitStockManager(&manager);
+    
+    ChurnSearchItems(&manager, &seed, 3000);
+    for (int i = 0; i < manager.itemCount; i++) AdjustStockItem(&manager, i, i % 13);
+    
+    int* full = (int*)malloc(manager.itemCount * sizeof(int));
+    int* page = (int*)malloc(manager.itemCount * sizeof(int));
+    StockItem* copies = (StockItem*)malloc(manager.itemCount * sizeof(StockItem));
+    if (!CHECK(full != NULL && page != NULL && copies != NULL)) return;
+    
+    for (int t = 0; t < 5; t++)
+    {
+        int count = SearchStockItemIndices(&manager, terms[t], STOCK_SEARCH_EXACT, 0, full, manager.itemCount);
+        CHECK(PagesAgree(&manager, terms[t], 0, full, count, page));
+        
+        int copied = -1;
+        SearchStockItems(&manager, terms[t], copies, &copied);
+        int same = copied == count;
+        for (int i = 0; same && i < count; i++) same = copies[i].id == GetStockItem(&manager, full[i])->id;
+        CHECK(same);
+    }
+    
+    for (int threshold = 0; threshold <= 12; threshold += 4)
+    {
+        int count = GetLowStockItemIndices(&manager, threshold, 0, full, manager.itemCount);
+        CHECK(count == CountStockItemsAtOrBelow(&manager, threshold));
+        CHECK(PagesAgree(&manager, NULL, threshold, full, count, page));
+    }
+    
+    free(full);
+    free(page);
+    free(copies);
+    FreeStockManager(&manager);
+}
+
+static int WriteCheckFile(const char* filename, const char* text)
+{
+    FILE* output = fopen(filename, "wb");
+    if (output == NULL) return 0;
+    
+    int written = fwrite(text, 1, strlen(text), output) == strlen(text);
+    return fclose(output) == 0 && written;
+}
+
+#define IMPORT_CHECK_ERRORS 256
+
+typedef struct {
+    int count;
+    int lines[IMPORT_CHECK_ERRORS];
+    int errors[IMPORT_CHECK_ERRORS];
+} ImportErrors;
+
+static void RecordImportError(int line, int error, void* context)
+{
+    ImportErrors* errors = (ImportErrors*)context;
+    
+    if (errors->count < IMPORT_CHECK_ERRORS)
+    {
+        errors->lines[errors->count] = line;
+        errors->errors[errors->count] = error;
+    }
+    errors->count++;
+}
+
+// Whitespace-only lines are blank, spaces may pad a quoted field, and text
+// after a closing quote makes the row malformed
+static void CheckImportQuoting(void)
+{
+    static const char* file = "check_quoting.csv";
+    static ImportErrors errors;
+    StockImportOptions options;
+    StockImportResult result;
+    StockManager manager;
+    
+    errors.count = 0;
+    InitStockManager(&manager);
+    InitStockImportOptions(&options);
+    options.onError = RecordImportError;
+    options.context = &errors;
+    
+    CHECK(WriteCheckFile(file, "name,quantity,category\n   \n\t \n\"a\"b,1,X\n\"padded\"  ,2,Y\nok,3,\"Z\" \n"));
+    CHECK(ImportStockFromFile(&manager, file, &options, &result));
+    CHECK(result.rows == 3 && result.imported == 2 && result.rejected == 1);
+    CHECK(errors.count == 1 && errors.lines[0] == 4 && errors.errors[0] == STOCK_IMPORT_ERROR_QUOTES);
+    CHECK(manager.itemCount == 2 && strcmp(GetStockItem(&manager, 0)->name, "padded") == 0);
+    CHECK(strcmp(GetStockItemCategory(&manager, GetStockItem(&manager, 1)), "Z") == 0);
+    
+    // File names are UTF-8
+    static const char* named = "check_\xC3\x87" "ay_\xE6\x97\xA5.csv";
+    CHECK(WriteCheckFile(named, "name,quantity\nnamed,4\n"));
+    CHECK(ImportStockFromFile(&manager, named, NULL, &result) && result.imported == 1);
+    CHECK(manager.itemCount == 3 && strcmp(GetStockItem(&manager, 2)->name, "named") == 0);
+    
+    FreeStockManager(&manager);
+    remove(file);
+    remove(named);
+}
+
+#define IMPORT_NAME     0
+#define IMPORT_STOCK    1
+#define IMPORT_CATEGORY 2
+#define IMPORT_REORDER  3
+
+// One way to lay out an import file, and the options that read it
+typedef struct {
+    char delimiter;
+    int hasHeader;
+    int byteOrderMark;
+    int crlf;
+    int columns;                // Fields per row
+    int kinds[4];               // IMPORT_* held by each column
+    const char* header;
+} ImportLayout;
+
+static const char* const g_importNames[] = {
+    "Bolt", "a,b", "say \"hi\"", "two\nlines", " lead", "trail ", "tab\tin", "\xC3\x87" "ay", "cr\r\nlf", "x",
+};
+static const char* const g_importCategories[] = { "Tools", "", "Bolts, nuts", " Spaced " };
+static const int g_importFaults[] = {
+    STOCK_IMPORT_ERROR_COLUMNS, STOCK_IMPORT_ERROR_TEXT, STOCK_IMPORT_ERROR_NUMBER, STOCK_IMPORT_ERROR_QUOTES,
+};
+
+// Quoted when the text needs it, and sometimes when it does not
+static void WriteImportField(FILE* output, const char* text, char delimiter, int quote, int* line)
+{
+    size_t length = strlen(text);
+    
+    if (length > 0 && (text[0] == ' ' || text[0] == '\t' || text[length - 1] == ' ' || text[length - 1] == '\t')) quote = 1;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] == delimiter || text[i] == '"' || text[i] == '\n' || text[i] == '\r') quote = 1;
+    }
+    
+    if (quote) fputc('"', output);
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] == '"') fputc('"', output);
+        if (text[i] == '\n') (*line)++;
+        fputc(text[i], output);
+    }
+    if (quote) fputc('"', output);
+}
+
+// Writes rows of every kind, good and bad, and imports them; the inventory must
+// hold exactly the good rows and every bad one must be reported on its line
+static int ImportLayoutAgrees(const ImportLayout* layout, unsigned* seed)
+{
+    static const char* file = "check_import.csv";
+    static ImportErrors errors;
+    static ImportErrors expectedErrors;
+    const char* end = layout->crlf ? "\r\n" : "\n";
+    char number[32];
+    int line = 1;
+    int good = 0;
+    StockManager expected, imported;
+    
+    FILE* output = fopen(file, "wb");
+    if (output == NULL) return 0;
+    
+    InitStockManager(&expected);
+    InitStockManager(&imported);
+    errors.count = expectedErrors.count = 0;
+    
+    if (layout->byteOrderMark) fputs("\xEF\xBB\xBF", output);
+    if (layout->hasHeader)
+    {
+        fputs(layout->header, output);
+        fputs(end, output);
+        line++;
+    }
+    
+    // Enough rows to cross several read buffer boundaries
+    for (int row = 0; row < 6000; row++)
+    {
+        unsigned pick = NextCheckRandom(seed);
+        const char* name = g_importNames[pick % 10];
+        const char* category = g_importCategories[(pick >> 4) % 4];
+        int stock = (int)((pick >> 6) % 500);
+        int reorder = (int)((pick >> 3) % 7);
+        int fault = (pick >> 12) % 8 == 0 ? g_importFaults[(pick >> 16) % 4] : 0;   // A mistake in one row of eight
+        int rowLine = line;
+        
+        if (NextCheckRandom(seed) % 8 == 0)
+        {
+            fputs(NextCheckRandom(seed) % 2 ? " \t" : "", output);
+            fputs(end, output);
+            line++;
+            rowLine = line;
+        }
+        
+        for (int column = 0; column < layout->columns; column++)
+        {
+            int kind = layout->kinds[column];
+            unsigned style = NextCheckRandom(seed) % 4;
+            
+            // A short row keeps its first field, quoted so an empty one is not a blank line
+            if (fault == STOCK_IMPORT_ERROR_COLUMNS && column > 0) break;
+            if (column > 0) fputc(layout->delimiter, output);
+            
+            if (kind == IMPORT_NAME && fault == STOCK_IMPORT_ERROR_TEXT)
+                fputs("\"\"", output);
+            else if (kind == IMPORT_NAME && fault == STOCK_IMPORT_ERROR_QUOTES)
+                fputs("\"ab\"c", output);
+            else if (kind == IMPORT_NAME)
+                WriteImportField(output, name, layout->delimiter, style == 0, &line);
+            else if (kind == IMPORT_CATEGORY)
+                WriteImportField(output, category, layout->delimiter, style == 0 || fault == STOCK_IMPORT_ERROR_COLUMNS, &line);
+            else if (kind == IMPORT_STOCK && fault == STOCK_IMPORT_ERROR_NUMBER)
+                fputs(style % 2 ? "1x" : "-3", output);
+            else
+            {
+                int value = kind == IMPORT_STOCK ? stock : reorder;
+                if (kind == IMPORT_REORDER && value == 0 && style < 2)
+                    number[0] = '\0';
+                else
+                    snprintf(number, sizeof(number), style == 0 ? "%d" : style == 1 ? "+%d" : style == 2 ? " %d " : "\"%d\"", value);
+                fputs(number, output);
+            }
+        }
+        fputs(end, output);
+        line++;
+        
+        if (fault != 0)
+        {
+            if (expectedErrors.count < IMPORT_CHECK_ERRORS)
+            {
+                expectedErrors.lines[expectedErrors.count] = rowLine;
+                expectedErrors.errors[expectedErrors.count] = fault;
+            }
+            expectedErrors.count++;
+            continue;
+        }
+        
+        int hasReorder = 0;
+        for (int column = 0; column < layout->columns; column++) hasReorder |= layout->kinds[column] == IMPORT_REORDER;
+        
+        AddStockItem(&expected, name, category, stock);
+        if (hasReorder) SetStockReorderLevel(&expected, expected.itemCount - 1, reorder);
+        good++;
+    }
+    
+    int agree = fclose(output) == 0;
+    
+    StockImportOptions options;
+    StockImportResult result;
+    InitStockImportOptions(&options);
+    options.onError = RecordImportError;
+    options.context = &errors;
+    options.hasHeader = layout->hasHeader;
+    if (!layout->hasHeader)
+    {
+        // Without a header every column is given by position
+        options.delimiter = layout->delimiter;
+        options.nameColumn = options.stockColumn = options.categoryColumn = options.reorderColumn = STOCK_IMPORT_ABSENT;
+        for (int column = 0; column < layout->columns; column++)
+        {
+            int* mapped[] = { &options.nameColumn, &options.stockColumn, &options.categoryColumn, &options.reorderColumn };
+            *mapped[layout->kinds[column]] = column;
+        }
+    }
+    
+    agree = agree && ImportStockFromFile(&imported, file, &options, &result);
+    agree = agree && result.imported == good && result.rejected == expectedErrors.count && result.rows == good + result.rejected;
+    agree = agree && SameInventory(&expected, &imported) && errors.count == expectedErrors.count;
+    for (int i = 0; agree && i < errors.count && i < IMPORT_CHECK_ERRORS; i++)
+    {
+        agree = errors.lines[i] == expectedErrors.lines[i] && errors.errors[i] == expectedErrors.errors[i];
+    }
+    if (!agree) fprintf(stderr, "import with delimiter %#x and header \"%s\" differs\n", layout->delimiter, layout->hasHeader ? layout->header : "");
+    
+    FreeStockManager(&imported);
+    FreeStockManager(&expected);
+    remove(file);
+    return agree;
+}
+
+// Generated CSV and TSV files, with and without headers, read back as written
+static void CheckImportLayouts(void)
+{
+    static const ImportLayout layouts[] = {
+        { ',', 1, 0, 0, 3, { IMPORT_NAME, IMPORT_STOCK, IMPORT_CATEGORY, 0 }, "name,quantity,category" },
+        { '\t', 1, 1, 1, 4, { IMPORT_CATEGORY, IMPORT_STOCK, IMPORT_NAME, IMPORT_REORDER }, "Category\tQty\tProduct Name\tReorder Level" },
+        { ',', 0, 0, 1, 4, { IMPORT_STOCK, IMPORT_NAME, IMPORT_REORDER, IMPORT_CATEGORY }, NULL },
+    };
+    unsigned seed = 41;
+    
+    for (int i = 0; i < 3; i++) CHECK(ImportLayoutAgrees(&layouts[i], &seed));
+}
+
+// A copy of the inventory to compare against later: items and category names
+typedef struct {
+    int count;
+    StockItem* items;
+    char (*categories)[MAX_CATEGORY_LENGTH];
+} InventoryShot;
+
+static int TakeInventoryShot(StockManager* manager, InventoryShot* shot)
+{
+    shot->count = manager->itemCount;
+    shot->items = (StockItem*)malloc((manager->itemCount + 1) * sizeof(StockItem));
+    shot->categories = (char (*)[MAX_CATEGORY_LENGTH])malloc((manager->itemCount + 1) * MAX_CATEGORY_LENGTH);
+    if (shot->items == NULL || shot->categories == NULL) return 0;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        shot->items[i] = *GetStockItem(manager, i);
+        snprintf(shot->categories[i], MAX_CATEGORY_LENGTH, "%s", GetStockItemCategory(manager, &shot->items[i]));
+    }
+    return 1;
+}
+
+static void FreeInventoryShot(InventoryShot* shot)
+{
+    free(shot->items);
+    free(shot->categories);
+}
+
+// Same items under the same ids as when the shot was taken, in any order
+static int MatchesShot(StockManager* manager, const InventoryShot* shot)
+{
+    if (manager->itemCount != shot->count) return 0;
+    
+    for (int i = 0; i < shot->count; i++)
+    {
+        const StockItem* item = &shot->items[i];
+        const StockItem* other = GetStockItemById(manager, item->id);
+        
+        if (other == NULL || strcmp(item->name, other->name) != 0 || item->stock != other->stock ||
+            item->reorderLevel != other->reorderLevel || strcmp(shot->categories[i], GetStockItemCategory(manager, other)) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Steps logged so far, including any the budget dropped
+static long long LoggedUndoSteps(StockManager* manager)
+{
+    StockUndoStats stats;
+    GetStockUndoStats(manager, &stats);
+    return stats.undoSteps + stats.droppedSteps;
+}
+
+// One random change: a single edit of any kind, an undo group or a bulk insert
+static void MakeUndoableChange(StockManager* manager, unsigned* seed, int step)
+{
+    char name[32];
+    unsigned action = NextCheckRandom(seed) % 7;
+    int index = (int)(NextCheckRandom(seed) % (unsigned)manager->itemCount);
+    StockItem* item = GetStockItem(manager, index);
+    
+    snprintf(name, sizeof(name), "Step %d", step);
+    if (action == 0)
+        AddStockItem(manager, name, step % 2 ? "Added" : "Tools", step);
+    else if (action == 1 && manager->itemCount > 1)
+        RemoveStockItem(manager, index);
+    else if (action == 2)
+        UpdateStockItem(manager, index, name, step % 3 ? item->name[0] == 'S' ? "Renamed" : "Tools" : "New category", step);
+    else if (action == 3)
+        AdjustStockItem(manager, index, item->stock > 0 && step % 2 ? -1 : 3);
+    else if (action == 4)
+        SetStockReorderLevel(manager, index, step);
+    else if (action == 5)
+    {
+        BeginStockUndoGroup(manager);
+        AdjustStockItem(manager, index, 2);
+        AddStockItem(manager, name, "Grouped", 1);
+        if (manager->itemCount > 2) RemoveStockItem(manager, 0);
+        SetStockReorderLevel(manager, manager->itemCount - 1, 4);
+        EndStockUndoGroup(manager);
+    }
+    else
+    {
+        BeginStockBulkInsert(manager, 20);
+        for (int i = 0; i < 20; i++)
+        {
+            snprintf(name, sizeof(name), "Bulk %d.%d", step, i);
+            AddStockItem(manager, name, "Bulk", i);
+        }
+        EndStockBulkInsert(manager);
+    }
+}
+
+#define UNDO_CHECK_STEPS 150
+
+// Undo walks back through every earlier state and redo forward again, and a
+// checkpoint rolls back to the state it marked
+static void CheckUndoLog(void)
+{
+    static InventoryShot shots[UNDO_CHECK_STEPS + 1];
+    unsigned seed = 17;
+    char name[32];
+    StockManager manager;
+    InitStockManager(&manager);
+    
+    for (int i = 0; i < 50; i++)
+    {
+        snprintf(name, sizeof(name), "Item %d", i);
+        AddStockItem(&manager, name, i % 2 ? "Tools" : "Parts", i);
+    }
+    CHECK(EnableStockUndo(&manager, STOCK_UNDO_DEFAULT_BYTES));
+    
+    // One shot per logged step; a change that logged nothing is not a step
+    int steps = 0, mark = -1;
+    CHECK(TakeInventoryShot(&manager, &shots[0]));
+    for (int change = 0; steps < UNDO_CHECK_STEPS; change++)
+    {
+        if (steps == 60 && mark < 0)
+        {
+            CHECK(MarkStockCheckpoint(&manager, "middle"));
+            mark = steps;
+        }
+        
+        long long before = LoggedUndoSteps(&manager);
+        MakeUndoableChange(&manager, &seed, change);
+        if (LoggedUndoSteps(&manager) != before) CHECK(TakeInventoryShot(&manager, &shots[++steps]));
+    }
+    
+    int undone = 1, redone = 1;
+    for (int step = steps; step > 0 && undone; step--) undone = UndoStockChange(&manager) && MatchesShot(&manager, &shots[step - 1]);
+    CHECK(undone);
+    CHECK(!CanUndoStockChange(&manager) && !UndoStockChange(&manager) && MatchesShot(&manager, &shots[0]));
+    
+    for (int step = 1; step <= steps && redone; step++) redone = RedoStockChange(&manager) && MatchesShot(&manager, &shots[step]);
+    CHECK(redone);
+    CHECK(!CanRedoStockChange(&manager) && !RedoStockChange(&manager));
+    
+    CHECK(RollbackStockCheckpoint(&manager, "middle") && MatchesShot(&manager, &shots[mark]));
+    CHECK(RedoStockChange(&manager) && MatchesShot(&manager, &shots[mark + 1]));
+    
+    // A new change after undoing drops the redo steps
+    CHECK(UndoStockChange(&manager) && AdjustStockItem(&manager, 0, 1));
+    CHECK(!CanRedoStockChange(&manager));
+    
+    for (int step = 0; step <= steps; step++) FreeInventoryShot(&shots[step]);
+    FreeStockManager(&manager);
+}
+
+// With a small budget the oldest steps go, each undo still steps back exactly
+// one state, and a checkpoint whose steps were dropped is refused
+static void CheckUndoBudget(void)
+{
+    static InventoryShot shots[UNDO_CHECK_STEPS + 1];
+    const size_t budget = 2048;
+    unsigned seed = 29;
+    char name[MAX_NAME_LENGTH];
+    StockManager manager;
+    InitStockManager(&manager);
+    
+    // Long names make removals and renames log a lot of text
+    for (int i = 0; i < 50; i++)
+    {
+        snprintf(name, sizeof(name), "Item %d %0200d", i, 0);
+        AddStockItem(&manager, name, "Tools", i);
+    }
+    CHECK(EnableStockUndo(&manager, budget));
+    CHECK(MarkStockCheckpoint(&manager, "start"));
+    
+    int steps = 0;
+    CHECK(TakeInventoryShot(&manager, &shots[0]));
+    for (int change = 0; steps < UNDO_CHECK_STEPS; change++)
+    {
+        long long before = LoggedUndoSteps(&manager);
+        MakeUndoableChange(&manager, &seed, change);
+        if (LoggedUndoSteps(&manager) != before) CHECK(TakeInventoryShot(&manager, &shots[++steps]));
+    }
+    
+    StockUndoStats stats;
+    GetStockUndoStats(&manager, &stats);
+    CHECK(stats.droppedSteps > 0 && stats.undoBytes <= budget);
+    CHECK(!RollbackStockCheckpoint(&manager, "start") && MatchesShot(&manager, &shots[steps]));
+    
+    int step = steps, stepsBack = 1;
+    while (stepsBack && UndoStockChange(&manager)) stepsBack = MatchesShot(&manager, &shots[--step]);
+    CHECK(stepsBack);
+    CHECK(step == steps - stats.undoSteps);
+    
+    for (int i = 0; i <= steps; i++) FreeInventoryShot(&shots[i]);
+    FreeStockManager(&manager);
+}
+
+// Results of the scans that shard, from one pool size
+typedef struct {
+    int counts[5];
+    int* lists[5];
+} ShardedResults;
+
+static int RunShardedScans(StockManager* manager, ShardedResults* results)
+{
+    static const int thresholds[] = { 3, 0, 7, 1, 12, 5, 9 };
+    
+    results->counts[0] = SearchStockItemIndices(manager, "duct 7", STOCK_SEARCH_EXACT | STOCK_SEARCH_SCAN, 0, results->lists[0], manager->itemCount);
+    results->counts[1] = SearchStockItemIndices(manager, "PRODUCT 12", STOCK_SEARCH_FOLDED | STOCK_SEARCH_SCAN, 0, results->lists[1], manager->itemCount);
+    results->counts[2] = GetStockItemsInRange(manager, 10, 30, results->lists[2], manager->itemCount);
+    results->counts[3] = GetLowStockItemsByCategory(manager, thresholds, 7, results->lists[3], manager->itemCount);
+    results->counts[4] = GetStockItemsInCategory(manager, 3, results->lists[4], manager->itemCount);
+    
+    for (int q = 0; q < 5; q++)
+    {
+        if (results->counts[q] <= 0) return 0;     // Every query is meant to find something
+    }
+    return 1;
+}
+
+// Sharded scans over pools of every size return the serial results, in the
+// same order, before and after edits move items between shards
+static void CheckShardedScans(void)
+{
+    static const int poolSizes[] = { 2, 3, 4, 8 };
+    const int count = STOCK_PARALLEL_MIN_ITEMS + 3 * STOCK_SHARD_ITEMS / 2 + 7;     // A ragged last shard
+    char name[64];
+    char category[32];
+    ShardedResults serial, sharded;
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    ReserveStockItems(&manager, count);
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "Product %d", i);
+        snprintf(category, sizeof(category), "Category %d", i % 9);
+        AddStockItem(&manager, name, category, i % 40);
+    }
+    for (int q = 0; q < 5; q++)
+    {
+        serial.lists[q] = (int*)malloc(count * sizeof(int));
+        sharded.lists[q] = (int*)malloc(count * sizeof(int));
+        if (!CHECK(serial.lists[q] != NULL && sharded.lists[q] != NULL)) return;
+    }
+    
+    unsigned seed = 31;
+    for (int round = 0; round < 2; round++)
+    {
+        CHECK(SetStockQueryThreads(&manager, 1) == 1);
+        CHECK(RunShardedScans(&manager, &serial));
+        
+        for (int p = 0; p < 4; p++)
+        {
+            int same = SetStockQueryThreads(&manager, poolSizes[p]) == poolSizes[p] && RunShardedScans(&manager, &sharded);
+            for (int q = 0; q < 5 && same; q++)
+            {
+                same = sharded.counts[q] == serial.counts[q] &&
+                       memcmp(sharded.lists[q], serial.lists[q], (size_t)serial.counts[q] * sizeof(int)) == 0;
+            }
+            if (!same) fprintf(stderr, "sharded scans on %d threads differ from the serial ones\n", poolSizes[p]);
+            CHECK(same);
+        }
+        
+        // Removes swap items across shard edges; renames and quantity changes update the columns
+        for (int e = 0; e < 5000; e++)
+        {
+            int index = (int)(NextCheckRandom(&seed) % (unsigned)manager.itemCount);
+            StockItem* item = GetStockItem(&manager, index);
+            
+            if (e % 3 == 0)
+                RemoveStockItem(&manager, index);
+            else if (e % 3 == 1)
+                AdjustStockItem(&manager, index, (int)(NextCheckRandom(&seed) % 20));
+            else
+            {
+                snprintf(name, sizeof(name), "Product 7%d", e);
+                snprintf(category, sizeof(category), "%s", GetStockItemCategory(&manager, item));
+                UpdateStockItem(&manager, index, name, category, item->stock);
+            }
+        }
+    }
+    
+    SetStockQueryThreads(&manager, 1);
+    for (int q = 0; q < 5; q++)
+    {
+        free(serial.lists[q]);
+        free(sharded.lists[q]);
+    }
+    FreeStockManager(&manager);
+}
+
+#define ROW_TEXT_SIZE 400
+#define ROW_CHECK_MAX_ROWS 4000
+
+// A row as the list view draws it, through the row model
+static void PaintRow(StockRowModel* model, int row, char* text)
+{
+    const char* name = GetStockRowText(model, row, STOCK_COLUMN_NAME);
+    const char* category = GetStockRowText(model, row, STOCK_COLUMN_CATEGORY);
+    snprintf(text, ROW_TEXT_SIZE, "%s|%s|%s", name, GetStockRowText(model, row, STOCK_COLUMN_QUANTITY), category);
+}
+
+// Redraw what the model reports dirty, plus rows the count change uncovered
+static int RedrawDirtyRows(StockRowModel* model, char* screen, int shownRows)
+{
+    int first, last;
+    int rows = TakeStockRowUpdate(model, &first, &last);
+    
+    for (int row = first; row >= 0 && row <= last; row++) PaintRow(model, row, screen + (size_t)row * ROW_TEXT_SIZE);
+    for (int row = shownRows; row < rows; row++) PaintRow(model, row, screen + (size_t)row * ROW_TEXT_SIZE);
+    return rows;
+}
+
+// Every row on screen shows its item as it is now
+static int ScreenIsCurrent(StockManager* manager, const char* screen, int shownRows)
+{
+    char text[ROW_TEXT_SIZE];
+    
+    if (shownRows != manager->itemCount) return 0;
+    for (int row = 0; row < shownRows; row++)
+    {
+        const StockItem* item = GetStockItem(manager, row);
+        
+        snprintf(text, sizeof(text), "%s|%d|%s", item->name, item->stock, GetStockItemCategory(manager, item));
+        if (strcmp(text, screen + (size_t)row * ROW_TEXT_SIZE) != 0) return 0;
+    }
+    return 1;
+}
+
+// A view that redraws only the reported dirty rows stays current through edits,
+// batches, undo and reloads, and single edits dirty only their own row
+static void CheckRowModel(void)
+{
+    static const char* file = "check_rows.dat";
+    char name[32];
+    unsigned seed = 37;
+    int first, last;
+    StockManager manager;
+    StockRowModel model;
+    
+    InitStockManager(&manager);
+    for (int i = 0; i < 200; i++)
+    {
+        snprintf(name, sizeof(name), "Row %d", i);
+        AddStockItem(&manager, name, i % 2 ? "Tools" : "Parts", i);
+    }
+    EnableStockUndo(&manager, STOCK_UNDO_DEFAULT_BYTES);
+    InitStockRowModel(&model, &manager);
+    
+    char* screen = (char*)malloc((size_t)ROW_CHECK_MAX_ROWS * ROW_TEXT_SIZE);
+    if (!CHECK(screen != NULL)) return;
+    int shownRows = RedrawDirtyRows(&model, screen, 0);
+    CHECK(ScreenIsCurrent(&manager, screen, shownRows));
+    
+    // One edit, one dirty row; a removal dirties the row the last item moved into
+    CHECK(AdjustStockItem(&manager, 5, 1) && TakeStockRowUpdate(&model, &first, &last) == 200 && first == 5 && last == 5);
+    CHECK(RemoveStockItem(&manager, 17) && TakeStockRowUpdate(&model, &first, &last) == 199 && first == 17 && last == 17);
+    CHECK(TakeStockRowUpdate(&model, &first, &last) == 199 && first == -1);
+    shownRows = 199;
+    PaintRow(&model, 5, screen + 5 * ROW_TEXT_SIZE);
+    PaintRow(&model, 17, screen + 17 * ROW_TEXT_SIZE);
+    
+    int current = 1;
+    for (int round = 0; round < 400 && current; round++)
+    {
+        unsigned action = NextCheckRandom(&seed) % 10;
+        int index = (int)(NextCheckRandom(&seed) % (unsigned)manager.itemCount);
+        
+        snprintf(name, sizeof(name), "Edit %d", round);
+        if (action < 2)
+            AddStockItem(&manager, name, "Added", round);
+        else if (action < 4 && manager.itemCount > 1)
+            RemoveStockItem(&manager, index);
+        else if (action < 6)
+            UpdateStockItem(&manager, index, name, round % 3 ? "Tools" : "Renamed", round);
+        else if (action == 6)
+        {
+            BeginStockBatch(&manager);
+            for (int i = 0; i < 5 && manager.itemCount > 1; i++)
+            {
+                AdjustStockItem(&manager, (index + i * 31) % manager.itemCount, 2);
+                if (i % 2) RemoveStockItem(&manager, (index + i * 7) % manager.itemCount);
+            }
+            AddStockItem(&manager, name, "Batched", 1);
+            EndStockBatch(&manager);
+        }
+        else if (action == 7)
+            UndoStockChange(&manager);
+        else if (action == 8)
+            RedoStockChange(&manager);
+        else if (round % 50 == 8)
+            current = SaveStockToFile(&manager, file) && LoadStockFromFile(&manager, file);
+        else
+            AdjustStockItem(&manager, index, -1);
+        
+        // The view asks for the rows on screen, which fills the quantity cache
+        HintStockRows(&model, index - 20, index + 40);
+        
+        shownRows = RedrawDirtyRows(&model, screen, shownRows);
+        current = current && shownRows < ROW_CHECK_MAX_ROWS && ScreenIsCurrent(&manager, screen, shownRows);
+        if (!current) fprintf(stderr, "row model: stale rows after round %d (action %u)\n", round, action);
+    }
+    CHECK(current);
+    
+    FreeStockRowModel(&model);
+    free(screen);
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+// Whether wide text holds exactly the given UTF-16 units
+static int SameWideText(const StockWideChar* text, const StockWideChar* expected, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        if (text[i] != expected[i]) return 0;
+    }
+    return text[length] == 0;
+}
+
+// Shown strings after an edit, compared with a fresh conversion of the item
+static int DisplayIsCurrent(StockManager* manager, int index)
+{
+    StockWideChar wide[MAX_NAME_LENGTH];
+    StockDisplayText text;
+    char quantity[16];
+    const StockItem* item = GetStockItem(manager, index);
+    
+    if (!GetStockDisplayText(manager, index, &text)) return 0;
+    
+    size_t length = WidenStockText(item->name, wide, MAX_NAME_LENGTH);
+    if (!SameWideText(text.name, wide, (int)length)) return 0;
+    length = WidenStockText(GetStockItemCategory(manager, item), wide, MAX_NAME_LENGTH);
+    if (!SameWideText(text.category, wide, (int)length)) return 0;
+    snprintf(quantity, sizeof(quantity), "%d", item->stock);
+    length = WidenStockText(quantity, wide, MAX_NAME_LENGTH);
+    return SameWideText(text.quantity, wide, (int)length);
+}
+
+// UTF-16 conversion, hit and conversion counts, LRU eviction, and edits that
+// drop exactly the entries they change
+static void CheckDisplayCache(void)
+{
+    static const StockWideChar expectedName[] = { 0x00C7, 'a', 'y', ' ', 0x2615, ' ', 0xD834, 0xDD1E, ' ', 0xFFFD, '!' };
+    char name[32];
+    StockDisplayText text;
+    StockDisplayStats stats;
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    AddStockItem(&manager, "\xC3\x87" "ay \xE2\x98\x95 \xF0\x9D\x84\x9E \xFF!", "Mutfak", 1234);    // Çay ☕ 𝄞, a bad byte
+    for (int i = 1; i < 6; i++)
+    {
+        snprintf(name, sizeof(name), "Item %d", i);
+        AddStockItem(&manager, name, "Tools", i);
+    }
+    CHECK(SetStockDisplayCacheSize(&manager, 4));
+    
+    // A miss converts three strings, a hit none
+    CHECK(GetStockDisplayText(&manager, 0, &text));
+    CHECK(SameWideText(text.name, expectedName, 11));
+    CHECK(text.quantity[0] == '1' && text.quantity[3] == '4' && text.quantity[4] == 0);
+    CHECK(GetStockDisplayText(&manager, 0, &text));
+    GetStockDisplayStats(&manager, &stats);
+    CHECK(stats.misses == 1 && stats.hits == 1 && stats.conversions == 3 && stats.evictions == 0);
+    
+    // Items 1-3 fill the cache; item 4 evicts the least recently used, item 0
+    for (int i = 1; i <= 4; i++) GetStockDisplayText(&manager, i, &text);
+    GetStockDisplayStats(&manager, &stats);
+    CHECK(stats.misses == 5 && stats.evictions == 1 && stats.conversions == 15);
+    GetStockDisplayText(&manager, 4, &text);
+    GetStockDisplayText(&manager, 0, &text);
+    GetStockDisplayStats(&manager, &stats);
+    CHECK(stats.hits == 2 && stats.misses == 6 && stats.evictions == 2);
+    
+    // An edit drops only that item's entry, and the next lookup shows the change
+    CHECK(AdjustStockItem(&manager, 4, 10));
+    GetStockDisplayStats(&manager, &stats);
+    CHECK(stats.invalidations == 1);
+    CHECK(DisplayIsCurrent(&manager, 4));
+    CHECK(UpdateStockItem(&manager, 3, "Renamed", "Parts", 3) && DisplayIsCurrent(&manager, 3));
+    CHECK(SetStockReorderLevel(&manager, 0, 5));
+    GetStockDisplayStats(&manager, &stats);
+    CHECK(stats.invalidations == 2);
+    
+    // Entries follow ids, so the item swapped into a removed row shows its own text
+    CHECK(RemoveStockItem(&manager, 1) && DisplayIsCurrent(&manager, 1));
+    for (int i = 0; i < manager.itemCount; i++) CHECK(DisplayIsCurrent(&manager, i));
+    
+    FreeStockManager(&manager);
+}
+
+// Whole contents of a file (free them), or NULL
+#define CHANGE_CHECK_KEPT 8
+
+// Changes one subscriber received; only the first few are kept
+typedef struct {
+    int deliveries;
+    int total;
+    int ordered;            // Every delivery listed its ids ascending
+    StockChange kept[CHANGE_CHECK_KEPT];
+} ChangeLog;
+
+static void RecordChanges(StockManager* manager, const StockChange* changes, int count, void* context)
+{
+    ChangeLog* log = (ChangeLog*)context;
+    (void)manager;
+    
+    log->deliveries++;
+    for (int i = 0; i < count; i++)
+    {
+        if (log->total < CHANGE_CHECK_KEPT) log->kept[log->total] = changes[i];
+        if (i > 0 && changes[i].id <= changes[i - 1].id) log->ordered = 0;
+        log->total++;
+    }
+}
+
+static void ClearChangeLog(ChangeLog* log)
+{
+    memset(log, 0, sizeof(ChangeLog));
+    log->ordered = 1;
+}
+
+static int LoggedChange(const ChangeLog* log, int kind, int id, int index, unsigned fields)
+{
+    return log->deliveries == 1 && log->total == 1 && log->kept[0].kind == kind && log->kept[0].id == id &&
+           log->kept[0].index == index && log->kept[0].fields == fields;
+}
+
+// Batches coalesce per item and deliver once at the outermost end; empty and
+// cancelled-out batches deliver nothing, and unsubscribed listeners hear nothing
+static void CheckChangeNotifications(void)
+{
+    static const char* file = "check_changes.dat";
+    ChangeLog log, other;
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    EnableStockUndo(&manager, STOCK_UNDO_DEFAULT_BYTES);
+    ClearChangeLog(&log);
+    ClearChangeLog(&other);
+    int handle = SubscribeStockChanges(&manager, RecordChanges, &log);
+    int otherHandle = SubscribeStockChanges(&manager, RecordChanges, &other);
+    CHECK(handle > 0 && otherHandle > 0 && handle != otherHandle);
+    CHECK(SubscribeStockChanges(&manager, NULL, &log) == 0);
+    
+    // Outside a batch every change is delivered on its own
+    CHECK(AddStockItem(&manager, "First", "Tools", 1) && LoggedChange(&log, STOCK_CHANGE_INSERTED, 1, 0, STOCK_FIELD_ALL));
+    
+    // Empty batches, nested or not, and an unmatched end deliver nothing
+    ClearChangeLog(&log);
+    BeginStockBatch(&manager);
+    EndStockBatch(&manager);
+    BeginStockBatch(&manager);
+    BeginStockBatch(&manager);
+    EndStockBatch(&manager);
+    EndStockBatch(&manager);
+    EndStockBatch(&manager);
+    CHECK(log.deliveries == 0);
+    
+    // Nested batches deliver at the outermost end; an insert then edit stays an insert
+    BeginStockBatch(&manager);
+    BeginStockBatch(&manager);
+    CHECK(AddStockItem(&manager, "Second", "Tools", 2));
+    CHECK(AdjustStockItem(&manager, 1, 5));
+    EndStockBatch(&manager);
+    CHECK(log.deliveries == 0);
+    EndStockBatch(&manager);
+    CHECK(LoggedChange(&log, STOCK_CHANGE_INSERTED, 2, 1, STOCK_FIELD_ALL));
+    
+    // An insert then remove vanishes; edits merge their fields
+    ClearChangeLog(&log);
+    BeginStockBatch(&manager);
+    CHECK(AddStockItem(&manager, "Brief", "Tools", 3));
+    CHECK(RemoveStockItemById(&manager, 3));
+    EndStockBatch(&manager);
+    CHECK(log.deliveries == 0);
+    
+    BeginStockBatch(&manager);
+    CHECK(AdjustStockItem(&manager, 0, 1));
+    CHECK(UpdateStockItem(&manager, 0, "Renamed", "Tools", 2));
+    CHECK(SetStockReorderLevel(&manager, 0, 4));
+    EndStockBatch(&manager);
+    CHECK(LoggedChange(&log, STOCK_CHANGE_UPDATED, 1, 0, STOCK_FIELD_STOCK | STOCK_FIELD_NAME | STOCK_FIELD_REORDER));
+    
+    // A removal undone in the same batch comes back as a full update at its new index
+    ClearChangeLog(&log);
+    BeginStockBatch(&manager);
+    CHECK(RemoveStockItemById(&manager, 1));
+    CHECK(UndoStockChange(&manager));
+    EndStockBatch(&manager);
+    CHECK(log.deliveries == 1 && log.total == 2 && log.kept[0].id == 1 && log.kept[0].kind == STOCK_CHANGE_UPDATED &&
+          log.kept[0].fields == STOCK_FIELD_ALL && log.kept[0].index == FindStockItemById(&manager, 1));
+    
+    // A reload covers every other change in the batch
+    CHECK(SaveStockToFile(&manager, file));
+    ClearChangeLog(&log);
+    BeginStockBatch(&manager);
+    CHECK(AddStockItem(&manager, "Third", "Tools", 3));
+    CHECK(LoadStockFromFile(&manager, file));
+    CHECK(AdjustStockItem(&manager, 0, 1));
+    EndStockBatch(&manager);
+    CHECK(LoggedChange(&log, STOCK_CHANGE_RELOADED, 0, -1, STOCK_FIELD_ALL));
+    
+    // A batch larger than the kept slot table arrives whole, in first-change order
+    ClearChangeLog(&log);
+    BeginStockBatch(&manager);
+    for (int i = 0; i < 10000; i++) AddStockItem(&manager, "Bulk", "Bulk", i);
+    EndStockBatch(&manager);
+    CHECK(log.deliveries == 1 && log.total == 10000 && log.ordered);
+    
+    // Unsubscribed listeners hear nothing; stale handles are ignored and the slot is reused
+    ClearChangeLog(&log);
+    ClearChangeLog(&other);
+    UnsubscribeStockChanges(&manager, handle);
+    UnsubscribeStockChanges(&manager, handle);
+    UnsubscribeStockChanges(&manager, 0);
+    UnsubscribeStockChanges(&manager, 99);
+    CHECK(AdjustStockItem(&manager, 0, 1));
+    CHECK(log.deliveries == 0 && other.deliveries == 1);
+    CHECK(SubscribeStockChanges(&manager, RecordChanges, &log) == handle);
+    
+    // With nobody listening, a batch keeps nothing for a later subscriber
+    UnsubscribeStockChanges(&manager, handle);
+    UnsubscribeStockChanges(&manager, otherHandle);
+    ClearChangeLog(&log);
+    BeginStockBatch(&manager);
+    CHECK(AdjustStockItem(&manager, 0, 1));
+    handle = SubscribeStockChanges(&manager, RecordChanges, &log);
+    EndStockBatch(&manager);
+    CHECK(log.deliveries == 0);
+    
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+static unsigned char* ReadCheckFile(const char* filename, size_t* size)
+{
+    FILE* input = fopen(filename, "rb");
+    if (input == NULL) return NULL;
+    
+    unsigned char* bytes = NULL;
+    if (fseek(input, 0, SEEK_END) == 0)
+    {
+        long length = ftell(input);
+        bytes = length >= 0 ? (unsigned char*)malloc((size_t)length + 1) : NULL;
+        
+        rewind(input);
+        if (bytes != NULL && fread(bytes, 1, (size_t)length, input) != (size_t)length)
+        {
+            free(bytes);
+            bytes = NULL;
+        }
+        *size = (size_t)length;
+    }
+    fclose(input);
+    return bytes;
+}
+
+// A save with nothing to write leaves the file's bytes and modification time
+// alone; the time is set far back first so a rewrite in the same second shows
+static int SaveLeavesFileAlone(StockManager* manager, const char* filename)
+{
+    struct utimbuf old = { 1000000000, 1000000000 };
+    struct stat after;
+    size_t beforeSize = 0, afterSize = 0;
+    
+    unsigned char* before = ReadCheckFile(filename, &beforeSize);
+    int alone = before != NULL && utime(filename, &old) == 0 && SaveStockIncremental(manager, filename) &&
+                stat(filename, &after) == 0 && after.st_mtime == old.modtime;
+    
+    unsigned char* saved = ReadCheckFile(filename, &afterSize);
+    alone = alone && saved != NULL && afterSize == beforeSize && memcmp(before, saved, beforeSize) == 0;
+    
+    free(before);
+    free(saved);
+    return alone;
+}
+
+// Incremental saves rewrite records in place and reload as the inventory
+static void CheckIncrementalSave(void)
+{
+    static const char* file = "check_incremental.dat";
+    char name[32];
+    StockManager manager, loaded;
+    
+    remove(file);
+    InitStockManager(&manager);
+    for (int i = 0; i < 3000; i++)
+    {
+        snprintf(name, sizeof(name), "Saved %d", i);
+        AddStockItem(&manager, name, i % 3 ? "Tools" : "Parts", i);
+    }
+    CHECK(SaveStockIncremental(&manager, file));
+    CHECK(SaveLeavesFileAlone(&manager, file));
+    
+    for (int round = 0; round < 3; round++)
+    {
+        // Few enough changes to stay under the rewrite share, then a shrink
+        for (int i = 0; i < 20; i++) AdjustStockItem(&manager, (i * 131 + round) % manager.itemCount, 1);
+        if (round == 1) RemoveStockItem(&manager, 10);
+        if (round == 2) AddStockItem(&manager, "Appended", "New", 7);
+        CHECK(SaveStockIncremental(&manager, file));
+        
+        InitStockManager(&loaded);
+        CHECK(LoadStockFromFile(&loaded, file) && SameInventory(&manager, &loaded));
+        FreeStockManager(&loaded);
+        CHECK(SaveLeavesFileAlone(&manager, file));
+    }
+    
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+// Id deltas that would run past INT_MAX stop the load instead of wrapping, and
+// a record index entry with such an id is refused. Id 0x7FFFFFFF itself is
+// loaded and then renumbered like any other id the index does not accept.
+static void CheckOverflowingIds(void)
+{
+    static const char* file = "check_ids.dat";
+    static const unsigned char stream[] = {
+        'H', 'S', 'M', 'D', 2, 0, 0, 0,
+        3, 5, 1, 5, 'T', 'o', 'o', 'l', 's',             // Items, next id, categories
+        0x02, 1, 'A', 0, 1,                             // Id 1
+        0xFC, 0xFF, 0xFF, 0xFF, 0x0F, 1, 'B', 0, 2,     // Id 0x7FFFFFFF
+        0x02, 1, 'C', 0, 3                              // Would be 0x80000000
+    };
+    StockManager manager;
+    
+    FILE* output = fopen(file, "wb");
+    CHECK(output != NULL && fwrite(stream, 1, sizeof(stream), output) == sizeof(stream));
+    if (output != NULL) fclose(output);
+    
+    InitStockManager(&manager);
+    CHECK(LoadStockFromFile(&manager, file) && manager.itemCount == 2);
+    CHECK(GetStockItemById(&manager, 1) != NULL && GetStockItemById(&manager, 1) == GetStockItem(&manager, 0));
+    CHECK(FindStockItemById(&manager, 0x7FFFFFFF) < 0 && GetStockItem(&manager, 1)->id > 1 &&
+          strcmp(GetStockItem(&manager, 1)->name, "B") == 0);
+    
+    // Save two items with a record index, then point the second entry past INT_MAX
+    FreeStockManager(&manager);
+    InitStockManager(&manager);
+    AddStockItem(&manager, "First", "Tools", 1);
+    AddStockItem(&manager, "Second", "Tools", 2);
+    CHECK(SaveStockToFile(&manager, file));
+    
+    unsigned char bytes[256];
+    size_t size = 0;
+    FILE* input = fopen(file, "rb");
+    if (input != NULL)
+    {
+        size = fread(bytes, 1, sizeof(bytes), input);
+        fclose(input);
+    }
+    CHECK(size > 16 && size < sizeof(bytes));
+    if (size > 16 && size < sizeof(bytes))
+    {
+        size_t indexOffset = bytes[size - 16] | (bytes[size - 15] << 8) | ((size_t)bytes[size - 14] << 16);
+        unsigned char* id = bytes + indexOffset + 16 + 12 + 4;
+        
+        id[0] = 0;
+        id[1] = 0;
+        id[2] = 0;
+        id[3] = 0x80;
+        output = fopen(file, "wb");
+        CHECK(output != NULL && fwrite(bytes, 1, size, output) == size);
+        if (output != NULL) fclose(output);
+        
+        StockManager mapped;
+        InitStockManager(&mapped);
+        CHECK(!LoadStockFromFileMapped(&mapped, file) && mapped.itemCount == 0);
+        FreeStockManager(&mapped);
+    }
+    
+    FreeStockManager(&manager);
+    remove(file);
+}
+
+// Fill an inventory that spans `count` items over a few categories, some with reorder levels
+static void FillMappedItems(StockManager* manager, int count, int reorder)
+{
+    static const char* const categories[] = { "Tools", "", "Paint", "Bolts & nuts" };
+    char name[32];
+    
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "Item %d", i);
+        AddStockItem(manager, name, categories[i % 4], i * 7 % 100);
+        if (reorder && i % 3 == 0) SetStockReorderLevel(manager, manager->itemCount - 1, i % 40);
+    }
+}
+
+static int WriteCheckBytes(const char* filename, const unsigned char* bytes, size_t size)
+{
+    FILE* output = fopen(filename, "wb");
+    if (output == NULL) return 0;
+    
+    int written = fwrite(bytes, 1, size, output) == size;
+    return fclose(output) == 0 && written;
+}
+
+// Mapped loads agree with the regular loader for empty and segment-sized
+// inventories, for edits made before the items are decoded, and for files
+// whose record index is missing or damaged
+static void CheckMappedLoading(void)
+{
+    static const char* file = "check_mapped.dat";
+    static const int counts[] = { 1, STOCK_SEGMENT_SIZE - 1, STOCK_SEGMENT_SIZE, STOCK_SEGMENT_SIZE + 1, 2 * STOCK_SEGMENT_SIZE + 1 };
+    StockManager expected, mapped;
+    
+    // Missing, empty and empty-inventory files
+    remove(file);
+    InitStockManager(&mapped);
+    CHECK(!LoadStockFromFileMapped(&mapped, file) && mapped.itemCount == 0);
+    CHECK(WriteCheckFile(file, "") && !LoadStockFromFileMapped(&mapped, file) && mapped.itemCount == 0);
+    
+    InitStockManager(&expected);
+    CHECK(AddStockItem(&expected, "Gone", "Tools", 1) && RemoveStockItemById(&expected, 1));
+    CHECK(SaveStockToFile(&expected, file));
+    CHECK(LoadStockFromFileMapped(&mapped, file) && mapped.itemCount == 0 && mapped.mappedCount == 0);
+    CHECK(FindStockCategory(&mapped, "Tools") < 0);
+    CHECK(AddStockItem(&mapped, "Later", "Tools", 2) && GetStockItem(&mapped, 0)->id == 2);
+    FreeStockManager(&mapped);
+    FreeStockManager(&expected);
+    
+    // Sizes around the segment boundary, checked item by item before anything else decodes them
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        InitStockManager(&expected);
+        FillMappedItems(&expected, counts[c], 1);
+        CHECK(SaveStockToFile(&expected, file));
+        
+        InitStockManager(&mapped);
+        CHECK(LoadStockFromFileMapped(&mapped, file) && mapped.mappedCount == counts[c]);
+        CHECK(GetStockCategoryItemCount(&mapped, FindStockCategory(&mapped, "Tools")) == (counts[c] + 3) / 4);
+        
+        const StockItem* last = GetStockItemById(&mapped, counts[c]);
+        CHECK(last != NULL && strcmp(last->name, GetStockItem(&expected, counts[c] - 1)->name) == 0);
+        CHECK(SameInventory(&expected, &mapped));
+        CHECK(EnsureStockResident(&mapped) && mapped.mapping == NULL && mapped.mappedCount == 0);
+        CHECK(SameInventory(&expected, &mapped));
+        FreeStockManager(&mapped);
+        FreeStockManager(&expected);
+    }
+    
+    // Edits to items that are still on disk, then a save over the mapped file
+    int count = 2 * STOCK_SEGMENT_SIZE + 1;
+    InitStockManager(&expected);
+    FillMappedItems(&expected, count, 1);
+    CHECK(SaveStockToFile(&expected, file));
+    InitStockManager(&mapped);
+    CHECK(LoadStockFromFileMapped(&mapped, file));
+    
+    for (int pass = 0; pass < 2; pass++)
+    {
+        StockManager* manager = pass == 0 ? &expected : &mapped;
+        
+        CHECK(RemoveStockItemById(manager, 1));
+        CHECK(UpdateStockItemById(manager, STOCK_SEGMENT_SIZE + 5, "Moved", "Garden", 3));
+        CHECK(AdjustStockItem(manager, FindStockItemById(manager, count - 1), 11));
+        CHECK(RemoveStockItemById(manager, count));
+    }
+    CHECK(mapped.mapping != NULL);
+    CHECK(GetStockCategoryItemCount(&mapped, FindStockCategory(&mapped, "Tools")) ==
+          GetStockCategoryItemCount(&expected, FindStockCategory(&expected, "Tools")));
+    CHECK(GetStockCategoryItemCount(&mapped, FindStockCategory(&mapped, "Garden")) == 1);
+    CHECK(SaveStockToFile(&mapped, file) && mapped.mapping == NULL);
+    CHECK(SameInventory(&expected, &mapped));
+    
+    StockManager reloaded;
+    InitStockManager(&reloaded);
+    CHECK(LoadStockFromFileMapped(&reloaded, file) && SameInventory(&expected, &reloaded));
+    FreeStockManager(&reloaded);
+    FreeStockManager(&mapped);
+    
+    // v1 files and v2 files cut before the index footer take the regular path
+    FreeStockManager(&expected);
+    InitStockManager(&expected);
+    FillMappedItems(&expected, 100, 0);
+    CHECK(SaveStockToFileFormat(&expected, file, STOCK_FILE_FORMAT_V1));
+    InitStockManager(&mapped);
+    CHECK(LoadStockFromFileMapped(&mapped, file) && mapped.mapping == NULL && SameInventory(&expected, &mapped));
+    FreeStockManager(&mapped);
+    
+    CHECK(SaveStockToFile(&expected, file));
+    size_t size = 0;
+    unsigned char* bytes = ReadCheckFile(file, &size);
+    CHECK(bytes != NULL && size > 32);
+    if (bytes != NULL && size > 32)
+    {
+        InitStockManager(&mapped);
+        CHECK(WriteCheckBytes(file, bytes, size - 16));
+        CHECK(LoadStockFromFileMapped(&mapped, file) && mapped.mapping == NULL && SameInventory(&expected, &mapped));
+        FreeStockManager(&mapped);
+        
+        // An index entry pointing past the records fails the load and leaves an empty inventory
+        size_t indexOffset = bytes[size - 16] | (bytes[size - 15] << 8) | ((size_t)bytes[size - 14] << 16);
+        unsigned char* entry = bytes + indexOffset + 16;
+        
+        entry[3] = 0x7F;
+        InitStockManager(&mapped);
+        CHECK(WriteCheckBytes(file, bytes, size));
+        CHECK(!LoadStockFromFileMapped(&mapped, file) && mapped.itemCount == 0 && mapped.mapping == NULL);
+        CHECK(FindStockCategory(&mapped, "Tools") < 0);
+        CHECK(AddStockItem(&mapped, "After", "Tools", 1) && mapped.itemCount == 1);
+        FreeStockManager(&mapped);
+        
+        // A damaged record keeps the id and category from the index and loses the rest
+        entry[3] = 0;
+        size_t recordsStart = bytes[indexOffset] | (bytes[indexOffset + 1] << 8) | ((size_t)bytes[indexOffset + 2] << 16);
+        bytes[recordsStart + 1] = 0xFF;     // Name length runs on into the name and past the records
+        InitStockManager(&mapped);
+        CHECK(WriteCheckBytes(file, bytes, size));
+        CHECK(LoadStockFromFileMapped(&mapped, file) && mapped.itemCount == 100);
+        
+        const StockItem* damaged = GetStockItemById(&mapped, 1);
+        CHECK(damaged != NULL && damaged->name[0] == '\0' && damaged->stock == 0 &&
+              strcmp(GetStockItemCategory(&mapped, damaged), "Tools") == 0);
+        CHECK(strcmp(GetStockItemById(&mapped, 2)->name, "Item 1") == 0);
+        FreeStockManager(&mapped);
+    }
+    
+    free(bytes);
+    FreeStockManager(&expected);
+    remove(file);
+}
+
+static long long CheckFileSize(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) return -1;
+    
+    long long size = SeekStockFile(file, 0, SEEK_END) ? TellStockFile(file) : -1;
+    fclose(file);
+    return size;
+}
+
+// Stock of the item with `id` in a saved file, or -1
+static int SavedStock(const char* filename, int id)
+{
+    StockManager saved;
+    InitStockManager(&saved);
+    
+    const StockItem* item = LoadStockFromFile(&saved, filename) ? GetStockItemById(&saved, id) : NULL;
+    int stock = item != NULL ? item->stock : -1;
+    
+    FreeStockManager(&saved);
+    return stock;
+}
+
+// Save-path hook for the saver checks. While `holding` is set the next save
+// waits at its open, so requests can be queued behind a running save; a step
+// equal to `failPoint` fails.
+typedef struct {
+    StockLock* lock;
+    int holding;
+    int held;               // A save is waiting at the gate
+    int failPoint;
+    int written;            // Saver callbacks for good saves
+    int polling;            // Callbacks wait until the test has polled
+} SaveGate;
+
+static int PassSaveGate(int point, void* context)
+{
+    SaveGate* gate = (SaveGate*)context;
+    
+    AcquireStockLock(gate->lock);
+    if (point == STOCK_FAULT_OPEN && gate->holding)
+    {
+        gate->held = 1;
+        SignalStockLock(gate->lock);
+        while (gate->holding) WaitStockLock(gate->lock);
+        gate->held = 0;
+    }
+    int fail = point == gate->failPoint;
+    ReleaseStockLock(gate->lock);
+    return fail;
+}
+
+// Start a save of `filename` and return once the saver holds it at the gate
+static int HoldSave(StockManager* manager, SaveGate* gate, const char* filename)
+{
+    AcquireStockLock(gate->lock);
+    gate->holding = 1;
+    ReleaseStockLock(gate->lock);
+    
+    int requested = RequestStockSave(manager, filename);
+    
+    AcquireStockLock(gate->lock);
+    while (requested && !gate->held) WaitStockLock(gate->lock);
+    ReleaseStockLock(gate->lock);
+    return requested;
+}
+
+static void OpenSaveGate(SaveGate* gate)
+{
+    AcquireStockLock(gate->lock);
+    gate->holding = 0;
+    SignalStockLock(gate->lock);
+    ReleaseStockLock(gate->lock);
+}
+
+static void CountSavesWritten(int result, void* context)
+{
+    SaveGate* gate = (SaveGate*)context;
+    
+    AcquireStockLock(gate->lock);
+    gate->written += result;
+    SignalStockLock(gate->lock);
+    while (gate->polling) WaitStockLock(gate->lock);
+    ReleaseStockLock(gate->lock);
+}
+
+// Requests queued behind a running save: those for the same file collapse into
+// the newest copy, those for other files are all written, and snapshots of the
+// journal's own file empty the journal even when one replaced another
+static void CheckBackgroundSaves(void)
+{
+    static const char* files[] = { "check_save_a.dat", "check_save_b.dat", "check_save_c.dat" };
+    static const char* journal = "check_save.journal";
+    SaveGate gate = { CreateStockLock(), 0, 0, 0, 0, 0 };
+    StockManager manager;
+    
+    for (int f = 0; f < 3; f++) remove(files[f]);
+    remove(journal);
+    InitStockManager(&manager);
+    AddStockItem(&manager, "Tracked", "Tools", 0);
+    AddStockItem(&manager, "Other", "Tools", 5);
+    
+    CHECK(gate.lock != NULL);
+    SetStockFaultHook(PassSaveGate, &gate);
+    CHECK(StartStockSaver(&manager, CountSavesWritten, &gate));
+    
+    // a.dat is being written while b.dat, c.dat and b.dat again arrive
+    CHECK(HoldSave(&manager, &gate, files[0]));
+    AdjustStockItem(&manager, 0, 1);
+    CHECK(RequestStockSave(&manager, files[1]));
+    AdjustStockItem(&manager, 0, 1);
+    CHECK(RequestStockSave(&manager, files[2]));
+    AdjustStockItem(&manager, 0, 1);
+    CHECK(RequestStockSave(&manager, files[1]));
+    OpenSaveGate(&gate);
+    CHECK(WaitStockSave(&manager) == 1);
+    CHECK(SavedStock(files[0], 1) == 0);
+    CHECK(SavedStock(files[2], 1) == 2);
+    CHECK(SavedStock(files[1], 1) == 3);
+    
+    // Journal snapshots of c.dat: a waiting marked copy is replaced by a newer
+    // one, and another file's save is queued behind them
+    CHECK(OpenStockJournal(&manager, files[2], journal));
+    long long emptyJournal = CheckFileSize(journal);
+    
+    CHECK(HoldSave(&manager, &gate, files[0]));
+    AdjustStockItem(&manager, 0, 1);
+    CHECK(RequestStockSave(&manager, files[2]));
+    CHECK(CheckFileSize(journal) > emptyJournal);
+    AdjustStockItem(&manager, 0, 1);
+    CHECK(RequestStockSave(&manager, files[2]));
+    CHECK(RequestStockSave(&manager, files[1]));
+    OpenSaveGate(&gate);
+    CHECK(WaitStockSave(&manager) == 1);
+    CHECK(CheckFileSize(journal) == emptyJournal);
+    CHECK(SavedStock(files[0], 1) == 3);
+    CHECK(SavedStock(files[2], 1) == 5 && SavedStock(files[1], 1) == 5);
+    
+    // An edit after the snapshot keeps the journal until the next one
+    AdjustStockItem(&manager, 1, 1);
+    CHECK(FlushStockJournal(&manager) && CheckFileSize(journal) > emptyJournal);
+    CHECK(RequestStockSave(&manager, files[2]) && WaitStockSave(&manager) == 1);
+    CHECK(CheckFileSize(journal) == emptyJournal);
+    CHECK(SavedStock(files[2], 2) == 6);
+    
+    // A poll made while the callback runs sees the save and settles its journal mark
+    AdjustStockItem(&manager, 1, 1);
+    AcquireStockLock(gate.lock);
+    while (gate.written < 7) WaitStockLock(gate.lock);     // Callbacks may trail WaitStockSave
+    gate.polling = 1;
+    ReleaseStockLock(gate.lock);
+    
+    CHECK(RequestStockSave(&manager, files[2]));
+    AcquireStockLock(gate.lock);
+    while (gate.written < 8) WaitStockLock(gate.lock);
+    ReleaseStockLock(gate.lock);
+    CHECK(PollStockSave(&manager) == 1);
+    CHECK(CheckFileSize(journal) == emptyJournal);
+    
+    AcquireStockLock(gate.lock);
+    gate.polling = 0;
+    SignalStockLock(gate.lock);
+    ReleaseStockLock(gate.lock);
+    
+    CloseStockJournal(&manager);
+    StopStockSaver(&manager);
+    CHECK(gate.written == 8);
+    
+    SetStockFaultHook(NULL, NULL);
+    DestroyStockLock(gate.lock);
+    FreeStockManager(&manager);
+    for (int f = 0; f < 3; f++) remove(files[f]);
+    remove(journal);
+}
+
+// A failure at any step of a background save is reported and leaves the
+// previous file intact, with no temporary file behind
+static void CheckSaveFaults(void)
+{
+    static const char* file = "check_faults.dat";
+    SaveGate gate = { CreateStockLock(), 0, 0, 0, 0, 0 };
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    AddStockItem(&manager, "Tracked", "Tools", 1);
+    CHECK(gate.lock != NULL && SaveStockToFile(&manager, file));
+    
+    SetStockFaultHook(PassSaveGate, &gate);
+    CHECK(StartStockSaver(&manager, NULL, NULL));
+    AdjustStockItem(&manager, 0, 1);
+    for (int point = STOCK_FAULT_OPEN; point <= STOCK_FAULT_RENAME; point++)
+    {
+        gate.failPoint = point;     // The saver is idle and the request below orders it
+        CHECK(RequestStockSave(&manager, file));
+        CHECK(WaitStockSave(&manager) == 0);
+        CHECK(PollStockSave(&manager) == STOCK_SAVE_NONE);
+        CHECK(SavedStock(file, 1) == 1);
+        CHECK(CheckFileSize("check_faults.dat.tmp") < 0);
+    }
+    
+    // A failed save among several is not hidden by a later good one
+    gate.failPoint = STOCK_FAULT_SYNC;
+    CHECK(HoldSave(&manager, &gate, "check_faults_other.dat"));
+    CHECK(RequestStockSave(&manager, file));
+    OpenSaveGate(&gate);
+    CHECK(WaitStockSave(&manager) == 0);
+    
+    gate.failPoint = 0;
+    CHECK(RequestStockSave(&manager, file) && WaitStockSave(&manager) == 1);
+    CHECK(SavedStock(file, 1) == 2);
+    
+    StopStockSaver(&manager);
+    SetStockFaultHook(NULL, NULL);
+    DestroyStockLock(gate.lock);
+    FreeStockManager(&manager);
+    remove(file);
+    remove("check_faults_other.dat");
+}
+
+// Churn on ids far past the item count: the sparse id map drops the entries of
+// removed ids instead of growing, and handles to removed items stay stale even
+// when undo brings their ids back
+static void CheckSparseIdChurn(void)
+{
+    char name[32];
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    CHECK(EnableStockUndo(&manager, STOCK_UNDO_DEFAULT_BYTES));
+    manager.nextId = 50000000;
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(name, sizeof(name), "Kept %d", i);
+        AddStockItem(&manager, name, "Tools", i);
+    }
+    StockHandle kept = GetStockItemHandle(&manager, 0);
+    
+    CHECK(AddStockItem(&manager, "Removed", "Tools", 1));
+    int removedId = GetStockItem(&manager, manager.itemCount - 1)->id;
+    StockHandle removed = GetStockItemHandle(&manager, manager.itemCount - 1);
+    CHECK(RemoveStockItemById(&manager, removedId));
+    CHECK(ResolveStockHandle(&manager, removed) == -1);
+    
+    int largest = 0;
+    for (int i = 0; i < 100000; i++)
+    {
+        snprintf(name, sizeof(name), "Churn %d", i);
+        AddStockItem(&manager, name, "Tools", 1);
+        RemoveStockItem(&manager, manager.itemCount - 1);
+        if (manager.sparseCapacity > largest) largest = manager.sparseCapacity;
+    }
+    CHECK(manager.itemCount == 100 && manager.idCapacity == 0);
+    CHECK(largest <= 512);
+    CHECK(ResolveStockHandle(&manager, kept) == FindStockItemById(&manager, GetStockItem(&manager, 0)->id));
+    CHECK(ResolveStockHandle(&manager, kept) == 0);
+    
+    // Undo the churn back to the removal, then the removal itself: the id is back, the old handle is not
+    int steps = 0;
+    while (FindStockItemById(&manager, removedId) < 0 && UndoStockChange(&manager)) steps++;
+    CHECK(steps == 200001 && FindStockItemById(&manager, removedId) >= 0);
+    CHECK(ResolveStockHandle(&manager, removed) == -1);
+    CHECK(ResolveStockHandle(&manager, kept) == 0);
+    
+    FreeStockManager(&manager);
+}
+
+// Reference order for the sort checks: insertion sort on the same keys, which
+// is stable, comparing category text rather than codes
+static int CompareSortedItems(StockManager* manager, const StockSortKey* keys, int keyCount, int left, int right)
+{
+    const StockItem* a = GetStockItem(manager, left);
+    const StockItem* b = GetStockItem(manager, right);
+    
+    for (int k = 0; k < keyCount; k++)
+    {
+        int result = 0;
+        if (keys[k].field == STOCK_SORT_NAME) result = strcmp(a->name, b->name);
+        if (keys[k].field == STOCK_SORT_STOCK) result = (a->stock > b->stock) - (a->stock < b->stock);
+        if (keys[k].field == STOCK_SORT_ID) result = (a->id > b->id) - (a->id < b->id);
+        if (keys[k].field == STOCK_SORT_CATEGORY)
+            result = strcmp(GetStockItemCategory(manager, a), GetStockItemCategory(manager, b));
+        
+        if (result != 0) return keys[k].descending ? -result : result;
+    }
+    return 0;
+}
+
+static int SortAgrees(StockManager* manager, const StockSortKey* keys, int keyCount, int* expected)
+{
+    const int* order = SortStockItemsBy(manager, keys, keyCount);
+    if (order == NULL) return 0;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        int j = i;
+        while (j > 0 && CompareSortedItems(manager, keys, keyCount, expected[j - 1], i) > 0)
+        {
+            expected[j] = expected[j - 1];
+            j--;
+        }
+        expected[j] = i;
+    }
+    return memcmp(order, expected, (size_t)manager->itemCount * sizeof(int)) == 0;
+}
+
+// Sorted permutations match a stable reference at sizes around the insertion
+// runs, stay cached until a field they order by changes, and reject bad keys
+static void CheckSorting(void)
+{
+    static const StockSortKey orders[][3] = {
+        { { STOCK_SORT_NAME, 0 } },
+        { { STOCK_SORT_STOCK, 1 } },
+        { { STOCK_SORT_CATEGORY, 0 }, { STOCK_SORT_STOCK, 1 } },
+        { { STOCK_SORT_CATEGORY, 1 }, { STOCK_SORT_NAME, 0 }, { STOCK_SORT_ID, 1 } },
+        { { STOCK_SORT_ID, 1 } },
+        { { STOCK_SORT_STOCK, 0 }, { STOCK_SORT_CATEGORY, 0 } }
+    };
+    static const int keyCounts[] = { 1, 1, 2, 3, 1, 2 };
+    static const int sizes[] = { 1, 2, 15, 16, 17, 33, 1000 };
+    static const char* const categories[] = { "Zinc", "apple", "Bolts", "", "Zinc2" };
+    StockSortKey tooMany[STOCK_SORT_MAX_KEYS + 1];
+    char name[32];
+    StockManager manager;
+    int* expected = (int*)malloc(1000 * sizeof(int));
+    unsigned seed = 77;
+    
+    // Nothing to sort is still a valid (empty) order; bad key lists are refused
+    InitStockManager(&manager);
+    memset(tooMany, 0, sizeof(tooMany));
+    CHECK(GetStockSortOrder(&manager) == NULL);
+    CHECK(SortStockItemsBy(&manager, orders[0], 1) != NULL);
+    CHECK(SortStockItemsBy(&manager, orders[0], 0) == NULL);
+    CHECK(SortStockItemsBy(&manager, tooMany, STOCK_SORT_MAX_KEYS + 1) == NULL);
+    SortStockItems(&manager, STOCK_SORT_ID + 1);
+    CHECK(GetStockSortOrder(&manager) == NULL);
+    
+    // Few distinct values, so most comparisons tie on the first key
+    for (int s = 0; s < 7; s++)
+    {
+        while (manager.itemCount < sizes[s])
+        {
+            snprintf(name, sizeof(name), "Item %u", NextCheckRandom(&seed) % 40);
+            AddStockItem(&manager, name, categories[NextCheckRandom(&seed) % 5], (int)(NextCheckRandom(&seed) % 6));
+        }
+        for (int o = 0; o < 6; o++)
+        {
+            int agrees = SortAgrees(&manager, orders[o], keyCounts[o], expected);
+            if (!agrees) fprintf(stderr, "sort order %d differs at %d items\n", o, manager.itemCount);
+            CHECK(agrees);
+        }
+    }
+    
+    // A quantity change keeps the name order cached and rebuilds the quantity one
+    const int* byName = SortStockItemsBy(&manager, orders[0], 1);
+    CHECK(SortStockItemsBy(&manager, orders[0], 1) == byName);
+    AdjustStockItem(&manager, 0, 100);
+    CHECK(SortStockItemsBy(&manager, orders[0], 1) == byName);
+    CHECK(SortAgrees(&manager, orders[1], 1, expected));
+    CHECK(SortStockItemsBy(&manager, orders[1], 1)[0] == 0);
+    
+    // Renames, category moves, removals and adds all reach the cached orders
+    UpdateStockItem(&manager, 5, "AAA first", "zzz last", 3);
+    CHECK(SortAgrees(&manager, orders[0], 1, expected) && SortStockItemsBy(&manager, orders[0], 1)[0] == 5);
+    CHECK(SortAgrees(&manager, orders[2], 2, expected));
+    RemoveStockItem(&manager, 0);
+    AddStockItem(&manager, "Added", "apple", 2);
+    for (int o = 0; o < 6; o++) CHECK(SortAgrees(&manager, orders[o], keyCounts[o], expected));
+    
+    // SortStockItems picks the order GetStockSortOrder keeps returning
+    StockSortKey byStock = { STOCK_SORT_STOCK, 0 };
+    SortStockItems(&manager, STOCK_SORT_STOCK);
+    CHECK(SortAgrees(&manager, &byStock, 1, expected));
+    CHECK(GetStockSortOrder(&manager) == SortStockItemsBy(&manager, &byStock, 1));
+    
+    free(expected);
+    FreeStockManager(&manager);
+}
+
+// The category dictionary under churn: every code in use names one category,
+// counts its items exactly and is dropped with its last item; texts past the
+// length limit are cut on a character boundary and share a code
+static void CheckCategoryDictionary(void)
+{
+    enum { CATEGORY_NAMES = 150 };
+    char name[32];
+    char category[32];
+    int counts[CATEGORY_NAMES];
+    int indices[8];
+    StockManager manager;
+    unsigned seed = 19;
+    
+    InitStockManager(&manager);
+    CHECK(FindStockCategory(&manager, "Tools") == -1 && GetStockCategoryItemCount(&manager, 0) == 0);
+    CHECK(strcmp(GetStockCategoryName(&manager, -1), "") == 0 && strcmp(GetStockCategoryName(&manager, 99), "") == 0);
+    CHECK(GetStockItemsInCategory(&manager, -1, indices, 8) == 0);
+    
+    // The empty category and case variants are categories of their own
+    AddStockItem(&manager, "Blank", "", 1);
+    AddStockItem(&manager, "Upper", "Tools", 1);
+    AddStockItem(&manager, "Lower", "tools", 1);
+    int blank = FindStockCategory(&manager, "");
+    CHECK(blank >= 0 && blank != FindStockCategory(&manager, "Tools") && FindStockCategory(&manager, "tools") >= 0);
+    CHECK(FindStockCategory(&manager, "Tools") != FindStockCategory(&manager, "tools"));
+    CHECK(GetStockItemsInCategory(&manager, blank, indices, 8) == 1 && indices[0] == 0);
+    
+    // The last item leaving a category drops it, and a new category may take its code
+    int tools = FindStockCategory(&manager, "Tools");
+    CHECK(UpdateStockItem(&manager, 1, "Upper", "tools", 1));
+    CHECK(FindStockCategory(&manager, "Tools") == -1 && GetStockCategoryItemCount(&manager, tools) == 0);
+    CHECK(GetStockCategoryItemCount(&manager, FindStockCategory(&manager, "tools")) == 2);
+    AddStockItem(&manager, "Fresh", "Fresh", 1);
+    CHECK(FindStockCategory(&manager, "Fresh") == tools);
+    CHECK(GetStockItemsInCategory(&manager, FindStockCategory(&manager, "tools"), indices, 1) == 2 && indices[0] == 1);
+    
+    // 127 bytes are kept; a two-byte character straddling the limit goes whole
+    char longText[200];
+    memset(longText, 'x', sizeof(longText));
+    memcpy(longText + 126, "\xC3\xA9", 2);
+    longText[199] = '\0';
+    AddStockItem(&manager, "Long", longText, 1);
+    longText[150] = 'y';
+    AddStockItem(&manager, "Long 2", longText, 1);
+    const char* kept = GetStockItemCategory(&manager, GetStockItem(&manager, manager.itemCount - 1));
+    CHECK(strlen(kept) == 126 && kept[125] == 'x');
+    CHECK(GetStockItem(&manager, manager.itemCount - 1)->categoryId == GetStockItem(&manager, manager.itemCount - 2)->categoryId);
+    
+    while (manager.itemCount > 0) RemoveStockItem(&manager, 0);
+    CHECK(FindStockCategory(&manager, "") == -1 && FindStockCategory(&manager, "tools") == -1 && FindStockCategory(&manager, kept) == -1);
+    
+    // Random adds, moves and removals over more categories than the first table holds
+    memset(counts, 0, sizeof(counts));
+    for (int step = 0; step < 20000; step++)
+    {
+        int pick = (int)(NextCheckRandom(&seed) % CATEGORY_NAMES);
+        int action = (int)(NextCheckRandom(&seed) % 3);
+        snprintf(category, sizeof(category), "Category %d", pick);
+        
+        if (action == 0 || manager.itemCount == 0)
+        {
+            snprintf(name, sizeof(name), "Item %d", step);
+            if (AddStockItem(&manager, name, category, 1)) counts[pick]++;
+            continue;
+        }
+        
+        int index = (int)(NextCheckRandom(&seed) % (unsigned)manager.itemCount);
+        StockItem* item = GetStockItem(&manager, index);
+        int old = atoi(GetStockItemCategory(&manager, item) + 9);
+        
+        if (action == 1 && UpdateStockItem(&manager, index, item->name, category, item->stock))
+        {
+            counts[old]--;
+            counts[pick]++;
+        }
+        if (action == 2 && RemoveStockItem(&manager, index)) counts[old]--;
+    }
+    
+    int consistent = 1;
+    for (int c = 0; c < CATEGORY_NAMES; c++)
+    {
+        snprintf(category, sizeof(category), "Category %d", c);
+        int code = FindStockCategory(&manager, category);
+        
+        if (counts[c] == 0 ? code != -1 :
+            code < 0 || GetStockCategoryItemCount(&manager, code) != counts[c] ||
+            strcmp(GetStockCategoryName(&manager, code), category) != 0 ||
+            GetStockItemsInCategory(&manager, code, NULL, 0) != counts[c])
+        {
+            consistent = 0;
+        }
+    }
+    for (int i = 0; i < manager.itemCount; i++)
+    {
+        const StockItem* item = GetStockItem(&manager, i);
+        if (FindStockCategory(&manager, GetStockItemCategory(&manager, item)) != item->categoryId) consistent = 0;
+    }
+    CHECK(consistent);
+    
+    FreeStockManager(&manager);
+}
+
+int main(void)
+{
+    CheckRenames();
+    CheckSorting();
+    CheckCategoryDictionary();
+    CheckCsvRoundTrip();
+    CheckJsonExport();
+    CheckSearchIndex(STOCK_SEARCH_EXACT);
+    CheckSearchIndex(STOCK_SEARCH_FOLDED);
+    CheckFoldedSearch();
+    CheckScanKernels();
+    CheckQuantityFilters();
+    CheckLowStockOrder();
+    CheckQuantityIndex();
+    CheckVisitorPaging();
+    CheckImportQuoting();
+    CheckImportLayouts();
+    CheckUndoLog();
+    CheckUndoBudget();
+    CheckShardedScans();
+    CheckRowModel();
+    CheckDisplayCache();
+    CheckChangeNotifications();
+    CheckSparseIdChurn();
+    CheckJournalRestart(0);
+    CheckJournalRestart(1);
+    CheckIncrementalSave();
+    CheckOverflowingIds();
+    CheckMappedLoading();
+    CheckBackgroundSaves();
+    CheckSaveFaults();
+    
+    if (g_failures > 0)
+    {
+        fprintf(stderr, "%d of %d checks failed\n", g_failures, g_checks);
+        return 1;
+    }
+    printf("%d checks passed\n", g_checks);
+    return 0;
+}
@@ -3,7 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "stock.h"
+#include "stock_dialog.h"
 #include "resource.h"
 #include "theme.h"
 
@@ -14,15 +14,23 @@
 #define ID_BTN_DELETE   1004
 #define ID_BTN_SAVE     1005
 #define ID_BTN_LOAD     1006
+#define ID_BTN_IMPORT   1009
+#define ID_BTN_UNDO     1010
+#define ID_BTN_REDO     1011
 #define ID_MENU_FILE    1007
 #define ID_MENU_ABOUT   1008
 
+// Posted by the background saver; wParam holds the save result
+#define WM_APP_STOCK_SAVED (WM_APP + 1)
+
 // Global variables
 HWND hMainWindow;
 HWND hListView;
-HWND hBtnAdd, hBtnEdit, hBtnDelete, hBtnSave, hBtnLoad;
+HWND hBtnAdd, hBtnEdit, hBtnDelete, hBtnSave, hBtnLoad, hBtnImport, hBtnUndo, hBtnRedo;
 HINSTANCE hInst;
 StockManager stockManager;
+StockRowModel rowModel;     // Rows of the owner-data list view
+int saveRequested = 0;      // A Save button click waits for the background saver
 
 // Function prototypes
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
@@ -30,11 +38,16 @@ void CreateMainWindow(void);
 void CreateControls(HWND hwnd);
 void InitializeListView(void);
 void RefreshListView(void);
+void HandleListViewNotify(NMHDR* header);
 void ShowAddItemDialogWrapper(void);
-void ShowEditItemDialogWrapper(int index);
+void ShowEditItemDialogWrapper(int itemId);
 void DeleteSelectedItem(void);
+int GetSelectedItemId(void);
 void SaveStockData(void);
 void LoadStockData(void);
+void ImportStockData(void);
+void UndoStockStep(int redo);
+void OnStockSaved(int result, void* context);
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
@@ -61,8 +74,23 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Initialize stock manager
     InitStockManager(&stockManager);
     
-    // Auto-load stock data on startup
-    LoadStockFromFile(&stockManager, "stock_data.dat");
+    // Auto-load stock data on startup (items are decoded as rows are shown)
+    LoadStockFromFileMapped(&stockManager, "stock_data.dat");
+    
+    // Replay edits made since the last snapshot and record new ones
+    OpenStockJournal(&stockManager, "stock_data.dat", "stock_data.journal");
+    
+    // Edits, deletes and imports can be undone
+    EnableStockUndo(&stockManager, STOCK_UNDO_DEFAULT_BYTES);
+    
+    // Scan large inventories on every processor
+    SetStockQueryThreads(&stockManager, 0);
+    
+    // Write snapshots on a worker thread so large inventories do not stall the window
+    StartStockSaver(&stockManager, OnStockSaved, NULL);
+    
+    // The list view pulls its rows from the model as they are shown
+    InitStockRowModel(&rowModel, &stockManager);
     
     // Create main window
     CreateMainWindow();
@@ -71,15 +99,26 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     ShowWindow(hMainWindow, nCmdShow);
     UpdateWindow(hMainWindow);
     
+    // Ctrl+Z and Ctrl+Y work like the Undo and Redo buttons
+    ACCEL keys[2] = {
+        { FCONTROL | FVIRTKEY, 'Z', ID_BTN_UNDO },
+        { FCONTROL | FVIRTKEY, 'Y', ID_BTN_REDO }
+    };
+    HACCEL accelerators = CreateAcceleratorTable(keys, 2);
+    
     // Message loop
     MSG msg;
     while (GetMessage(&msg, NULL, 0, 0))
     {
+        if (accelerators != NULL && TranslateAccelerator(hMainWindow, accelerators, &msg)) continue;
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
     
+    if (accelerators != NULL) DestroyAcceleratorTable(accelerators);
+    
     // Cleanup
+    FreeStockRowModel(&rowModel);
     FreeStockManager(&stockManager);
     FreeTheme(&g_theme);
     
@@ -111,12 +150,12 @@ void CreateMainWindow(void)
 
 void CreateControls(HWND hwnd)
 {
-    // Create ListView with modern styling
+    // Create ListView with modern styling; rows are supplied on demand (owner data)
     hListView = CreateWindowEx(
         0,
         WC_LISTVIEW,
         L"",
-        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL,
+        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | LVS_OWNERDATA,
         20, 20, 680, 580,
         hwnd, (HMENU)ID_LISTVIEW, hInst, NULL
     );
@@ -137,6 +176,15 @@ void CreateControls(HWND hwnd)
     hBtnLoad = CreateWindow(L"BUTTON", L"📁 Load Data", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
                            720, 250, 140, 40, hwnd, (HMENU)ID_BTN_LOAD, hInst, NULL);
     
+    hBtnImport = CreateWindow(L"BUTTON", L"📥 Import CSV", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                             720, 300, 140, 40, hwnd, (HMENU)ID_BTN_IMPORT, hInst, NULL);
+    
+    hBtnUndo = CreateWindow(L"BUTTON", L"↩️ Undo", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                           720, 380, 140, 40, hwnd, (HMENU)ID_BTN_UNDO, hInst, NULL);
+    
+    hBtnRedo = CreateWindow(L"BUTTON", L"↪️ Redo", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                           720, 430, 140, 40, hwnd, (HMENU)ID_BTN_REDO, hInst, NULL);
+    
     InitializeListView();
     
     // Apply modern theme to all controls
@@ -146,6 +194,9 @@ void CreateControls(HWND hwnd)
     ApplyThemeToButton(hBtnDelete, BUTTON_TYPE_DANGER, &g_theme);
     ApplyThemeToButton(hBtnSave, BUTTON_TYPE_SUCCESS, &g_theme);
     ApplyThemeToButton(hBtnLoad, BUTTON_TYPE_SECONDARY, &g_theme);
+    ApplyThemeToButton(hBtnImport, BUTTON_TYPE_SECONDARY, &g_theme);
+    ApplyThemeToButton(hBtnUndo, BUTTON_TYPE_SECONDARY, &g_theme);
+    ApplyThemeToButton(hBtnRedo, BUTTON_TYPE_SECONDARY, &g_theme);
 }
 
 void InitializeListView(void)
@@ -173,34 +224,35 @@ void InitializeListView(void)
     ListView_InsertColumn(hListView, 2, &lvc);
 }
 
+// Bring the list up to date: only rows touched since the last refresh are redrawn
 void RefreshListView(void)
 {
-    // Clear ListView
-    ListView_DeleteAllItems(hListView);
+    int first, last;
+    int count = TakeStockRowUpdate(&rowModel, &first, &last);
     
-    // Add stock items
-    for (int i = 0; i < stockManager.itemCount; i++)
+    ListView_SetItemCountEx(hListView, count, LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+    if (first >= 0) ListView_RedrawItems(hListView, first, last);
+}
+
+// Owner-data requests: text for one visible cell, or a range about to be shown
+void HandleListViewNotify(NMHDR* header)
+{
+    if (header->code == LVN_GETDISPINFO)
     {
-        LVITEM lvi;
-        lvi.mask = LVIF_TEXT;
-        lvi.iItem = i;
-        lvi.iSubItem = 0;
-        
-        // Product name - convert to wide string
-        wchar_t wname[MAX_NAME_LENGTH];
-        MultiByteToWideChar(CP_UTF8, 0, stockManager.items[i].name, -1, wname, MAX_NAME_LENGTH);
-        lvi.pszText = wname;
-        ListView_InsertItem(hListView, &lvi);
+        NMLVDISPINFO* info = (NMLVDISPINFO*)header;
+        if (!(info->item.mask & LVIF_TEXT) || info->item.cchTextMax <= 0) return;
         
-        // Stock quantity
-        wchar_t wstock[32];
-        swprintf(wstock, 32, L"%d", stockManager.items[i].stock);
-        ListView_SetItemText(hListView, i, 1, wstock);
-        
-        // Category - convert to wide string
-        wchar_t wcategory[MAX_CATEGORY_LENGTH];
-        MultiByteToWideChar(CP_UTF8, 0, stockManager.items[i].category, -1, wcategory, MAX_CATEGORY_LENGTH);
-        ListView_SetItemText(hListView, i, 2, wcategory);
+        // Cached UTF-16 text: a copy, with no conversion after the first redraw
+        const StockWideChar* text = GetStockRowDisplayText(&rowModel, info->item.iItem, info->item.iSubItem);
+        int length = 0;
+        while (text[length] != 0 && length < info->item.cchTextMax - 1) length++;
+        memcpy(info->item.pszText, text, length * sizeof(wchar_t));
+        info->item.pszText[length] = L'\0';
+    }
+    else if (header->code == LVN_ODCACHEHINT)
+    {
+        NMLVCACHEHINT* hint = (NMLVCACHEHINT*)header;
+        HintStockRows(&rowModel, hint->iFrom, hint->iTo);
     }
 }
 
@@ -213,38 +265,57 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             // Refresh ListView with auto-loaded data
             RefreshListView();
             break;
-            
+        
         case WM_COMMAND:
             switch (LOWORD(wParam))
             {
                 case ID_BTN_ADD:
                     ShowAddItemDialogWrapper();
                     break;
-                    
+                
                 case ID_BTN_EDIT:
                     {
-                        int selected = ListView_GetNextItem(hListView, -1, LVNI_SELECTED);
-                        if (selected != -1)
-                            ShowEditItemDialogWrapper(selected);
+                        int selectedId = GetSelectedItemId();
+                        if (selectedId > 0)
+                            ShowEditItemDialogWrapper(selectedId);
                         else
                             ThemedMessageBox(hwnd, L"⚠️ Please select an item to edit.", L"Warning", MB_OK | MB_ICONWARNING);
                     }
                     break;
-                    
+                
                 case ID_BTN_DELETE:
                     DeleteSelectedItem();
                     break;
-                    
+                
                 case ID_BTN_SAVE:
                     SaveStockData();
                     break;
-                    
+                
                 case ID_BTN_LOAD:
                     LoadStockData();
                     break;
+                
+                case ID_BTN_IMPORT:
+                    ImportStockData();
+                    break;
+                
+                case ID_BTN_UNDO:
+                    UndoStockStep(0);
+                    break;
+                
+                case ID_BTN_REDO:
+                    UndoStockStep(1);
+                    break;
             }
             break;
-            
+        
+        case WM_NOTIFY:
+            if (((NMHDR*)lParam)->hwndFrom == hListView)
+            {
+                HandleListViewNotify((NMHDR*)lParam);
+            }
+            break;
+        
         case WM_SIZE:
             // Resize controls when window size changes
             if (hListView)
@@ -266,15 +337,34 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 if (hBtnDelete) SetWindowPos(hBtnDelete, NULL, buttonX, 120, 140, 40, SWP_NOZORDER);
                 if (hBtnSave) SetWindowPos(hBtnSave, NULL, buttonX, 200, 140, 40, SWP_NOZORDER);
                 if (hBtnLoad) SetWindowPos(hBtnLoad, NULL, buttonX, 250, 140, 40, SWP_NOZORDER);
+                if (hBtnImport) SetWindowPos(hBtnImport, NULL, buttonX, 300, 140, 40, SWP_NOZORDER);
+                if (hBtnUndo) SetWindowPos(hBtnUndo, NULL, buttonX, 380, 140, 40, SWP_NOZORDER);
+                if (hBtnRedo) SetWindowPos(hBtnRedo, NULL, buttonX, 430, 140, 40, SWP_NOZORDER);
+            }
+            break;
+        
+        case WM_APP_STOCK_SAVED:
+            PollStockSave(&stockManager);
+            if (saveRequested)
+            {
+                saveRequested = 0;
+                if (wParam)
+                    ThemedMessageBox(hMainWindow, L"✅ Stock data saved successfully.", L"Information", MB_OK | MB_ICONINFORMATION);
+                else
+                    ThemedMessageBox(hMainWindow, L"❌ Error occurred while saving stock data.", L"Error", MB_OK | MB_ICONERROR);
             }
             break;
-            
+        
         case WM_DESTROY:
-            // Auto-save stock data on exit
-            SaveStockToFile(&stockManager, "stock_data.dat");
+            // Edits are already journaled; without a journal, save the whole file
+            // (FreeStockManager waits for the saver to finish)
+            if (!FlushStockJournal(&stockManager) && !RequestStockSave(&stockManager, "stock_data.dat"))
+            {
+                SaveStockToFile(&stockManager, "stock_data.dat");
+            }
             PostQuitMessage(0);
             break;
-            
+        
         default:
             return DefWindowProc(hwnd, uMsg, wParam, lParam);
     }
@@ -283,26 +373,40 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 void ShowAddItemDialogWrapper(void)
 {
+    // The row model hears about the new item and marks its row
     ShowAddItemDialog(hMainWindow, &stockManager);
+    FlushStockJournal(&stockManager);
     RefreshListView();
 }
 
-void ShowEditItemDialogWrapper(int index)
+void ShowEditItemDialogWrapper(int itemId)
 {
-    ShowEditItemDialog(hMainWindow, &stockManager, index);
+    ShowEditItemDialog(hMainWindow, &stockManager, itemId);
+    FlushStockJournal(&stockManager);
     RefreshListView();
 }
 
-void DeleteSelectedItem(void)
+// Id of the item in the selected row, or 0 when nothing is selected
+int GetSelectedItemId(void)
 {
     int selected = ListView_GetNextItem(hListView, -1, LVNI_SELECTED);
-    if (selected != -1)
+    if (selected == -1) return 0;
+    
+    // Rows address items by position; the id stays valid across later edits
+    return GetStockRowItemId(&rowModel, selected);
+}
+
+void DeleteSelectedItem(void)
+{
+    int selectedId = GetSelectedItemId();
+    if (selectedId > 0)
     {
         int result = ThemedMessageBox(hMainWindow, L"❓ Are you sure you want to delete the selected item?", 
                                L"Delete Confirmation", MB_YESNO | MB_ICONQUESTION);
         if (result == IDYES)
         {
-            RemoveStockItem(&stockManager, selected);
+            RemoveStockItemById(&stockManager, selectedId);
+            FlushStockJournal(&stockManager);
             RefreshListView();
         }
     }
@@ -312,9 +416,25 @@ void DeleteSelectedItem(void)
     }
 }
 
+// Runs on the saver thread: hand the result over to the UI thread
+void OnStockSaved(int result, void* context)
+{
+    (void)context;
+    PostMessage(hMainWindow, WM_APP_STOCK_SAVED, (WPARAM)result, 0);
+}
+
 void SaveStockData(void)
 {
-    if (SaveStockToFile(&stockManager, "stock_data.dat"))
+    // The snapshot is written in the background and also empties the journal
+    if (RequestStockSave(&stockManager, "stock_data.dat"))
+    {
+        saveRequested = 1;
+        return;
+    }
+    
+    int saved = stockManager.journal != NULL ? CompactStockJournal(&stockManager)
+                                             : SaveStockToFile(&stockManager, "stock_data.dat");
+    if (saved)
     {
         ThemedMessageBox(hMainWindow, L"✅ Stock data saved successfully.", L"Information", MB_OK | MB_ICONINFORMATION);
     }
@@ -326,9 +446,15 @@ void SaveStockData(void)
 
 void LoadStockData(void)
 {
-    if (LoadStockFromFile(&stockManager, "stock_data.dat"))
+    // Reload the snapshot, then replay the journaled edits on top of it
+    CloseStockJournal(&stockManager);
+    int loaded = LoadStockFromFile(&stockManager, "stock_data.dat");
+    OpenStockJournal(&stockManager, "stock_data.dat", "stock_data.journal");
+    
+    RefreshListView();
+    
+    if (loaded)
     {
-        RefreshListView();
         ThemedMessageBox(hMainWindow, L"✅ Stock data loaded successfully.", L"Information", MB_OK | MB_ICONINFORMATION);
     }
     else
@@ -336,3 +462,53 @@ void LoadStockData(void)
         ThemedMessageBox(hMainWindow, L"❌ Error occurred while loading stock data.\nFile may not exist or be corrupted.", L"Error", MB_OK | MB_ICONERROR);
     }
 }
+
+// Add the rows of a CSV/TSV spreadsheet; bad rows are skipped and counted
+void ImportStockData(void)
+{
+    wchar_t path[MAX_PATH] = L"";
+    OPENFILENAMEW dialog;
+    ZeroMemory(&dialog, sizeof(dialog));
+    dialog.lStructSize = sizeof(dialog);
+    dialog.hwndOwner = hMainWindow;
+    dialog.lpstrFilter = L"Spreadsheets (*.csv;*.tsv;*.txt)\0*.csv;*.tsv;*.txt\0All Files (*.*)\0*.*\0";
+    dialog.lpstrFile = path;
+    dialog.nMaxFile = MAX_PATH;
+    dialog.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+    if (!GetOpenFileNameW(&dialog)) return;
+    
+    // The import takes UTF-8 names and opens them by their wide form, so any path works
+    char filename[MAX_PATH * 3];
+    if (WideCharToMultiByte(CP_UTF8, 0, path, -1, filename, sizeof(filename), NULL, NULL) == 0) return;
+    
+    // The row model hears of the import as a reload
+    StockImportResult result;
+    int imported = ImportStockFromFile(&stockManager, filename, NULL, &result);
+    FlushStockJournal(&stockManager);
+    RefreshListView();
+    
+    if (imported)
+    {
+        wchar_t message[160];
+        swprintf(message, 160, L"✅ Imported %d of %d rows.\n%d rows were skipped.\nUndo takes the whole import back.", result.imported, result.rows, result.rejected);
+        ThemedMessageBox(hMainWindow, message, L"Import", MB_OK | MB_ICONINFORMATION);
+    }
+    else
+    {
+        ThemedMessageBox(hMainWindow, L"❌ The file could not be imported.\nIt needs a name and a quantity column.", L"Error", MB_OK | MB_ICONERROR);
+    }
+}
+
+// Undo or redo one step (an import is a single step); the row model hears of the changes
+void UndoStockStep(int redo)
+{
+    int done = redo ? RedoStockChange(&stockManager) : UndoStockChange(&stockManager);
+    if (!done)
+    {
+        MessageBeep(MB_OK);
+        return;
+    }
+    
+    FlushStockJournal(&stockManager);
+    RefreshListView();
+}
@@ -1,7 +1,17 @@
 #include "stock.h"
-#include "resource.h"
-#include "theme.h"
-#include <commctrl.h>
+#include "stock_internal.h"
+#include "stock_index.h"
+#include "stock_sort.h"
+#include "stock_category.h"
+#include "stock_journal.h"
+#include "stock_search.h"
+#include "stock_columns.h"
+#include "stock_quantity.h"
+#include "stock_display.h"
+#include "stock_events.h"
+#include "stock_undo.h"
+#include "stock_view.h"
+#include "stock_pool.h"
 
 // UTF-8 validation function
 int IsValidUTF8(const char* str)
@@ -45,8 +55,15 @@ void SafeUTF8Copy(char* dest, const char* src, size_t destSize)
     
     if (IsValidUTF8(src))
     {
-        strncpy(dest, src, destSize - 1);
-        dest[destSize - 1] = '\0';
+        // Cut before a character that does not fit whole
+        size_t len = strlen(src);
+        if (len >= destSize)
+        {
+            len = destSize - 1;
+            while (len > 0 && ((unsigned char)src[len] & 0xC0) == 0x80) len--;
+        }
+        memcpy(dest, src, len);
+        dest[len] = '\0';
     }
     else
     {
@@ -58,64 +75,283 @@ void SafeUTF8Copy(char* dest, const char* src, size_t destSize)
     }
 }
 
-// Global variables
-StockManager* g_stockManager = NULL;
-int g_editIndex = -1;
-HWND g_hMainWindow = NULL;
+// Grow the segment table to `segmentCount` entries; new entries start out NULL
+// and are allocated by EnsureStockCapacity or on first access to a mapped item
+int ReserveStockSegments(StockManager* manager, int segmentCount)
+{
+    if (segmentCount <= manager->segmentCount) return 1;
+    
+    // Grow the segment table (only pointers are copied, never items)
+    if (segmentCount > manager->segmentCapacity)
+    {
+        int newCapacity = manager->segmentCapacity > 0 ? manager->segmentCapacity : 8;
+        while (newCapacity < segmentCount) newCapacity *= 2;
+        
+        StockItem** segments = (StockItem**)realloc(manager->segments, newCapacity * sizeof(StockItem*));
+        if (segments == NULL) return 0;
+        
+        manager->segments = segments;
+        manager->segmentCapacity = newCapacity;
+    }
+    
+    while (manager->segmentCount < segmentCount)
+    {
+        manager->segments[manager->segmentCount++] = NULL;
+    }
+    
+    return 1;
+}
+
+int AllocateStockSegment(StockManager* manager, int segment)
+{
+    if (manager->segments[segment] != NULL) return 1;
+    
+    manager->segments[segment] = (StockItem*)calloc(STOCK_SEGMENT_SIZE, sizeof(StockItem));
+    return manager->segments[segment] != NULL;
+}
+
+// Make room for at least `capacity` items without touching existing segments
+int EnsureStockCapacity(StockManager* manager, int capacity)
+{
+    if (capacity <= 0) return 1;
+    
+    int oldCount = manager->segmentCount;
+    int neededSegments = (capacity + STOCK_SEGMENT_SIZE - 1) >> STOCK_SEGMENT_SHIFT;
+    
+    if (!ReserveStockSegments(manager, neededSegments)) return 0;
+    
+    for (int segment = oldCount; segment < neededSegments; segment++)
+    {
+        if (!AllocateStockSegment(manager, segment)) return 0;
+    }
+    
+    // Segments below a lazily loaded range may still be unallocated
+    return AllocateStockSegment(manager, (capacity - 1) >> STOCK_SEGMENT_SHIFT);
+}
 
 void InitStockManager(StockManager* manager)
 {
     if (manager == NULL) return;
     
-    // Set console to UTF-8 for MinGW-w64
-    #ifdef __MINGW32__
-    SetConsoleOutputCP(CP_UTF8);
-    SetConsoleCP(CP_UTF8);
-    #endif
-    
+    manager->segments = NULL;
+    manager->segmentCount = 0;
+    manager->segmentCapacity = 0;
     manager->itemCount = 0;
     manager->nextId = 1;
-    memset(manager->items, 0, sizeof(manager->items));
+    manager->uniqueNames = 0;
+    InitNameIndex(&manager->nameIndex);
+    InitIdIndex(manager);
+    InitSortCache(manager);
+    InitCategoryDict(&manager->categories);
+    manager->mapping = NULL;
+    manager->mappedCount = 0;
+    manager->residentBits = NULL;
+    manager->deferredIndexes = 0;
+    manager->bulkInserts = 0;
+    manager->bulkNameIndex = 0;
+    manager->journal = NULL;
+    manager->saver = NULL;
+    manager->trigrams = NULL;
+    manager->quantities = NULL;
+    manager->display = NULL;
+    manager->events = NULL;
+    manager->undo = NULL;
+    manager->views = NULL;
+    manager->pool = NULL;
+    memset(&manager->searchKeys, 0, sizeof(StockSearchKeys));
+    memset(&manager->columns, 0, sizeof(StockColumns));
+    memset(&manager->dirty, 0, sizeof(StockDirtySet));
 }
 
 void FreeStockManager(StockManager* manager)
 {
     if (manager == NULL) return;
     
-    // In this implementation, we don't use dynamic memory
-    // We only reset the counter
+    StopStockSaver(manager);
+    CloseStockJournal(manager);
+    ReleaseStockMapping(manager);
+    ResetStockDirty(manager, NULL);
+    free(manager->dirty.bits);
+    
+    for (int i = 0; i < manager->segmentCount; i++)
+    {
+        free(manager->segments[i]);
+    }
+    free(manager->segments);
+    FreeNameIndex(&manager->nameIndex);
+    FreeIdIndex(manager);
+    FreeSortCache(manager);
+    FreeCategoryDict(&manager->categories);
+    DropSearchKeys(manager);
+    DropStockColumns(manager);
+    DropQuantityIndex(manager);
+    FreeStockDisplay(manager);
+    FreeStockViews(manager);
+    FreeStockPool(manager);
+    FreeStockEvents(manager);
+    FreeStockUndo(manager);
+    
+    manager->segments = NULL;
+    manager->segmentCount = 0;
+    manager->segmentCapacity = 0;
     manager->itemCount = 0;
 }
 
+int ReserveStockItems(StockManager* manager, int capacity)
+{
+    if (manager == NULL || capacity < 0) return 0;
+    
+    return EnsureStockCapacity(manager, capacity);
+}
+
+int BeginStockBulkInsert(StockManager* manager, int expectedItems)
+{
+    if (manager == NULL || expectedItems < 0) return 0;
+    if (!RequireIdIndex(manager)) return 0;
+    if (!EnsureStockCapacity(manager, manager->itemCount + expectedItems)) return 0;
+    
+    BeginStockBatch(manager);
+    BeginStockUndoGroup(manager);
+    
+    // Rebuilding costs O(n) once; worth it when the batch adds a good share
+    if (manager->bulkInserts++ == 0 && expectedItems >= manager->itemCount / 4)
+    {
+        DropSearchKeys(manager);
+        DropStockColumns(manager);
+        DropQuantityIndex(manager);
+        
+        // Unique names need the index for every insert
+        if (!manager->uniqueNames && !(manager->deferredIndexes & STOCK_DEFERRED_NAME_INDEX))
+        {
+            manager->deferredIndexes |= STOCK_DEFERRED_NAME_INDEX;
+            manager->bulkNameIndex = 1;
+        }
+        
+        // One reload instead of an insert change per item
+        PublishStockChange(manager, STOCK_CHANGE_RELOADED, 0, -1, STOCK_FIELD_ALL);
+    }
+    return 1;
+}
+
+void EndStockBulkInsert(StockManager* manager)
+{
+    if (manager == NULL || manager->bulkInserts == 0) return;
+    
+    if (--manager->bulkInserts == 0 && manager->bulkNameIndex)
+    {
+        manager->bulkNameIndex = 0;
+        manager->deferredIndexes &= ~STOCK_DEFERRED_NAME_INDEX;
+        
+        // Without memory now, RequireNameIndex tries again later
+        if (!RebuildNameIndex(manager)) manager->deferredIndexes |= STOCK_DEFERRED_NAME_INDEX;
+    }
+    EndStockUndoGroup(manager);
+    EndStockBatch(manager);
+}
+
+StockItem* GetStockItem(StockManager* manager, int index)
+{
+    if (manager == NULL || index < 0 || index >= manager->itemCount) return NULL;
+    
+    return ResidentStockItem(manager, index);
+}
+
 int AddStockItem(StockManager* manager, const char* name, const char* category, int stock)
+{
+    if (manager == NULL || !RequireIdIndex(manager)) return 0;
+    
+    return InsertStockItem(manager, name, category, stock, manager->nextId);
+}
+
+// Append an item under a given id (a fresh one, or one replayed from the journal)
+int InsertStockItem(StockManager* manager, const char* name, const char* category, int stock, int id)
 {
     if (manager == NULL || name == NULL || category == NULL) return 0;
-    if (manager->itemCount >= MAX_ITEMS) return 0;
     if (stock < 0) return 0;
+    if (!RequireIdIndex(manager)) return 0;
+    if (!IdIndexAcceptsId(manager, id)) return 0;
+    if (manager->uniqueNames && !RequireNameIndex(manager)) return 0;
+    if (!EnsureStockCapacity(manager, manager->itemCount + 1)) return 0;
     
-    StockItem* item = &manager->items[manager->itemCount];
+    StockItem* item = StockItemAt(manager, manager->itemCount);
     
     SafeUTF8Copy(item->name, name, MAX_NAME_LENGTH);
-    SafeUTF8Copy(item->category, category, MAX_CATEGORY_LENGTH);
     
+    if (manager->uniqueNames && NameIndexFind(manager, item->name) >= 0) return 0;
+    
+    char categoryText[MAX_CATEGORY_LENGTH];
+    SafeUTF8Copy(categoryText, category, MAX_CATEGORY_LENGTH);
+    
+    int categoryId = InternCategory(&manager->categories, categoryText);
+    if (categoryId < 0) return 0;
+    
+    if (!IdIndexSet(manager, id, manager->itemCount))
+    {
+        ReleaseCategory(&manager->categories, categoryId);
+        return 0;
+    }
+    if (!NameIndexInsert(manager, manager->itemCount))
+    {
+        IdIndexClear(manager, id);
+        ReleaseCategory(&manager->categories, categoryId);
+        return 0;
+    }
+    
+    item->categoryId = categoryId;
     item->stock = stock;
-    item->id = manager->nextId++;
+    item->id = id;
+    item->reorderLevel = 0;
+    if (id >= manager->nextId) manager->nextId = id + 1;
+    SearchKeysInsert(manager, manager->itemCount);
+    SyncStockColumns(manager, manager->itemCount);
+    QuantityIndexInsert(manager, item);
+    ForgetStockDisplay(manager, id);
     
     manager->itemCount++;
+    InvalidateSortCache(manager, STOCK_FIELD_MEMBERSHIP);
+    MarkStockDirty(manager, manager->itemCount - 1);
+    if (manager->journal != NULL) JournalPutItem(manager, item);
+    if (manager->undo != NULL) RecordUndoInsert(manager, id);
+    PublishStockChange(manager, STOCK_CHANGE_INSERTED, id, manager->itemCount - 1, STOCK_FIELD_ALL);
     return 1;
 }
 
 int RemoveStockItem(StockManager* manager, int index)
 {
     if (manager == NULL || index < 0 || index >= manager->itemCount) return 0;
+    if (!RequireIdIndex(manager)) return 0;
+    
+    StockItem* item = ResidentStockItem(manager, index);
+    StockItem* moved = ResidentStockItem(manager, manager->itemCount - 1);
+    if (item == NULL || moved == NULL) return 0;
+    
+    int removedId = item->id;
+    if (manager->undo != NULL) RecordUndoRemove(manager, item);
     
-    // Remove item (shift)
-    for (int i = index; i < manager->itemCount - 1; i++)
+    NameIndexRemove(manager, index);
+    SearchKeysRemove(manager, index);
+    QuantityIndexRemove(manager, item);
+    ForgetStockDisplay(manager, removedId);
+    IdIndexClear(manager, item->id);
+    ReleaseCategory(&manager->categories, item->categoryId);
+    
+    // Swap-remove: the last item takes over the freed slot
+    int last = manager->itemCount - 1;
+    if (index != last)
     {
-        manager->items[i] = manager->items[i + 1];
+        NameIndexMove(manager, last, index);
+        IdIndexSet(manager, moved->id, index);
+        *item = *moved;
+        SyncStockColumns(manager, index);
+        MarkStockDirty(manager, index);
     }
     
     manager->itemCount--;
+    if (manager->mappedCount > manager->itemCount) manager->mappedCount = manager->itemCount;
+    InvalidateSortCache(manager, STOCK_FIELD_MEMBERSHIP);
+    if (manager->journal != NULL) JournalRemoveItem(manager, removedId);
+    PublishStockChange(manager, STOCK_CHANGE_REMOVED, removedId, -1, STOCK_FIELD_ALL);
+    if (index != last) PublishStockChange(manager, STOCK_CHANGE_UPDATED, item->id, index, STOCK_FIELD_POSITION);
     return 1;
 }
 
@@ -125,332 +361,495 @@ int UpdateStockItem(StockManager* manager, int index, const char* name, const ch
     if (name == NULL || category == NULL) return 0;
     if (stock < 0) return 0;
     
-    StockItem* item = &manager->items[index];
+    StockItem* item = ResidentStockItem(manager, index);
+    if (item == NULL) return 0;
     
-    SafeUTF8Copy(item->name, name, MAX_NAME_LENGTH);
-    SafeUTF8Copy(item->category, category, MAX_CATEGORY_LENGTH);
+    char newName[MAX_NAME_LENGTH];
+    char newCategory[MAX_CATEGORY_LENGTH];
+    unsigned changed = 0;
     
-    item->stock = stock;
+    SafeUTF8Copy(newName, name, MAX_NAME_LENGTH);
+    SafeUTF8Copy(newCategory, category, MAX_CATEGORY_LENGTH);
+    
+    int nameChanged = strcmp(item->name, newName) != 0;
+    if (nameChanged && manager->uniqueNames &&
+        (!RequireNameIndex(manager) || NameIndexFind(manager, newName) >= 0)) return 0;
+    
+    // Everything that can fail happens first, so a failure leaves the item untouched
+    if (nameChanged && !NameIndexReserve(manager)) return 0;
+    
+    int categoryId = InternCategory(&manager->categories, newCategory);
+    if (categoryId < 0) return 0;
+    
+    if (manager->undo != NULL && (nameChanged || categoryId != item->categoryId || item->stock != stock))
+        RecordUndoUpdate(manager, item);
+    
+    if (nameChanged)
+    {
+        NameIndexRemove(manager, index);
+        memcpy(item->name, newName, MAX_NAME_LENGTH);
+        SearchKeysUpdate(manager, index);
+        NameIndexInsert(manager, index);    // Room was reserved above
+        changed |= STOCK_FIELD_NAME;
+    }
     
+    // Drop the reference held by whichever code the item no longer uses
+    if (categoryId != item->categoryId)
+    {
+        ReleaseCategory(&manager->categories, item->categoryId);
+        item->categoryId = categoryId;
+        changed |= STOCK_FIELD_CATEGORY;
+    }
+    else
+    {
+        ReleaseCategory(&manager->categories, categoryId);
+    }
+    
+    if (item->stock != stock)
+    {
+        QuantityIndexRemove(manager, item);
+        item->stock = stock;
+        QuantityIndexInsert(manager, item);
+        changed |= STOCK_FIELD_STOCK;
+    }
+    
+    InvalidateSortCache(manager, changed);
+    if (changed & (STOCK_FIELD_NAME | STOCK_FIELD_CATEGORY | STOCK_FIELD_STOCK)) ForgetStockDisplay(manager, item->id);
+    if (changed != 0) SyncStockColumns(manager, index);
+    if (changed != 0) MarkStockDirty(manager, index);
+    if (changed != 0 && manager->journal != NULL) JournalPutItem(manager, item);
+    if (changed != 0) PublishStockChange(manager, STOCK_CHANGE_UPDATED, item->id, index, changed);
     return 1;
 }
 
-int FindStockItem(StockManager* manager, const char* name)
+int AdjustStockItem(StockManager* manager, int index, int delta)
 {
-    if (manager == NULL || name == NULL) return -1;
+    if (manager == NULL || index < 0 || index >= manager->itemCount) return 0;
     
-    for (int i = 0; i < manager->itemCount; i++)
-    {
-        if (strcmp(manager->items[i].name, name) == 0)
-            return i;
-    }
+    StockItem* item = ResidentStockItem(manager, index);
+    if (item == NULL) return 0;
+    
+    // Reject results below zero or past INT_MAX
+    long long stock = (long long)item->stock + delta;
+    if (stock < 0 || stock > 0x7FFFFFFF) return 0;
+    if (delta == 0) return 1;
+    
+    if (manager->undo != NULL) RecordUndoStock(manager, item->id, item->stock);
+    QuantityIndexRemove(manager, item);
+    item->stock = (int)stock;
+    QuantityIndexInsert(manager, item);
+    ForgetStockDisplay(manager, item->id);
+    SyncStockColumns(manager, index);
+    InvalidateSortCache(manager, STOCK_FIELD_STOCK);
+    MarkStockDirty(manager, index);
+    if (manager->journal != NULL) JournalSetStock(manager, item->id, item->stock);
+    PublishStockChange(manager, STOCK_CHANGE_UPDATED, item->id, index, STOCK_FIELD_STOCK);
+    return 1;
+}
+
+int SetStockReorderLevel(StockManager* manager, int index, int level)
+{
+    if (manager == NULL || index < 0 || index >= manager->itemCount || level < 0) return 0;
+    
+    StockItem* item = ResidentStockItem(manager, index);
+    if (item == NULL) return 0;
+    if (item->reorderLevel == level) return 1;
+    
+    if (manager->undo != NULL) RecordUndoReorder(manager, item->id, item->reorderLevel);
+    QuantityIndexRemove(manager, item);
+    item->reorderLevel = level;
+    QuantityIndexInsert(manager, item);
+    InvalidateSortCache(manager, STOCK_FIELD_REORDER);
+    MarkStockDirty(manager, index);
+    if (manager->journal != NULL) JournalSetReorderLevel(manager, item->id, level);
+    PublishStockChange(manager, STOCK_CHANGE_UPDATED, item->id, index, STOCK_FIELD_REORDER);
+    return 1;
+}
+
+int FindStockItemById(StockManager* manager, int id)
+{
+    if (manager == NULL || !RequireIdIndex(manager)) return -1;
     
-    return -1;
+    return IdIndexFind(manager, id);
+}
+
+StockItem* GetStockItemById(StockManager* manager, int id)
+{
+    return GetStockItem(manager, FindStockItemById(manager, id));
+}
+
+int UpdateStockItemById(StockManager* manager, int id, const char* name, const char* category, int stock)
+{
+    return UpdateStockItem(manager, FindStockItemById(manager, id), name, category, stock);
+}
+
+int RemoveStockItemById(StockManager* manager, int id)
+{
+    return RemoveStockItem(manager, FindStockItemById(manager, id));
 }
 
-void SortStockItems(StockManager* manager, int sortBy)
+StockHandle GetStockItemHandle(StockManager* manager, int index)
 {
-    if (manager == NULL || manager->itemCount <= 1) return;
+    StockItem* item = GetStockItem(manager, index);
+    if (item == NULL || !RequireIdIndex(manager)) return STOCK_INVALID_HANDLE;
     
-    // Simple bubble sort
-    for (int i = 0; i < manager->itemCount - 1; i++)
-    {
-        for (int j = 0; j < manager->itemCount - i - 1; j++)
-        {
-            int shouldSwap = 0;
-            
-            switch (sortBy)
-            {
-                case 0: // Name
-                    shouldSwap = strcmp(manager->items[j].name, manager->items[j + 1].name) > 0;
-                    break;
-                case 1: // Stock
-                    shouldSwap = manager->items[j].stock > manager->items[j + 1].stock;
-                    break;
-                case 2: // Category
-                    shouldSwap = strcmp(manager->items[j].category, manager->items[j + 1].category) > 0;
-                    break;
-            }
-            
-            if (shouldSwap)
-            {
-                StockItem temp = manager->items[j];
-                manager->items[j] = manager->items[j + 1];
-                manager->items[j + 1] = temp;
-            }
-        }
-    }
+    unsigned generation = IdIndexGeneration(manager, item->id);
+    return ((StockHandle)generation << 32) | (unsigned)item->id;
 }
 
-int SaveStockToFile(StockManager* manager, const char* filename)
+int ResolveStockHandle(StockManager* manager, StockHandle handle)
 {
-    if (manager == NULL || filename == NULL) return 0;
+    if (manager == NULL || handle == STOCK_INVALID_HANDLE || !RequireIdIndex(manager)) return -1;
     
-    FILE* file = fopen(filename, "wb");
-    if (file == NULL) return 0;
+    int id = (int)(handle & 0x7FFFFFFFu);
+    int index = IdIndexFind(manager, id);
     
-    // Write binary header
-    fwrite(&manager->itemCount, sizeof(int), 1, file);
-    fwrite(&manager->nextId, sizeof(int), 1, file);
+    if (index < 0 || IdIndexGeneration(manager, id) != (unsigned)(handle >> 32)) return -1;
+    return index;
+}
+
+int FindStockItem(StockManager* manager, const char* name)
+{
+    if (manager == NULL || name == NULL || !RequireNameIndex(manager)) return -1;
     
-    // Write all items in binary format
-    for (int i = 0; i < manager->itemCount; i++)
-    {
-        StockItem* item = &manager->items[i];
-        fwrite(&item->id, sizeof(int), 1, file);
-        fwrite(item->name, sizeof(char), MAX_NAME_LENGTH, file);
-        fwrite(item->category, sizeof(char), MAX_CATEGORY_LENGTH, file);
-        fwrite(&item->stock, sizeof(int), 1, file);
-    }
+    return NameIndexFind(manager, name);
+}
+
+const char* GetStockCategoryName(const StockManager* manager, int categoryId)
+{
+    if (manager == NULL || categoryId < 0 || categoryId >= manager->categories.codeCount) return "";
     
-    fclose(file);
-    return 1;
+    const char* text = manager->categories.entries[categoryId].text;
+    return text != NULL ? text : "";
 }
 
-int LoadStockFromFile(StockManager* manager, const char* filename)
+const char* GetStockItemCategory(const StockManager* manager, const StockItem* item)
 {
-    if (manager == NULL || filename == NULL) return 0;
+    if (item == NULL) return "";
     
-    FILE* file = fopen(filename, "rb");
-    if (file == NULL) return 0;
+    return GetStockCategoryName(manager, item->categoryId);
+}
+
+int FindStockCategory(const StockManager* manager, const char* category)
+{
+    if (manager == NULL) return -1;
     
-    int itemCount, nextId;
+    return LookupCategory(&manager->categories, category);
+}
+
+int GetStockCategoryItemCount(const StockManager* manager, int categoryId)
+{
+    if (manager == NULL || categoryId < 0 || categoryId >= manager->categories.codeCount) return 0;
+    if (manager->categories.entries[categoryId].text == NULL) return 0;
     
-    // Read binary header
-    if (fread(&itemCount, sizeof(int), 1, file) != 1 || 
-        fread(&nextId, sizeof(int), 1, file) != 1)
-    {
-        fclose(file);
-        return 0;
-    }
+    return manager->categories.entries[categoryId].refCount;
+}
+
+int SetStockUniqueNames(StockManager* manager, int enabled)
+{
+    if (manager == NULL) return 0;
+    if (enabled && !RequireNameIndex(manager)) return 0;
     
-    if (itemCount < 0 || itemCount > MAX_ITEMS)
+    if (enabled)
     {
-        fclose(file);
-        return 0;
+        // Refuse to enable while duplicates are present
+        for (int i = 0; i < manager->itemCount; i++)
+        {
+            if (NameIndexFind(manager, StockItemAt(manager, i)->name) != i) return 0;
+        }
     }
     
+    manager->uniqueNames = enabled ? 1 : 0;
+    return 1;
+}
+
+// Start replacing the inventory with items read from a file. Callers load
+// inside a change batch, so subscribers hear of the reload once it is complete.
+void BeginStockLoad(StockManager* manager, int nextId)
+{
+    ReleaseStockMapping(manager);
+    ResetStockDirty(manager, NULL);
+    DropSearchKeys(manager);
+    DropStockColumns(manager);
+    DropQuantityIndex(manager);
+    ClearStockDisplay(manager);
+    ClearStockUndo(manager);
+    PublishStockChange(manager, STOCK_CHANGE_RELOADED, 0, -1, STOCK_FIELD_ALL);
+    manager->deferredIndexes = 0;
+    manager->bulkNameIndex = 0;
     manager->itemCount = 0;
-    manager->nextId = nextId;
+    manager->nextId = nextId > 0 ? nextId : 1;
+    ResetCategoryDict(&manager->categories);
+}
+
+// Rebuild every index once all loaded items are in place
+void FinishStockLoad(StockManager* manager)
+{
+    RebuildIdIndex(manager);
     
-    // Read all items in binary format
-    for (int i = 0; i < itemCount; i++)
+    // Index the loaded items in one pass
+    RebuildNameIndex(manager);
+    InvalidateSortCache(manager, STOCK_FIELD_ALL);
+}
+
+void MarkStockDirty(StockManager* manager, int index)
+{
+    StockDirtySet* dirty = &manager->dirty;
+    if (dirty->file == NULL) return;
+    
+    if (index >= dirty->capacity)
     {
-        StockItem* item = &manager->items[i];
+        int capacity = dirty->capacity > 0 ? dirty->capacity : 1024;
+        while (capacity <= index) capacity *= 2;
         
-        if (fread(&item->id, sizeof(int), 1, file) != 1 ||
-            fread(item->name, sizeof(char), MAX_NAME_LENGTH, file) != MAX_NAME_LENGTH ||
-            fread(item->category, sizeof(char), MAX_CATEGORY_LENGTH, file) != MAX_CATEGORY_LENGTH ||
-            fread(&item->stock, sizeof(int), 1, file) != 1)
+        unsigned char* bits = (unsigned char*)realloc(dirty->bits, capacity / 8);
+        if (bits == NULL)
         {
-            break;
+            // Without the bits the next save has to rewrite everything
+            ResetStockDirty(manager, NULL);
+            return;
         }
-        
-        // Ensure null termination for strings
-        item->name[MAX_NAME_LENGTH - 1] = '\0';
-        item->category[MAX_CATEGORY_LENGTH - 1] = '\0';
-        
-        manager->itemCount++;
+        memset(bits + dirty->capacity / 8, 0, (capacity - dirty->capacity) / 8);
+        dirty->bits = bits;
+        dirty->capacity = capacity;
     }
     
-    fclose(file);
-    return 1;
+    unsigned char mask = (unsigned char)(1u << (index & 7));
+    if (!(dirty->bits[index >> 3] & mask))
+    {
+        dirty->bits[index >> 3] |= mask;
+        dirty->count++;
+    }
 }
 
-void SearchStockItems(StockManager* manager, const char* searchTerm, StockItem* results, int* resultCount)
+// Clear every mark; `file` (or NULL) is what the marks are relative to from now on
+void ResetStockDirty(StockManager* manager, const char* file)
 {
-    if (manager == NULL || searchTerm == NULL || results == NULL || resultCount == NULL) return;
+    StockDirtySet* dirty = &manager->dirty;
     
-    *resultCount = 0;
+    if (dirty->bits != NULL) memset(dirty->bits, 0, dirty->capacity / 8);
+    dirty->count = 0;
+    dirty->persistedCount = manager->itemCount;
+    dirty->persistedNextId = manager->nextId;
     
-    for (int i = 0; i < manager->itemCount; i++)
+    if (file != NULL && dirty->file != NULL && strcmp(file, dirty->file) == 0) return;
+    
+    free(dirty->file);
+    dirty->file = NULL;
+    if (file != NULL)
     {
-        if (strstr(manager->items[i].name, searchTerm) != NULL ||
-            strstr(manager->items[i].category, searchTerm) != NULL)
-        {
-            results[*resultCount] = manager->items[i];
-            (*resultCount)++;
-        }
+        dirty->file = (char*)malloc(strlen(file) + 1);
+        if (dirty->file != NULL) strcpy(dirty->file, file);
     }
 }
 
-int GetLowStockItems(StockManager* manager, int threshold, StockItem* results, int* resultCount)
+// Id of an item without decoding it when it still lives in the mapping
+static int StockItemIdAt(const StockManager* manager, int index)
 {
-    if (manager == NULL || results == NULL || resultCount == NULL) return 0;
+    if (!IsStockItemResident(manager, index)) return MappedStockItemId(manager, index);
     
-    *resultCount = 0;
+    return StockItemAt(manager, index)->id;
+}
+
+// Rebuild the id map; only ids that are invalid or duplicated get fresh ones
+int RebuildIdIndex(StockManager* manager)
+{
+    int* renumber = NULL;
+    int renumberCount = 0;
+    int renumberCapacity = 0;
     
+    ResetIdIndex(manager);
     for (int i = 0; i < manager->itemCount; i++)
     {
-        if (manager->items[i].stock <= threshold)
+        int id = StockItemIdAt(manager, i);
+        
+        if (IdIndexAcceptsId(manager, id) && IdIndexSet(manager, id, i))
+        {
+            if (id >= manager->nextId) manager->nextId = id + 1;
+            continue;
+        }
+        
+        if (renumberCount == renumberCapacity)
         {
-            results[*resultCount] = manager->items[i];
-            (*resultCount)++;
+            renumberCapacity = renumberCapacity > 0 ? renumberCapacity * 2 : 16;
+            int* grown = (int*)realloc(renumber, renumberCapacity * sizeof(int));
+            if (grown == NULL)
+            {
+                free(renumber);
+                return 0;
+            }
+            renumber = grown;
         }
+        renumber[renumberCount++] = i;
     }
     
+    // Fresh ids are handed out only after every valid id has raised nextId
+    for (int i = 0; i < renumberCount; i++)
+    {
+        StockItem* item = ResidentStockItem(manager, renumber[i]);
+        if (item == NULL || manager->nextId == 0x7FFFFFFF)
+        {
+            free(renumber);
+            return 0;
+        }
+        
+        item->id = manager->nextId++;
+        IdIndexSet(manager, item->id, renumber[i]);
+        MarkStockDirty(manager, renumber[i]);
+    }
+    
+    free(renumber);
+    if (renumberCount > 0)
+    {
+        DropSearchKeys(manager);
+        DropStockColumns(manager);
+        DropQuantityIndex(manager);
+        ClearStockDisplay(manager);
+        ClearStockUndo(manager);
+        PublishStockChange(manager, STOCK_CHANGE_RELOADED, 0, -1, STOCK_FIELD_ALL);
+    }
+    manager->deferredIndexes &= ~STOCK_DEFERRED_ID_INDEX;
     return 1;
 }
 
-// Dialog functions
-void ShowAddItemDialog(HWND parent, StockManager* manager)
+int RequireIdIndex(StockManager* manager)
 {
-    g_stockManager = manager;
-    g_editIndex = -1;
-    g_hMainWindow = parent;
+    if (!(manager->deferredIndexes & STOCK_DEFERRED_ID_INDEX)) return 1;
     
-    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_ADD_ITEM), parent, AddEditItemDialogProc);
+    return RebuildIdIndex(manager);
 }
 
-void ShowEditItemDialog(HWND parent, StockManager* manager, int itemIndex)
+int RequireNameIndex(StockManager* manager)
 {
-    if (itemIndex < 0 || itemIndex >= manager->itemCount) return;
+    if (!(manager->deferredIndexes & STOCK_DEFERRED_NAME_INDEX)) return 1;
+    
+    // Every name has to be decoded to build the index
+    return EnsureStockResident(manager);
+}
+
+int EnsureStockResident(StockManager* manager)
+{
+    if (manager == NULL) return 0;
+    if (manager->mapping == NULL && manager->deferredIndexes == 0) return 1;
+    
+    for (int i = 0; i < manager->mappedCount; i++)
+    {
+        if (ResidentStockItem(manager, i) == NULL) return 0;
+    }
+    
+    if (!RequireIdIndex(manager)) return 0;
     
-    g_stockManager = manager;
-    g_editIndex = itemIndex;
-    g_hMainWindow = parent;
+    if (manager->deferredIndexes & STOCK_DEFERRED_NAME_INDEX)
+    {
+        manager->deferredIndexes &= ~STOCK_DEFERRED_NAME_INDEX;
+        if (!RebuildNameIndex(manager))
+        {
+            manager->deferredIndexes |= STOCK_DEFERRED_NAME_INDEX;
+            return 0;
+        }
+    }
     
-    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_ADD_ITEM), parent, AddEditItemDialogProc);
+    ReleaseStockMapping(manager);
+    return 1;
 }
 
-INT_PTR CALLBACK AddEditItemDialogProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
+// Consistent, compact copy of the inventory for a background save. Only the
+// used bytes of each name are copied so the calling thread pays as little as possible.
+StockSnapshot* CaptureStockSnapshot(StockManager* manager)
 {
-    (void)lParam; // Suppress unused parameter warning
+    if (manager == NULL || !EnsureStockResident(manager)) return NULL;
+    
+    StockSnapshot* snapshot = (StockSnapshot*)calloc(1, sizeof(StockSnapshot));
+    if (snapshot == NULL) return NULL;
+    
+    int count = manager->itemCount;
+    size_t namesCapacity = (size_t)count * 16 + 64;
+    
+    snapshot->itemCount = count;
+    snapshot->nextId = manager->nextId;
+    snapshot->fields = (int*)malloc(((size_t)count * 4 + 1) * sizeof(int));
+    snapshot->nameOffsets = (size_t*)malloc(((size_t)count + 1) * sizeof(size_t));
+    snapshot->names = (char*)malloc(namesCapacity);
     
-    switch (message)
+    if (snapshot->fields == NULL || snapshot->nameOffsets == NULL || snapshot->names == NULL ||
+        !CopyCategoryDict(&snapshot->categories, &manager->categories))
     {
-        case WM_INITDIALOG:
+        FreeStockSnapshot(snapshot);
+        return NULL;
+    }
+    
+    size_t namesLength = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const StockItem* item = StockItemAt(manager, i);
+        size_t length = strlen(item->name) + 1;
+        
+        if (namesLength + length > namesCapacity)
         {
-            // Set dialog title
-            SetWindowText(hDlg, g_editIndex >= 0 ? L"✏️ Edit Product" : L"➕ Add New Product");
-            
-            // Apply modern theme to dialog
-            ApplyThemeToDialog(hDlg, &g_theme);
-            
-            // Update static text labels with emojis
-            HWND hNameLabel = GetDlgItem(hDlg, IDC_STATIC_NAME);
-            HWND hCategoryLabel = GetDlgItem(hDlg, IDC_STATIC_CATEGORY);
-            HWND hStockLabel = GetDlgItem(hDlg, IDC_STATIC_STOCK);
-            
-            if (hNameLabel) SetWindowText(hNameLabel, L"📦 Product Name:");
-            if (hCategoryLabel) SetWindowText(hCategoryLabel, L"🏷️ Category:");
-            if (hStockLabel) SetWindowText(hStockLabel, L"📊 Quantity:");
-            
-            // Apply theme to dialog buttons
-            HWND hOkBtn = GetDlgItem(hDlg, IDOK);
-            HWND hCancelBtn = GetDlgItem(hDlg, IDCANCEL);
-            
-            if (hOkBtn) {
-                SetWindowText(hOkBtn, g_editIndex >= 0 ? L"💾 Update" : L"➕ Add");
-                ApplyThemeToButton(hOkBtn, BUTTON_TYPE_PRIMARY, &g_theme);
-            }
-            if (hCancelBtn) {
-                SetWindowText(hCancelBtn, L"❌ Cancel");
-                ApplyThemeToButton(hCancelBtn, BUTTON_TYPE_SECONDARY, &g_theme);
-            }
-            
-            // If in edit mode, fill existing values
-            if (g_editIndex >= 0 && g_stockManager != NULL)
+            namesCapacity *= 2;
+            char* grown = (char*)realloc(snapshot->names, namesCapacity);
+            if (grown == NULL)
             {
-                StockItem* item = &g_stockManager->items[g_editIndex];
-                
-                wchar_t wstock[32];
-                swprintf(wstock, 32, L"%d", item->stock);
-                
-                // Convert UTF-8 to wide strings
-                wchar_t wname[MAX_NAME_LENGTH];
-                wchar_t wcategory[MAX_CATEGORY_LENGTH];
-                
-                MultiByteToWideChar(CP_UTF8, 0, item->name, -1, wname, MAX_NAME_LENGTH);
-                MultiByteToWideChar(CP_UTF8, 0, item->category, -1, wcategory, MAX_CATEGORY_LENGTH);
-                
-                SetDlgItemText(hDlg, IDC_EDIT_NAME, wname);
-                SetDlgItemText(hDlg, IDC_EDIT_CATEGORY, wcategory);
-                SetDlgItemText(hDlg, IDC_EDIT_STOCK, wstock);
+                FreeStockSnapshot(snapshot);
+                return NULL;
             }
-            
-            return TRUE;
+            snapshot->names = grown;
         }
         
-        case WM_COMMAND:
-            switch (LOWORD(wParam))
-            {
-                case IDOK:
-                {
-                    if (g_stockManager == NULL)
-                    {
-                        EndDialog(hDlg, IDCANCEL);
-                        return TRUE;
-                    }
-                    
-                    // Get form data
-                    wchar_t wname[MAX_NAME_LENGTH];
-                    wchar_t wcategory[MAX_CATEGORY_LENGTH];
-                    wchar_t wstockStr[32];
-                    
-                    GetDlgItemText(hDlg, IDC_EDIT_NAME, wname, MAX_NAME_LENGTH);
-                    GetDlgItemText(hDlg, IDC_EDIT_CATEGORY, wcategory, MAX_CATEGORY_LENGTH);
-                    GetDlgItemText(hDlg, IDC_EDIT_STOCK, wstockStr, 32);
-                    
-                    // Convert wide strings to UTF-8
-                    char name[MAX_NAME_LENGTH];
-                    char category[MAX_CATEGORY_LENGTH];
-                    char stockStr[32];
-                    
-                    WideCharToMultiByte(CP_UTF8, 0, wname, -1, name, MAX_NAME_LENGTH, NULL, NULL);
-                    WideCharToMultiByte(CP_UTF8, 0, wcategory, -1, category, MAX_CATEGORY_LENGTH, NULL, NULL);
-                    WideCharToMultiByte(CP_UTF8, 0, wstockStr, -1, stockStr, 32, NULL, NULL);
-                    
-                    int stock = atoi(stockStr);
-                    
-                    // Validation
-                    if (strlen(name) == 0)
-                    {
-                        ThemedMessageBox(hDlg, L"❌ Product name cannot be empty!", L"Error", MB_OK | MB_ICONERROR);
-                        return TRUE;
-                    }
-                    
-                    if (stock < 0)
-                    {
-                        ThemedMessageBox(hDlg, L"❌ Quantity cannot be negative!", L"Error", MB_OK | MB_ICONERROR);
-                        return TRUE;
-                    }
-                    
-                    // Add or update product
-                    if (g_editIndex >= 0)
-                    {
-                        // Update
-                        if (UpdateStockItem(g_stockManager, g_editIndex, name, category, stock))
-                        {
-                            EndDialog(hDlg, IDOK);
-                        }
-                        else
-                        {
-                            ThemedMessageBox(hDlg, L"❌ Error updating product!", L"Error", MB_OK | MB_ICONERROR);
-                        }
-                    }
-                    else
-                    {
-                        // Add
-                        if (AddStockItem(g_stockManager, name, category, stock))
-                        {
-                            EndDialog(hDlg, IDOK);
-                        }
-                        else
-                        {
-                            ThemedMessageBox(hDlg, L"❌ Error adding product!", L"Error", MB_OK | MB_ICONERROR);
-                        }
-                    }
-                    
-                    return TRUE;
-                }
-                
-                case IDCANCEL:
-                    EndDialog(hDlg, IDCANCEL);
-                    return TRUE;
-            }
-            break;
+        memcpy(snapshot->names + namesLength, item->name, length);
+        snapshot->nameOffsets[i] = namesLength;
+        namesLength += length;
+        
+        snapshot->fields[4 * i] = item->id;
+        snapshot->fields[4 * i + 1] = item->stock;
+        snapshot->fields[4 * i + 2] = item->categoryId;
+        snapshot->fields[4 * i + 3] = item->reorderLevel;
     }
     
-    return FALSE;
+    return snapshot;
+}
+
+// Expand a snapshot into a manager that can be saved (it has no lookup indexes)
+StockManager* RestoreStockSnapshot(StockSnapshot* snapshot)
+{
+    StockManager* manager = (StockManager*)malloc(sizeof(StockManager));
+    if (manager == NULL) return NULL;
+    
+    InitStockManager(manager);
+    if (!EnsureStockCapacity(manager, snapshot->itemCount))
+    {
+        FreeStockManager(manager);
+        free(manager);
+        return NULL;
+    }
+    
+    // The manager takes over the category dictionary
+    manager->categories = snapshot->categories;
+    InitCategoryDict(&snapshot->categories);
+    manager->nextId = snapshot->nextId;
+    
+    for (int i = 0; i < snapshot->itemCount; i++)
+    {
+        StockItem* item = StockItemAt(manager, i);
+        
+        strcpy(item->name, snapshot->names + snapshot->nameOffsets[i]);
+        item->id = snapshot->fields[4 * i];
+        item->stock = snapshot->fields[4 * i + 1];
+        item->categoryId = snapshot->fields[4 * i + 2];
+        item->reorderLevel = snapshot->fields[4 * i + 3];
+    }
+    manager->itemCount = snapshot->itemCount;
+    
+    return manager;
+}
+
+void FreeStockSnapshot(StockSnapshot* snapshot)
+{
+    if (snapshot == NULL) return;
+    
+    free(snapshot->fields);
+    free(snapshot->nameOffsets);
+    free(snapshot->names);
+    FreeCategoryDict(&snapshot->categories);
+    free(snapshot);
 }
@@ -4,54 +4,590 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
-
-// MinGW-w64 UTF-8 support
-#ifdef __MINGW32__
-#define _WIN32_WINNT 0x0600
-#endif
 
 // Maximum values
 #define MAX_NAME_LENGTH 256
 #define MAX_CATEGORY_LENGTH 128
-#define MAX_ITEMS 1000
+
+// Item storage is split into fixed-size segments so that growing the
+// inventory never moves existing items (StockItem pointers stay valid)
+#define STOCK_SEGMENT_SHIFT 10
+#define STOCK_SEGMENT_SIZE (1 << STOCK_SEGMENT_SHIFT)
+#define STOCK_SEGMENT_MASK (STOCK_SEGMENT_SIZE - 1)
 
 // Stock item structure
 typedef struct {
     char name[MAX_NAME_LENGTH];
-    char category[MAX_CATEGORY_LENGTH];
+    int categoryId;         // Code in the manager's category dictionary
     int stock;
     int id;
+    int reorderLevel;       // Restock once stock is at or below this (0: when it runs out)
 } StockItem;
 
+// Interned category string
+typedef struct {
+    char* text;             // NULL while the code is unused
+    char* folded;           // Search key of text (same allocation)
+    unsigned hash;
+    int refCount;           // Items using this category
+    int nextFree;           // Free-list link while unused
+} StockCategory;
+
+// Category dictionary: maps category text to small integer codes
+typedef struct {
+    StockCategory* entries; // Indexed by code
+    int codeCount;          // Codes handed out so far (live or free)
+    int allocated;
+    int count;              // Live categories
+    int freeHead;           // First recyclable code, or -1
+    int* slots;             // Open-addressing table of codes (-1 = empty)
+    int slotCapacity;
+    int* ranks;             // Alphabetical rank per code
+    int rankCapacity;
+    int ranksValid;
+} StockCategoryDict;
+
+// Item fields, used to describe what a change touched
+#define STOCK_FIELD_NAME        0x01
+#define STOCK_FIELD_CATEGORY    0x02
+#define STOCK_FIELD_STOCK       0x04
+#define STOCK_FIELD_ID          0x08
+#define STOCK_FIELD_REORDER     0x10
+#define STOCK_FIELD_POSITION    0x20    // Item moved to another index
+#define STOCK_FIELD_MEMBERSHIP  0x80    // Items added, removed or reloaded
+#define STOCK_FIELD_ALL         0xFF
+
+// Sort fields (values match the SortStockItems sortBy argument)
+#define STOCK_SORT_NAME     0
+#define STOCK_SORT_STOCK    1
+#define STOCK_SORT_CATEGORY 2
+#define STOCK_SORT_ID       3
+
+#define STOCK_SORT_MAX_KEYS 4
+#define STOCK_SORT_CACHE_SIZE 4
+
+// One key of a multi-key ordering
+typedef struct {
+    unsigned char field;        // STOCK_SORT_*
+    unsigned char descending;
+} StockSortKey;
+
+// Ordered list of sort keys
+typedef struct {
+    StockSortKey keys[STOCK_SORT_MAX_KEYS];
+    int keyCount;
+} StockSortSpec;
+
+// Cached permutation of item indices for one key list
+typedef struct {
+    StockSortKey keys[STOCK_SORT_MAX_KEYS];
+    int keyCount;
+    unsigned fieldMask;     // STOCK_FIELD_* bits that invalidate this order
+    int* order;
+    int capacity;
+    int valid;
+    unsigned lastUse;
+} StockSortCacheEntry;
+
+// Name index entry (item is -1 for an empty slot)
+typedef struct {
+    unsigned hash;
+    int item;
+} StockNameEntry;
+
+// Open-addressing hash index on the UTF-8 product name
+typedef struct {
+    StockNameEntry* entries;
+    int capacity;           // Power of two
+    int count;
+} StockNameIndex;
+
+// Id -> slot map entry (slot is -1 when the id is not in use)
+typedef struct {
+    int slot;
+    unsigned generation;
+} StockIdSlot;
+
+// Entry of the map for ids too far apart for the flat table (id 0 = empty)
+typedef struct {
+    int id;
+    StockIdSlot entry;
+} StockSparseId;
+
+// Stable item handle: slot generation in the high 32 bits, item id in the low 32 bits.
+// A handle stops resolving once its item is removed or the inventory is reloaded.
+typedef unsigned long long StockHandle;
+#define STOCK_INVALID_HANDLE 0ULL
+
+// Item slots changed since the last incremental save (see SaveStockIncremental)
+typedef struct {
+    unsigned char* bits;    // One bit per item slot; NULL until the first mark
+    int capacity;           // Slots covered by bits
+    int count;              // Slots marked
+    int persistedCount;     // Records in the file after the last save
+    int persistedNextId;    // nextId in the file's header
+    char* file;             // File the bits describe, or NULL when not tracking
+} StockDirtySet;
+
+// Packed text column: one NUL-terminated string per item slot, back to back
+typedef struct {
+    size_t offset;
+    int slot;               // Owning item slot, or -1 once replaced
+} StockTextEntry;
+
+typedef struct {
+    char* text;
+    size_t length;          // Bytes in use
+    size_t capacity;
+    size_t garbage;         // Bytes of strings that were replaced or removed
+    size_t* offsets;        // String of each item slot
+    int offsetCapacity;
+    StockTextEntry* entries;    // Every string in buffer order, to map offsets back to slots
+    int entryCount;
+    int entryCapacity;
+} StockTextColumn;
+
+// Search columns: the names as stored and their folded keys (see FoldStockText)
+typedef struct {
+    StockTextColumn names;
+    StockTextColumn folded;
+    int valid;              // Built by the first search after a load
+} StockSearchKeys;
+
+// Dense copies of the numeric item fields, one entry per item slot
+typedef struct {
+    int* stock;
+    int* ids;
+    int* categories;        // Category codes
+    int capacity;
+    int* scratch;           // Filter output
+    int valid;              // Built by the first query after a load
+} StockColumns;
+
+// Indexes whose construction is postponed after a lazy (mapped) load
+#define STOCK_DEFERRED_NAME_INDEX 0x01
+#define STOCK_DEFERRED_ID_INDEX   0x02
+
+// Journal group commit: pending records are written with one write and sync per batch
+#define STOCK_JOURNAL_BATCH 64
+#define STOCK_JOURNAL_COMPACT_SIZE (4 * 1024 * 1024)  // Journal bytes that trigger a fresh snapshot
+
+struct StockMapping;
+struct StockJournal;
+struct StockSaver;
+struct StockTrigramIndex;
+struct StockQuantityIndex;
+struct StockDisplayCache;
+struct StockEventHub;
+struct StockUndoLog;
+struct StockViews;
+struct StockPool;
+
 // Stock manager structure
 typedef struct {
-    StockItem items[MAX_ITEMS];
+    StockItem** segments;   // Segment table, each segment holds STOCK_SEGMENT_SIZE items
+    int segmentCount;       // Allocated segments
+    int segmentCapacity;    // Size of the segment table
     int itemCount;
     int nextId;
+    StockNameIndex nameIndex;
+    int uniqueNames;        // Reject duplicate names on add/update
+    StockIdSlot* idSlots;   // Indexed by StockItem.id, for ids below idCapacity
+    int idCapacity;
+    StockSparseId* sparseIds;   // Ids past the table, open addressing
+    int sparseCapacity;     // Power of two
+    int sparseCount;
+    unsigned sparseGeneration;  // First generation of new sparse entries, past every dropped one
+    StockSortCacheEntry sortCache[STOCK_SORT_CACHE_SIZE];
+    unsigned sortClock;
+    StockSortSpec activeSort;   // Ordering chosen with SortStockItems
+    StockCategoryDict categories;
+    struct StockMapping* mapping;   // Mapped data file backing lazily loaded items
+    int mappedCount;                // Items below this index may not be decoded yet
+    unsigned char* residentBits;    // One bit per mapped item: decoded into its segment
+    unsigned deferredIndexes;       // STOCK_DEFERRED_* indexes not built yet
+    int bulkInserts;                // Open BeginStockBulkInsert calls
+    int bulkNameIndex;              // The name index waits for the end of the bulk insert
+    struct StockJournal* journal;   // Open edit journal, or NULL
+    struct StockSaver* saver;       // Background save thread, or NULL
+    StockSearchKeys searchKeys;
+    StockColumns columns;
+    struct StockTrigramIndex* trigrams; // Search key index, built by the first search
+    struct StockQuantityIndex* quantities;  // Ordered by stock, built by the first ordered query
+    struct StockDisplayCache* display;      // UTF-16 display strings, created by the first lookup
+    struct StockEventHub* events;           // Change subscribers and the open batch
+    struct StockUndoLog* undo;              // Inverse of each change, or NULL with undo off
+    struct StockViews* views;               // Versions published for reader threads, or NULL
+    struct StockPool* pool;                 // Query threads, or NULL to scan on the calling thread
+    StockDirtySet dirty;
 } StockManager;
 
+// Unchecked item access for indices in [0, itemCount). After LoadStockFromFileMapped
+// items are decoded on demand, so use GetStockItem unless the item is known resident.
+static inline StockItem* StockItemAt(const StockManager* manager, int index)
+{
+    return &manager->segments[index >> STOCK_SEGMENT_SHIFT][index & STOCK_SEGMENT_MASK];
+}
+
 // Function prototypes
 void InitStockManager(StockManager* manager);
 void FreeStockManager(StockManager* manager);
+int ReserveStockItems(StockManager* manager, int capacity);
+StockItem* GetStockItem(StockManager* manager, int index);
 int AddStockItem(StockManager* manager, const char* name, const char* category, int stock);
-int RemoveStockItem(StockManager* manager, int index);
+int RemoveStockItem(StockManager* manager, int index); // Moves the last item into `index`
 int UpdateStockItem(StockManager* manager, int index, const char* name, const char* category, int stock);
+int AdjustStockItem(StockManager* manager, int index, int delta);  // Add `delta` to the quantity
+int SetStockReorderLevel(StockManager* manager, int index, int level);
+
+// Bulk inserts reserve room for `expectedItems` more items up front. When the
+// batch is large for the inventory, the name index is rebuilt once at the end
+// and the query indexes by their next query instead of being kept up per item,
+// and subscribers are told of a reload. Bulk inserts nest and are change batches
+// and undo groups.
+int BeginStockBulkInsert(StockManager* manager, int expectedItems);
+void EndStockBulkInsert(StockManager* manager);
+
+// Id and handle based access (stable across removals of other items)
+int FindStockItemById(StockManager* manager, int id);
+StockItem* GetStockItemById(StockManager* manager, int id);
+int UpdateStockItemById(StockManager* manager, int id, const char* name, const char* category, int stock);
+int RemoveStockItemById(StockManager* manager, int id);
+StockHandle GetStockItemHandle(StockManager* manager, int index);
+int ResolveStockHandle(StockManager* manager, StockHandle handle);
 int FindStockItem(StockManager* manager, const char* name);
-void SortStockItems(StockManager* manager, int sortBy); // 0=name, 1=stock, 2=category
+
+// Change notifications. Every mutation publishes a typed change; inside a batch
+// the changes are coalesced per item (an insert then edit stays one insert, an
+// insert then remove vanishes, edit masks are merged, a reload replaces
+// everything) and delivered once when the outermost batch ends.
+#define STOCK_CHANGE_INSERTED   1
+#define STOCK_CHANGE_UPDATED    2   // `fields` says what changed
+#define STOCK_CHANGE_REMOVED    3
+#define STOCK_CHANGE_RELOADED   4   // The whole inventory was replaced
+
+typedef struct {
+    int kind;               // STOCK_CHANGE_*
+    int id;                 // Item id, 0 for a reload
+    int index;              // Index now holding the item, -1 when it is gone
+    unsigned fields;        // STOCK_FIELD_* bits
+} StockChange;
+
+typedef void (*StockChangeListener)(StockManager* manager, const StockChange* changes, int count, void* context);
+
+int SubscribeStockChanges(StockManager* manager, StockChangeListener listener, void* context);  // Handle, or 0
+void UnsubscribeStockChanges(StockManager* manager, int handle);
+void BeginStockBatch(StockManager* manager);    // Batches nest
+void EndStockBatch(StockManager* manager);      // Delivers the coalesced changes
+
+// Undo and redo. Once enabled, every change logs its inverse: a few bytes for a
+// quantity, the old text for an update or removal, one id range for any run of
+// inserts. Changes inside an undo group or a bulk insert form one undo step.
+// Each of the undo and redo stacks keeps to `maxBytes` by dropping its oldest
+// steps; a step too large for it clears that stack. A checkpoint names the
+// current position in O(1), and rolling back to it undoes every step since,
+// e.g. a whole import. Loading or renumbering the inventory clears the log.
+#define STOCK_UNDO_DEFAULT_BYTES (4 * 1024 * 1024)
+#define STOCK_UNDO_CHECKPOINTS  16      // Named positions kept at once
+#define STOCK_UNDO_NAME_LENGTH  32
+
+typedef struct {
+    int undoSteps;
+    int redoSteps;
+    size_t undoBytes;       // Logged records
+    size_t redoBytes;
+    size_t allocatedBytes;  // Everything the log holds on to
+    long long droppedSteps; // Oldest steps given up for the budget
+} StockUndoStats;
+
+int EnableStockUndo(StockManager* manager, size_t maxBytes);   // 0 turns undo off
+void BeginStockUndoGroup(StockManager* manager);    // Groups nest
+void EndStockUndoGroup(StockManager* manager);
+int UndoStockChange(StockManager* manager);         // 1 if a step was undone
+int RedoStockChange(StockManager* manager);
+int CanUndoStockChange(const StockManager* manager);
+int CanRedoStockChange(const StockManager* manager);
+int MarkStockCheckpoint(StockManager* manager, const char* name);      // Replaces one of the same name
+int RollbackStockCheckpoint(StockManager* manager, const char* name);  // 0 if the mark is out of reach
+void GetStockUndoStats(const StockManager* manager, StockUndoStats* stats);
+
+// Concurrent readers. A StockManager belongs to one thread; every function
+// above must be called from it. With views enabled, the owner publishes an
+// immutable version of the inventory after each change or batch, and other
+// threads read the latest version without locks: readers never block the owner
+// or each other. A version shares everything the change did not touch with the
+// one before it, so publishing an edit copies one 64-item leaf.
+// Superseded versions are freed once no reader can still hold them (epoch
+// reclamation), so a reader should not keep a version pinned for long.
+//     int reader = OpenStockReader(views);            // On the reader thread
+//     const StockView* view = BeginStockRead(views, reader);
+//     ... GetStockViewItem(view, i) for i < GetStockViewCount(view) ...
+//     EndStockRead(views, reader);
+#define STOCK_MAX_READERS 64
+
+typedef struct StockViews StockViews;
+typedef struct StockView StockView;
+
+typedef struct {
+    int id;
+    int stock;
+    int reorderLevel;
+    const char* name;
+    const char* category;
+} StockViewItem;
+
+StockViews* EnableStockViews(StockManager* manager);   // Owner; publishes the current inventory
+int OpenStockReader(StockViews* views);                 // Any thread: reader slot, or -1 if all are taken
+void CloseStockReader(StockViews* views, int reader);
+const StockView* BeginStockRead(StockViews* views, int reader);    // Pins the latest version
+void EndStockRead(StockViews* views, int reader);                  // The version may be freed after this
+int GetStockViewCount(const StockView* view);
+const StockViewItem* GetStockViewItem(const StockView* view, int index);
+unsigned long long GetStockViewVersion(const StockView* view);     // Grows with each publish
+
+// Categories
+const char* GetStockItemCategory(const StockManager* manager, const StockItem* item);
+const char* GetStockCategoryName(const StockManager* manager, int categoryId);
+int FindStockCategory(const StockManager* manager, const char* category);     // Code or -1
+int GetStockCategoryItemCount(const StockManager* manager, int categoryId);
+int GetStockItemsInCategory(StockManager* manager, int categoryId, int* indices, int maxIndices);
+int SetStockUniqueNames(StockManager* manager, int enabled);
+
+// Sorting returns a permutation of item indices; items themselves never move.
+// The returned array has itemCount entries and stays valid until the next change.
+const int* SortStockItemsBy(StockManager* manager, const StockSortKey* keys, int keyCount);
+void SortStockItems(StockManager* manager, int sortBy); // 0=name, 1=stock, 2=category, 3=id
+const int* GetStockSortOrder(StockManager* manager);    // Order chosen by SortStockItems, or NULL
+
+
+// Persistence. SaveStockToFile writes the compact v2 format through a synced
+// temporary file renamed over the target; LoadStockFromFile detects and reads
+// both v2 and the legacy fixed-record v1 format.
+#define STOCK_FILE_FORMAT_V1 1
+#define STOCK_FILE_FORMAT_V2 2
+
 int SaveStockToFile(StockManager* manager, const char* filename);
+int SaveStockToFileFormat(StockManager* manager, const char* filename, int format);
 int LoadStockFromFile(StockManager* manager, const char* filename);
+int LoadStockFromFileMapped(StockManager* manager, const char* filename);  // Lazy, zero-copy
+int EnsureStockResident(StockManager* manager);     // Decode everything and drop the mapping
+int DetectStockFileFormat(const char* filename);    // STOCK_FILE_FORMAT_* or 0
+
+// Saves in the fixed-record v1 format, rewriting only the records changed since
+// the previous call for the same file (a full save the first time)
+int SaveStockIncremental(StockManager* manager, const char* filename);
+
+// Spreadsheet import. The file is streamed through a fixed buffer, so its size
+// does not matter; rows are added in one bulk insert. RFC 4180 quoting (quoted
+// delimiters, line breaks and doubled quotes) and a UTF-8 byte order mark are
+// accepted; spaces may follow a closing quote, other text may not. Lines of only
+// spaces and tabs are blank. A bad row is reported and skipped; the import goes on.
+// The filename is UTF-8, on Windows too.
+#define STOCK_IMPORT_ABSENT     -1      // Column mapping: the file has no such column
+#define STOCK_IMPORT_AUTO       -2      // Column mapping: find it by header name, else by position
+
+#define STOCK_IMPORT_BUFFER_SIZE (64 * 1024)
+
+#define STOCK_IMPORT_ERROR_COLUMNS   1  // A mapped column is missing from the row
+#define STOCK_IMPORT_ERROR_TEXT      2  // Empty name, or a text field too long
+#define STOCK_IMPORT_ERROR_NUMBER    3  // Quantity or reorder level is not a number >= 0
+#define STOCK_IMPORT_ERROR_REJECTED  4  // Not accepted by the inventory (e.g. duplicate name)
+#define STOCK_IMPORT_ERROR_HEADER    5  // Header lacks a required column (stops the import)
+#define STOCK_IMPORT_ERROR_QUOTES    6  // Text after a field's closing quote, as in "a"b
+
+typedef void (*StockImportErrorHandler)(int line, int error, void* context);
+
+typedef struct {
+    char delimiter;         // ',' or '\t'; 0 picks a tab if the first line has one
+    int hasHeader;          // Skip the first row (and use it to map columns)
+    int nameColumn;         // Zero-based column, STOCK_IMPORT_ABSENT or STOCK_IMPORT_AUTO
+    int stockColumn;
+    int categoryColumn;
+    int reorderColumn;
+    StockImportErrorHandler onError;    // Optional
+    void* context;
+} StockImportOptions;
+
+typedef struct {
+    int rows;               // Data rows read
+    int imported;
+    int rejected;
+} StockImportResult;
+
+void InitStockImportOptions(StockImportOptions* options);  // Header row, columns by name
+int ImportStockFromFile(StockManager* manager, const char* filename, const StockImportOptions* options, StockImportResult* result);
+
+// Export for reports: CSV (id, name, quantity, category, reorder level, readable
+// by ImportStockFromFile) or JSON Lines (one object per item). Rows go through a
+// fixed buffer with no allocation per row. An exporter is also a StockItemVisitor,
+// so query results stream straight into it:
+//     VisitLowStockItems(manager, 5, 0, 0, ExportStockItemVisitor, exporter);
+#define STOCK_EXPORT_CSV    0
+#define STOCK_EXPORT_JSONL  1
+
+#define STOCK_EXPORT_BUFFER_SIZE (64 * 1024)
+
+struct StockExporter;
+
+struct StockExporter* OpenStockExport(const char* filename, int format);  // Writes the CSV header
+int ExportStockItem(struct StockExporter* exporter, const StockManager* manager, const StockItem* item);
+int ExportStockItemVisitor(StockManager* manager, int index, void* exporter);
+int CloseStockExport(struct StockExporter* exporter);     // 1 if every row reached the file
+int ExportStockToFile(StockManager* manager, const char* filename, int format, const int* indices, int count);  // NULL indices: all items
+
+// Append-only edit journal kept next to the snapshot file. Opening replays the
+// journal on top of the loaded snapshot; afterwards every change is recorded.
+int OpenStockJournal(StockManager* manager, const char* snapshotFile, const char* journalFile);
+int FlushStockJournal(StockManager* manager);      // Commit pending records
+int CompactStockJournal(StockManager* manager);    // Write a fresh snapshot and empty the journal
+void CloseStockJournal(StockManager* manager);     // Flushes first
+
+// Background saving. RequestStockSave copies the inventory on the calling thread
+// and writes the copy on the saver thread; a request that has not started yet is
+// replaced by a newer one for the same file, while saves of other files wait their
+// turn. Saver calls must come from the thread owning the manager.
+#define STOCK_SAVE_NONE -1      // PollStockSave: no save finished since the last poll
+
+typedef void (*StockSaveCallback)(int result, void* context);  // Runs on the saver thread
+
+int StartStockSaver(StockManager* manager, StockSaveCallback callback, void* context);
+int RequestStockSave(StockManager* manager, const char* filename);  // 0 if the copy was not queued
+int PollStockSave(StockManager* manager);  // 0 if a save finished since the last poll failed, or STOCK_SAVE_NONE
+int WaitStockSave(StockManager* manager);  // Block until idle; 0 if a save since the last poll failed
+void StopStockSaver(StockManager* manager); // Finishes queued saves first
+
+// Save-path fault injection for tests: a hook returning nonzero fails that step
+#define STOCK_FAULT_OPEN    1
+#define STOCK_FAULT_WRITE   2   // Leaves a torn temporary file
+#define STOCK_FAULT_SYNC    3
+#define STOCK_FAULT_RENAME  4
+
+typedef int (*StockFaultHook)(int point, void* context);
+void SetStockFaultHook(StockFaultHook hook, void* context);
+
+// Streaming query results: the visitor gets the index of each match in the
+// query's order and returns nonzero to continue or 0 to stop. Queries skip the
+// first `offset` matches, deliver at most `limit` (0: no limit) and return how
+// many were delivered. Indices stay valid until the inventory changes.
+typedef int (*StockItemVisitor)(StockManager* manager, int index, void* context);
+
+// Substring search over names and categories. Exact matching compares bytes;
+// folded matching ignores case and diacritics. Both go through a trigram index
+// of the folded names when the term is three bytes or longer.
+#define STOCK_SEARCH_EXACT  0
+#define STOCK_SEARCH_FOLDED 1
+#define STOCK_SEARCH_SCAN   0x10    // Flag: skip the index and scan the packed name column
+
+// Matches come in item index order; the copying variants need room for itemCount results.
+int VisitSearchResults(StockManager* manager, const char* searchTerm, int mode, int offset, int limit,
+                       StockItemVisitor visitor, void* context);
+int SearchStockItemIndices(StockManager* manager, const char* searchTerm, int mode, int offset,
+                           int* indices, int maxIndices);  // Returns how many were stored
 void SearchStockItems(StockManager* manager, const char* searchTerm, StockItem* results, int* resultCount);
-int GetLowStockItems(StockManager* manager, int threshold, StockItem* results, int* resultCount);
+void SearchStockItemsMode(StockManager* manager, const char* searchTerm, int mode, StockItem* results, int* resultCount);
+size_t FoldStockText(const char* text, char* folded, size_t foldedSize);  // Returns the folded length
+
+// Scan kernels for the packed columns, picked at run time from what the processor supports
+#define STOCK_SCAN_AUTO   -1
+#define STOCK_SCAN_SCALAR 0
+#define STOCK_SCAN_SSE2   1
+#define STOCK_SCAN_AVX2   2
+
+int SetStockScanKernel(int kernel);    // Returns the kernel in use (never one the processor lacks)
+int GetStockScanKernel(void);
+
+// Parallel scans. With more than one query thread, the scans of large
+// inventories (name search over the packed column, quantity and category
+// filters) are split into shards of STOCK_SHARD_ITEMS items that a small
+// work-stealing pool runs in parallel. Results are merged in item order, so
+// they are the same as a serial scan's. Smaller inventories stay serial.
+#define STOCK_SHARD_ITEMS 16384                     // 64 KB of a 4-byte column
+#define STOCK_PARALLEL_MIN_ITEMS (4 * STOCK_SHARD_ITEMS)
+#define STOCK_MAX_QUERY_THREADS 64
+
+int SetStockQueryThreads(StockManager* manager, int threads);  // 0: one per processor; returns the count in use
+int GetStockQueryThreads(const StockManager* manager);        // 1 without a pool
+
+// Quantity filters over a dense stock column; the index lists come back ascending
+int GetStockItemsInRange(StockManager* manager, int minStock, int maxStock, int* indices, int maxIndices);
+int GetLowStockItemsByCategory(StockManager* manager, const int* thresholds, int thresholdCount,
+                               int* indices, int maxIndices);  // thresholds[] by category code
+
+// Ordered quantity queries through a balanced index on (stock, id): O(log n + k)
+// for k results. Lists come back lowest stock first, or most short first for
+// reordering; the returned count may exceed maxIndices.
+int VisitLowStockItems(StockManager* manager, int threshold, int offset, int limit,
+                       StockItemVisitor visitor, void* context);  // Skipping costs O(log n)
+int GetLowStockItemIndices(StockManager* manager, int threshold, int offset, int* indices, int maxIndices);
+int GetLowStockItems(StockManager* manager, int threshold, StockItem* results, int* resultCount);  // Item order
+int CountStockItemsAtOrBelow(StockManager* manager, int threshold);
+int GetStockItemsByQuantity(StockManager* manager, int minStock, int maxStock, int* indices, int maxIndices);
+int GetLowestStockItems(StockManager* manager, int count, int* indices);   // Returns how many were stored
+int GetHighestStockItems(StockManager* manager, int count, int* indices);
+int GetStockItemsToReorder(StockManager* manager, int* indices, int maxIndices);  // stock <= reorderLevel
 
-// Helper functions for dialog operations
-INT_PTR CALLBACK AddEditItemDialogProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam);
-void ShowAddItemDialog(HWND parent, StockManager* manager);
-void ShowEditItemDialog(HWND parent, StockManager* manager, int itemIndex);
+// UTF-16 display strings per item (name, category, formatted quantity), converted
+// once and kept in a bounded LRU cache keyed by item id. Edits that change a
+// shown field drop the item's entry. The strings stay valid until the next
+// display lookup or inventory change.
+#define STOCK_DISPLAY_CACHE_DEFAULT 1024    // Entries; each holds up to ~800 bytes
+
+typedef unsigned short StockWideChar;       // UTF-16 code unit (wchar_t on Windows)
+
+typedef struct {
+    const StockWideChar* name;
+    const StockWideChar* category;
+    const StockWideChar* quantity;
+} StockDisplayText;
+
+typedef struct {
+    long long hits;
+    long long misses;
+    long long conversions;      // Strings converted to UTF-16
+    long long evictions;        // Entries reused for another item
+    long long invalidations;    // Entries dropped by edits
+} StockDisplayStats;
+
+int GetStockDisplayText(StockManager* manager, int index, StockDisplayText* text);
+int SetStockDisplayCacheSize(StockManager* manager, int entries);   // Empties the cache
+void GetStockDisplayStats(const StockManager* manager, StockDisplayStats* stats);
+size_t WidenStockText(const char* text, StockWideChar* wide, size_t wideSize);  // UTF-8 to UTF-16; returns the length
+
+// Row model for virtual (owner-data) list views: one row per item in index
+// order, read on demand for the rows on screen. The model subscribes to the
+// manager's changes, and TakeStockRowUpdate says which rows have to be redrawn.
+#define STOCK_COLUMN_NAME       0
+#define STOCK_COLUMN_QUANTITY   1
+#define STOCK_COLUMN_CATEGORY   2
+#define STOCK_COLUMN_COUNT      3
+
+#define STOCK_ROW_CACHE_SIZE 256    // Rows kept ready around the last hint
+
+typedef struct {
+    int id;                 // Item shown, or 0 when the entry is stale
+    char quantity[12];
+} StockRowCacheEntry;
+
+typedef struct {
+    StockManager* manager;
+    int subscription;       // Change subscription handle
+    int rowCount;           // Rows the view was last told about
+    int dirtyFirst;         // Rows to redraw, or -1 when none
+    int dirtyLast;
+    int cacheFirst;         // Row of cache[0]
+    int cacheCount;
+    StockRowCacheEntry cache[STOCK_ROW_CACHE_SIZE];
+    char scratch[12];       // Quantity text of a row outside the cache
+} StockRowModel;
 
-// Global variables (for dialog operations)
-extern StockManager* g_stockManager;
-extern int g_editIndex;
-extern HWND g_hMainWindow;
+void InitStockRowModel(StockRowModel* model, StockManager* manager);  // The model must not move afterwards
+void FreeStockRowModel(StockRowModel* model);
+void HintStockRows(StockRowModel* model, int first, int last);  // Rows about to be shown
+const char* GetStockRowText(StockRowModel* model, int row, int column);  // UTF-8, valid until the next edit
+const StockWideChar* GetStockRowDisplayText(StockRowModel* model, int row, int column);  // UTF-16, see GetStockDisplayText
+int GetStockRowItemId(StockRowModel* model, int row);           // 0 for no row
+int FindStockRowById(StockRowModel* model, int id);             // -1 if absent
+void ResetStockRows(StockRowModel* model);                      // Redraw every row (done on reloads)
+int TakeStockRowUpdate(StockRowModel* model, int* first, int* last);  // Row count; first = -1 if nothing to redraw
 
 #endif // STOCK_H
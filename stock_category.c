@@ -0,0 +1,303 @@
+#include "stock_category.h"
+#include "stock_index.h"
+
+// Category strings are interned once and items refer to them by a small
+// integer code. Each entry counts the items using it and is dropped (its
+// code recycled) when the count falls to zero.
+
+#define CATEGORY_EMPTY_SLOT -1
+#define CATEGORY_MIN_SLOTS 64
+
+void InitCategoryDict(StockCategoryDict* dict)
+{
+    if (dict == NULL) return;
+    
+    memset(dict, 0, sizeof(StockCategoryDict));
+    dict->freeHead = -1;
+}
+
+void FreeCategoryDict(StockCategoryDict* dict)
+{
+    if (dict == NULL) return;
+    
+    for (int i = 0; i < dict->codeCount; i++)
+    {
+        free(dict->entries[i].text);
+    }
+    free(dict->entries);
+    free(dict->slots);
+    free(dict->ranks);
+    
+    InitCategoryDict(dict);
+}
+
+// Drop every entry but keep the allocated tables
+void ResetCategoryDict(StockCategoryDict* dict)
+{
+    for (int i = 0; i < dict->codeCount; i++)
+    {
+        free(dict->entries[i].text);
+        dict->entries[i].text = NULL;
+        dict->entries[i].refCount = 0;
+    }
+    for (int i = 0; i < dict->slotCapacity; i++)
+    {
+        dict->slots[i] = CATEGORY_EMPTY_SLOT;
+    }
+    
+    dict->codeCount = 0;
+    dict->count = 0;
+    dict->freeHead = -1;
+    dict->ranksValid = 0;
+}
+
+// Deep copy into an empty dictionary (alphabetical ranks are not copied)
+int CopyCategoryDict(StockCategoryDict* dest, const StockCategoryDict* source)
+{
+    InitCategoryDict(dest);
+    if (source->codeCount == 0) return 1;
+    
+    dest->entries = (StockCategory*)malloc(source->codeCount * sizeof(StockCategory));
+    dest->slots = (int*)malloc(source->slotCapacity * sizeof(int));
+    if (dest->entries == NULL || dest->slots == NULL)
+    {
+        FreeCategoryDict(dest);
+        return 0;
+    }
+    
+    memcpy(dest->slots, source->slots, source->slotCapacity * sizeof(int));
+    dest->slotCapacity = source->slotCapacity;
+    dest->allocated = source->codeCount;
+    dest->freeHead = source->freeHead;
+    dest->count = source->count;
+    
+    for (int code = 0; code < source->codeCount; code++)
+    {
+        dest->entries[code] = source->entries[code];
+        dest->entries[code].text = NULL;
+        dest->codeCount = code + 1;
+        
+        const char* text = source->entries[code].text;
+        if (text == NULL) continue;
+        
+        // Text and search key share one allocation
+        size_t length = strlen(text);
+        dest->entries[code].text = (char*)malloc(2 * (length + 1));
+        if (dest->entries[code].text == NULL)
+        {
+            FreeCategoryDict(dest);
+            return 0;
+        }
+        memcpy(dest->entries[code].text, text, length + 1);
+        dest->entries[code].folded = dest->entries[code].text + length + 1;
+        strcpy(dest->entries[code].folded, source->entries[code].folded);
+    }
+    
+    return 1;
+}
+
+static int FindCategorySlot(const StockCategoryDict* dict, const char* text, unsigned hash)
+{
+    if (dict->slotCapacity == 0) return -1;
+    
+    unsigned mask = (unsigned)dict->slotCapacity - 1;
+    unsigned pos = hash & mask;
+    
+    while (dict->slots[pos] != CATEGORY_EMPTY_SLOT)
+    {
+        const StockCategory* entry = &dict->entries[dict->slots[pos]];
+        
+        if (entry->hash == hash && strcmp(entry->text, text) == 0) return (int)pos;
+        pos = (pos + 1) & mask;
+    }
+    
+    return -1;
+}
+
+static void PlaceCategorySlot(StockCategoryDict* dict, int code)
+{
+    unsigned mask = (unsigned)dict->slotCapacity - 1;
+    unsigned pos = dict->entries[code].hash & mask;
+    
+    while (dict->slots[pos] != CATEGORY_EMPTY_SLOT)
+    {
+        pos = (pos + 1) & mask;
+    }
+    dict->slots[pos] = code;
+}
+
+// Keep the hash table at most half full
+static int ReserveCategorySlots(StockCategoryDict* dict, int count)
+{
+    if (count * 2 <= dict->slotCapacity) return 1;
+    
+    int capacity = dict->slotCapacity > 0 ? dict->slotCapacity : CATEGORY_MIN_SLOTS;
+    while (count * 2 > capacity) capacity *= 2;
+    
+    int* slots = (int*)malloc(capacity * sizeof(int));
+    if (slots == NULL) return 0;
+    
+    free(dict->slots);
+    dict->slots = slots;
+    dict->slotCapacity = capacity;
+    
+    for (int i = 0; i < capacity; i++)
+    {
+        slots[i] = CATEGORY_EMPTY_SLOT;
+    }
+    for (int code = 0; code < dict->codeCount; code++)
+    {
+        if (dict->entries[code].text != NULL) PlaceCategorySlot(dict, code);
+    }
+    
+    return 1;
+}
+
+int LookupCategory(const StockCategoryDict* dict, const char* text)
+{
+    if (dict == NULL || text == NULL) return -1;
+    
+    int slot = FindCategorySlot(dict, text, HashStockName(text));
+    return slot >= 0 ? dict->slots[slot] : -1;
+}
+
+int InternCategory(StockCategoryDict* dict, const char* text)
+{
+    unsigned hash = HashStockName(text);
+    int slot = FindCategorySlot(dict, text, hash);
+    
+    if (slot >= 0)
+    {
+        int code = dict->slots[slot];
+        dict->entries[code].refCount++;
+        return code;
+    }
+    
+    if (!ReserveCategorySlots(dict, dict->count + 1)) return -1;
+    
+    // The folded search key follows the text; folding never makes it longer
+    size_t length = strlen(text);
+    char* copy = (char*)malloc(2 * (length + 1));
+    if (copy == NULL) return -1;
+    memcpy(copy, text, length + 1);
+    FoldStockText(text, copy + length + 1, length + 1);
+    
+    // Recycle a dropped code, or append a new one
+    int code = dict->freeHead;
+    if (code >= 0)
+    {
+        dict->freeHead = dict->entries[code].nextFree;
+    }
+    else
+    {
+        if (dict->codeCount == dict->allocated)
+        {
+            int allocated = dict->allocated > 0 ? dict->allocated * 2 : 16;
+            StockCategory* entries = (StockCategory*)realloc(dict->entries, allocated * sizeof(StockCategory));
+            if (entries == NULL)
+            {
+                free(copy);
+                return -1;
+            }
+            dict->entries = entries;
+            dict->allocated = allocated;
+        }
+        code = dict->codeCount++;
+    }
+    
+    dict->entries[code].text = copy;
+    dict->entries[code].folded = copy + length + 1;
+    dict->entries[code].hash = hash;
+    dict->entries[code].refCount = 1;
+    dict->count++;
+    dict->ranksValid = 0;
+    
+    PlaceCategorySlot(dict, code);
+    return code;
+}
+
+void RetainCategory(StockCategoryDict* dict, int code)
+{
+    if (code < 0 || code >= dict->codeCount || dict->entries[code].text == NULL) return;
+    
+    dict->entries[code].refCount++;
+}
+
+void ReleaseCategory(StockCategoryDict* dict, int code)
+{
+    if (code < 0 || code >= dict->codeCount) return;
+    
+    StockCategory* entry = &dict->entries[code];
+    if (entry->text == NULL || --entry->refCount > 0) return;
+    
+    // Last user gone: unlink from the hash table (backward shift) and recycle the code
+    unsigned mask = (unsigned)dict->slotCapacity - 1;
+    unsigned hole = (unsigned)FindCategorySlot(dict, entry->text, entry->hash);
+    unsigned next = (hole + 1) & mask;
+    
+    while (dict->slots[next] != CATEGORY_EMPTY_SLOT)
+    {
+        unsigned home = dict->entries[dict->slots[next]].hash & mask;
+        
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            dict->slots[hole] = dict->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    dict->slots[hole] = CATEGORY_EMPTY_SLOT;
+    
+    free(entry->text);
+    entry->text = NULL;
+    entry->folded = NULL;
+    entry->nextFree = dict->freeHead;
+    dict->freeHead = code;
+    dict->count--;
+}
+
+typedef struct {
+    const char* text;
+    int code;
+} CategoryRankEntry;
+
+static int CompareCategoryRankEntries(const void* left, const void* right)
+{
+    return strcmp(((const CategoryRankEntry*)left)->text, ((const CategoryRankEntry*)right)->text);
+}
+
+// Alphabetical rank of every code, so category ordering is an integer compare
+const int* GetCategoryRanks(StockCategoryDict* dict)
+{
+    if (dict->ranksValid) return dict->ranks;
+    
+    // NULL means failure, so an empty dictionary still gets an array
+    if (dict->codeCount > dict->rankCapacity || dict->ranks == NULL)
+    {
+        int capacity = dict->codeCount > 0 ? dict->codeCount : 1;
+        int* ranks = (int*)realloc(dict->ranks, capacity * sizeof(int));
+        if (ranks == NULL) return NULL;
+        dict->ranks = ranks;
+        dict->rankCapacity = capacity;
+    }
+    
+    CategoryRankEntry* sorted = (CategoryRankEntry*)malloc((dict->codeCount > 0 ? dict->codeCount : 1) * sizeof(CategoryRankEntry));
+    if (sorted == NULL) return NULL;
+    
+    for (int i = 0; i < dict->codeCount; i++)
+    {
+        sorted[i].text = dict->entries[i].text != NULL ? dict->entries[i].text : "";
+        sorted[i].code = i;
+    }
+    
+    qsort(sorted, dict->codeCount, sizeof(CategoryRankEntry), CompareCategoryRankEntries);
+    
+    for (int i = 0; i < dict->codeCount; i++)
+    {
+        dict->ranks[sorted[i].code] = i;
+    }
+    
+    free(sorted);
+    dict->ranksValid = 1;
+    return dict->ranks;
+}
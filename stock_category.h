@@ -0,0 +1,17 @@
+#ifndef STOCK_CATEGORY_H
+#define STOCK_CATEGORY_H
+
+#include "stock.h"
+
+// Internal helpers for the category dictionary (see StockCategoryDict)
+void InitCategoryDict(StockCategoryDict* dict);
+void FreeCategoryDict(StockCategoryDict* dict);
+void ResetCategoryDict(StockCategoryDict* dict);
+int CopyCategoryDict(StockCategoryDict* dest, const StockCategoryDict* source);
+int InternCategory(StockCategoryDict* dict, const char* text);
+void RetainCategory(StockCategoryDict* dict, int code);
+void ReleaseCategory(StockCategoryDict* dict, int code);
+int LookupCategory(const StockCategoryDict* dict, const char* text);
+const int* GetCategoryRanks(StockCategoryDict* dict);
+
+#endif // STOCK_CATEGORY_H
@@ -0,0 +1,201 @@
+#include "stock_internal.h"
+#include "stock_columns.h"
+#include "stock_scan.h"
+#include "stock_pool.h"
+
+// Quantity queries. The stock, id and category code of every item slot are
+// mirrored into dense arrays so a filter streams 4 bytes per item instead of
+// a whole StockItem; the compare-and-compress kernels (stock_scan.c) turn a
+// column into the list of slots that pass.
+
+void DropStockColumns(StockManager* manager)
+{
+    StockColumns* columns = &manager->columns;
+    
+    free(columns->stock);
+    free(columns->ids);
+    free(columns->categories);
+    free(columns->scratch);
+    memset(columns, 0, sizeof(StockColumns));
+}
+
+static int GrowStockColumns(StockColumns* columns, int capacity)
+{
+    if (capacity <= columns->capacity) return 1;
+    
+    int grown = columns->capacity > 0 ? columns->capacity : 1024;
+    while (grown < capacity) grown *= 2;
+    
+    int* stock = (int*)realloc(columns->stock, grown * sizeof(int));
+    if (stock != NULL) columns->stock = stock;
+    int* ids = (int*)realloc(columns->ids, grown * sizeof(int));
+    if (ids != NULL) columns->ids = ids;
+    int* categories = (int*)realloc(columns->categories, grown * sizeof(int));
+    if (categories != NULL) columns->categories = categories;
+    int* scratch = (int*)realloc(columns->scratch, (grown + STOCK_FILTER_SLACK) * sizeof(int));
+    if (scratch != NULL) columns->scratch = scratch;
+    
+    if (stock == NULL || ids == NULL || categories == NULL || scratch == NULL) return 0;
+    
+    columns->capacity = grown;
+    return 1;
+}
+
+void SyncStockColumns(StockManager* manager, int index)
+{
+    StockColumns* columns = &manager->columns;
+    if (!columns->valid) return;
+    
+    // Without memory the columns are rebuilt by the next query
+    if (!GrowStockColumns(columns, index + 1))
+    {
+        DropStockColumns(manager);
+        return;
+    }
+    
+    const StockItem* item = StockItemAt(manager, index);
+    columns->stock[index] = item->stock;
+    columns->ids[index] = item->id;
+    columns->categories[index] = item->categoryId;
+}
+
+static int RequireStockColumns(StockManager* manager)
+{
+    StockColumns* columns = &manager->columns;
+    
+    if (!EnsureStockResident(manager)) return 0;
+    if (columns->valid) return 1;
+    if (!GrowStockColumns(columns, manager->itemCount > 0 ? manager->itemCount : 1)) return 0;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        const StockItem* item = StockItemAt(manager, i);
+        
+        columns->stock[i] = item->stock;
+        columns->ids[i] = item->id;
+        columns->categories[i] = item->categoryId;
+    }
+    
+    columns->valid = 1;
+    return 1;
+}
+
+// One filter over the columns; `keys` selects the per-category threshold kernel
+typedef struct {
+    const int* values;
+    const int* keys;
+    const int* thresholds;
+    int low;
+    int high;
+    int count;
+    int* indices;           // Slots that pass; a shard writes only to its own range
+    int* found;             // Per shard
+} StockColumnFilter;
+
+static int FilterColumnRange(const StockColumnFilter* filter, int first, int count, int* indices)
+{
+    if (filter->keys != NULL)
+        return FilterStockThresholds(filter->values + first, filter->keys + first, filter->thresholds, count, indices);
+    
+    return FilterStockRange(filter->values + first, count, filter->low, filter->high, indices);
+}
+
+// The kernels store no further than the positions already read, so a shard
+// stays inside its own part of the index list
+static void FilterColumnShard(void* context, int shard)
+{
+    StockColumnFilter* filter = (StockColumnFilter*)context;
+    int first = shard * STOCK_SHARD_ITEMS;
+    int count = filter->count - first < STOCK_SHARD_ITEMS ? filter->count - first : STOCK_SHARD_ITEMS;
+    int* indices = filter->indices + first;
+    
+    int found = FilterColumnRange(filter, first, count, indices);
+    for (int i = 0; i < found; i++) indices[i] += first;
+    filter->found[shard] = found;
+}
+
+// Run a filter into the scratch list, in shards across the query threads when
+// the inventory is large enough; returns the number of slots that pass
+static int RunColumnFilter(StockManager* manager, StockColumnFilter* filter)
+{
+    filter->count = manager->itemCount;
+    filter->indices = manager->columns.scratch;
+    
+    int shards = CountStockShards(manager, filter->count);
+    filter->found = shards > 0 ? (int*)malloc(shards * sizeof(int)) : NULL;
+    if (filter->found == NULL) return FilterColumnRange(filter, 0, filter->count, filter->indices);
+    
+    // Pick the kernel before the shards race to
+    GetStockScanKernel();
+    RunStockShards(manager, shards, FilterColumnShard, filter);
+    
+    // Close the gaps between the shards' lists, in shard order
+    int total = 0;
+    for (int shard = 0; shard < shards; shard++)
+    {
+        memmove(filter->indices + total, filter->indices + shard * STOCK_SHARD_ITEMS, filter->found[shard] * sizeof(int));
+        total += filter->found[shard];
+    }
+    
+    free(filter->found);
+    return total;
+}
+
+// Hand out the first maxIndices of `count` filtered slots; returns count
+static int CopyFilterResult(const StockColumns* columns, int count, int* indices, int maxIndices)
+{
+    if (indices != NULL && maxIndices > 0)
+    {
+        memcpy(indices, columns->scratch, (count < maxIndices ? count : maxIndices) * sizeof(int));
+    }
+    
+    return count;
+}
+
+// Collect indices of items in a category; returns the number of matches
+// (which may exceed maxIndices, only the first maxIndices are stored)
+int GetStockItemsInCategory(StockManager* manager, int categoryId, int* indices, int maxIndices)
+{
+    if (manager == NULL || categoryId < 0 || !RequireStockColumns(manager)) return 0;
+    
+    StockColumnFilter filter = { manager->columns.categories, NULL, NULL, categoryId, categoryId, 0, NULL, NULL };
+    int count = RunColumnFilter(manager, &filter);
+    
+    return CopyFilterResult(&manager->columns, count, indices, maxIndices);
+}
+
+// Collect indices of items with minStock <= stock <= maxStock, like GetStockItemsInCategory
+int GetStockItemsInRange(StockManager* manager, int minStock, int maxStock, int* indices, int maxIndices)
+{
+    if (manager == NULL || !RequireStockColumns(manager)) return 0;
+    
+    StockColumnFilter filter = { manager->columns.stock, NULL, NULL, minStock, maxStock, 0, NULL, NULL };
+    int count = RunColumnFilter(manager, &filter);
+    
+    return CopyFilterResult(&manager->columns, count, indices, maxIndices);
+}
+
+// Collect indices of items at or below the threshold of their category
+// (thresholds[code]; categories past thresholdCount are never low)
+int GetLowStockItemsByCategory(StockManager* manager, const int* thresholds, int thresholdCount,
+                               int* indices, int maxIndices)
+{
+    if (manager == NULL || thresholds == NULL || thresholdCount < 0) return 0;
+    if (!RequireStockColumns(manager)) return 0;
+    
+    // The kernel looks up every code, so cover the whole dictionary
+    int codeCount = manager->categories.codeCount;
+    int* limits = (int*)malloc((codeCount > 0 ? codeCount : 1) * sizeof(int));
+    if (limits == NULL) return 0;
+    
+    for (int code = 0; code < codeCount; code++)
+    {
+        limits[code] = code < thresholdCount ? thresholds[code] : -1;
+    }
+    
+    StockColumnFilter filter = { manager->columns.stock, manager->columns.categories, limits, 0, 0, 0, NULL, NULL };
+    int count = RunColumnFilter(manager, &filter);
+    
+    free(limits);
+    return CopyFilterResult(&manager->columns, count, indices, maxIndices);
+}
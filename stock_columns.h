@@ -0,0 +1,11 @@
+#ifndef STOCK_COLUMNS_H
+#define STOCK_COLUMNS_H
+
+#include "stock.h"
+
+// Internal hooks for the dense quantity/id/category columns (see StockColumns).
+// The columns exist only after the first query; until then the hooks do nothing.
+void SyncStockColumns(StockManager* manager, int index);   // After the item in `index` changed
+void DropStockColumns(StockManager* manager);   // Rebuilt by the next query
+
+#endif // STOCK_COLUMNS_H
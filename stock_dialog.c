@@ -0,0 +1,163 @@
+#include "stock_dialog.h"
+#include "resource.h"
+#include "theme.h"
+#include <commctrl.h>
+
+// Global variables
+StockManager* g_stockManager = NULL;
+int g_editId = 0;
+HWND g_hMainWindow = NULL;
+
+// Dialog functions
+void ShowAddItemDialog(HWND parent, StockManager* manager)
+{
+    g_stockManager = manager;
+    g_editId = 0;
+    g_hMainWindow = parent;
+    
+    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_ADD_ITEM), parent, AddEditItemDialogProc);
+}
+
+void ShowEditItemDialog(HWND parent, StockManager* manager, int itemId)
+{
+    if (GetStockItemById(manager, itemId) == NULL) return;
+    
+    g_stockManager = manager;
+    g_editId = itemId;
+    g_hMainWindow = parent;
+    
+    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_ADD_ITEM), parent, AddEditItemDialogProc);
+}
+
+INT_PTR CALLBACK AddEditItemDialogProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    (void)lParam; // Suppress unused parameter warning
+    
+    switch (message)
+    {
+        case WM_INITDIALOG:
+        {
+            // Set dialog title
+            SetWindowText(hDlg, g_editId > 0 ? L"✏️ Edit Product" : L"➕ Add New Product");
+            
+            // Apply modern theme to dialog
+            ApplyThemeToDialog(hDlg, &g_theme);
+            
+            // Update static text labels with emojis
+            HWND hNameLabel = GetDlgItem(hDlg, IDC_STATIC_NAME);
+            HWND hCategoryLabel = GetDlgItem(hDlg, IDC_STATIC_CATEGORY);
+            HWND hStockLabel = GetDlgItem(hDlg, IDC_STATIC_STOCK);
+            
+            if (hNameLabel) SetWindowText(hNameLabel, L"📦 Product Name:");
+            if (hCategoryLabel) SetWindowText(hCategoryLabel, L"🏷️ Category:");
+            if (hStockLabel) SetWindowText(hStockLabel, L"📊 Quantity:");
+            
+            // Apply theme to dialog buttons
+            HWND hOkBtn = GetDlgItem(hDlg, IDOK);
+            HWND hCancelBtn = GetDlgItem(hDlg, IDCANCEL);
+            
+            if (hOkBtn) {
+                SetWindowText(hOkBtn, g_editId > 0 ? L"💾 Update" : L"➕ Add");
+                ApplyThemeToButton(hOkBtn, BUTTON_TYPE_PRIMARY, &g_theme);
+            }
+            if (hCancelBtn) {
+                SetWindowText(hCancelBtn, L"❌ Cancel");
+                ApplyThemeToButton(hCancelBtn, BUTTON_TYPE_SECONDARY, &g_theme);
+            }
+            
+            // If in edit mode, fill existing values
+            int index = g_editId > 0 ? FindStockItemById(g_stockManager, g_editId) : -1;
+            StockDisplayText text;
+            if (index >= 0 && GetStockDisplayText(g_stockManager, index, &text))
+            {
+                // StockWideChar is UTF-16, the same units as wchar_t here
+                SetDlgItemText(hDlg, IDC_EDIT_NAME, (LPCWSTR)text.name);
+                SetDlgItemText(hDlg, IDC_EDIT_CATEGORY, (LPCWSTR)text.category);
+                SetDlgItemText(hDlg, IDC_EDIT_STOCK, (LPCWSTR)text.quantity);
+            }
+            
+            return TRUE;
+        }
+        
+        case WM_COMMAND:
+            switch (LOWORD(wParam))
+            {
+                case IDOK:
+                {
+                    if (g_stockManager == NULL)
+                    {
+                        EndDialog(hDlg, IDCANCEL);
+                        return TRUE;
+                    }
+                    
+                    // Get form data
+                    wchar_t wname[MAX_NAME_LENGTH];
+                    wchar_t wcategory[MAX_CATEGORY_LENGTH];
+                    wchar_t wstockStr[32];
+                    
+                    GetDlgItemText(hDlg, IDC_EDIT_NAME, wname, MAX_NAME_LENGTH);
+                    GetDlgItemText(hDlg, IDC_EDIT_CATEGORY, wcategory, MAX_CATEGORY_LENGTH);
+                    GetDlgItemText(hDlg, IDC_EDIT_STOCK, wstockStr, 32);
+                    
+                    // Convert wide strings to UTF-8
+                    char name[MAX_NAME_LENGTH];
+                    char category[MAX_CATEGORY_LENGTH];
+                    char stockStr[32];
+                    
+                    WideCharToMultiByte(CP_UTF8, 0, wname, -1, name, MAX_NAME_LENGTH, NULL, NULL);
+                    WideCharToMultiByte(CP_UTF8, 0, wcategory, -1, category, MAX_CATEGORY_LENGTH, NULL, NULL);
+                    WideCharToMultiByte(CP_UTF8, 0, wstockStr, -1, stockStr, 32, NULL, NULL);
+                    
+                    int stock = atoi(stockStr);
+                    
+                    // Validation
+                    if (strlen(name) == 0)
+                    {
+                        ThemedMessageBox(hDlg, L"❌ Product name cannot be empty!", L"Error", MB_OK | MB_ICONERROR);
+                        return TRUE;
+                    }
+                    
+                    if (stock < 0)
+                    {
+                        ThemedMessageBox(hDlg, L"❌ Quantity cannot be negative!", L"Error", MB_OK | MB_ICONERROR);
+                        return TRUE;
+                    }
+                    
+                    // Add or update product
+                    if (g_editId > 0)
+                    {
+                        // Update
+                        if (UpdateStockItemById(g_stockManager, g_editId, name, category, stock))
+                        {
+                            EndDialog(hDlg, IDOK);
+                        }
+                        else
+                        {
+                            ThemedMessageBox(hDlg, L"❌ Error updating product!", L"Error", MB_OK | MB_ICONERROR);
+                        }
+                    }
+                    else
+                    {
+                        // Add
+                        if (AddStockItem(g_stockManager, name, category, stock))
+                        {
+                            EndDialog(hDlg, IDOK);
+                        }
+                        else
+                        {
+                            ThemedMessageBox(hDlg, L"❌ Error adding product!", L"Error", MB_OK | MB_ICONERROR);
+                        }
+                    }
+                    
+                    return TRUE;
+                }
+                
+                case IDCANCEL:
+                    EndDialog(hDlg, IDCANCEL);
+                    return TRUE;
+            }
+            break;
+    }
+    
+    return FALSE;
+}
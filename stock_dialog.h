@@ -0,0 +1,24 @@
+#ifndef STOCK_DIALOG_H
+#define STOCK_DIALOG_H
+
+// MinGW-w64 UTF-8 support
+#ifdef __MINGW32__
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+#endif
+
+#include <windows.h>
+#include "stock.h"
+
+// Helper functions for dialog operations
+INT_PTR CALLBACK AddEditItemDialogProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam);
+void ShowAddItemDialog(HWND parent, StockManager* manager);
+void ShowEditItemDialog(HWND parent, StockManager* manager, int itemId);
+
+// Global variables (for dialog operations)
+extern StockManager* g_stockManager;
+extern int g_editId;
+extern HWND g_hMainWindow;
+
+#endif // STOCK_DIALOG_H
@@ -0,0 +1,326 @@
+#include "stock_internal.h"
+#include "stock_display.h"
+
+// Display strings for the UI. Each entry holds one item's name, category and
+// quantity already converted to UTF-16, so redrawing a row or opening the edit
+// dialog copies strings instead of converting them again. Entries are found by
+// item id through a chained hash table and reused in least-recently-used order;
+// edits that change a shown field send the item's entry to the reuse end.
+// Conversion is plain C so the cache behaves the same on every platform.
+
+#define DISPLAY_QUANTITY_LENGTH 12
+
+typedef struct {
+    int id;                 // Item shown, or 0 while unused
+    int hashNext;           // Next entry in the same bucket, or -1
+    int newer;              // Recency list neighbours, -1 at either end
+    int older;
+    StockWideChar name[MAX_NAME_LENGTH];    // UTF-16 never needs more units than UTF-8 bytes
+    StockWideChar category[MAX_CATEGORY_LENGTH];
+    StockWideChar quantity[DISPLAY_QUANTITY_LENGTH];
+} StockDisplayEntry;
+
+struct StockDisplayCache {
+    StockDisplayEntry* entries;
+    int capacity;
+    int* buckets;           // First entry per bucket, or -1
+    unsigned bucketMask;    // Bucket count - 1 (a power of two)
+    int newest;
+    int oldest;             // Reused next
+    StockDisplayStats stats;
+};
+
+// Decode one UTF-8 sequence; malformed input yields U+FFFD and consumes one byte
+static unsigned DecodeUTF8(const unsigned char** cursor)
+{
+    const unsigned char* bytes = *cursor;
+    unsigned lead = bytes[0];
+    unsigned codePoint;
+    int extra;
+    
+    if (lead < 0x80)
+    {
+        *cursor += 1;
+        return lead;
+    }
+    if (lead >= 0xC2 && lead < 0xE0)
+    {
+        codePoint = lead & 0x1F;
+        extra = 1;
+    }
+    else if (lead >= 0xE0 && lead < 0xF0)
+    {
+        codePoint = lead & 0x0F;
+        extra = 2;
+    }
+    else if (lead >= 0xF0 && lead < 0xF5)
+    {
+        codePoint = lead & 0x07;
+        extra = 3;
+    }
+    else
+    {
+        *cursor += 1;
+        return 0xFFFD;
+    }
+    
+    for (int i = 1; i <= extra; i++)
+    {
+        if ((bytes[i] & 0xC0) != 0x80)
+        {
+            *cursor += 1;
+            return 0xFFFD;
+        }
+        codePoint = (codePoint << 6) | (bytes[i] & 0x3F);
+    }
+    
+    // Overlong forms, surrogates and values past U+10FFFF are not characters
+    static const unsigned minimum[4] = { 0, 0x80, 0x800, 0x10000 };
+    if (codePoint < minimum[extra] || (codePoint >= 0xD800 && codePoint < 0xE000) || codePoint > 0x10FFFF)
+    {
+        *cursor += 1;
+        return 0xFFFD;
+    }
+    
+    *cursor += 1 + extra;
+    return codePoint;
+}
+
+size_t WidenStockText(const char* text, StockWideChar* wide, size_t wideSize)
+{
+    if (wide == NULL || wideSize == 0) return 0;
+    
+    const unsigned char* cursor = (const unsigned char*)(text != NULL ? text : "");
+    size_t length = 0;
+    
+    while (*cursor != '\0')
+    {
+        const unsigned char* start = cursor;
+        unsigned codePoint = DecodeUTF8(&cursor);
+        size_t units = codePoint >= 0x10000 ? 2 : 1;
+        
+        if (length + units >= wideSize)
+        {
+            cursor = start;
+            break;
+        }
+        
+        if (units == 2)
+        {
+            codePoint -= 0x10000;
+            wide[length++] = (StockWideChar)(0xD800 | (codePoint >> 10));
+            wide[length++] = (StockWideChar)(0xDC00 | (codePoint & 0x3FF));
+        }
+        else
+        {
+            wide[length++] = (StockWideChar)codePoint;
+        }
+    }
+    
+    wide[length] = 0;
+    return length;
+}
+
+static unsigned DisplayBucket(const struct StockDisplayCache* cache, int id)
+{
+    return ((unsigned)id * 2654435761u >> 7) & cache->bucketMask;
+}
+
+static void UnlinkRecency(struct StockDisplayCache* cache, int entry)
+{
+    StockDisplayEntry* e = &cache->entries[entry];
+    
+    if (e->newer >= 0) cache->entries[e->newer].older = e->older;
+    else cache->newest = e->older;
+    if (e->older >= 0) cache->entries[e->older].newer = e->newer;
+    else cache->oldest = e->newer;
+}
+
+static void MakeNewest(struct StockDisplayCache* cache, int entry)
+{
+    if (cache->newest == entry) return;
+    
+    UnlinkRecency(cache, entry);
+    cache->entries[entry].newer = -1;
+    cache->entries[entry].older = cache->newest;
+    cache->entries[cache->newest].newer = entry;
+    cache->newest = entry;
+}
+
+static void MakeOldest(struct StockDisplayCache* cache, int entry)
+{
+    if (cache->oldest == entry) return;
+    
+    UnlinkRecency(cache, entry);
+    cache->entries[entry].older = -1;
+    cache->entries[entry].newer = cache->oldest;
+    cache->entries[cache->oldest].older = entry;
+    cache->oldest = entry;
+}
+
+static int FindDisplayEntry(const struct StockDisplayCache* cache, int id)
+{
+    int entry = cache->buckets[DisplayBucket(cache, id)];
+    
+    while (entry >= 0 && cache->entries[entry].id != id)
+    {
+        entry = cache->entries[entry].hashNext;
+    }
+    
+    return entry;
+}
+
+// Take an entry out of its bucket and mark it unused
+static void ReleaseDisplayEntry(struct StockDisplayCache* cache, int entry)
+{
+    int* link = &cache->buckets[DisplayBucket(cache, cache->entries[entry].id)];
+    
+    while (*link != entry) link = &cache->entries[*link].hashNext;
+    *link = cache->entries[entry].hashNext;
+    cache->entries[entry].id = 0;
+}
+
+// Empty entries in one recency list, all buckets empty
+static int AllocateDisplayEntries(struct StockDisplayCache* cache, int capacity)
+{
+    unsigned bucketCount = 1;
+    while (bucketCount < (unsigned)capacity * 2) bucketCount *= 2;
+    
+    StockDisplayEntry* entries = (StockDisplayEntry*)malloc(capacity * sizeof(StockDisplayEntry));
+    int* buckets = (int*)malloc(bucketCount * sizeof(int));
+    if (entries == NULL || buckets == NULL)
+    {
+        free(entries);
+        free(buckets);
+        return 0;
+    }
+    
+    for (int i = 0; i < capacity; i++)
+    {
+        entries[i].id = 0;
+        entries[i].hashNext = -1;
+        entries[i].newer = i > 0 ? i - 1 : -1;
+        entries[i].older = i + 1 < capacity ? i + 1 : -1;
+    }
+    for (unsigned i = 0; i < bucketCount; i++) buckets[i] = -1;
+    
+    free(cache->entries);
+    free(cache->buckets);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    cache->buckets = buckets;
+    cache->bucketMask = bucketCount - 1;
+    cache->newest = 0;
+    cache->oldest = capacity - 1;
+    return 1;
+}
+
+int SetStockDisplayCacheSize(StockManager* manager, int entries)
+{
+    if (manager == NULL || entries < 1) return 0;
+    
+    if (manager->display == NULL)
+    {
+        manager->display = (struct StockDisplayCache*)calloc(1, sizeof(struct StockDisplayCache));
+        if (manager->display == NULL) return 0;
+    }
+    
+    return AllocateDisplayEntries(manager->display, entries);
+}
+
+static void FillDisplayEntry(StockManager* manager, StockDisplayEntry* entry, const StockItem* item)
+{
+    char quantity[DISPLAY_QUANTITY_LENGTH];
+    snprintf(quantity, sizeof(quantity), "%d", item->stock);
+    
+    WidenStockText(item->name, entry->name, MAX_NAME_LENGTH);
+    WidenStockText(GetStockItemCategory(manager, item), entry->category, MAX_CATEGORY_LENGTH);
+    WidenStockText(quantity, entry->quantity, DISPLAY_QUANTITY_LENGTH);
+    manager->display->stats.conversions += 3;
+}
+
+int GetStockDisplayText(StockManager* manager, int index, StockDisplayText* text)
+{
+    if (text == NULL) return 0;
+    
+    StockItem* item = GetStockItem(manager, index);
+    if (item == NULL) return 0;
+    if (manager->display == NULL && !SetStockDisplayCacheSize(manager, STOCK_DISPLAY_CACHE_DEFAULT)) return 0;
+    
+    struct StockDisplayCache* cache = manager->display;
+    int entry = FindDisplayEntry(cache, item->id);
+    
+    if (entry >= 0)
+    {
+        cache->stats.hits++;
+    }
+    else
+    {
+        cache->stats.misses++;
+        
+        entry = cache->oldest;
+        if (cache->entries[entry].id != 0)
+        {
+            ReleaseDisplayEntry(cache, entry);
+            cache->stats.evictions++;
+        }
+        
+        StockDisplayEntry* e = &cache->entries[entry];
+        FillDisplayEntry(manager, e, item);
+        e->id = item->id;
+        
+        unsigned bucket = DisplayBucket(cache, item->id);
+        e->hashNext = cache->buckets[bucket];
+        cache->buckets[bucket] = entry;
+    }
+    MakeNewest(cache, entry);
+    
+    const StockDisplayEntry* e = &cache->entries[entry];
+    text->name = e->name;
+    text->category = e->category;
+    text->quantity = e->quantity;
+    return 1;
+}
+
+void GetStockDisplayStats(const StockManager* manager, StockDisplayStats* stats)
+{
+    if (stats == NULL) return;
+    
+    if (manager == NULL || manager->display == NULL)
+        memset(stats, 0, sizeof(StockDisplayStats));
+    else
+        *stats = manager->display->stats;
+}
+
+void ForgetStockDisplay(StockManager* manager, int id)
+{
+    struct StockDisplayCache* cache = manager->display;
+    if (cache == NULL) return;
+    
+    int entry = FindDisplayEntry(cache, id);
+    if (entry < 0) return;
+    
+    ReleaseDisplayEntry(cache, entry);
+    MakeOldest(cache, entry);
+    cache->stats.invalidations++;
+}
+
+void ClearStockDisplay(StockManager* manager)
+{
+    struct StockDisplayCache* cache = manager->display;
+    if (cache == NULL) return;
+    
+    for (int i = 0; i < cache->capacity; i++) cache->entries[i].id = 0;
+    for (unsigned i = 0; i <= cache->bucketMask; i++) cache->buckets[i] = -1;
+}
+
+void FreeStockDisplay(StockManager* manager)
+{
+    struct StockDisplayCache* cache = manager->display;
+    if (cache == NULL) return;
+    
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache);
+    manager->display = NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef STOCK_DISPLAY_H
+#define STOCK_DISPLAY_H
+
+#include "stock.h"
+
+// Internal hooks that keep the display string cache in step with the items.
+// Until the first lookup there is no cache and the hooks do nothing.
+void ForgetStockDisplay(StockManager* manager, int id);    // A shown field of the item changed
+void ClearStockDisplay(StockManager* manager);             // Every item may have changed
+void FreeStockDisplay(StockManager* manager);
+
+#endif // STOCK_DISPLAY_H
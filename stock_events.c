@@ -0,0 +1,277 @@
+#include "stock_internal.h"
+#include "stock_events.h"
+
+// Change notifications. Outside a batch each change goes straight to the
+// subscribers. Inside one, changes collect in a pending list with one entry per
+// item id, found through an open-addressing table, and each new change is
+// folded into the item's entry; the outermost EndStockBatch hands the surviving
+// entries over in first-change order.
+
+typedef struct {
+    StockChangeListener listener;   // NULL once unsubscribed
+    void* context;
+} StockSubscriber;
+
+struct StockEventHub {
+    StockSubscriber* subscribers;
+    int subscriberCount;
+    int subscriberCapacity;
+    int listening;          // Subscribers still registered
+    int batchDepth;
+    int reloaded;           // A reload in this batch covers every other change
+    StockChange* pending;
+    int pendingCount;
+    int pendingCapacity;
+    int* slots;             // Pending position + 1 per slot, 0 when empty
+    unsigned slotMask;
+};
+
+#define EVENT_SLOTS_KEPT 4096   // Larger tables are released after a batch
+
+static struct StockEventHub* RequireEventHub(StockManager* manager)
+{
+    if (manager->events == NULL)
+        manager->events = (struct StockEventHub*)calloc(1, sizeof(struct StockEventHub));
+    
+    return manager->events;
+}
+
+int SubscribeStockChanges(StockManager* manager, StockChangeListener listener, void* context)
+{
+    if (manager == NULL || listener == NULL) return 0;
+    
+    struct StockEventHub* hub = RequireEventHub(manager);
+    if (hub == NULL) return 0;
+    
+    // Reuse a slot left by an earlier subscriber
+    int slot = 0;
+    while (slot < hub->subscriberCount && hub->subscribers[slot].listener != NULL) slot++;
+    
+    if (slot == hub->subscriberCount)
+    {
+        if (hub->subscriberCount == hub->subscriberCapacity)
+        {
+            int capacity = hub->subscriberCapacity > 0 ? hub->subscriberCapacity * 2 : 4;
+            StockSubscriber* subscribers = (StockSubscriber*)realloc(hub->subscribers, capacity * sizeof(StockSubscriber));
+            if (subscribers == NULL) return 0;
+            
+            hub->subscribers = subscribers;
+            hub->subscriberCapacity = capacity;
+        }
+        hub->subscriberCount++;
+    }
+    
+    hub->subscribers[slot].listener = listener;
+    hub->subscribers[slot].context = context;
+    hub->listening++;
+    return slot + 1;
+}
+
+void UnsubscribeStockChanges(StockManager* manager, int handle)
+{
+    if (manager == NULL || manager->events == NULL) return;
+    
+    struct StockEventHub* hub = manager->events;
+    if (handle < 1 || handle > hub->subscriberCount || hub->subscribers[handle - 1].listener == NULL) return;
+    
+    hub->subscribers[handle - 1].listener = NULL;
+    hub->listening--;
+}
+
+static void DeliverStockChanges(StockManager* manager, const StockChange* changes, int count)
+{
+    struct StockEventHub* hub = manager->events;
+    
+    // Re-read the count: a listener may subscribe or unsubscribe others
+    for (int i = 0; i < hub->subscriberCount; i++)
+    {
+        StockSubscriber subscriber = hub->subscribers[i];
+        if (subscriber.listener != NULL) subscriber.listener(manager, changes, count, subscriber.context);
+    }
+}
+
+static unsigned EventSlot(const struct StockEventHub* hub, int id)
+{
+    return ((unsigned)id * 2654435761u >> 5) & hub->slotMask;
+}
+
+static int GrowEventSlots(struct StockEventHub* hub)
+{
+    unsigned count = hub->slots != NULL ? (hub->slotMask + 1) * 2 : 64;
+    int* slots = (int*)calloc(count, sizeof(int));
+    if (slots == NULL) return 0;
+    
+    free(hub->slots);
+    hub->slots = slots;
+    hub->slotMask = count - 1;
+    
+    for (int i = 0; i < hub->pendingCount; i++)
+    {
+        unsigned slot = EventSlot(hub, hub->pending[i].id);
+        while (slots[slot] != 0) slot = (slot + 1) & hub->slotMask;
+        slots[slot] = i + 1;
+    }
+    return 1;
+}
+
+// Pending entry of an item, appended (as kind 0) when it has none yet
+static StockChange* PendingChange(struct StockEventHub* hub, int id)
+{
+    if (hub->slots == NULL || (unsigned)hub->pendingCount * 2 >= hub->slotMask + 1)
+    {
+        if (!GrowEventSlots(hub)) return NULL;
+    }
+    
+    unsigned slot = EventSlot(hub, id);
+    while (hub->slots[slot] != 0)
+    {
+        StockChange* change = &hub->pending[hub->slots[slot] - 1];
+        if (change->id == id) return change;
+        slot = (slot + 1) & hub->slotMask;
+    }
+    
+    if (hub->pendingCount == hub->pendingCapacity)
+    {
+        int capacity = hub->pendingCapacity > 0 ? hub->pendingCapacity * 2 : 64;
+        StockChange* pending = (StockChange*)realloc(hub->pending, capacity * sizeof(StockChange));
+        if (pending == NULL) return NULL;
+        
+        hub->pending = pending;
+        hub->pendingCapacity = capacity;
+    }
+    
+    StockChange* change = &hub->pending[hub->pendingCount++];
+    change->kind = 0;
+    change->id = id;
+    change->index = -1;
+    change->fields = 0;
+    hub->slots[slot] = hub->pendingCount;
+    return change;
+}
+
+// Fold a new change into what the batch already holds for the item
+static void CoalesceStockChange(struct StockEventHub* hub, int kind, int id, int index, unsigned fields)
+{
+    if (hub->reloaded) return;
+    
+    if (kind == STOCK_CHANGE_RELOADED)
+    {
+        hub->reloaded = 1;
+        return;
+    }
+    
+    StockChange* change = PendingChange(hub, id);
+    if (change == NULL)
+    {
+        // Out of memory: fall back to the change that covers everything
+        hub->reloaded = 1;
+        return;
+    }
+    
+    change->index = index;
+    switch (kind)
+    {
+        case STOCK_CHANGE_INSERTED:
+            // Removed and inserted again under the same id: every field may differ
+            change->kind = change->kind == STOCK_CHANGE_REMOVED ? STOCK_CHANGE_UPDATED : STOCK_CHANGE_INSERTED;
+            change->fields = STOCK_FIELD_ALL;
+            break;
+        
+        case STOCK_CHANGE_UPDATED:
+            if (change->kind == 0) change->kind = STOCK_CHANGE_UPDATED;
+            change->fields |= fields;
+            break;
+        
+        case STOCK_CHANGE_REMOVED:
+            // An item inserted in this batch was never seen by the subscribers
+            change->kind = change->kind == STOCK_CHANGE_INSERTED ? 0 : STOCK_CHANGE_REMOVED;
+            change->fields = change->kind != 0 ? STOCK_FIELD_ALL : 0;
+            break;
+    }
+}
+
+void PublishStockChange(StockManager* manager, int kind, int id, int index, unsigned fields)
+{
+    struct StockEventHub* hub = manager->events;
+    if (hub == NULL || hub->listening == 0) return;
+    
+    if (hub->batchDepth > 0)
+    {
+        CoalesceStockChange(hub, kind, id, index, fields);
+        return;
+    }
+    
+    StockChange change;
+    change.kind = kind;
+    change.id = id;
+    change.index = index;
+    change.fields = fields;
+    DeliverStockChanges(manager, &change, 1);
+}
+
+void BeginStockBatch(StockManager* manager)
+{
+    if (manager == NULL) return;
+    
+    struct StockEventHub* hub = RequireEventHub(manager);
+    if (hub != NULL) hub->batchDepth++;
+}
+
+void EndStockBatch(StockManager* manager)
+{
+    if (manager == NULL || manager->events == NULL || manager->events->batchDepth == 0) return;
+    
+    struct StockEventHub* hub = manager->events;
+    if (--hub->batchDepth > 0) return;
+    
+    // Take the batch over, so listeners that edit the inventory start a new one
+    StockChange* changes = hub->pending;
+    int count = 0;
+    int reloaded = hub->reloaded;
+    
+    for (int i = 0; i < hub->pendingCount && !reloaded; i++)
+    {
+        if (hub->pending[i].kind != 0) changes[count++] = hub->pending[i];
+    }
+    
+    hub->pending = NULL;
+    hub->pendingCount = 0;
+    hub->pendingCapacity = 0;
+    hub->reloaded = 0;
+    if (hub->slots != NULL && hub->slotMask + 1 > EVENT_SLOTS_KEPT)
+    {
+        free(hub->slots);
+        hub->slots = NULL;
+    }
+    else if (hub->slots != NULL)
+    {
+        memset(hub->slots, 0, (hub->slotMask + 1) * sizeof(int));
+    }
+    
+    if (reloaded)
+    {
+        StockChange reload;
+        reload.kind = STOCK_CHANGE_RELOADED;
+        reload.id = 0;
+        reload.index = -1;
+        reload.fields = STOCK_FIELD_ALL;
+        DeliverStockChanges(manager, &reload, 1);
+    }
+    else if (count > 0)
+    {
+        DeliverStockChanges(manager, changes, count);
+    }
+    free(changes);
+}
+
+void FreeStockEvents(StockManager* manager)
+{
+    struct StockEventHub* hub = manager->events;
+    if (hub == NULL) return;
+    
+    free(hub->subscribers);
+    free(hub->pending);
+    free(hub->slots);
+    free(hub);
+    manager->events = NULL;
+}
@@ -0,0 +1,11 @@
+#ifndef STOCK_EVENTS_H
+#define STOCK_EVENTS_H
+
+#include "stock.h"
+
+// Internal side of the change notifications: mutators publish each change
+// after it is complete. Without subscribers publishing costs one check.
+void PublishStockChange(StockManager* manager, int kind, int id, int index, unsigned fields);
+void FreeStockEvents(StockManager* manager);
+
+#endif // STOCK_EVENTS_H
@@ -0,0 +1,242 @@
+#include "stock_internal.h"
+
+// CSV and JSON Lines export. Rows are formatted straight into one fixed buffer
+// that is written out whenever less than a worst-case row is left, so memory
+// stays constant however many items are exported.
+
+#define EXPORT_ROW_MAX 4096     // Worst case: every name and category byte escaped as \u00XX
+
+struct StockExporter {
+    FILE* file;
+    int format;
+    int failed;
+    size_t used;
+    char buffer[STOCK_EXPORT_BUFFER_SIZE];
+};
+
+static const char g_digitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static void FlushExport(struct StockExporter* exporter)
+{
+    if (exporter->used > 0 && fwrite(exporter->buffer, 1, exporter->used, exporter->file) != exporter->used)
+        exporter->failed = 1;
+    
+    exporter->used = 0;
+}
+
+static inline void PutExportText(struct StockExporter* exporter, const char* text, size_t length)
+{
+    memcpy(exporter->buffer + exporter->used, text, length);
+    exporter->used += length;
+}
+
+// Decimal digits two at a time, written back to front
+static void PutExportInt(struct StockExporter* exporter, int value)
+{
+    char digits[12];
+    char* end = digits + sizeof(digits);
+    char* cursor = end;
+    unsigned number = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    
+    while (number >= 100)
+    {
+        unsigned pair = (number % 100) * 2;
+        number /= 100;
+        *--cursor = g_digitPairs[pair + 1];
+        *--cursor = g_digitPairs[pair];
+    }
+    if (number >= 10)
+    {
+        *--cursor = g_digitPairs[number * 2 + 1];
+        *--cursor = g_digitPairs[number * 2];
+    }
+    else
+    {
+        *--cursor = (char)('0' + number);
+    }
+    if (value < 0) *--cursor = '-';
+    
+    PutExportText(exporter, cursor, (size_t)(end - cursor));
+}
+
+// Quoted only when needed: delimiters, quotes, line breaks or edge spaces
+static void PutCsvField(struct StockExporter* exporter, const char* text)
+{
+    size_t length = strlen(text);
+    int quote = length > 0 && (text[0] == ' ' || text[0] == '\t' || text[length - 1] == ' ' || text[length - 1] == '\t');
+    
+    for (size_t i = 0; i < length && !quote; i++)
+    {
+        char c = text[i];
+        quote = c == ',' || c == '"' || c == '\n' || c == '\r';
+    }
+    
+    if (!quote)
+    {
+        PutExportText(exporter, text, length);
+        return;
+    }
+    
+    char* out = exporter->buffer + exporter->used;
+    *out++ = '"';
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] == '"') *out++ = '"';
+        *out++ = text[i];
+    }
+    *out++ = '"';
+    exporter->used = (size_t)(out - exporter->buffer);
+}
+
+// JSON string body: quotes, backslashes and control characters escaped, UTF-8
+// passed through (or U+FFFD per byte if the text is not valid UTF-8)
+static void PutJsonString(struct StockExporter* exporter, const char* text)
+{
+    static const char hex[] = "0123456789abcdef";
+    int valid = IsValidUTF8(text);
+    char* out = exporter->buffer + exporter->used;
+    
+    *out++ = '"';
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            *out++ = '\\';
+            *out++ = (char)*c;
+        }
+        else if (*c < 0x20)
+        {
+            *out++ = '\\';
+            switch (*c)
+            {
+                case '\n': *out++ = 'n'; break;
+                case '\r': *out++ = 'r'; break;
+                case '\t': *out++ = 't'; break;
+                case '\b': *out++ = 'b'; break;
+                case '\f': *out++ = 'f'; break;
+                default:
+                    memcpy(out, "u00", 3);
+                    out += 3;
+                    *out++ = hex[*c >> 4];
+                    *out++ = hex[*c & 15];
+                    break;
+            }
+        }
+        else if (*c >= 0x80 && !valid)
+        {
+            memcpy(out, "\\ufffd", 6);
+            out += 6;
+        }
+        else
+        {
+            *out++ = (char)*c;
+        }
+    }
+    *out++ = '"';
+    exporter->used = (size_t)(out - exporter->buffer);
+}
+
+struct StockExporter* OpenStockExport(const char* filename, int format)
+{
+    if (filename == NULL || (format != STOCK_EXPORT_CSV && format != STOCK_EXPORT_JSONL)) return NULL;
+    
+    struct StockExporter* exporter = (struct StockExporter*)malloc(sizeof(struct StockExporter));
+    if (exporter == NULL) return NULL;
+    
+    exporter->file = fopen(filename, "wb");
+    if (exporter->file == NULL)
+    {
+        free(exporter);
+        return NULL;
+    }
+    
+    exporter->format = format;
+    exporter->failed = 0;
+    exporter->used = 0;
+    if (format == STOCK_EXPORT_CSV)
+    {
+        static const char header[] = "id,name,quantity,category,reorder level\n";
+        PutExportText(exporter, header, sizeof(header) - 1);
+    }
+    return exporter;
+}
+
+int ExportStockItem(struct StockExporter* exporter, const StockManager* manager, const StockItem* item)
+{
+    if (exporter == NULL || manager == NULL || item == NULL) return 0;
+    
+    if (exporter->used > STOCK_EXPORT_BUFFER_SIZE - EXPORT_ROW_MAX) FlushExport(exporter);
+    if (exporter->failed) return 0;
+    
+    const char* category = GetStockItemCategory(manager, item);
+    
+    if (exporter->format == STOCK_EXPORT_CSV)
+    {
+        PutExportInt(exporter, item->id);
+        exporter->buffer[exporter->used++] = ',';
+        PutCsvField(exporter, item->name);
+        exporter->buffer[exporter->used++] = ',';
+        PutExportInt(exporter, item->stock);
+        exporter->buffer[exporter->used++] = ',';
+        PutCsvField(exporter, category);
+        exporter->buffer[exporter->used++] = ',';
+        PutExportInt(exporter, item->reorderLevel);
+        exporter->buffer[exporter->used++] = '\n';
+    }
+    else
+    {
+        PutExportText(exporter, "{\"id\":", 6);
+        PutExportInt(exporter, item->id);
+        PutExportText(exporter, ",\"name\":", 8);
+        PutJsonString(exporter, item->name);
+        PutExportText(exporter, ",\"quantity\":", 12);
+        PutExportInt(exporter, item->stock);
+        PutExportText(exporter, ",\"category\":", 12);
+        PutJsonString(exporter, category);
+        PutExportText(exporter, ",\"reorderLevel\":", 16);
+        PutExportInt(exporter, item->reorderLevel);
+        PutExportText(exporter, "}\n", 2);
+    }
+    return 1;
+}
+
+int ExportStockItemVisitor(StockManager* manager, int index, void* exporter)
+{
+    return ExportStockItem((struct StockExporter*)exporter, manager, GetStockItem(manager, index));
+}
+
+int CloseStockExport(struct StockExporter* exporter)
+{
+    if (exporter == NULL) return 0;
+    
+    FlushExport(exporter);
+    if (fclose(exporter->file) != 0) exporter->failed = 1;
+    
+    int result = !exporter->failed;
+    free(exporter);
+    return result;
+}
+
+int ExportStockToFile(StockManager* manager, const char* filename, int format, const int* indices, int count)
+{
+    if (manager == NULL) return 0;
+    
+    struct StockExporter* exporter = OpenStockExport(filename, format);
+    if (exporter == NULL) return 0;
+    
+    int written = 1;
+    int total = indices != NULL ? count : manager->itemCount;
+    
+    for (int i = 0; i < total && written; i++)
+    {
+        written = ExportStockItemVisitor(manager, indices != NULL ? indices[i] : i, exporter);
+    }
+    
+    // A report cut short is worse than none
+    int result = CloseStockExport(exporter) && written;
+    if (!result) remove(filename);
+    return result;
+}
@@ -0,0 +1,927 @@
+#include "stock_internal.h"
+#include "stock_category.h"
+#include "stock_sort.h"
+#include "stock_platform.h"
+
+// On-disk formats
+//
+// v1 (legacy, fixed-size records):
+//   int itemCount, int nextId
+//   per item: int id, char name[256], char category[128], int stock
+//   (no reorder levels: they load as 0)
+//
+// v2 (compact):
+//   "HSMD", u16 version, u16 flags (little endian)
+//   varint itemCount, varint nextId, varint categoryCount
+//   category table: varint length + UTF-8 bytes, per category
+//   per item: zigzag varint id delta, varint name length + UTF-8 bytes,
+//             varint category table index, varint stock,
+//             varint reorder level (only with STOCK_FILE_FLAG_REORDER)
+//   optional record index (read by LoadStockFromFileMapped, ignored otherwise):
+//     u64 records start, u32 itemCount, u32 categoryCount
+//     per item: u32 record offset (from records start), u32 id, u32 category table index
+//     footer: u64 record index offset, u32 index version, "HSMX"
+//
+// v1 files start with a non-negative item count, which can never spell the
+// v2 magic for any realistic inventory, so the loader tells them apart by
+// the first four bytes.
+
+#define STOCK_FILE_MAGIC "HSMD"
+#define STOCK_FILE_HEADER_SIZE 8
+#define STOCK_FILE_FLAG_REORDER 0x0001     // Records carry a reorder level; written only when one is set
+#define STOCK_FILE_KNOWN_FLAGS STOCK_FILE_FLAG_REORDER
+#define STOCK_FILE_BUFFER_SIZE 65536
+#define V1_RECORD_SIZE (sizeof(int) + MAX_NAME_LENGTH + MAX_CATEGORY_LENGTH + sizeof(int))
+#define STOCK_TEMP_SUFFIX ".tmp"
+#define STOCK_INCREMENTAL_MAX_SHARE 16     // Rewrite v1 files with more than 1/16 of the records changed
+#define STOCK_INDEX_MAGIC "HSMX"
+#define STOCK_INDEX_VERSION 1
+#define STOCK_INDEX_HEADER_SIZE 16
+#define STOCK_INDEX_ENTRY_SIZE 12
+#define STOCK_INDEX_FOOTER_SIZE 16
+
+// Data file mapped by LoadStockFromFileMapped; items are decoded from it on demand
+struct StockMapping {
+    StockFileView view;
+    const unsigned char* records;       // First item record
+    size_t recordsLength;
+    const unsigned char* entries;       // Record index, STOCK_INDEX_ENTRY_SIZE bytes per item
+    int* codes;                         // Category code per file table index
+    unsigned tableCount;
+    unsigned flags;                     // STOCK_FILE_FLAG_* from the header
+};
+
+// Buffered writer: one fwrite per STOCK_FILE_BUFFER_SIZE bytes
+typedef struct {
+    FILE* file;
+    size_t length;
+    unsigned long long offset;  // Bytes written so far
+    int failed;
+    unsigned char buffer[STOCK_FILE_BUFFER_SIZE];
+} FileWriter;
+
+// Buffered reader: one fread per STOCK_FILE_BUFFER_SIZE bytes
+typedef struct {
+    FILE* file;
+    size_t position;
+    size_t length;
+    unsigned char buffer[STOCK_FILE_BUFFER_SIZE];
+} FileReader;
+
+// Save-path fault injection (see SetStockFaultHook)
+static StockFaultHook g_faultHook = NULL;
+static void* g_faultContext = NULL;
+
+void SetStockFaultHook(StockFaultHook hook, void* context)
+{
+    g_faultHook = hook;
+    g_faultContext = context;
+}
+
+int InjectStockFault(int point)
+{
+    return g_faultHook != NULL && g_faultHook(point, g_faultContext);
+}
+
+static void FlushWriter(FileWriter* writer)
+{
+    if (writer->length > 0 && !writer->failed)
+    {
+        // An injected fault leaves a torn, half-written buffer behind
+        size_t length = InjectStockFault(STOCK_FAULT_WRITE) ? writer->length / 2 : writer->length;
+        if (fwrite(writer->buffer, 1, length, writer->file) != writer->length) writer->failed = 1;
+    }
+    writer->length = 0;
+}
+
+static void WriteBytes(FileWriter* writer, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    
+    while (size > 0)
+    {
+        if (writer->length == STOCK_FILE_BUFFER_SIZE) FlushWriter(writer);
+        
+        size_t chunk = STOCK_FILE_BUFFER_SIZE - writer->length;
+        if (chunk > size) chunk = size;
+        
+        memcpy(writer->buffer + writer->length, bytes, chunk);
+        writer->length += chunk;
+        writer->offset += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+static void WriteVarint(FileWriter* writer, unsigned value)
+{
+    unsigned char bytes[5];
+    WriteBytes(writer, bytes, EncodeStockVarint(bytes, value));
+}
+
+static void WriteU16(FileWriter* writer, unsigned value)
+{
+    unsigned char bytes[2] = { (unsigned char)(value & 0xFF), (unsigned char)(value >> 8) };
+    WriteBytes(writer, bytes, 2);
+}
+
+static void WriteU32(FileWriter* writer, unsigned value)
+{
+    unsigned char bytes[4];
+    StoreStockU32(bytes, value);
+    WriteBytes(writer, bytes, 4);
+}
+
+static void WriteU64(FileWriter* writer, unsigned long long value)
+{
+    WriteU32(writer, (unsigned)(value & 0xFFFFFFFFu));
+    WriteU32(writer, (unsigned)(value >> 32));
+}
+
+// Map a signed delta onto small unsigned values (0, -1, 1, -2, ...)
+static unsigned ZigZagEncode(int value)
+{
+    return ((unsigned)value << 1) ^ (unsigned)(value >> 31);
+}
+
+static int ZigZagDecode(unsigned value)
+{
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+static size_t ReadBytes(FileReader* reader, void* data, size_t size)
+{
+    unsigned char* bytes = (unsigned char*)data;
+    size_t done = 0;
+    
+    while (done < size)
+    {
+        if (reader->position == reader->length)
+        {
+            reader->length = fread(reader->buffer, 1, STOCK_FILE_BUFFER_SIZE, reader->file);
+            reader->position = 0;
+            if (reader->length == 0) break;
+        }
+        
+        size_t chunk = reader->length - reader->position;
+        if (chunk > size - done) chunk = size - done;
+        
+        if (bytes != NULL) memcpy(bytes + done, reader->buffer + reader->position, chunk);
+        reader->position += chunk;
+        done += chunk;
+    }
+    
+    return done;
+}
+
+static int ReadVarint(FileReader* reader, unsigned* value)
+{
+    unsigned result = 0;
+    
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        unsigned char byte;
+        if (ReadBytes(reader, &byte, 1) != 1) return 0;
+        
+        result |= (unsigned)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return 1;
+        }
+    }
+    
+    return 0; // Over-long encoding
+}
+
+static void WriteV1Record(StockManager* manager, FileWriter* writer, const StockItem* item)
+{
+    // Categories keep their fixed-width, NUL-padded on-disk field
+    char category[MAX_CATEGORY_LENGTH] = {0};
+    strncpy(category, GetStockItemCategory(manager, item), MAX_CATEGORY_LENGTH - 1);
+    
+    WriteBytes(writer, &item->id, sizeof(int));
+    WriteBytes(writer, item->name, MAX_NAME_LENGTH);
+    WriteBytes(writer, category, MAX_CATEGORY_LENGTH);
+    WriteBytes(writer, &item->stock, sizeof(int));
+}
+
+static int SaveStockV1(StockManager* manager, FileWriter* writer)
+{
+    // Write binary header
+    WriteBytes(writer, &manager->itemCount, sizeof(int));
+    WriteBytes(writer, &manager->nextId, sizeof(int));
+    
+    // Write all items in binary format
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        WriteV1Record(manager, writer, StockItemAt(manager, i));
+    }
+    
+    return 1;
+}
+
+static int SaveStockV2(StockManager* manager, FileWriter* writer)
+{
+    StockCategoryDict* dict = &manager->categories;
+    
+    // Number the live categories densely in the file's string table
+    int* tableIndex = (int*)malloc((dict->codeCount > 0 ? dict->codeCount : 1) * sizeof(int));
+    if (tableIndex == NULL) return 0;
+    
+    int tableCount = 0;
+    for (int code = 0; code < dict->codeCount; code++)
+    {
+        tableIndex[code] = dict->entries[code].text != NULL ? tableCount++ : -1;
+    }
+    
+    // Files without reorder levels stay readable by loaders that predate them
+    unsigned flags = 0;
+    for (int i = 0; i < manager->itemCount && flags == 0; i++)
+    {
+        if (StockItemAt(manager, i)->reorderLevel != 0) flags = STOCK_FILE_FLAG_REORDER;
+    }
+    
+    WriteBytes(writer, STOCK_FILE_MAGIC, 4);
+    WriteU16(writer, STOCK_FILE_FORMAT_V2);
+    WriteU16(writer, flags);
+    WriteVarint(writer, (unsigned)manager->itemCount);
+    WriteVarint(writer, (unsigned)manager->nextId);
+    WriteVarint(writer, (unsigned)tableCount);
+    
+    for (int code = 0; code < dict->codeCount; code++)
+    {
+        if (tableIndex[code] < 0) continue;
+        
+        size_t length = strlen(dict->entries[code].text);
+        WriteVarint(writer, (unsigned)length);
+        WriteBytes(writer, dict->entries[code].text, length);
+    }
+    
+    // Record offsets for the trailing index; skipped if the records outgrow 32-bit offsets
+    unsigned* offsets = (unsigned*)malloc((manager->itemCount > 0 ? manager->itemCount : 1) * sizeof(unsigned));
+    unsigned long long recordsStart = writer->offset;
+    
+    int previousId = 0;
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        StockItem* item = StockItemAt(manager, i);
+        size_t nameLength = strlen(item->name);
+        
+        if (offsets != NULL && writer->offset - recordsStart > 0xFFFFFFFFull)
+        {
+            free(offsets);
+            offsets = NULL;
+        }
+        if (offsets != NULL) offsets[i] = (unsigned)(writer->offset - recordsStart);
+        
+        WriteVarint(writer, ZigZagEncode(item->id - previousId));
+        WriteVarint(writer, (unsigned)nameLength);
+        WriteBytes(writer, item->name, nameLength);
+        WriteVarint(writer, (unsigned)tableIndex[item->categoryId]);
+        WriteVarint(writer, (unsigned)item->stock);
+        if (flags & STOCK_FILE_FLAG_REORDER) WriteVarint(writer, (unsigned)item->reorderLevel);
+        
+        previousId = item->id;
+    }
+    
+    if (offsets != NULL)
+    {
+        unsigned long long indexOffset = writer->offset;
+        
+        WriteU64(writer, recordsStart);
+        WriteU32(writer, (unsigned)manager->itemCount);
+        WriteU32(writer, (unsigned)tableCount);
+        for (int i = 0; i < manager->itemCount; i++)
+        {
+            StockItem* item = StockItemAt(manager, i);
+            
+            WriteU32(writer, offsets[i]);
+            WriteU32(writer, (unsigned)item->id);
+            WriteU32(writer, (unsigned)tableIndex[item->categoryId]);
+        }
+        
+        WriteU64(writer, indexOffset);
+        WriteU32(writer, STOCK_INDEX_VERSION);
+        WriteBytes(writer, STOCK_INDEX_MAGIC, 4);
+        free(offsets);
+    }
+    
+    free(tableIndex);
+    return 1;
+}
+
+int SaveStockToFileFormat(StockManager* manager, const char* filename, int format)
+{
+    if (manager == NULL || filename == NULL) return 0;
+    if (format != STOCK_FILE_FORMAT_V1 && format != STOCK_FILE_FORMAT_V2) return 0;
+    
+    // Decode lazily loaded items first; the target may be the mapped file itself
+    if (!EnsureStockResident(manager)) return 0;
+    
+    // Replacing the file invalidates the incremental save bookkeeping for it
+    if (manager->dirty.file != NULL && strcmp(manager->dirty.file, filename) == 0) ResetStockDirty(manager, NULL);
+    
+    // Write a synced temporary file next to the target and rename it over the
+    // target, so a crash at any point leaves either the old or the new file
+    size_t nameLength = strlen(filename);
+    char* temporary = (char*)malloc(nameLength + sizeof(STOCK_TEMP_SUFFIX));
+    FileWriter* writer = (FileWriter*)malloc(sizeof(FileWriter));
+    
+    if (temporary == NULL || writer == NULL)
+    {
+        free(temporary);
+        free(writer);
+        return 0;
+    }
+    memcpy(temporary, filename, nameLength);
+    memcpy(temporary + nameLength, STOCK_TEMP_SUFFIX, sizeof(STOCK_TEMP_SUFFIX));
+    
+    writer->file = InjectStockFault(STOCK_FAULT_OPEN) ? NULL : fopen(temporary, "wb");
+    writer->length = 0;
+    writer->offset = 0;
+    writer->failed = 0;
+    
+    if (writer->file == NULL)
+    {
+        free(temporary);
+        free(writer);
+        return 0;
+    }
+    
+    int result = format == STOCK_FILE_FORMAT_V1 ? SaveStockV1(manager, writer) : SaveStockV2(manager, writer);
+    
+    FlushWriter(writer);
+    if (!writer->failed && (InjectStockFault(STOCK_FAULT_SYNC) || !SyncStockFile(writer->file))) writer->failed = 1;
+    if (fclose(writer->file) != 0) writer->failed = 1;
+    
+    result = result && !writer->failed;
+    if (result && (InjectStockFault(STOCK_FAULT_RENAME) || !ReplaceStockFile(temporary, filename))) result = 0;
+    if (!result) remove(temporary);
+    
+    free(temporary);
+    free(writer);
+    return result;
+}
+
+int SaveStockToFile(StockManager* manager, const char* filename)
+{
+    return SaveStockToFileFormat(manager, filename, STOCK_FILE_FORMAT_V2);
+}
+
+// Rewrite the changed v1 records in place: one positioned write per run of
+// consecutive changed slots, then resize the file to the current item count
+static int SaveStockV1Changes(StockManager* manager, FileWriter* writer)
+{
+    StockDirtySet* dirty = &manager->dirty;
+    
+    int slots = dirty->capacity < manager->itemCount ? dirty->capacity : manager->itemCount;
+    int index = 0;
+    
+    while (index < slots && !writer->failed)
+    {
+        // Skip clean bytes of the bitmap at once
+        if ((index & 7) == 0 && dirty->bits[index >> 3] == 0)
+        {
+            index += 8;
+            continue;
+        }
+        if (!(dirty->bits[index >> 3] & (1u << (index & 7))))
+        {
+            index++;
+            continue;
+        }
+        
+        FlushWriter(writer);
+        if (!SeekStockFile(writer->file, STOCK_FILE_HEADER_SIZE + (long long)index * V1_RECORD_SIZE, SEEK_SET)) return 0;
+        
+        while (index < slots && (dirty->bits[index >> 3] & (1u << (index & 7))))
+        {
+            WriteV1Record(manager, writer, StockItemAt(manager, index++));
+        }
+    }
+    FlushWriter(writer);
+    
+    // The header goes last, once every record it counts is in place
+    if (writer->failed || !SeekStockFile(writer->file, 0, SEEK_SET)) return 0;
+    WriteBytes(writer, &manager->itemCount, sizeof(int));
+    WriteBytes(writer, &manager->nextId, sizeof(int));
+    FlushWriter(writer);
+    
+    long long size = STOCK_FILE_HEADER_SIZE + (long long)manager->itemCount * V1_RECORD_SIZE;
+    return !writer->failed && (manager->itemCount >= dirty->persistedCount || TruncateStockFile(writer->file, size));
+}
+
+int SaveStockIncremental(StockManager* manager, const char* filename)
+{
+    if (manager == NULL || filename == NULL) return 0;
+    if (!EnsureStockResident(manager)) return 0;
+    
+    StockDirtySet* dirty = &manager->dirty;
+    
+    // Slots appended after the last save are always marked, so the bitmap
+    // covers every slot that differs from the file (no bitmap: nothing marked yet)
+    // Past STOCK_INCREMENTAL_MAX_SHARE of the slots, scattered writes cost more than a rewrite
+    FILE* file = NULL;
+    if (dirty->file != NULL && strcmp(dirty->file, filename) == 0 &&
+        dirty->count <= manager->itemCount / STOCK_INCREMENTAL_MAX_SHARE)
+    {
+        file = fopen(filename, "r+b");
+        long long size = STOCK_FILE_HEADER_SIZE + (long long)dirty->persistedCount * V1_RECORD_SIZE;
+        
+        // Fall back to a full save if the file is not the one we left behind
+        if (file != NULL && (!SeekStockFile(file, 0, SEEK_END) || TellStockFile(file) != size))
+        {
+            fclose(file);
+            file = NULL;
+        }
+    }
+    
+    if (file == NULL)
+    {
+        if (!SaveStockToFileFormat(manager, filename, STOCK_FILE_FORMAT_V1)) return 0;
+        
+        ResetStockDirty(manager, filename);
+        return 1;
+    }
+    
+    if (dirty->count == 0 && manager->itemCount == dirty->persistedCount)
+    {
+        // Only nextId can differ; it lives in the header. With nothing to write
+        // the file is left alone, modification time included.
+        int header[2] = { manager->itemCount, manager->nextId };
+        int result = 1;
+        
+        if (manager->nextId != dirty->persistedNextId)
+        {
+            result = SeekStockFile(file, 0, SEEK_SET) && fwrite(header, sizeof(int), 2, file) == 2 && SyncStockFile(file);
+        }
+        result = fclose(file) == 0 && result;
+        if (result) dirty->persistedNextId = manager->nextId;
+        return result;
+    }
+    
+    FileWriter* writer = (FileWriter*)malloc(sizeof(FileWriter));
+    if (writer == NULL)
+    {
+        fclose(file);
+        return 0;
+    }
+    writer->file = file;
+    writer->length = 0;
+    writer->offset = 0;
+    writer->failed = 0;
+    
+    int result = SaveStockV1Changes(manager, writer) && SyncStockFile(file);
+    result = fclose(file) == 0 && result;
+    free(writer);
+    
+    // A failed in-place save leaves the file in an unknown state: rewrite it next time
+    if (result)
+        ResetStockDirty(manager, filename);
+    else
+        ResetStockDirty(manager, NULL);
+    return result;
+}
+
+// `header` holds the first 8 bytes of the file (itemCount, nextId)
+static int LoadStockV1(StockManager* manager, FileReader* reader, const unsigned char* header)
+{
+    int itemCount, nextId;
+    memcpy(&itemCount, header, sizeof(int));
+    memcpy(&nextId, header + sizeof(int), sizeof(int));
+    
+    if (itemCount < 0) return 0;
+    
+    BeginStockLoad(manager, nextId);
+    
+    // Read all items in binary format
+    for (int i = 0; i < itemCount; i++)
+    {
+        if (!EnsureStockCapacity(manager, i + 1)) break;
+        
+        unsigned char record[V1_RECORD_SIZE];
+        if (ReadBytes(reader, record, V1_RECORD_SIZE) != V1_RECORD_SIZE) break;
+        
+        StockItem* item = StockItemAt(manager, i);
+        char category[MAX_CATEGORY_LENGTH];
+        
+        memcpy(&item->id, record, sizeof(int));
+        memcpy(item->name, record + sizeof(int), MAX_NAME_LENGTH);
+        memcpy(category, record + sizeof(int) + MAX_NAME_LENGTH, MAX_CATEGORY_LENGTH);
+        memcpy(&item->stock, record + sizeof(int) + MAX_NAME_LENGTH + MAX_CATEGORY_LENGTH, sizeof(int));
+        item->reorderLevel = 0;
+        
+        // Ensure null termination for strings
+        item->name[MAX_NAME_LENGTH - 1] = '\0';
+        category[MAX_CATEGORY_LENGTH - 1] = '\0';
+        
+        item->categoryId = InternCategory(&manager->categories, category);
+        if (item->categoryId < 0) break;
+        
+        manager->itemCount++;
+    }
+    
+    return 1;
+}
+
+// Read a length-prefixed string into `dest`, truncating to destSize - 1 bytes
+static int ReadLengthPrefixed(FileReader* reader, char* dest, size_t destSize)
+{
+    unsigned length;
+    if (!ReadVarint(reader, &length)) return 0;
+    
+    size_t kept = length < destSize ? length : destSize - 1;
+    if (ReadBytes(reader, dest, kept) != kept) return 0;
+    if (ReadBytes(reader, NULL, length - kept) != length - kept) return 0;
+    
+    dest[kept] = '\0';
+    return 1;
+}
+
+static int LoadStockV2(StockManager* manager, FileReader* reader, const unsigned char* header)
+{
+    unsigned version = header[4] | (header[5] << 8);
+    unsigned flags = header[6] | (header[7] << 8);
+    unsigned itemCount = 0, nextId = 0, categoryCount = 0;
+    
+    if (version != STOCK_FILE_FORMAT_V2 || (flags & ~STOCK_FILE_KNOWN_FLAGS)) return 0;
+    if (!ReadVarint(reader, &itemCount) || !ReadVarint(reader, &nextId) || !ReadVarint(reader, &categoryCount)) return 0;
+    if (itemCount > 0x7FFFFFFFu || nextId > 0x7FFFFFFFu) return 0;
+    
+    // Read the category table before touching the manager
+    char** table = NULL;
+    unsigned tableCount = 0;
+    unsigned tableCapacity = 0;
+    int result = 1;
+    
+    while (tableCount < categoryCount)
+    {
+        if (tableCount == tableCapacity)
+        {
+            tableCapacity = tableCapacity > 0 ? tableCapacity * 2 : 64;
+            char** grown = (char**)realloc(table, tableCapacity * sizeof(char*));
+            if (grown == NULL)
+            {
+                result = 0;
+                break;
+            }
+            table = grown;
+        }
+        
+        char text[MAX_CATEGORY_LENGTH];
+        table[tableCount] = NULL;
+        
+        if (!ReadLengthPrefixed(reader, text, MAX_CATEGORY_LENGTH) ||
+            (table[tableCount] = (char*)malloc(strlen(text) + 1)) == NULL)
+        {
+            result = 0;
+            break;
+        }
+        strcpy(table[tableCount++], text);
+    }
+    
+    int* codes = NULL;
+    if (result)
+    {
+        codes = (int*)malloc((tableCount > 0 ? tableCount : 1) * sizeof(int));
+        result = codes != NULL;
+    }
+    
+    if (result)
+    {
+        BeginStockLoad(manager, (int)nextId);
+        
+        // The table holds one reference per category until the items are in
+        for (unsigned i = 0; i < tableCount; i++)
+        {
+            codes[i] = InternCategory(&manager->categories, table[i]);
+        }
+        
+        long long id = 0;     // Wide enough that no run of deltas can wrap
+        for (unsigned i = 0; i < itemCount; i++)
+        {
+            if (!EnsureStockCapacity(manager, (int)i + 1)) break;
+            
+            StockItem* item = StockItemAt(manager, (int)i);
+            unsigned idDelta, categoryIndex, stock, reorderLevel = 0;
+            
+            if (!ReadVarint(reader, &idDelta) ||
+                !ReadLengthPrefixed(reader, item->name, MAX_NAME_LENGTH) ||
+                !ReadVarint(reader, &categoryIndex) ||
+                !ReadVarint(reader, &stock) ||
+                ((flags & STOCK_FILE_FLAG_REORDER) && !ReadVarint(reader, &reorderLevel)))
+            {
+                break;
+            }
+            if (categoryIndex >= tableCount || codes[categoryIndex] < 0 || stock > 0x7FFFFFFFu) break;
+            if (reorderLevel > 0x7FFFFFFFu) break;
+            
+            // Past the int range the file is damaged; ids inside it that are
+            // not valid get fresh ones from the id index
+            id += ZigZagDecode(idDelta);
+            if (id < -0x7FFFFFFFLL - 1 || id > 0x7FFFFFFF) break;
+            
+            item->id = (int)id;
+            item->stock = (int)stock;
+            item->reorderLevel = (int)reorderLevel;
+            item->categoryId = codes[categoryIndex];
+            RetainCategory(&manager->categories, item->categoryId);
+            
+            manager->itemCount++;
+        }
+        
+        for (unsigned i = 0; i < tableCount; i++)
+        {
+            ReleaseCategory(&manager->categories, codes[i]);
+        }
+    }
+    
+    for (unsigned i = 0; i < tableCount; i++)
+    {
+        free(table[i]);
+    }
+    free(table);
+    free(codes);
+    
+    return result;
+}
+
+int LoadStockFromFile(StockManager* manager, const char* filename)
+{
+    if (manager == NULL || filename == NULL) return 0;
+    
+    FileReader* reader = (FileReader*)malloc(sizeof(FileReader));
+    if (reader == NULL) return 0;
+    
+    reader->file = fopen(filename, "rb");
+    reader->position = 0;
+    reader->length = 0;
+    
+    if (reader->file == NULL)
+    {
+        free(reader);
+        return 0;
+    }
+    
+    unsigned char header[STOCK_FILE_HEADER_SIZE];
+    int result = 0;
+    
+    if (ReadBytes(reader, header, STOCK_FILE_HEADER_SIZE) == STOCK_FILE_HEADER_SIZE)
+    {
+        BeginStockBatch(manager);
+        if (memcmp(header, STOCK_FILE_MAGIC, 4) == 0)
+            result = LoadStockV2(manager, reader, header);
+        else
+            result = LoadStockV1(manager, reader, header);
+        
+        if (result) FinishStockLoad(manager);
+        EndStockBatch(manager);
+    }
+    
+    fclose(reader->file);
+    free(reader);
+    return result;
+}
+
+static unsigned long long ReadU64(const unsigned char* bytes)
+{
+    return (unsigned long long)ReadStockU32(bytes) | ((unsigned long long)ReadStockU32(bytes + 4) << 32);
+}
+
+// Check the header and record index of a mapped v2 file and locate its parts.
+// Leaves the category table cursor at the first table string.
+static int OpenMappedIndex(struct StockMapping* mapping, const unsigned char** table, unsigned* itemCount, unsigned* nextId)
+{
+    const unsigned char* data = mapping->view.data;
+    size_t size = mapping->view.size;
+    
+    if (size < STOCK_FILE_HEADER_SIZE + STOCK_INDEX_HEADER_SIZE + STOCK_INDEX_FOOTER_SIZE) return 0;
+    if (memcmp(data, STOCK_FILE_MAGIC, 4) != 0 || (data[4] | (data[5] << 8)) != STOCK_FILE_FORMAT_V2) return 0;
+    
+    mapping->flags = data[6] | (data[7] << 8);
+    if (mapping->flags & ~STOCK_FILE_KNOWN_FLAGS) return 0;
+    
+    const unsigned char* footer = data + size - STOCK_INDEX_FOOTER_SIZE;
+    if (memcmp(footer + 12, STOCK_INDEX_MAGIC, 4) != 0 || ReadStockU32(footer + 8) != STOCK_INDEX_VERSION) return 0;
+    
+    unsigned long long indexOffset = ReadU64(footer);
+    if (indexOffset > size - STOCK_INDEX_FOOTER_SIZE - STOCK_INDEX_HEADER_SIZE) return 0;
+    
+    const unsigned char* index = data + indexOffset;
+    unsigned long long recordsStart = ReadU64(index);
+    unsigned count = ReadStockU32(index + 8);
+    
+    // The entries must exactly fill the space up to the footer
+    if ((unsigned long long)count * STOCK_INDEX_ENTRY_SIZE != size - STOCK_INDEX_FOOTER_SIZE - STOCK_INDEX_HEADER_SIZE - indexOffset) return 0;
+    if (recordsStart > indexOffset || count > 0x7FFFFFFFu) return 0;
+    
+    const unsigned char* cursor = data + STOCK_FILE_HEADER_SIZE;
+    const unsigned char* end = data + recordsStart;
+    unsigned categoryCount = 0;
+    
+    if (!DecodeStockVarint(&cursor, end, itemCount) || !DecodeStockVarint(&cursor, end, nextId) ||
+        !DecodeStockVarint(&cursor, end, &categoryCount))
+    {
+        return 0;
+    }
+    if (*itemCount != count || *nextId > 0x7FFFFFFFu || categoryCount != ReadStockU32(index + 12)) return 0;
+    
+    *table = cursor;
+    mapping->records = end;
+    mapping->recordsLength = (size_t)(indexOffset - recordsStart);
+    mapping->entries = index + STOCK_INDEX_HEADER_SIZE;
+    mapping->tableCount = categoryCount;
+    return 1;
+}
+
+// Intern the file's category table and count references from the record index
+static int InternMappedCategories(StockManager* manager, struct StockMapping* mapping, const unsigned char* cursor, unsigned itemCount)
+{
+    const unsigned char* end = mapping->records;
+    
+    mapping->codes = (int*)malloc((mapping->tableCount > 0 ? mapping->tableCount : 1) * sizeof(int));
+    if (mapping->codes == NULL) return 0;
+    
+    // The table holds one reference per category until the items are counted
+    unsigned interned = 0;
+    int result = 1;
+    
+    while (interned < mapping->tableCount)
+    {
+        unsigned length;
+        char text[MAX_CATEGORY_LENGTH];
+        
+        if (!DecodeStockVarint(&cursor, end, &length) || length > (size_t)(end - cursor))
+        {
+            result = 0;
+            break;
+        }
+        
+        size_t kept = length < MAX_CATEGORY_LENGTH ? length : MAX_CATEGORY_LENGTH - 1;
+        memcpy(text, cursor, kept);
+        text[kept] = '\0';
+        cursor += length;
+        
+        mapping->codes[interned] = InternCategory(&manager->categories, text);
+        if (mapping->codes[interned++] < 0)
+        {
+            result = 0;
+            break;
+        }
+    }
+    
+    // Only the index entries are touched here; item records stay on disk
+    for (unsigned i = 0; result && i < itemCount; i++)
+    {
+        const unsigned char* entry = mapping->entries + (size_t)i * STOCK_INDEX_ENTRY_SIZE;
+        unsigned id = ReadStockU32(entry + 4);
+        unsigned tableIndex = ReadStockU32(entry + 8);
+        
+        if (ReadStockU32(entry) >= mapping->recordsLength || id > 0x7FFFFFFFu || tableIndex >= mapping->tableCount)
+        {
+            result = 0;
+            break;
+        }
+        RetainCategory(&manager->categories, mapping->codes[tableIndex]);
+    }
+    
+    for (unsigned i = 0; i < interned; i++)
+    {
+        ReleaseCategory(&manager->categories, mapping->codes[i]);
+    }
+    
+    return result;
+}
+
+int LoadStockFromFileMapped(StockManager* manager, const char* filename)
+{
+    if (manager == NULL || filename == NULL) return 0;
+    
+    struct StockMapping* mapping = (struct StockMapping*)calloc(1, sizeof(struct StockMapping));
+    if (mapping == NULL) return 0;
+    
+    const unsigned char* table = NULL;
+    unsigned itemCount = 0, nextId = 0;
+    
+    // v1 files and v2 files without a record index take the regular load path
+    if (!MapStockFileView(filename, &mapping->view) || !OpenMappedIndex(mapping, &table, &itemCount, &nextId))
+    {
+        UnmapStockFileView(&mapping->view);
+        free(mapping);
+        return LoadStockFromFile(manager, filename);
+    }
+    
+    BeginStockBatch(manager);
+    BeginStockLoad(manager, (int)nextId);
+    
+    int result = InternMappedCategories(manager, mapping, table, itemCount) &&
+                 ReserveStockSegments(manager, ((int)itemCount + STOCK_SEGMENT_SIZE - 1) >> STOCK_SEGMENT_SHIFT) &&
+                 (manager->residentBits = (unsigned char*)calloc(itemCount / 8 + 1, 1)) != NULL;
+    
+    if (!result)
+    {
+        free(manager->residentBits);
+        manager->residentBits = NULL;
+        free(mapping->codes);
+        UnmapStockFileView(&mapping->view);
+        free(mapping);
+        
+        // Leave an empty, consistent inventory behind
+        BeginStockLoad(manager, (int)nextId);
+        FinishStockLoad(manager);
+        EndStockBatch(manager);
+        return 0;
+    }
+    
+    manager->mapping = mapping;
+    manager->itemCount = (int)itemCount;
+    manager->mappedCount = (int)itemCount;
+    manager->deferredIndexes = STOCK_DEFERRED_NAME_INDEX | STOCK_DEFERRED_ID_INDEX;
+    InvalidateSortCache(manager, STOCK_FIELD_ALL);
+    EndStockBatch(manager);
+    return 1;
+}
+
+int MaterializeStockItem(StockManager* manager, int index)
+{
+    struct StockMapping* mapping = manager->mapping;
+    if (!AllocateStockSegment(manager, index >> STOCK_SEGMENT_SHIFT)) return 0;
+    
+    const unsigned char* entry = mapping->entries + (size_t)index * STOCK_INDEX_ENTRY_SIZE;
+    const unsigned char* cursor = mapping->records + ReadStockU32(entry);
+    const unsigned char* end = mapping->records + mapping->recordsLength;
+    StockItem* item = StockItemAt(manager, index);
+    
+    // Id and category come from the validated index; a damaged record only loses its name, stock or reorder level
+    item->id = (int)ReadStockU32(entry + 4);
+    item->categoryId = mapping->codes[ReadStockU32(entry + 8)];
+    item->name[0] = '\0';
+    item->stock = 0;
+    item->reorderLevel = 0;
+    
+    unsigned idDelta, length, categoryIndex, stock, reorderLevel;
+    if (DecodeStockVarint(&cursor, end, &idDelta) && DecodeStockVarint(&cursor, end, &length) && length <= (size_t)(end - cursor))
+    {
+        size_t kept = length < MAX_NAME_LENGTH ? length : MAX_NAME_LENGTH - 1;
+        memcpy(item->name, cursor, kept);
+        item->name[kept] = '\0';
+        cursor += length;
+        
+        if (DecodeStockVarint(&cursor, end, &categoryIndex) && DecodeStockVarint(&cursor, end, &stock) && stock <= 0x7FFFFFFFu)
+        {
+            item->stock = (int)stock;
+            
+            if ((mapping->flags & STOCK_FILE_FLAG_REORDER) && DecodeStockVarint(&cursor, end, &reorderLevel) &&
+                reorderLevel <= 0x7FFFFFFFu)
+            {
+                item->reorderLevel = (int)reorderLevel;
+            }
+        }
+    }
+    
+    manager->residentBits[index >> 3] |= (unsigned char)(1u << (index & 7));
+    return 1;
+}
+
+int MappedStockItemId(const StockManager* manager, int index)
+{
+    return (int)ReadStockU32(manager->mapping->entries + (size_t)index * STOCK_INDEX_ENTRY_SIZE + 4);
+}
+
+void ReleaseStockMapping(StockManager* manager)
+{
+    if (manager->mapping != NULL)
+    {
+        UnmapStockFileView(&manager->mapping->view);
+        free(manager->mapping->codes);
+        free(manager->mapping);
+        manager->mapping = NULL;
+    }
+    
+    free(manager->residentBits);
+    manager->residentBits = NULL;
+    manager->mappedCount = 0;
+}
+
+int DetectStockFileFormat(const char* filename)
+{
+    if (filename == NULL) return 0;
+    
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) return 0;
+    
+    unsigned char header[STOCK_FILE_HEADER_SIZE];
+    int format = 0;
+    
+    if (fread(header, 1, STOCK_FILE_HEADER_SIZE, file) == STOCK_FILE_HEADER_SIZE)
+    {
+        if (memcmp(header, STOCK_FILE_MAGIC, 4) == 0)
+            format = header[4] | (header[5] << 8);
+        else
+            format = STOCK_FILE_FORMAT_V1;
+    }
+    
+    fclose(file);
+    return format;
+}
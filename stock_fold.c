@@ -0,0 +1,181 @@
+#include "stock.h"
+
+// Search key folding: lower case, diacritics stripped, ligatures spelled out.
+// Turkish I, İ, ı and i all fold to "i", so dotted and dotless spellings match.
+// A folded key is never longer than its source text.
+
+// Folded form of U+00C0..U+024F (Latin-1 Supplement, Latin Extended-A and -B)
+static const char g_latinFold[0x190][4] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c",
+    "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", "\xC3\x97",
+    "o", "u", "u", "u", "u", "y", "th", "ss",
+    "a", "a", "a", "a", "a", "a", "ae", "c",
+    "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", "\xC3\xB7",
+    "o", "u", "u", "u", "u", "y", "th", "y",
+    "a", "a", "a", "a", "a", "a", "c", "c",
+    "c", "c", "c", "c", "c", "c", "d", "d",
+    "d", "d", "e", "e", "e", "e", "e", "e",
+    "e", "e", "e", "e", "g", "g", "g", "g",
+    "g", "g", "g", "g", "h", "h", "h", "h",
+    "i", "i", "i", "i", "i", "i", "i", "i",
+    "i", "i", "ij", "ij", "j", "j", "k", "k",
+    "k", "l", "l", "l", "l", "l", "l", "l",
+    "l", "l", "l", "n", "n", "n", "n", "n",
+    "n", "n", "n", "n", "o", "o", "o", "o",
+    "o", "o", "oe", "oe", "r", "r", "r", "r",
+    "r", "r", "s", "s", "s", "s", "s", "s",
+    "s", "s", "t", "t", "t", "t", "t", "t",
+    "u", "u", "u", "u", "u", "u", "u", "u",
+    "u", "u", "u", "u", "w", "w", "y", "y",
+    "y", "z", "z", "z", "z", "z", "z", "s",
+    "b", "\xC9\x93", "b", "b", "\xC6\x85", "\xC6\x85", "\xC9\x94", "c",
+    "c", "\xC9\x96", "\xC9\x97", "d", "d", "\xC6\x8D", "e", "\xC9\x99",
+    "\xC9\x9B", "f", "f", "\xC9\xA0", "\xC9\xA3", "\xC6\x95", "\xC9\xA9", "\xC9\xA8",
+    "k", "k", "l", "\xC6\x9B", "\xC9\xAF", "\xC9\xB2", "n", "\xC9\xB5",
+    "o", "o", "\xC6\xA3", "\xC6\xA3", "p", "p", "\xCA\x80", "\xC6\xA8",
+    "\xC6\xA8", "\xCA\x83", "\xC6\xAA", "t", "t", "t", "\xCA\x88", "u",
+    "u", "\xCA\x8A", "\xCA\x8B", "y", "y", "z", "z", "\xCA\x92",
+    "\xC6\xB9", "\xC6\xB9", "\xC6\xBA", "\xC6\xBB", "\xC6\xBD", "\xC6\xBD", "\xC6\xBE", "\xC6\xBF",
+    "\xC7\x80", "\xC7\x81", "\xC7\x82", "\xC7\x83", "dz", "dz", "dz", "lj",
+    "lj", "lj", "nj", "nj", "nj", "a", "a", "i",
+    "i", "o", "o", "u", "u", "u", "u", "u",
+    "u", "u", "u", "u", "u", "e", "a", "a",
+    "a", "a", "\xC7\xA3", "\xC7\xA3", "g", "g", "g", "g",
+    "k", "k", "o", "o", "o", "o", "\xC7\xAF", "\xC7\xAF",
+    "j", "dz", "dz", "dz", "g", "g", "\xC6\x95", "\xC6\xBF",
+    "n", "n", "a", "a", "\xC7\xBD", "\xC7\xBD", "\xC7\xBF", "\xC7\xBF",
+    "a", "a", "a", "a", "e", "e", "e", "e",
+    "i", "i", "i", "i", "o", "o", "o", "o",
+    "r", "r", "r", "r", "u", "u", "u", "u",
+    "s", "s", "t", "t", "\xC8\x9D", "\xC8\x9D", "h", "h",
+    "n", "d", "\xC8\xA3", "\xC8\xA3", "z", "z", "a", "a",
+    "e", "e", "o", "o", "o", "o", "o", "o",
+    "o", "o", "y", "y", "l", "n", "t", "j",
+    "\xC8\xB8", "\xC8\xB9", "\xC8\xBA", "c", "c", "l", "\xC8\xBE", "s",
+    "z", "\xC9\x81", "\xC9\x82", "b", "\xCA\x89", "\xCA\x8C", "e", "e",
+    "j", "j", "q", "q", "r", "r", "y", "y",
+};
+
+// Folded form of U+1E00..U+1EFF (Latin Extended Additional)
+static const char g_latinAdditionalFold[0x100][4] = {
+    "a", "a", "b", "b", "b", "b", "b", "b",
+    "c", "c", "d", "d", "d", "d", "d", "d",
+    "d", "d", "d", "d", "e", "e", "e", "e",
+    "e", "e", "e", "e", "e", "e", "f", "f",
+    "g", "g", "h", "h", "h", "h", "h", "h",
+    "h", "h", "h", "h", "i", "i", "i", "i",
+    "k", "k", "k", "k", "k", "k", "l", "l",
+    "l", "l", "l", "l", "l", "l", "m", "m",
+    "m", "m", "m", "m", "n", "n", "n", "n",
+    "n", "n", "n", "n", "o", "o", "o", "o",
+    "o", "o", "o", "o", "p", "p", "p", "p",
+    "r", "r", "r", "r", "r", "r", "r", "r",
+    "s", "s", "s", "s", "s", "s", "s", "s",
+    "s", "s", "t", "t", "t", "t", "t", "t",
+    "t", "t", "u", "u", "u", "u", "u", "u",
+    "u", "u", "u", "u", "v", "v", "v", "v",
+    "w", "w", "w", "w", "w", "w", "w", "w",
+    "w", "w", "x", "x", "x", "x", "y", "y",
+    "z", "z", "z", "z", "z", "z", "h", "t",
+    "w", "y", "\xE1\xBA\x9A", "\xE1\xBA\x9B", "\xE1\xBA\x9C", "\xE1\xBA\x9D", "ss", "\xE1\xBA\x9F",
+    "a", "a", "a", "a", "a", "a", "a", "a",
+    "a", "a", "a", "a", "a", "a", "a", "a",
+    "a", "a", "a", "a", "a", "a", "a", "a",
+    "e", "e", "e", "e", "e", "e", "e", "e",
+    "e", "e", "e", "e", "e", "e", "e", "e",
+    "i", "i", "i", "i", "o", "o", "o", "o",
+    "o", "o", "o", "o", "o", "o", "o", "o",
+    "o", "o", "o", "o", "o", "o", "o", "o",
+    "o", "o", "o", "o", "u", "u", "u", "u",
+    "u", "u", "u", "u", "u", "u", "u", "u",
+    "u", "u", "y", "y", "y", "y", "y", "y",
+    "y", "y", "\xE1\xBB\xBB", "\xE1\xBB\xBB", "\xE1\xBB\xBD", "\xE1\xBB\xBD", "\xE1\xBB\xBF", "\xE1\xBB\xBF",
+};
+
+// Length of the UTF-8 sequence at `text` and its code point; 0 if malformed
+static size_t DecodeUTF8(const unsigned char* text, unsigned* codePoint)
+{
+    unsigned char lead = text[0];
+    size_t length;
+    unsigned value;
+    
+    if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        length = 4;
+        value = lead & 0x07;
+    }
+    else if (lead >= 0xE0 && lead < 0xF0)
+    {
+        length = 3;
+        value = lead & 0x0F;
+    }
+    else if (lead >= 0xC2 && lead < 0xE0)
+    {
+        length = 2;
+        value = lead & 0x1F;
+    }
+    else
+    {
+        return 0;
+    }
+    
+    for (size_t i = 1; i < length; i++)
+    {
+        if ((text[i] & 0xC0) != 0x80) return 0;
+        value = (value << 6) | (text[i] & 0x3F);
+    }
+    
+    *codePoint = value;
+    return length;
+}
+
+size_t FoldStockText(const char* text, char* folded, size_t foldedSize)
+{
+    if (text == NULL || folded == NULL || foldedSize == 0) return 0;
+    
+    const unsigned char* cursor = (const unsigned char*)text;
+    size_t length = 0;
+    
+    while (*cursor != 0)
+    {
+        const char* replacement = NULL;
+        size_t sourceLength = 1;
+        unsigned codePoint = *cursor;
+        
+        if (codePoint < 0x80)
+        {
+            if (codePoint >= 'A' && codePoint <= 'Z') codePoint += 'a' - 'A';
+        }
+        else if ((sourceLength = DecodeUTF8(cursor, &codePoint)) == 0)
+        {
+            sourceLength = 1;   // Malformed byte: kept as it is
+        }
+        else if (codePoint >= 0x0300 && codePoint <= 0x036F)
+        {
+            replacement = "";   // Combining diacritic of decomposed text
+        }
+        else if (codePoint >= 0x00C0 && codePoint <= 0x024F)
+        {
+            replacement = g_latinFold[codePoint - 0x00C0];
+        }
+        else if (codePoint >= 0x1E00 && codePoint <= 0x1EFF)
+        {
+            replacement = g_latinAdditionalFold[codePoint - 0x1E00];
+        }
+        
+        size_t outLength = replacement != NULL ? strlen(replacement) : sourceLength;
+        if (length + outLength >= foldedSize) break;
+        
+        if (replacement != NULL) memcpy(folded + length, replacement, outLength);
+        else if (sourceLength == 1) folded[length] = (char)codePoint;
+        else memcpy(folded + length, cursor, sourceLength);
+        
+        length += outLength;
+        cursor += sourceLength;
+    }
+    
+    folded[length] = '\0';
+    return length;
+}
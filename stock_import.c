@@ -0,0 +1,419 @@
+#include "stock_internal.h"
+#include "stock_platform.h"
+
+// CSV/TSV import. A first pass counts the lines to reserve the inventory, then
+// rows are parsed straight out of a fixed read buffer by a small state machine
+// and added inside one bulk insert. Only the mapped columns are copied out.
+
+#define IMPORT_MAX_COLUMNS 64
+#define IMPORT_FIELD_SIZE MAX_NAME_LENGTH  // Longest accepted field, plus the terminator
+#define IMPORT_TOO_LONG -1
+
+typedef struct {
+    FILE* file;
+    size_t position;
+    size_t length;
+    int line;                   // Line of the next byte
+    char delimiter;
+    unsigned char buffer[STOCK_IMPORT_BUFFER_SIZE];
+} ImportReader;
+
+typedef struct {
+    int count;                  // Fields in the row
+    int line;                   // Line the row starts on
+    int keep;                   // Fields below this column are copied
+    int malformed;              // Text followed a closing quote
+    int blank;                  // The line holds only spaces and tabs (delimiters included)
+    int lengths[IMPORT_MAX_COLUMNS];   // IMPORT_TOO_LONG for an overlong field
+    unsigned char quoted[IMPORT_MAX_COLUMNS];   // Quoted text is kept exactly
+    char fields[IMPORT_MAX_COLUMNS][IMPORT_FIELD_SIZE];
+} ImportRow;
+
+void InitStockImportOptions(StockImportOptions* options)
+{
+    if (options == NULL) return;
+    
+    options->delimiter = 0;
+    options->hasHeader = 1;
+    options->nameColumn = STOCK_IMPORT_AUTO;
+    options->stockColumn = STOCK_IMPORT_AUTO;
+    options->categoryColumn = STOCK_IMPORT_AUTO;
+    options->reorderColumn = STOCK_IMPORT_AUTO;
+    options->onError = NULL;
+    options->context = NULL;
+}
+
+static int RefillImportBuffer(ImportReader* reader)
+{
+    reader->position = 0;
+    reader->length = fread(reader->buffer, 1, STOCK_IMPORT_BUFFER_SIZE, reader->file);
+    return reader->length > 0;
+}
+
+static inline int NextImportByte(ImportReader* reader)
+{
+    if (reader->position == reader->length && !RefillImportBuffer(reader)) return -1;
+    
+    return reader->buffer[reader->position++];
+}
+
+static inline int PeekImportByte(ImportReader* reader)
+{
+    if (reader->position == reader->length && !RefillImportBuffer(reader)) return -1;
+    
+    return reader->buffer[reader->position];
+}
+
+// Upper bound on the rows: one per line break, plus an unterminated last line
+static long CountImportLines(ImportReader* reader)
+{
+    long lines = 0;
+    unsigned char last = '\n';
+    
+    while (RefillImportBuffer(reader))
+    {
+        const unsigned char* cursor = reader->buffer;
+        const unsigned char* end = reader->buffer + reader->length;
+        
+        while ((cursor = (const unsigned char*)memchr(cursor, '\n', (size_t)(end - cursor))) != NULL)
+        {
+            lines++;
+            cursor++;
+        }
+        last = end[-1];
+    }
+    
+    return lines + (last != '\n');
+}
+
+// Skip a byte order mark and pick the delimiter from the first line
+static void StartImport(ImportReader* reader, char delimiter)
+{
+    RefillImportBuffer(reader);
+    
+    if (reader->length >= 3 && memcmp(reader->buffer, "\xEF\xBB\xBF", 3) == 0) reader->position = 3;
+    
+    if (delimiter == 0)
+    {
+        delimiter = ',';
+        for (size_t i = reader->position; i < reader->length && reader->buffer[i] != '\n'; i++)
+        {
+            if (reader->buffer[i] == '\t')
+            {
+                delimiter = '\t';
+                break;
+            }
+        }
+    }
+    reader->delimiter = delimiter;
+}
+
+static inline void AppendImportByte(ImportRow* row, int c)
+{
+    if (row->count >= row->keep) return;
+    
+    int* length = &row->lengths[row->count];
+    if (*length == IMPORT_TOO_LONG) return;
+    
+    if (*length == IMPORT_FIELD_SIZE - 1)
+        *length = IMPORT_TOO_LONG;
+    else
+        row->fields[row->count][(*length)++] = (char)c;
+}
+
+static inline void EndImportField(ImportRow* row)
+{
+    if (row->count < row->keep && row->lengths[row->count] != IMPORT_TOO_LONG)
+        row->fields[row->count][row->lengths[row->count]] = '\0';
+    
+    row->count++;
+    if (row->count < row->keep)
+    {
+        row->lengths[row->count] = 0;
+        row->quoted[row->count] = 0;
+    }
+}
+
+// Parse one row; returns 0 at the end of the file
+static int ReadImportRow(ImportReader* reader, ImportRow* row)
+{
+    int quoted = 0;             // Inside a quoted field
+    int started = 0;            // The current field has content (or quotes)
+    int closed = 0;             // The current field's closing quote has been read
+    int c = NextImportByte(reader);
+    
+    if (c < 0) return 0;
+    
+    row->count = 0;
+    row->line = reader->line;
+    row->malformed = 0;
+    row->blank = 1;
+    row->lengths[0] = 0;
+    row->quoted[0] = 0;
+    
+    for (; c >= 0; c = NextImportByte(reader))
+    {
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') row->blank = 0;
+        
+        if (quoted)
+        {
+            if (c == '"')
+            {
+                // A doubled quote stands for one; a single one ends the quotes
+                if (PeekImportByte(reader) == '"')
+                {
+                    reader->position++;
+                    AppendImportByte(row, '"');
+                }
+                else
+                {
+                    quoted = 0;
+                    closed = 1;
+                }
+            }
+            else
+            {
+                if (c == '\n') reader->line++;
+                AppendImportByte(row, c);
+            }
+        }
+        else if (c == reader->delimiter)
+        {
+            EndImportField(row);
+            started = 0;
+            closed = 0;
+        }
+        else if (c == '\n' || c == '\r')
+        {
+            if (c == '\r' && PeekImportByte(reader) == '\n') reader->position++;
+            reader->line++;
+            break;
+        }
+        else if (c == '"' && !started)
+        {
+            quoted = 1;
+            started = 1;
+            if (row->count < row->keep) row->quoted[row->count] = 1;
+        }
+        else if (closed)
+        {
+            // Spaces may pad a quoted field; anything else is not CSV
+            if (c != ' ' && c != '\t') row->malformed = 1;
+        }
+        else
+        {
+            AppendImportByte(row, c);
+            started = 1;
+        }
+    }
+    
+    EndImportField(row);
+    return 1;
+}
+
+// Field text (without surrounding spaces unless quoted), or NULL for a missing or overlong field
+static const char* ImportField(ImportRow* row, int column)
+{
+    if (column < 0 || column >= row->count || column >= row->keep || row->lengths[column] == IMPORT_TOO_LONG) return NULL;
+    
+    char* text = row->fields[column];
+    int length = row->lengths[column];
+    if (row->quoted[column]) return text;
+    
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t')) length--;
+    text[length] = '\0';
+    while (*text == ' ' || *text == '\t') text++;
+    return text;
+}
+
+// Non-negative decimal integer; returns 0 if `text` is anything else
+static int ParseImportCount(const char* text, int* value)
+{
+    long long number = 0;
+    
+    if (text == NULL) return 0;
+    if (*text == '+') text++;
+    if (*text == '\0') return 0;
+    
+    for (; *text != '\0'; text++)
+    {
+        if (*text < '0' || *text > '9') return 0;
+        number = number * 10 + (*text - '0');
+        if (number > 0x7FFFFFFF) return 0;
+    }
+    
+    *value = (int)number;
+    return 1;
+}
+
+static int MatchImportHeader(const char* header, const char* const* names)
+{
+    for (; *names != NULL; names++)
+    {
+        const char* a = header;
+        const char* b = *names;
+        
+        while (*a != '\0' && (*a | 0x20) == *b)
+        {
+            a++;
+            b++;
+        }
+        if (*a == '\0' && *b == '\0') return 1;
+    }
+    
+    return 0;
+}
+
+// Resolve an automatic column from the header, or from its usual position
+static int MapImportColumn(int column, ImportRow* header, const char* const* names, int position)
+{
+    if (column != STOCK_IMPORT_AUTO) return column;
+    if (header == NULL) return position;
+    
+    for (int i = 0; i < header->count && i < header->keep; i++)
+    {
+        const char* text = ImportField(header, i);
+        if (text != NULL && MatchImportHeader(text, names)) return i;
+    }
+    
+    return STOCK_IMPORT_ABSENT;
+}
+
+static void ReportImportError(const StockImportOptions* options, StockImportResult* result, int line, int error)
+{
+    result->rejected++;
+    if (options->onError != NULL) options->onError(line, error, options->context);
+}
+
+static const char* const g_nameHeaders[] = { "name", "product", "product name", "item", NULL };
+static const char* const g_stockHeaders[] = { "stock", "quantity", "qty", "stock quantity", NULL };
+static const char* const g_categoryHeaders[] = { "category", NULL };
+static const char* const g_reorderHeaders[] = { "reorder", "reorder level", "reorderlevel", NULL };
+
+int ImportStockFromFile(StockManager* manager, const char* filename, const StockImportOptions* options, StockImportResult* result)
+{
+    StockImportOptions defaults;
+    StockImportResult counts = { 0, 0, 0 };
+    
+    if (result != NULL) *result = counts;
+    if (manager == NULL || filename == NULL) return 0;
+    if (options == NULL)
+    {
+        InitStockImportOptions(&defaults);
+        options = &defaults;
+    }
+    
+    ImportReader* reader = (ImportReader*)malloc(sizeof(ImportReader));
+    ImportRow* row = (ImportRow*)malloc(sizeof(ImportRow));
+    if (reader == NULL || row == NULL || (reader->file = OpenStockFile(filename, "rb")) == NULL)
+    {
+        free(reader);
+        free(row);
+        return 0;
+    }
+    
+    long lines = CountImportLines(reader);
+    rewind(reader->file);
+    reader->line = 1;
+    StartImport(reader, options->delimiter);
+    
+    int nameColumn = options->nameColumn;
+    int stockColumn = options->stockColumn;
+    int categoryColumn = options->categoryColumn;
+    int reorderColumn = options->reorderColumn;
+    int ok = 1;
+    
+    if (options->hasHeader)
+    {
+        row->keep = IMPORT_MAX_COLUMNS;
+        int hasRow = ReadImportRow(reader, row);
+        ImportRow* header = hasRow ? row : NULL;
+        
+        nameColumn = MapImportColumn(nameColumn, header, g_nameHeaders, 0);
+        stockColumn = MapImportColumn(stockColumn, header, g_stockHeaders, 1);
+        categoryColumn = MapImportColumn(categoryColumn, header, g_categoryHeaders, 2);
+        reorderColumn = MapImportColumn(reorderColumn, header, g_reorderHeaders, STOCK_IMPORT_ABSENT);
+    }
+    else
+    {
+        nameColumn = MapImportColumn(nameColumn, NULL, NULL, 0);
+        stockColumn = MapImportColumn(stockColumn, NULL, NULL, 1);
+        categoryColumn = MapImportColumn(categoryColumn, NULL, NULL, 2);
+        reorderColumn = MapImportColumn(reorderColumn, NULL, NULL, STOCK_IMPORT_ABSENT);
+    }
+    
+    // Name and quantity are required; every mapped column must fit in a row
+    if (nameColumn < 0 || stockColumn < 0 || nameColumn >= IMPORT_MAX_COLUMNS || stockColumn >= IMPORT_MAX_COLUMNS ||
+        categoryColumn >= IMPORT_MAX_COLUMNS || reorderColumn >= IMPORT_MAX_COLUMNS)
+    {
+        if (options->onError != NULL) options->onError(1, STOCK_IMPORT_ERROR_HEADER, options->context);
+        ok = 0;
+    }
+    
+    row->keep = nameColumn;
+    if (stockColumn >= row->keep) row->keep = stockColumn;
+    if (categoryColumn >= row->keep) row->keep = categoryColumn;
+    if (reorderColumn >= row->keep) row->keep = reorderColumn;
+    row->keep++;
+    
+    if (ok && !BeginStockBulkInsert(manager, lines < 0x7FFFFFFF - manager->itemCount ? (int)lines : 0)) ok = 0;
+    
+    while (ok && ReadImportRow(reader, row))
+    {
+        // Blank lines are not rows
+        if (row->blank) continue;
+        
+        counts.rows++;
+        
+        if (row->malformed)
+        {
+            ReportImportError(options, &counts, row->line, STOCK_IMPORT_ERROR_QUOTES);
+            continue;
+        }
+        
+        int required = nameColumn > stockColumn ? nameColumn : stockColumn;
+        if (row->count <= required)
+        {
+            ReportImportError(options, &counts, row->line, STOCK_IMPORT_ERROR_COLUMNS);
+            continue;
+        }
+        
+        // Optional columns may be cut off at the end of a row; NULL means too long
+        const char* name = ImportField(row, nameColumn);
+        const char* category = "";
+        const char* reorder = "";
+        if (categoryColumn >= 0 && categoryColumn < row->count) category = ImportField(row, categoryColumn);
+        if (reorderColumn >= 0 && reorderColumn < row->count) reorder = ImportField(row, reorderColumn);
+        
+        if (name == NULL || *name == '\0' || category == NULL || strlen(category) >= MAX_CATEGORY_LENGTH)
+        {
+            ReportImportError(options, &counts, row->line, STOCK_IMPORT_ERROR_TEXT);
+            continue;
+        }
+        
+        int stock = 0, reorderLevel = 0;
+        if (!ParseImportCount(ImportField(row, stockColumn), &stock) ||
+            (reorder == NULL || (*reorder != '\0' && !ParseImportCount(reorder, &reorderLevel))))
+        {
+            ReportImportError(options, &counts, row->line, STOCK_IMPORT_ERROR_NUMBER);
+            continue;
+        }
+        
+        if (!AddStockItem(manager, name, category, stock) ||
+            (reorderLevel > 0 && !SetStockReorderLevel(manager, manager->itemCount - 1, reorderLevel)))
+        {
+            ReportImportError(options, &counts, row->line, STOCK_IMPORT_ERROR_REJECTED);
+            continue;
+        }
+        
+        counts.imported++;
+    }
+    
+    if (ok) EndStockBulkInsert(manager);
+    
+    fclose(reader->file);
+    free(reader);
+    free(row);
+    if (result != NULL) *result = counts;
+    return ok;
+}
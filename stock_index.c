@@ -0,0 +1,441 @@
+#include "stock_index.h"
+
+// Open-addressing (linear probing) hash index over StockItem.name.
+// Deletion uses backward shifting, so the table never holds tombstones.
+
+#define NAME_INDEX_EMPTY -1
+#define NAME_INDEX_MIN_CAPACITY 64
+
+// FNV-1a over the UTF-8 bytes of the name
+unsigned HashStockName(const char* name)
+{
+    const unsigned char* bytes = (const unsigned char*)name;
+    unsigned hash = 2166136261u;
+    
+    while (*bytes)
+    {
+        hash ^= *bytes++;
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+void InitNameIndex(StockNameIndex* index)
+{
+    if (index == NULL) return;
+    
+    index->entries = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+void FreeNameIndex(StockNameIndex* index)
+{
+    if (index == NULL) return;
+    
+    free(index->entries);
+    InitNameIndex(index);
+}
+
+// Place an entry without checking the load factor
+static void PlaceNameEntry(StockNameIndex* index, unsigned hash, int itemIndex)
+{
+    unsigned mask = (unsigned)index->capacity - 1;
+    unsigned pos = hash & mask;
+    
+    while (index->entries[pos].item != NAME_INDEX_EMPTY)
+    {
+        pos = (pos + 1) & mask;
+    }
+    
+    index->entries[pos].hash = hash;
+    index->entries[pos].item = itemIndex;
+    index->count++;
+}
+
+// Resize the table to `capacity` slots (power of two) and re-place all entries
+static int ResizeNameIndex(StockNameIndex* index, int capacity)
+{
+    StockNameEntry* old = index->entries;
+    int oldCapacity = index->capacity;
+    
+    StockNameEntry* entries = (StockNameEntry*)malloc(capacity * sizeof(StockNameEntry));
+    if (entries == NULL) return 0;
+    
+    for (int i = 0; i < capacity; i++)
+    {
+        entries[i].item = NAME_INDEX_EMPTY;
+    }
+    
+    index->entries = entries;
+    index->capacity = capacity;
+    index->count = 0;
+    
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].item != NAME_INDEX_EMPTY)
+            PlaceNameEntry(index, old[i].hash, old[i].item);
+    }
+    
+    free(old);
+    return 1;
+}
+
+// Keep the load factor at or below 1/2
+static int ReserveNameIndex(StockNameIndex* index, int count)
+{
+    if (count * 2 <= index->capacity) return 1;
+    
+    int capacity = index->capacity > 0 ? index->capacity : NAME_INDEX_MIN_CAPACITY;
+    while (count * 2 > capacity) capacity *= 2;
+    
+    return ResizeNameIndex(index, capacity);
+}
+
+int RebuildNameIndex(StockManager* manager)
+{
+    StockNameIndex* index = &manager->nameIndex;
+    
+    index->count = 0;
+    for (int i = 0; i < index->capacity; i++)
+    {
+        index->entries[i].item = NAME_INDEX_EMPTY;
+    }
+    
+    if (!ReserveNameIndex(index, manager->itemCount)) return 0;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        PlaceNameEntry(index, HashStockName(StockItemAt(manager, i)->name), i);
+    }
+    
+    return 1;
+}
+
+// Room for one more entry, so the next NameIndexInsert cannot fail
+int NameIndexReserve(StockManager* manager)
+{
+    if (manager->deferredIndexes & STOCK_DEFERRED_NAME_INDEX) return 1;
+    
+    return ReserveNameIndex(&manager->nameIndex, manager->nameIndex.count + 1);
+}
+
+int NameIndexInsert(StockManager* manager, int itemIndex)
+{
+    StockNameIndex* index = &manager->nameIndex;
+    
+    // Built in one pass later when a lazy load postponed it
+    if (manager->deferredIndexes & STOCK_DEFERRED_NAME_INDEX) return 1;
+    if (!ReserveNameIndex(index, index->count + 1)) return 0;
+    
+    PlaceNameEntry(index, HashStockName(StockItemAt(manager, itemIndex)->name), itemIndex);
+    return 1;
+}
+
+void NameIndexRemove(StockManager* manager, int itemIndex)
+{
+    StockNameIndex* index = &manager->nameIndex;
+    if (index->count == 0 || (manager->deferredIndexes & STOCK_DEFERRED_NAME_INDEX)) return;
+    
+    unsigned mask = (unsigned)index->capacity - 1;
+    unsigned pos = HashStockName(StockItemAt(manager, itemIndex)->name) & mask;
+    
+    while (index->entries[pos].item != itemIndex)
+    {
+        if (index->entries[pos].item == NAME_INDEX_EMPTY) return;
+        pos = (pos + 1) & mask;
+    }
+    
+    // Backward-shift the rest of the cluster into the hole
+    unsigned hole = pos;
+    unsigned next = (pos + 1) & mask;
+    
+    while (index->entries[next].item != NAME_INDEX_EMPTY)
+    {
+        unsigned home = index->entries[next].hash & mask;
+        
+        // Move the entry if its home slot does not lie in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            index->entries[hole] = index->entries[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    
+    index->entries[hole].item = NAME_INDEX_EMPTY;
+    index->count--;
+}
+
+// Repoint the entry of the item at `fromIndex` (still readable there) to `toIndex`
+void NameIndexMove(StockManager* manager, int fromIndex, int toIndex)
+{
+    StockNameIndex* index = &manager->nameIndex;
+    if (index->count == 0 || (manager->deferredIndexes & STOCK_DEFERRED_NAME_INDEX)) return;
+    
+    unsigned mask = (unsigned)index->capacity - 1;
+    unsigned pos = HashStockName(StockItemAt(manager, fromIndex)->name) & mask;
+    
+    while (index->entries[pos].item != NAME_INDEX_EMPTY)
+    {
+        if (index->entries[pos].item == fromIndex)
+        {
+            index->entries[pos].item = toIndex;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+int NameIndexFind(const StockManager* manager, const char* name)
+{
+    const StockNameIndex* index = &manager->nameIndex;
+    if (index->count == 0) return -1;
+    
+    unsigned hash = HashStockName(name);
+    unsigned mask = (unsigned)index->capacity - 1;
+    unsigned pos = hash & mask;
+    int found = -1;
+    
+    // Duplicate names may exist, so scan the whole cluster and keep the lowest index
+    while (index->entries[pos].item != NAME_INDEX_EMPTY)
+    {
+        const StockNameEntry* entry = &index->entries[pos];
+        
+        if (entry->hash == hash && (found < 0 || entry->item < found) &&
+            strcmp(StockItemAt(manager, entry->item)->name, name) == 0)
+        {
+            found = entry->item;
+        }
+        pos = (pos + 1) & mask;
+    }
+    
+    return found;
+}
+
+// Id -> slot map. Ids are handed out sequentially from nextId, so most of
+// them fit a flat array indexed by id. Ids read from files or the journal can
+// be far apart, though, and they are the items' identity, so they are never
+// refused or rewritten: an id the table would have to grow too far for lives
+// in a small hash map instead, and moves into the table once it grows past it.
+// Each entry carries a generation that changes whenever the id is removed or
+// reloaded, which lets StockHandle values detect that they have gone stale.
+// Sparse entries of removed ids are dropped when the map fills up or the ids
+// are rebuilt; new sparse entries then start past every dropped generation,
+// so a handle to a dropped id still fails if the id comes back.
+
+#define ID_INDEX_MIN_CAPACITY 1024
+#define ID_INDEX_SLACK 4096
+#define SPARSE_ID_MIN_CAPACITY 64
+
+void InitIdIndex(StockManager* manager)
+{
+    manager->idSlots = NULL;
+    manager->idCapacity = 0;
+    manager->sparseIds = NULL;
+    manager->sparseCapacity = 0;
+    manager->sparseCount = 0;
+    manager->sparseGeneration = 1;
+}
+
+void FreeIdIndex(StockManager* manager)
+{
+    free(manager->idSlots);
+    free(manager->sparseIds);
+    InitIdIndex(manager);
+}
+
+static unsigned HashStockId(int id)
+{
+    unsigned hash = (unsigned)id * 0x9E3779B1u;
+    return hash ^ (hash >> 16);
+}
+
+static StockSparseId* FindSparseId(const StockManager* manager, int id)
+{
+    if (manager->sparseCount == 0) return NULL;
+    
+    unsigned mask = (unsigned)manager->sparseCapacity - 1;
+    for (unsigned pos = HashStockId(id) & mask; manager->sparseIds[pos].id != 0; pos = (pos + 1) & mask)
+    {
+        if (manager->sparseIds[pos].id == id) return &manager->sparseIds[pos];
+    }
+    return NULL;
+}
+
+static void PlaceSparseId(StockManager* manager, const StockSparseId* id)
+{
+    unsigned mask = (unsigned)manager->sparseCapacity - 1;
+    unsigned pos = HashStockId(id->id) & mask;
+    
+    while (manager->sparseIds[pos].id != 0) pos = (pos + 1) & mask;
+    manager->sparseIds[pos] = *id;
+    manager->sparseCount++;
+}
+
+static void DropSparseId(StockManager* manager, const StockSparseId* id)
+{
+    if (id->entry.generation >= manager->sparseGeneration) manager->sparseGeneration = id->entry.generation + 1;
+}
+
+// Move the sparse map to `capacity` slots, keeping the entries in use with ids
+// from `limit` up and dropping those of removed ids
+static int RehashSparseIds(StockManager* manager, int capacity, int limit)
+{
+    StockSparseId* ids = (StockSparseId*)calloc(capacity, sizeof(StockSparseId));
+    if (ids == NULL) return 0;
+    
+    StockSparseId* old = manager->sparseIds;
+    int oldCapacity = manager->sparseCapacity;
+    manager->sparseIds = ids;
+    manager->sparseCapacity = capacity;
+    manager->sparseCount = 0;
+    
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].id == 0 || old[i].id < limit) continue;
+        
+        if (old[i].entry.slot >= 0) PlaceSparseId(manager, &old[i]);
+        else DropSparseId(manager, &old[i]);
+    }
+    free(old);
+    return 1;
+}
+
+// Entry of `id` in the sparse map, added (unused) when missing
+static StockIdSlot* RequireSparseId(StockManager* manager, int id)
+{
+    StockSparseId* found = FindSparseId(manager, id);
+    if (found != NULL) return &found->entry;
+    
+    // A full map first sheds the entries of removed ids, then grows if the rest need it
+    if ((manager->sparseCount + 1) * 4 > manager->sparseCapacity * 3)
+    {
+        int used = 1;
+        for (int i = 0; i < manager->sparseCapacity; i++)
+        {
+            if (manager->sparseIds[i].id != 0 && manager->sparseIds[i].entry.slot >= 0) used++;
+        }
+        
+        int capacity = SPARSE_ID_MIN_CAPACITY;
+        while (used * 2 > capacity) capacity *= 2;
+        if (!RehashSparseIds(manager, capacity, 0)) return NULL;
+    }
+    
+    StockSparseId added = { id, { -1, manager->sparseGeneration } };
+    PlaceSparseId(manager, &added);
+    return &FindSparseId(manager, id)->entry;
+}
+
+// Forget every id (after a reload); generations move on so old handles fail
+void ResetIdIndex(StockManager* manager)
+{
+    for (int i = 0; i < manager->idCapacity; i++)
+    {
+        manager->idSlots[i].slot = -1;
+        manager->idSlots[i].generation++;
+    }
+    
+    // Every sparse id is unused now, so the rebuild starts from an empty map
+    for (int i = 0; i < manager->sparseCapacity; i++)
+    {
+        if (manager->sparseIds[i].id != 0) DropSparseId(manager, &manager->sparseIds[i]);
+    }
+    free(manager->sparseIds);
+    manager->sparseIds = NULL;
+    manager->sparseCapacity = 0;
+    manager->sparseCount = 0;
+}
+
+// Any positive id not in use is accepted. The largest id is kept free so
+// nextId never overflows.
+int IdIndexAcceptsId(const StockManager* manager, int id)
+{
+    if (id <= 0 || id == 0x7FFFFFFF) return 0;
+    
+    return IdIndexFind(manager, id) < 0;
+}
+
+// Grow the flat table to cover `id` while it stays mostly full; 0 leaves the id to the sparse map
+static int ReserveIdIndex(StockManager* manager, int id)
+{
+    if (id < manager->idCapacity) return 1;
+    if (id > manager->itemCount * 4 + ID_INDEX_SLACK) return 0;
+    
+    int capacity = manager->idCapacity > 0 ? manager->idCapacity : ID_INDEX_MIN_CAPACITY;
+    while (capacity <= id) capacity *= 2;
+    
+    StockIdSlot* slots = (StockIdSlot*)realloc(manager->idSlots, capacity * sizeof(StockIdSlot));
+    if (slots == NULL) return 0;
+    
+    // Past every dropped sparse entry, since the table may now cover its id
+    for (int i = manager->idCapacity; i < capacity; i++)
+    {
+        slots[i].slot = -1;
+        slots[i].generation = manager->sparseGeneration;
+    }
+    manager->idSlots = slots;
+    manager->idCapacity = capacity;
+    
+    // Sparse ids the table now covers move into it
+    if (manager->sparseCount > 0)
+    {
+        StockSparseId* old = manager->sparseIds;
+        int oldCapacity = manager->sparseCapacity;
+        
+        for (int i = 0; i < oldCapacity; i++)
+        {
+            if (old[i].id != 0 && old[i].id < capacity) slots[old[i].id] = old[i].entry;
+        }
+        
+        // Rehash the rest into an array of the same size
+        RehashSparseIds(manager, oldCapacity, capacity);
+        // Without memory the moved entries stay behind; lookups below the table size never reach them
+    }
+    return 1;
+}
+
+static StockIdSlot* IdIndexEntry(const StockManager* manager, int id)
+{
+    if (id <= 0) return NULL;
+    if (id < manager->idCapacity) return &manager->idSlots[id];
+    
+    StockSparseId* sparse = FindSparseId(manager, id);
+    return sparse != NULL ? &sparse->entry : NULL;
+}
+
+int IdIndexSet(StockManager* manager, int id, int itemIndex)
+{
+    if (id <= 0) return 0;
+    
+    StockIdSlot* entry = ReserveIdIndex(manager, id) ? &manager->idSlots[id] : RequireSparseId(manager, id);
+    if (entry == NULL) return 0;
+    
+    entry->slot = itemIndex;
+    return 1;
+}
+
+void IdIndexClear(StockManager* manager, int id)
+{
+    StockIdSlot* entry = IdIndexEntry(manager, id);
+    if (entry == NULL) return;
+    
+    entry->slot = -1;
+    entry->generation++;
+}
+
+int IdIndexFind(const StockManager* manager, int id)
+{
+    StockIdSlot* entry = IdIndexEntry(manager, id);
+    
+    return entry != NULL ? entry->slot : -1;
+}
+
+// Generation of `id`, for handles (1 for an id never seen)
+unsigned IdIndexGeneration(const StockManager* manager, int id)
+{
+    StockIdSlot* entry = IdIndexEntry(manager, id);
+    
+    return entry != NULL ? entry->generation : 1;
+}
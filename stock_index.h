@@ -0,0 +1,27 @@
+#ifndef STOCK_INDEX_H
+#define STOCK_INDEX_H
+
+#include "stock.h"
+
+// Internal helpers for the product name hash index (see StockNameIndex)
+unsigned HashStockName(const char* name);
+void InitNameIndex(StockNameIndex* index);
+void FreeNameIndex(StockNameIndex* index);
+int RebuildNameIndex(StockManager* manager);
+int NameIndexReserve(StockManager* manager);
+int NameIndexInsert(StockManager* manager, int itemIndex);
+void NameIndexRemove(StockManager* manager, int itemIndex);
+void NameIndexMove(StockManager* manager, int fromIndex, int toIndex);
+int NameIndexFind(const StockManager* manager, const char* name);
+
+// Internal helpers for the id -> slot map (see StockIdSlot)
+void InitIdIndex(StockManager* manager);
+void FreeIdIndex(StockManager* manager);
+void ResetIdIndex(StockManager* manager);
+int IdIndexAcceptsId(const StockManager* manager, int id);
+int IdIndexSet(StockManager* manager, int id, int itemIndex);
+void IdIndexClear(StockManager* manager, int id);
+int IdIndexFind(const StockManager* manager, int id);
+unsigned IdIndexGeneration(const StockManager* manager, int id);
+
+#endif // STOCK_INDEX_H
@@ -0,0 +1,160 @@
+#ifndef STOCK_INTERNAL_H
+#define STOCK_INTERNAL_H
+
+#include "stock.h"
+
+// Helpers shared between the core translation units
+int IsValidUTF8(const char* str);
+void SafeUTF8Copy(char* dest, const char* src, size_t destSize);
+int ReserveStockSegments(StockManager* manager, int segmentCount);
+int AllocateStockSegment(StockManager* manager, int segment);
+int EnsureStockCapacity(StockManager* manager, int capacity);
+int InsertStockItem(StockManager* manager, const char* name, const char* category, int stock, int id);
+void BeginStockLoad(StockManager* manager, int nextId);
+void FinishStockLoad(StockManager* manager);
+int RebuildIdIndex(StockManager* manager);
+void MarkStockDirty(StockManager* manager, int index);
+void ResetStockDirty(StockManager* manager, const char* file);   // NULL stops tracking
+int InjectStockFault(int point);
+
+// Packed copy of the inventory taken for a background save
+typedef struct {
+    int itemCount;
+    int nextId;
+    int* fields;                // id, stock, category code, reorder level per item
+    size_t* nameOffsets;        // Into names, per item
+    char* names;                // NUL-terminated names, back to back
+    StockCategoryDict categories;
+} StockSnapshot;
+
+StockSnapshot* CaptureStockSnapshot(StockManager* manager);
+StockManager* RestoreStockSnapshot(StockSnapshot* snapshot);
+void FreeStockSnapshot(StockSnapshot* snapshot);
+
+// Paging state of a visitor query (see StockItemVisitor)
+typedef struct {
+    StockItemVisitor visitor;
+    void* context;
+    int skip;               // Matches still to pass over
+    int remaining;          // Matches still to deliver, or -1 for no limit
+    int delivered;
+} StockVisit;
+
+static inline void BeginStockVisit(StockVisit* visit, StockItemVisitor visitor, void* context, int offset, int limit)
+{
+    visit->visitor = visitor;
+    visit->context = context;
+    visit->skip = offset > 0 ? offset : 0;
+    visit->remaining = limit > 0 ? limit : -1;
+    visit->delivered = 0;
+}
+
+// Hand one match to the visitor; returns 0 once the query can stop
+static inline int DeliverStockMatch(StockManager* manager, StockVisit* visit, int index)
+{
+    if (visit->skip > 0)
+    {
+        visit->skip--;
+        return 1;
+    }
+    if (visit->remaining == 0) return 0;
+    
+    visit->delivered++;
+    if (visit->remaining > 0) visit->remaining--;
+    if (!visit->visitor(manager, index, visit->context)) visit->remaining = 0;
+    return visit->remaining != 0;
+}
+
+// Visitor that appends indices to a StockIndexList (the *Indices query variants)
+typedef struct {
+    int* indices;
+    int count;
+    int capacity;
+} StockIndexList;
+
+static inline int AppendStockIndex(StockManager* manager, int index, void* context)
+{
+    StockIndexList* list = (StockIndexList*)context;
+    (void)manager;
+    
+    list->indices[list->count++] = index;
+    return list->count < list->capacity;
+}
+
+// Visitor that copies whole items (the legacy result-array queries)
+typedef struct {
+    StockItem* results;
+    int count;
+} StockItemCopies;
+
+static inline int CopyStockItemMatch(StockManager* manager, int index, void* context)
+{
+    StockItemCopies* copies = (StockItemCopies*)context;
+    
+    copies->results[copies->count++] = *StockItemAt(manager, index);
+    return 1;
+}
+
+// Lazily loaded items (see LoadStockFromFileMapped)
+int MaterializeStockItem(StockManager* manager, int index);
+int MappedStockItemId(const StockManager* manager, int index);
+void ReleaseStockMapping(StockManager* manager);
+int RequireIdIndex(StockManager* manager);
+int RequireNameIndex(StockManager* manager);
+
+static inline int IsStockItemResident(const StockManager* manager, int index)
+{
+    return index >= manager->mappedCount || (manager->residentBits[index >> 3] & (1u << (index & 7)));
+}
+
+// Item access that decodes a mapped item on first use (NULL if out of memory)
+static inline StockItem* ResidentStockItem(StockManager* manager, int index)
+{
+    if (!IsStockItemResident(manager, index) && !MaterializeStockItem(manager, index)) return NULL;
+    return StockItemAt(manager, index);
+}
+
+// Base-128 varints and little-endian integers shared by the file and journal formats
+static inline size_t EncodeStockVarint(unsigned char* out, unsigned value)
+{
+    size_t count = 0;
+    
+    while (value >= 0x80)
+    {
+        out[count++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[count++] = (unsigned char)value;
+    return count;
+}
+
+static inline int DecodeStockVarint(const unsigned char** cursor, const unsigned char* end, unsigned* value)
+{
+    unsigned result = 0;
+    
+    for (int shift = 0; shift < 35 && *cursor < end; shift += 7)
+    {
+        unsigned char byte = *(*cursor)++;
+        
+        result |= (unsigned)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return 1;
+        }
+    }
+    
+    return 0; // Truncated or over-long encoding
+}
+
+static inline void StoreStockU32(unsigned char* out, unsigned value)
+{
+    for (int i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static inline unsigned ReadStockU32(const unsigned char* bytes)
+{
+    return (unsigned)bytes[0] | ((unsigned)bytes[1] << 8) | ((unsigned)bytes[2] << 16) | ((unsigned)bytes[3] << 24);
+}
+
+#endif // STOCK_INTERNAL_H
@@ -0,0 +1,420 @@
+#include "stock_journal.h"
+#include "stock_internal.h"
+#include "stock_platform.h"
+#include "stock_undo.h"
+
+// Journal file layout:
+//   "HSMJ", u16 version, u16 flags (little endian)
+//   per record: varint body length, body, u32 FNV-1a checksum of the body
+//   body: u8 operation, varint item id, then
+//     PUT:    varint name length + UTF-8 bytes, varint category length + UTF-8 bytes, varint stock
+//     STOCK:  varint stock
+//     REMOVE: nothing
+//     REORDER: varint reorder level
+//
+// Records carry absolute values keyed by id, so replaying records the snapshot
+// already contains (a crash between writing the snapshot and emptying the
+// journal) leaves the inventory unchanged. Replay stops at the first torn or
+// damaged record, which is cut off before new records are appended.
+
+#define STOCK_JOURNAL_MAGIC "HSMJ"
+#define STOCK_JOURNAL_VERSION 1
+#define STOCK_JOURNAL_HEADER_SIZE 8
+
+#define JOURNAL_PUT     1
+#define JOURNAL_STOCK   2
+#define JOURNAL_REMOVE  3
+#define JOURNAL_REORDER 4
+
+// Largest body: operation, id, both strings with their lengths, stock
+#define JOURNAL_MAX_BODY (1 + 5 + 5 + MAX_NAME_LENGTH + 5 + MAX_CATEGORY_LENGTH + 5)
+
+struct StockJournal {
+    FILE* file;
+    char* snapshotFile;
+    char* journalFile;
+    unsigned char* pending;     // Encoded records waiting for the next commit
+    size_t pendingLength;
+    size_t pendingCapacity;
+    int pendingCount;
+    long long committedSize;    // Journal bytes known to be on disk
+    int failed;                 // A record was lost; cleared by the next compaction
+    int compacting;             // Snapshots of this journal being written or waiting
+};
+
+static unsigned JournalChecksum(const unsigned char* data, size_t length)
+{
+    unsigned hash = 2166136261u;
+    
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+static char* CopyFileName(const char* name)
+{
+    char* copy = (char*)malloc(strlen(name) + 1);
+    if (copy != NULL) strcpy(copy, name);
+    return copy;
+}
+
+static size_t EncodeString(unsigned char* out, const char* text)
+{
+    size_t length = strlen(text);
+    size_t count = EncodeStockVarint(out, (unsigned)length);
+    
+    memcpy(out + count, text, length);
+    return count + length;
+}
+
+static int DecodeString(const unsigned char** cursor, const unsigned char* end, char* dest, size_t destSize)
+{
+    unsigned length;
+    if (!DecodeStockVarint(cursor, end, &length) || length > (size_t)(end - *cursor)) return 0;
+    
+    size_t kept = length < destSize ? length : destSize - 1;
+    memcpy(dest, *cursor, kept);
+    dest[kept] = '\0';
+    *cursor += length;
+    return 1;
+}
+
+// Write pending records with one write and one sync (the group commit)
+static int CommitJournal(struct StockJournal* journal)
+{
+    if (journal->pendingLength == 0) return !journal->failed;
+    
+    if (fwrite(journal->pending, 1, journal->pendingLength, journal->file) != journal->pendingLength ||
+        !SyncStockFile(journal->file))
+    {
+        // Cut a partially written batch so later records are not stranded behind it
+        TruncateStockFile(journal->file, journal->committedSize);
+        fseek(journal->file, 0, SEEK_END);
+        journal->failed = 1;
+    }
+    else
+    {
+        journal->committedSize += (long long)journal->pendingLength;
+    }
+    
+    journal->pendingLength = 0;
+    journal->pendingCount = 0;
+    return !journal->failed;
+}
+
+static void AppendJournalRecord(StockManager* manager, const unsigned char* body, size_t length)
+{
+    struct StockJournal* journal = manager->journal;
+    size_t needed = journal->pendingLength + 5 + length + 4;
+    
+    if (needed > journal->pendingCapacity)
+    {
+        size_t capacity = journal->pendingCapacity > 0 ? journal->pendingCapacity * 2 : 4096;
+        while (capacity < needed) capacity *= 2;
+        
+        unsigned char* grown = (unsigned char*)realloc(journal->pending, capacity);
+        if (grown == NULL)
+        {
+            journal->failed = 1;
+            return;
+        }
+        journal->pending = grown;
+        journal->pendingCapacity = capacity;
+    }
+    
+    unsigned char* out = journal->pending + journal->pendingLength;
+    size_t count = EncodeStockVarint(out, (unsigned)length);
+    
+    memcpy(out + count, body, length);
+    StoreStockU32(out + count + length, JournalChecksum(body, length));
+    journal->pendingLength += count + length + 4;
+    
+    if (++journal->pendingCount >= STOCK_JOURNAL_BATCH) FlushStockJournal(manager);
+}
+
+void JournalPutItem(StockManager* manager, const StockItem* item)
+{
+    unsigned char body[JOURNAL_MAX_BODY];
+    size_t length = 0;
+    
+    body[length++] = JOURNAL_PUT;
+    length += EncodeStockVarint(body + length, (unsigned)item->id);
+    length += EncodeString(body + length, item->name);
+    length += EncodeString(body + length, GetStockItemCategory(manager, item));
+    length += EncodeStockVarint(body + length, (unsigned)item->stock);
+    
+    AppendJournalRecord(manager, body, length);
+}
+
+void JournalSetStock(StockManager* manager, int id, int stock)
+{
+    unsigned char body[JOURNAL_MAX_BODY];
+    size_t length = 0;
+    
+    body[length++] = JOURNAL_STOCK;
+    length += EncodeStockVarint(body + length, (unsigned)id);
+    length += EncodeStockVarint(body + length, (unsigned)stock);
+    
+    AppendJournalRecord(manager, body, length);
+}
+
+void JournalSetReorderLevel(StockManager* manager, int id, int level)
+{
+    unsigned char body[JOURNAL_MAX_BODY];
+    size_t length = 0;
+    
+    body[length++] = JOURNAL_REORDER;
+    length += EncodeStockVarint(body + length, (unsigned)id);
+    length += EncodeStockVarint(body + length, (unsigned)level);
+    
+    AppendJournalRecord(manager, body, length);
+}
+
+void JournalRemoveItem(StockManager* manager, int id)
+{
+    unsigned char body[JOURNAL_MAX_BODY];
+    size_t length = 0;
+    
+    body[length++] = JOURNAL_REMOVE;
+    length += EncodeStockVarint(body + length, (unsigned)id);
+    
+    AppendJournalRecord(manager, body, length);
+}
+
+// Apply one record; records that no longer fit the inventory are skipped
+static void ReplayJournalRecord(StockManager* manager, const unsigned char* body, size_t length)
+{
+    const unsigned char* cursor = body + 1;
+    const unsigned char* end = body + length;
+    unsigned id, stock;
+    
+    if (length == 0 || !DecodeStockVarint(&cursor, end, &id) || id == 0 || id > 0x7FFFFFFFu) return;
+    
+    int index = FindStockItemById(manager, (int)id);
+    
+    switch (body[0])
+    {
+        case JOURNAL_PUT:
+        {
+            char name[MAX_NAME_LENGTH];
+            char category[MAX_CATEGORY_LENGTH];
+            
+            if (!DecodeString(&cursor, end, name, MAX_NAME_LENGTH) ||
+                !DecodeString(&cursor, end, category, MAX_CATEGORY_LENGTH) ||
+                !DecodeStockVarint(&cursor, end, &stock) || stock > 0x7FFFFFFFu)
+            {
+                return;
+            }
+            
+            if (index >= 0)
+                UpdateStockItem(manager, index, name, category, (int)stock);
+            else
+                InsertStockItem(manager, name, category, (int)stock, (int)id);
+            break;
+        }
+        
+        case JOURNAL_STOCK:
+            if (index >= 0 && DecodeStockVarint(&cursor, end, &stock) && stock <= 0x7FFFFFFFu)
+            {
+                AdjustStockItem(manager, index, (int)stock - GetStockItem(manager, index)->stock);
+            }
+            break;
+        
+        case JOURNAL_REMOVE:
+            if (index >= 0) RemoveStockItem(manager, index);
+            break;
+        
+        case JOURNAL_REORDER:
+            if (index >= 0 && DecodeStockVarint(&cursor, end, &stock) && stock <= 0x7FFFFFFFu)
+            {
+                SetStockReorderLevel(manager, index, (int)stock);
+            }
+            break;
+    }
+}
+
+// Replay a mapped journal; returns the length of its intact prefix, or -1 if
+// the file is not a journal at all
+static long long ReplayJournal(StockManager* manager, const unsigned char* data, size_t size)
+{
+    if (size < STOCK_JOURNAL_HEADER_SIZE) return 0;
+    if (memcmp(data, STOCK_JOURNAL_MAGIC, 4) != 0 || (data[4] | (data[5] << 8)) != STOCK_JOURNAL_VERSION) return -1;
+    
+    const unsigned char* cursor = data + STOCK_JOURNAL_HEADER_SIZE;
+    const unsigned char* end = data + size;
+    long long intact = STOCK_JOURNAL_HEADER_SIZE;
+    
+    while (cursor < end)
+    {
+        unsigned length;
+        if (!DecodeStockVarint(&cursor, end, &length) || (size_t)(end - cursor) < (size_t)length + 4) break;
+        if (ReadStockU32(cursor + length) != JournalChecksum(cursor, length)) break;
+        
+        ReplayJournalRecord(manager, cursor, length);
+        cursor += (size_t)length + 4;
+        intact = (long long)(cursor - data);
+    }
+    
+    return intact;
+}
+
+static void FreeJournal(struct StockJournal* journal)
+{
+    if (journal->file != NULL) fclose(journal->file);
+    free(journal->snapshotFile);
+    free(journal->journalFile);
+    free(journal->pending);
+    free(journal);
+}
+
+int OpenStockJournal(StockManager* manager, const char* snapshotFile, const char* journalFile)
+{
+    if (manager == NULL || snapshotFile == NULL || journalFile == NULL) return 0;
+    
+    CloseStockJournal(manager);
+    
+    struct StockJournal* journal = (struct StockJournal*)calloc(1, sizeof(struct StockJournal));
+    if (journal == NULL) return 0;
+    
+    journal->snapshotFile = CopyFileName(snapshotFile);
+    journal->journalFile = CopyFileName(journalFile);
+    if (journal->snapshotFile == NULL || journal->journalFile == NULL)
+    {
+        FreeJournal(journal);
+        return 0;
+    }
+    
+    // Bring the loaded snapshot up to date; nothing is recorded while replaying
+    long long intact = 0;
+    StockFileView view;
+    if (MapStockFileView(journalFile, &view))
+    {
+        // Subscribers get the replayed edits as one change set
+        BeginStockBatch(manager);
+        intact = ReplayJournal(manager, view.data, view.size);
+        EndStockBatch(manager);
+        UnmapStockFileView(&view);
+        
+        // Recovered edits are not the user's to undo
+        ClearStockUndo(manager);
+    }
+    
+    // Never overwrite a file that is not a journal
+    if (intact < 0)
+    {
+        FreeJournal(journal);
+        return 0;
+    }
+    
+    journal->file = fopen(journalFile, "r+b");
+    if (journal->file == NULL) journal->file = fopen(journalFile, "w+b");
+    if (journal->file == NULL)
+    {
+        FreeJournal(journal);
+        return 0;
+    }
+    
+    int ready;
+    if (intact < STOCK_JOURNAL_HEADER_SIZE)
+    {
+        unsigned char header[STOCK_JOURNAL_HEADER_SIZE] = { 'H', 'S', 'M', 'J', STOCK_JOURNAL_VERSION, 0, 0, 0 };
+        
+        ready = TruncateStockFile(journal->file, 0) && fseek(journal->file, 0, SEEK_SET) == 0 &&
+                fwrite(header, 1, STOCK_JOURNAL_HEADER_SIZE, journal->file) == STOCK_JOURNAL_HEADER_SIZE &&
+                SyncStockFile(journal->file);
+        intact = STOCK_JOURNAL_HEADER_SIZE;
+    }
+    else
+    {
+        // Drop a torn tail left by a crash mid-commit
+        ready = TruncateStockFile(journal->file, intact) && fseek(journal->file, 0, SEEK_END) == 0;
+    }
+    
+    if (!ready)
+    {
+        FreeJournal(journal);
+        return 0;
+    }
+    
+    journal->committedSize = intact;
+    manager->journal = journal;
+    return 1;
+}
+
+int FlushStockJournal(StockManager* manager)
+{
+    if (manager == NULL || manager->journal == NULL) return 0;
+    
+    struct StockJournal* journal = manager->journal;
+    
+    PollStockSave(manager);
+    if (!CommitJournal(journal)) return 0;
+    
+    // Fold a long journal into a fresh snapshot, in the background when a saver runs
+    if (journal->committedSize >= STOCK_JOURNAL_COMPACT_SIZE && !journal->compacting)
+    {
+        if (manager->saver != NULL && RequestStockSave(manager, journal->snapshotFile)) return 1;
+        return CompactStockJournal(manager);
+    }
+    return 1;
+}
+
+int CompactStockJournal(StockManager* manager)
+{
+    if (manager == NULL || manager->journal == NULL) return 0;
+    
+    long long mark = JournalSaveMark(manager, manager->journal->snapshotFile);
+    int saved = SaveStockToFile(manager, manager->journal->snapshotFile);
+    
+    return FinishJournalSave(manager, mark, saved) && saved;
+}
+
+long long JournalSaveMark(StockManager* manager, const char* snapshotFile)
+{
+    struct StockJournal* journal = manager->journal;
+    if (journal == NULL || strcmp(journal->snapshotFile, snapshotFile) != 0) return -1;
+    
+    // The snapshot will hold everything committed so far
+    CommitJournal(journal);
+    journal->compacting++;
+    return journal->committedSize;
+}
+
+int FinishJournalSave(StockManager* manager, long long mark, int saved)
+{
+    struct StockJournal* journal = manager->journal;
+    if (journal == NULL || mark < 0) return 1;
+    
+    // A newer snapshot still on its way will do the trimming
+    if (--journal->compacting > 0) return 1;
+    
+    // Records added after the snapshot was taken keep the journal alive; replaying
+    // the older ones over the new snapshot is harmless and the next save trims them
+    if (!saved || journal->committedSize != mark || journal->pendingLength > 0) return 1;
+    
+    if (!TruncateStockFile(journal->file, STOCK_JOURNAL_HEADER_SIZE) ||
+        fseek(journal->file, 0, SEEK_END) != 0 || !SyncStockFile(journal->file))
+    {
+        return 0;
+    }
+    
+    journal->committedSize = STOCK_JOURNAL_HEADER_SIZE;
+    journal->failed = 0;
+    return 1;
+}
+
+void CloseStockJournal(StockManager* manager)
+{
+    if (manager == NULL || manager->journal == NULL) return;
+    
+    // Let a background snapshot of this journal finish its bookkeeping
+    if (manager->journal->compacting) WaitStockSave(manager);
+    
+    CommitJournal(manager->journal);
+    FreeJournal(manager->journal);
+    manager->journal = NULL;
+}
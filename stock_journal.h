@@ -0,0 +1,18 @@
+#ifndef STOCK_JOURNAL_H
+#define STOCK_JOURNAL_H
+
+#include "stock.h"
+
+// Internal hooks that record changes in the open journal (see OpenStockJournal)
+void JournalPutItem(StockManager* manager, const StockItem* item);
+void JournalSetStock(StockManager* manager, int id, int stock);
+void JournalSetReorderLevel(StockManager* manager, int id, int level);
+void JournalRemoveItem(StockManager* manager, int id);
+
+// Snapshot bookkeeping: a save of the journal's snapshot file empties the
+// journal if nothing was recorded between JournalSaveMark and FinishJournalSave.
+// Every mark must be finished once, with saved = 0 for a copy that was dropped.
+long long JournalSaveMark(StockManager* manager, const char* snapshotFile);  // -1 if unrelated
+int FinishJournalSave(StockManager* manager, long long mark, int saved);
+
+#endif // STOCK_JOURNAL_H
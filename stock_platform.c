@@ -0,0 +1,400 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64    // 64-bit off_t for fseeko, ftello and ftruncate on 32-bit systems
+#endif
+
+#include "stock_platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+int MapStockFileView(const char* filename, StockFileView* view)
+{
+    if (filename == NULL || view == NULL) return 0;
+    
+    memset(view, 0, sizeof(StockFileView));
+    
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+    
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1)
+    {
+        CloseHandle(file);
+        return 0;
+    }
+    
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return 0;
+    }
+    
+    const unsigned char* data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+    
+    view->data = data;
+    view->size = (size_t)size.QuadPart;
+    view->handles[0] = file;
+    view->handles[1] = mapping;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        close(fd);
+        return 0;
+    }
+    
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (data == MAP_FAILED) return 0;
+    
+    view->data = (const unsigned char*)data;
+    view->size = (size_t)info.st_size;
+#endif
+    
+    return 1;
+}
+
+void UnmapStockFileView(StockFileView* view)
+{
+    if (view == NULL || view->data == NULL) return;
+    
+#ifdef _WIN32
+    UnmapViewOfFile(view->data);
+    CloseHandle((HANDLE)view->handles[1]);
+    CloseHandle((HANDLE)view->handles[0]);
+#else
+    munmap((void*)view->data, view->size);
+#endif
+    
+    memset(view, 0, sizeof(StockFileView));
+}
+
+FILE* OpenStockFile(const char* filename, const char* mode)
+{
+    if (filename == NULL || mode == NULL) return NULL;
+    
+#ifdef _WIN32
+    wchar_t wideMode[8];
+    int modeLength = MultiByteToWideChar(CP_UTF8, 0, mode, -1, wideMode, 8);
+    int nameLength = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, filename, -1, NULL, 0);
+    if (modeLength == 0 || nameLength == 0) return NULL;
+    
+    wchar_t* wideName = (wchar_t*)malloc(nameLength * sizeof(wchar_t));
+    if (wideName == NULL) return NULL;
+    
+    FILE* file = NULL;
+    if (MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, filename, -1, wideName, nameLength) == nameLength)
+    {
+        file = _wfopen(wideName, wideMode);
+    }
+    free(wideName);
+    return file;
+#else
+    return fopen(filename, mode);
+#endif
+}
+
+int SyncStockFile(FILE* file)
+{
+    if (file == NULL || fflush(file) != 0) return 0;
+    
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+int TruncateStockFile(FILE* file, long long size)
+{
+    if (file == NULL || size < 0 || fflush(file) != 0) return 0;
+    
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+int SeekStockFile(FILE* file, long long offset, int origin)
+{
+    if (file == NULL) return 0;
+    
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin) == 0;
+#else
+    if ((off_t)offset != offset) return 0;
+    
+    return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+}
+
+long long TellStockFile(FILE* file)
+{
+    if (file == NULL) return -1;
+    
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (long long)ftello(file);
+#endif
+}
+
+int ReplaceStockFile(const char* source, const char* target)
+{
+    if (source == NULL || target == NULL) return 0;
+    
+#ifdef _WIN32
+    return MoveFileExA(source, target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(source, target) == 0;
+#endif
+}
+
+struct StockThread {
+    void (*entry)(void*);
+    void* argument;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+struct StockLock {
+#ifdef _WIN32
+    CRITICAL_SECTION mutex;
+    CONDITION_VARIABLE condition;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+#endif
+};
+
+#ifdef _WIN32
+static DWORD WINAPI RunStockThread(LPVOID parameter)
+{
+    StockThread* thread = (StockThread*)parameter;
+    thread->entry(thread->argument);
+    return 0;
+}
+#else
+static void* RunStockThread(void* parameter)
+{
+    StockThread* thread = (StockThread*)parameter;
+    thread->entry(thread->argument);
+    return NULL;
+}
+#endif
+
+StockThread* StartStockThread(void (*entry)(void*), void* argument)
+{
+    if (entry == NULL) return NULL;
+    
+    StockThread* thread = (StockThread*)malloc(sizeof(StockThread));
+    if (thread == NULL) return NULL;
+    
+    thread->entry = entry;
+    thread->argument = argument;
+    
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, RunStockThread, thread, 0, NULL);
+    if (thread->handle == NULL)
+#else
+    if (pthread_create(&thread->handle, NULL, RunStockThread, thread) != 0)
+#endif
+    {
+        free(thread);
+        return NULL;
+    }
+    
+    return thread;
+}
+
+int CountStockProcessors(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+void JoinStockThread(StockThread* thread)
+{
+    if (thread == NULL) return;
+    
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    
+    free(thread);
+}
+
+StockLock* CreateStockLock(void)
+{
+    StockLock* lock = (StockLock*)malloc(sizeof(StockLock));
+    if (lock == NULL) return NULL;
+    
+#ifdef _WIN32
+    InitializeCriticalSection(&lock->mutex);
+    InitializeConditionVariable(&lock->condition);
+#else
+    if (pthread_mutex_init(&lock->mutex, NULL) != 0)
+    {
+        free(lock);
+        return NULL;
+    }
+    if (pthread_cond_init(&lock->condition, NULL) != 0)
+    {
+        pthread_mutex_destroy(&lock->mutex);
+        free(lock);
+        return NULL;
+    }
+#endif
+    
+    return lock;
+}
+
+void DestroyStockLock(StockLock* lock)
+{
+    if (lock == NULL) return;
+    
+#ifdef _WIN32
+    DeleteCriticalSection(&lock->mutex);
+#else
+    pthread_cond_destroy(&lock->condition);
+    pthread_mutex_destroy(&lock->mutex);
+#endif
+    
+    free(lock);
+}
+
+void AcquireStockLock(StockLock* lock)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&lock->mutex);
+#else
+    pthread_mutex_lock(&lock->mutex);
+#endif
+}
+
+void ReleaseStockLock(StockLock* lock)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&lock->mutex);
+#else
+    pthread_mutex_unlock(&lock->mutex);
+#endif
+}
+
+void WaitStockLock(StockLock* lock)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(&lock->condition, &lock->mutex, INFINITE);
+#else
+    pthread_cond_wait(&lock->condition, &lock->mutex);
+#endif
+}
+
+void SignalStockLock(StockLock* lock)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(&lock->condition);
+#else
+    pthread_cond_broadcast(&lock->condition);
+#endif
+}
+
+void* LoadStockPointer(void* volatile* target)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchangePointer(target, NULL, NULL);
+#else
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void StoreStockPointer(void* volatile* target, void* value)
+{
+#ifdef _WIN32
+    InterlockedExchangePointer(target, value);
+#else
+    __atomic_store_n(target, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+unsigned long long LoadStockCounter(volatile unsigned long long* target)
+{
+#ifdef _WIN32
+    return (unsigned long long)InterlockedCompareExchange64((volatile LONG64*)target, 0, 0);
+#else
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void StoreStockCounter(volatile unsigned long long* target, unsigned long long value)
+{
+#ifdef _WIN32
+    InterlockedExchange64((volatile LONG64*)target, (LONG64)value);
+#else
+    __atomic_store_n(target, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+int SwapStockCounter(volatile unsigned long long* target, unsigned long long expected, unsigned long long value)
+{
+#ifdef _WIN32
+    return (unsigned long long)InterlockedCompareExchange64((volatile LONG64*)target, (LONG64)value, (LONG64)expected) == expected;
+#else
+    return __atomic_compare_exchange_n(target, &expected, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+int ClaimStockFlag(volatile long* flag)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchange(flag, 1, 0) == 0;
+#else
+    long expected = 0;
+    return __atomic_compare_exchange_n(flag, &expected, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void ClearStockFlag(volatile long* flag)
+{
+#ifdef _WIN32
+    InterlockedExchange(flag, 0);
+#else
+    __atomic_store_n(flag, 0, __ATOMIC_SEQ_CST);
+#endif
+}
@@ -0,0 +1,54 @@
+#ifndef STOCK_PLATFORM_H
+#define STOCK_PLATFORM_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Operating system services used by the portable core (Win32 or POSIX)
+
+// Read-only view of a whole file
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    void* handles[2];       // Platform handles kept open while mapped
+} StockFileView;
+
+int MapStockFileView(const char* filename, StockFileView* view);
+void UnmapStockFileView(StockFileView* view);
+
+// Files named in UTF-8; Windows opens them by their UTF-16 name, so names
+// outside the ANSI code page work too
+FILE* OpenStockFile(const char* filename, const char* mode);
+
+// Durable file updates
+int SyncStockFile(FILE* file);                                  // Flush buffers down to the disk
+int TruncateStockFile(FILE* file, long long size);
+int SeekStockFile(FILE* file, long long offset, int origin);     // fseek past 2 GB; 1 on success
+long long TellStockFile(FILE* file);                            // ftell past 2 GB; -1 on error
+int ReplaceStockFile(const char* source, const char* target);   // Atomic rename over `target`
+
+// Threads and a mutex paired with a condition variable
+typedef struct StockThread StockThread;
+typedef struct StockLock StockLock;
+
+StockThread* StartStockThread(void (*entry)(void*), void* argument);
+void JoinStockThread(StockThread* thread);      // Waits for the thread and frees it
+int CountStockProcessors(void);                 // Logical processors online, at least 1
+StockLock* CreateStockLock(void);
+void DestroyStockLock(StockLock* lock);
+void AcquireStockLock(StockLock* lock);
+void ReleaseStockLock(StockLock* lock);
+void WaitStockLock(StockLock* lock);            // Lock held: sleep until signalled
+void SignalStockLock(StockLock* lock);          // Wake every waiter
+
+// Sequentially consistent atomics for the lock-free reader paths
+void* LoadStockPointer(void* volatile* target);
+void StoreStockPointer(void* volatile* target, void* value);
+unsigned long long LoadStockCounter(volatile unsigned long long* target);
+void StoreStockCounter(volatile unsigned long long* target, unsigned long long value);
+int SwapStockCounter(volatile unsigned long long* target, unsigned long long expected,
+                     unsigned long long value);     // 1 if `target` held `expected` and now holds `value`
+int ClaimStockFlag(volatile long* flag);        // 1 if this call changed the flag from 0 to 1
+void ClearStockFlag(volatile long* flag);
+
+#endif // STOCK_PLATFORM_H
@@ -0,0 +1,218 @@
+#include "stock_internal.h"
+#include "stock_platform.h"
+#include "stock_pool.h"
+
+// Query threads. The calling thread and the pool's workers each start a job
+// with an equal run of shards. A thread takes shards from the front of its own
+// run and, once that is empty, steals from the back of another's, so a thread
+// that hits slow shards is helped by the others instead of holding up the job.
+// Each run is a (next, end) pair packed into one word and updated with
+// compare-and-swap, so the owner and a thief never take the same shard.
+//
+// Between jobs the workers sleep on the pool's lock; the caller waits on it
+// until every worker has left the job.
+
+#define RUN_NEXT(run) ((int)((run) & 0xFFFFFFFFu))
+#define RUN_END(run) ((int)((run) >> 32))
+#define PACK_RUN(next, end) ((unsigned long long)(unsigned)(next) | ((unsigned long long)(unsigned)(end) << 32))
+
+// One cache line per thread, so taking a shard does not slow the others
+typedef struct {
+    volatile unsigned long long run;
+    char padding[64 - sizeof(unsigned long long)];
+} StockShardRun;
+
+typedef struct {
+    struct StockPool* pool;
+    int index;              // Run of this worker; the caller uses run 0
+} StockWorker;
+
+struct StockPool {
+    int threadCount;        // Workers plus the calling thread
+    StockThread** threads;
+    StockWorker* workers;
+    StockShardRun* runs;    // One per thread
+    StockLock* lock;
+    
+    // Guarded by lock
+    unsigned long long generation;  // Job number, moved on to wake the workers
+    int finished;           // Workers done with the current job
+    int stopping;
+    
+    // Set by the caller before a job starts
+    StockShardTask task;
+    void* context;
+};
+
+// Next shard of run `own`, or a shard stolen from another run; -1 when none are left
+static int TakeStockShard(struct StockPool* pool, int own)
+{
+    for (;;)
+    {
+        unsigned long long run = LoadStockCounter(&pool->runs[own].run);
+        if (RUN_NEXT(run) >= RUN_END(run)) break;
+        if (SwapStockCounter(&pool->runs[own].run, run, PACK_RUN(RUN_NEXT(run) + 1, RUN_END(run)))) return RUN_NEXT(run);
+    }
+    
+    for (int i = 1; i < pool->threadCount; i++)
+    {
+        int victim = (own + i) % pool->threadCount;
+        
+        for (;;)
+        {
+            unsigned long long run = LoadStockCounter(&pool->runs[victim].run);
+            if (RUN_NEXT(run) >= RUN_END(run)) break;
+            if (SwapStockCounter(&pool->runs[victim].run, run, PACK_RUN(RUN_NEXT(run), RUN_END(run) - 1))) return RUN_END(run) - 1;
+        }
+    }
+    
+    return -1;
+}
+
+static void RunStockJob(struct StockPool* pool, int own)
+{
+    int shard;
+    while ((shard = TakeStockShard(pool, own)) >= 0) pool->task(pool->context, shard);
+}
+
+static void RunStockWorker(void* argument)
+{
+    StockWorker* worker = (StockWorker*)argument;
+    struct StockPool* pool = worker->pool;
+    unsigned long long seen = 0;
+    
+    AcquireStockLock(pool->lock);
+    while (!pool->stopping)
+    {
+        if (pool->generation == seen)
+        {
+            WaitStockLock(pool->lock);
+            continue;
+        }
+        
+        seen = pool->generation;
+        ReleaseStockLock(pool->lock);
+        RunStockJob(pool, worker->index);
+        AcquireStockLock(pool->lock);
+        
+        pool->finished++;
+        SignalStockLock(pool->lock);
+    }
+    ReleaseStockLock(pool->lock);
+}
+
+static void StopStockPool(struct StockPool* pool)
+{
+    if (pool->lock != NULL)
+    {
+        AcquireStockLock(pool->lock);
+        pool->stopping = 1;
+        SignalStockLock(pool->lock);
+        ReleaseStockLock(pool->lock);
+    }
+    
+    for (int i = 1; i < pool->threadCount; i++) JoinStockThread(pool->threads[i]);
+    
+    DestroyStockLock(pool->lock);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->runs);
+    free(pool);
+}
+
+static struct StockPool* StartStockPool(int threadCount)
+{
+    struct StockPool* pool = (struct StockPool*)calloc(1, sizeof(struct StockPool));
+    if (pool == NULL) return NULL;
+    
+    pool->threads = (StockThread**)calloc(threadCount, sizeof(StockThread*));
+    pool->workers = (StockWorker*)calloc(threadCount, sizeof(StockWorker));
+    pool->runs = (StockShardRun*)calloc(threadCount, sizeof(StockShardRun));
+    pool->lock = CreateStockLock();
+    if (pool->threads == NULL || pool->workers == NULL || pool->runs == NULL || pool->lock == NULL)
+    {
+        StopStockPool(pool);
+        return NULL;
+    }
+    
+    // Slot 0 is the calling thread
+    pool->threadCount = 1;
+    for (int i = 1; i < threadCount; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->threads[i] = StartStockThread(RunStockWorker, &pool->workers[i]);
+        if (pool->threads[i] == NULL) break;
+        
+        pool->threadCount++;
+    }
+    
+    return pool;
+}
+
+int SetStockQueryThreads(StockManager* manager, int threads)
+{
+    if (manager == NULL) return 0;
+    if (threads <= 0) threads = CountStockProcessors();
+    if (threads > STOCK_MAX_QUERY_THREADS) threads = STOCK_MAX_QUERY_THREADS;
+    if (threads == GetStockQueryThreads(manager)) return threads;
+    
+    FreeStockPool(manager);
+    if (threads > 1) manager->pool = StartStockPool(threads);
+    
+    return GetStockQueryThreads(manager);
+}
+
+int GetStockQueryThreads(const StockManager* manager)
+{
+    if (manager == NULL) return 0;
+    
+    return manager->pool != NULL ? manager->pool->threadCount : 1;
+}
+
+int CountStockShards(const StockManager* manager, int count)
+{
+    if (manager->pool == NULL || manager->pool->threadCount < 2 || count < STOCK_PARALLEL_MIN_ITEMS) return 0;
+    
+    return (count + STOCK_SHARD_ITEMS - 1) / STOCK_SHARD_ITEMS;
+}
+
+void RunStockShards(StockManager* manager, int shardCount, StockShardTask task, void* context)
+{
+    struct StockPool* pool = manager->pool;
+    
+    if (pool == NULL || pool->threadCount < 2 || shardCount < 2)
+    {
+        for (int shard = 0; shard < shardCount; shard++) task(context, shard);
+        return;
+    }
+    
+    pool->task = task;
+    pool->context = context;
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        int first = (int)((long long)shardCount * i / pool->threadCount);
+        int end = (int)((long long)shardCount * (i + 1) / pool->threadCount);
+        StoreStockCounter(&pool->runs[i].run, PACK_RUN(first, end));
+    }
+    
+    AcquireStockLock(pool->lock);
+    pool->finished = 0;
+    pool->generation++;
+    SignalStockLock(pool->lock);
+    ReleaseStockLock(pool->lock);
+    
+    RunStockJob(pool, 0);
+    
+    AcquireStockLock(pool->lock);
+    while (pool->finished < pool->threadCount - 1) WaitStockLock(pool->lock);
+    ReleaseStockLock(pool->lock);
+}
+
+void FreeStockPool(StockManager* manager)
+{
+    if (manager->pool == NULL) return;
+    
+    StopStockPool(manager->pool);
+    manager->pool = NULL;
+}
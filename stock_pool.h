@@ -0,0 +1,14 @@
+#ifndef STOCK_POOL_H
+#define STOCK_POOL_H
+
+#include "stock.h"
+
+// Internal side of the parallel scans. A scan over `count` items asks for its
+// shard count first; 0 means it should run serially (no pool, or too few items).
+typedef void (*StockShardTask)(void* context, int shard);
+
+int CountStockShards(const StockManager* manager, int count);
+void RunStockShards(StockManager* manager, int shardCount, StockShardTask task, void* context);  // Returns when all are done
+void FreeStockPool(StockManager* manager);
+
+#endif // STOCK_POOL_H
@@ -0,0 +1,527 @@
+#include "stock_internal.h"
+#include "stock_index.h"
+#include "stock_quantity.h"
+
+// Ordered quantity queries. Two treaps hold one node per item: one keyed by
+// (stock, id), one by (stock - reorder level, id). Every node knows the size of
+// its subtree, so counting the items at or below a quantity is one descent and
+// listing k of them costs O(log n + k). Nodes live in one pool with int links
+// and are keyed by id rather than slot, so swap-remove never touches them.
+//
+// The first query builds both trees from sorted keys in O(n log n), with heap
+// priorities drawn per depth so the result looks like a treap grown from
+// random insertions; after that every stock change is a remove and an insert.
+
+typedef struct {
+    int key;                // Stock, or stock minus reorder level
+    int id;
+    unsigned priority;      // Parents never have a lower priority than their children
+    int left;               // Also the free-list link
+    int right;
+    int size;               // Nodes in this subtree
+} QuantityNode;
+
+typedef struct {
+    QuantityNode* nodes;
+    int capacity;
+    int used;               // Nodes handed out from the pool so far
+    int freeHead;           // Recycled nodes, or -1
+    int root;               // -1 when empty
+} QuantityTree;
+
+typedef struct {
+    int key;
+    int id;
+} QuantityPair;
+
+struct StockQuantityIndex {
+    QuantityTree byStock;
+    QuantityTree byShortfall;   // Keys at or below zero need reordering
+    unsigned seed;
+};
+
+static unsigned NextPriority(struct StockQuantityIndex* index)
+{
+    // xorshift32
+    unsigned x = index->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return index->seed = x;
+}
+
+static void FreeQuantityTree(QuantityTree* tree)
+{
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->capacity = 0;
+    tree->used = 0;
+    tree->freeHead = -1;
+    tree->root = -1;
+}
+
+static int SubtreeSize(const QuantityTree* tree, int node)
+{
+    return node >= 0 ? tree->nodes[node].size : 0;
+}
+
+static void UpdateSubtreeSize(QuantityTree* tree, int node)
+{
+    QuantityNode* n = &tree->nodes[node];
+    n->size = 1 + SubtreeSize(tree, n->left) + SubtreeSize(tree, n->right);
+}
+
+// True when the node sorts before (key, id)
+static int NodeBefore(const QuantityNode* node, int key, int id)
+{
+    return node->key < key || (node->key == key && node->id < id);
+}
+
+static int AllocateQuantityNode(QuantityTree* tree)
+{
+    if (tree->freeHead >= 0)
+    {
+        int node = tree->freeHead;
+        tree->freeHead = tree->nodes[node].left;
+        return node;
+    }
+    
+    if (tree->used == tree->capacity)
+    {
+        int capacity = tree->capacity > 0 ? tree->capacity * 2 : 1024;
+        QuantityNode* nodes = (QuantityNode*)realloc(tree->nodes, capacity * sizeof(QuantityNode));
+        if (nodes == NULL) return -1;
+        
+        tree->nodes = nodes;
+        tree->capacity = capacity;
+    }
+    
+    return tree->used++;
+}
+
+// Split a subtree into the nodes before (key, id) and the rest
+static void SplitQuantityTree(QuantityTree* tree, int node, int key, int id, int* left, int* right)
+{
+    if (node < 0)
+    {
+        *left = -1;
+        *right = -1;
+        return;
+    }
+    
+    QuantityNode* n = &tree->nodes[node];
+    if (NodeBefore(n, key, id))
+    {
+        SplitQuantityTree(tree, n->right, key, id, &n->right, right);
+        *left = node;
+    }
+    else
+    {
+        SplitQuantityTree(tree, n->left, key, id, left, &n->left);
+        *right = node;
+    }
+    UpdateSubtreeSize(tree, node);
+}
+
+// Join two subtrees where every node of `left` sorts before every node of `right`
+static int MergeQuantityTrees(QuantityTree* tree, int left, int right)
+{
+    if (left < 0) return right;
+    if (right < 0) return left;
+    
+    if (tree->nodes[left].priority >= tree->nodes[right].priority)
+    {
+        tree->nodes[left].right = MergeQuantityTrees(tree, tree->nodes[left].right, right);
+        UpdateSubtreeSize(tree, left);
+        return left;
+    }
+    
+    tree->nodes[right].left = MergeQuantityTrees(tree, left, tree->nodes[right].left);
+    UpdateSubtreeSize(tree, right);
+    return right;
+}
+
+// Place a fresh node below the first ancestor with a higher priority, splitting
+// the subtree it displaces; returns the new subtree root
+static int InsertQuantityNode(QuantityTree* tree, int node, int fresh)
+{
+    if (node < 0) return fresh;
+    
+    QuantityNode* n = &tree->nodes[node];
+    QuantityNode* f = &tree->nodes[fresh];
+    
+    if (f->priority > n->priority)
+    {
+        SplitQuantityTree(tree, node, f->key, f->id, &f->left, &f->right);
+        UpdateSubtreeSize(tree, fresh);
+        return fresh;
+    }
+    
+    if (NodeBefore(n, f->key, f->id))
+        n->right = InsertQuantityNode(tree, n->right, fresh);
+    else
+        n->left = InsertQuantityNode(tree, n->left, fresh);
+    n->size++;
+    return node;
+}
+
+static int QuantityTreeInsert(QuantityTree* tree, int key, int id, unsigned priority)
+{
+    int node = AllocateQuantityNode(tree);
+    if (node < 0) return 0;
+    
+    QuantityNode* n = &tree->nodes[node];
+    n->key = key;
+    n->id = id;
+    n->priority = priority;
+    n->left = -1;
+    n->right = -1;
+    n->size = 1;
+    
+    tree->root = InsertQuantityNode(tree, tree->root, node);
+    return 1;
+}
+
+// Remove (key, id) from a subtree; returns the new subtree root
+static int QuantityTreeErase(QuantityTree* tree, int node, int key, int id)
+{
+    if (node < 0) return -1;
+    
+    QuantityNode* n = &tree->nodes[node];
+    if (n->key == key && n->id == id)
+    {
+        int merged = MergeQuantityTrees(tree, n->left, n->right);
+        n->left = tree->freeHead;
+        tree->freeHead = node;
+        return merged;
+    }
+    
+    if (NodeBefore(n, key, id))
+        n->right = QuantityTreeErase(tree, n->right, key, id);
+    else
+        n->left = QuantityTreeErase(tree, n->left, key, id);
+    UpdateSubtreeSize(tree, node);
+    return node;
+}
+
+// Nodes with a key at or below `key`
+static int CountAtOrBelow(const QuantityTree* tree, int key)
+{
+    int count = 0;
+    int node = tree->root;
+    
+    while (node >= 0)
+    {
+        const QuantityNode* n = &tree->nodes[node];
+        if (n->key <= key)
+        {
+            count += SubtreeSize(tree, n->left) + 1;
+            node = n->right;
+        }
+        else
+        {
+            node = n->left;
+        }
+    }
+    
+    return count;
+}
+
+static int CountInRange(const QuantityTree* tree, int low, int high)
+{
+    if (low > high) return 0;
+    
+    int below = low > -0x7FFFFFFF - 1 ? CountAtOrBelow(tree, low - 1) : 0;
+    return CountAtOrBelow(tree, high) - below;
+}
+
+// In-order walk over the keys in [low, high], stopping once `max` ids are stored
+static void CollectRange(const QuantityTree* tree, int node, int low, int high, int descending,
+                         int* ids, int max, int* count)
+{
+    if (node < 0 || *count >= max) return;
+    
+    const QuantityNode* n = &tree->nodes[node];
+    int inRange = n->key >= low && n->key <= high;
+    
+    if (!descending)
+    {
+        if (n->key >= low) CollectRange(tree, n->left, low, high, descending, ids, max, count);
+        if (inRange && *count < max) ids[(*count)++] = n->id;
+        if (n->key <= high) CollectRange(tree, n->right, low, high, descending, ids, max, count);
+    }
+    else
+    {
+        if (n->key <= high) CollectRange(tree, n->right, low, high, descending, ids, max, count);
+        if (inRange && *count < max) ids[(*count)++] = n->id;
+        if (n->key >= low) CollectRange(tree, n->left, low, high, descending, ids, max, count);
+    }
+}
+
+static int CompareQuantityPairs(const void* a, const void* b)
+{
+    const QuantityPair* left = (const QuantityPair*)a;
+    const QuantityPair* right = (const QuantityPair*)b;
+    
+    if (left->key != right->key) return left->key < right->key ? -1 : 1;
+    return (left->id > right->id) - (left->id < right->id);
+}
+
+// Balanced tree over pairs[low, high) where node i holds pairs[i]. A random treap
+// of n nodes has priorities near the top of the range at the root and spread
+// over the lower half at its leaves; depth band d of `levels` gets the slice
+// (max - max >> (levels - d - 1), max - max >> (levels - d)].
+static int BuildQuantitySubtree(struct StockQuantityIndex* index, QuantityTree* tree, const QuantityPair* pairs,
+                                int low, int high, int depth, int levels)
+{
+    if (low >= high) return -1;
+    
+    int middle = low + (high - low) / 2;
+    unsigned long long top = 0xFFFFFFFFull - (0xFFFFFFFFull >> (levels - depth));
+    unsigned long long bottom = 0xFFFFFFFFull - (0xFFFFFFFFull >> (levels - depth - 1));
+    QuantityNode* n = &tree->nodes[middle];
+    
+    n->key = pairs[middle].key;
+    n->id = pairs[middle].id;
+    n->priority = (unsigned)(bottom + 1 + NextPriority(index) % (top - bottom));
+    n->left = BuildQuantitySubtree(index, tree, pairs, low, middle, depth + 1, levels);
+    n->right = BuildQuantitySubtree(index, tree, pairs, middle + 1, high, depth + 1, levels);
+    n->size = high - low;
+    return middle;
+}
+
+static int BuildQuantityTree(struct StockQuantityIndex* index, QuantityTree* tree, QuantityPair* pairs, int count)
+{
+    int capacity = count > 1024 ? count : 1024;
+    
+    tree->nodes = (QuantityNode*)malloc(capacity * sizeof(QuantityNode));
+    if (tree->nodes == NULL) return 0;
+    
+    tree->capacity = capacity;
+    tree->used = count;
+    tree->freeHead = -1;
+    
+    int levels = 1;
+    while (levels < 32 && (1ll << levels) <= count) levels++;
+    
+    qsort(pairs, count, sizeof(QuantityPair), CompareQuantityPairs);
+    tree->root = BuildQuantitySubtree(index, tree, pairs, 0, count, 0, levels);
+    return 1;
+}
+
+void DropQuantityIndex(StockManager* manager)
+{
+    struct StockQuantityIndex* index = manager->quantities;
+    if (index == NULL) return;
+    
+    FreeQuantityTree(&index->byStock);
+    FreeQuantityTree(&index->byShortfall);
+    free(index);
+    manager->quantities = NULL;
+}
+
+static int RequireQuantityIndex(StockManager* manager)
+{
+    if (!EnsureStockResident(manager)) return 0;
+    if (manager->quantities != NULL) return 1;
+    
+    int count = manager->itemCount;
+    struct StockQuantityIndex* index = (struct StockQuantityIndex*)calloc(1, sizeof(struct StockQuantityIndex));
+    QuantityPair* pairs = (QuantityPair*)malloc((count > 0 ? count : 1) * sizeof(QuantityPair));
+    
+    if (index == NULL || pairs == NULL)
+    {
+        free(index);
+        free(pairs);
+        return 0;
+    }
+    
+    index->seed = 0x9E3779B9u ^ (unsigned)count;
+    manager->quantities = index;
+    
+    for (int i = 0; i < count; i++)
+    {
+        pairs[i].key = StockItemAt(manager, i)->stock;
+        pairs[i].id = StockItemAt(manager, i)->id;
+    }
+    int result = BuildQuantityTree(index, &index->byStock, pairs, count);
+    
+    for (int i = 0; result && i < count; i++)
+    {
+        const StockItem* item = StockItemAt(manager, i);
+        pairs[i].key = item->stock - item->reorderLevel;
+        pairs[i].id = item->id;
+    }
+    result = result && BuildQuantityTree(index, &index->byShortfall, pairs, count);
+    
+    free(pairs);
+    if (!result) DropQuantityIndex(manager);
+    return result;
+}
+
+void QuantityIndexInsert(StockManager* manager, const StockItem* item)
+{
+    struct StockQuantityIndex* index = manager->quantities;
+    if (index == NULL) return;
+    
+    // Without memory the index is rebuilt by the next query
+    if (!QuantityTreeInsert(&index->byStock, item->stock, item->id, NextPriority(index)) ||
+        !QuantityTreeInsert(&index->byShortfall, item->stock - item->reorderLevel, item->id, NextPriority(index)))
+    {
+        DropQuantityIndex(manager);
+    }
+}
+
+void QuantityIndexRemove(StockManager* manager, const StockItem* item)
+{
+    struct StockQuantityIndex* index = manager->quantities;
+    if (index == NULL) return;
+    
+    QuantityTree* byStock = &index->byStock;
+    QuantityTree* byShortfall = &index->byShortfall;
+    
+    byStock->root = QuantityTreeErase(byStock, byStock->root, item->stock, item->id);
+    byShortfall->root = QuantityTreeErase(byShortfall, byShortfall->root, item->stock - item->reorderLevel, item->id);
+}
+
+// Turn the ids of a walk into item indices, in place
+static void IdsToIndices(const StockManager* manager, int* ids, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        ids[i] = IdIndexFind(manager, ids[i]);
+    }
+}
+
+int CountStockItemsAtOrBelow(StockManager* manager, int threshold)
+{
+    if (manager == NULL || !RequireQuantityIndex(manager)) return 0;
+    
+    return CountAtOrBelow(&manager->quantities->byStock, threshold);
+}
+
+// Collect indices of items with minStock <= stock <= maxStock, lowest stock first
+// (ties by id); returns the number in range, only the first maxIndices are stored
+int GetStockItemsByQuantity(StockManager* manager, int minStock, int maxStock, int* indices, int maxIndices)
+{
+    if (manager == NULL || !RequireQuantityIndex(manager)) return 0;
+    
+    const QuantityTree* tree = &manager->quantities->byStock;
+    int stored = 0;
+    
+    if (indices != NULL && maxIndices > 0)
+    {
+        CollectRange(tree, tree->root, minStock, maxStock, 0, indices, maxIndices, &stored);
+        IdsToIndices(manager, indices, stored);
+    }
+    
+    return CountInRange(tree, minStock, maxStock);
+}
+
+typedef struct {
+    StockManager* manager;
+    const QuantityTree* tree;
+    int high;               // Walk ends at the first larger key
+    StockVisit* visit;
+} QuantityWalk;
+
+// In-order walk of a subtree starting at its node of rank `skip`; subtrees that
+// lie wholly before it are stepped over by size. Returns 0 once the walk is done.
+static int WalkQuantityTree(QuantityWalk* walk, int node, int skip)
+{
+    if (node < 0) return 1;
+    
+    const QuantityNode* n = &walk->tree->nodes[node];
+    int leftSize = SubtreeSize(walk->tree, n->left);
+    
+    if (skip < leftSize && !WalkQuantityTree(walk, n->left, skip)) return 0;
+    if (skip <= leftSize)
+    {
+        if (n->key > walk->high) return 0;
+        if (!DeliverStockMatch(walk->manager, walk->visit, IdIndexFind(walk->manager, n->id))) return 0;
+    }
+    
+    return WalkQuantityTree(walk, n->right, skip > leftSize ? skip - leftSize - 1 : 0);
+}
+
+int VisitLowStockItems(StockManager* manager, int threshold, int offset, int limit,
+                       StockItemVisitor visitor, void* context)
+{
+    if (manager == NULL || visitor == NULL || !RequireQuantityIndex(manager)) return 0;
+    
+    StockVisit visit;
+    BeginStockVisit(&visit, visitor, context, 0, limit);
+    
+    QuantityWalk walk = { manager, &manager->quantities->byStock, threshold, &visit };
+    WalkQuantityTree(&walk, walk.tree->root, offset > 0 ? offset : 0);
+    return visit.delivered;
+}
+
+int GetLowStockItemIndices(StockManager* manager, int threshold, int offset, int* indices, int maxIndices)
+{
+    if (indices == NULL || maxIndices <= 0) return 0;
+    
+    StockIndexList list = { indices, 0, maxIndices };
+    return VisitLowStockItems(manager, threshold, offset, maxIndices, AppendStockIndex, &list);
+}
+
+// Copies of the items at or below the threshold in item order, as this has
+// always returned them; the stock column filter finds them in that order
+int GetLowStockItems(StockManager* manager, int threshold, StockItem* results, int* resultCount)
+{
+    if (manager == NULL || results == NULL || resultCount == NULL) return 0;
+    
+    *resultCount = 0;
+    if (manager->itemCount == 0) return 1;
+    
+    int* indices = (int*)malloc(manager->itemCount * sizeof(int));
+    if (indices == NULL) return 0;
+    
+    int count = GetStockItemsInRange(manager, -0x7FFFFFFF - 1, threshold, indices, manager->itemCount);
+    for (int i = 0; i < count; i++) results[i] = *StockItemAt(manager, indices[i]);
+    
+    free(indices);
+    *resultCount = count;
+    return 1;
+}
+
+// The `count` items with the least (or most) stock, in that order; returns how many were stored
+static int GetStockItemsAtEnd(StockManager* manager, int count, int* indices, int descending)
+{
+    if (manager == NULL || indices == NULL || count <= 0 || !RequireQuantityIndex(manager)) return 0;
+    
+    const QuantityTree* tree = &manager->quantities->byStock;
+    int stored = 0;
+    
+    CollectRange(tree, tree->root, -0x7FFFFFFF - 1, 0x7FFFFFFF, descending, indices, count, &stored);
+    IdsToIndices(manager, indices, stored);
+    return stored;
+}
+
+int GetLowestStockItems(StockManager* manager, int count, int* indices)
+{
+    return GetStockItemsAtEnd(manager, count, indices, 0);
+}
+
+int GetHighestStockItems(StockManager* manager, int count, int* indices)
+{
+    return GetStockItemsAtEnd(manager, count, indices, 1);
+}
+
+// Collect indices of items at or below their reorder level, largest shortfall
+// first; returns the number of such items, only the first maxIndices are stored
+int GetStockItemsToReorder(StockManager* manager, int* indices, int maxIndices)
+{
+    if (manager == NULL || !RequireQuantityIndex(manager)) return 0;
+    
+    const QuantityTree* tree = &manager->quantities->byShortfall;
+    int stored = 0;
+    
+    if (indices != NULL && maxIndices > 0)
+    {
+        CollectRange(tree, tree->root, -0x7FFFFFFF - 1, 0, 0, indices, maxIndices, &stored);
+        IdsToIndices(manager, indices, stored);
+    }
+    
+    return CountAtOrBelow(tree, 0);
+}
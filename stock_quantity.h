@@ -0,0 +1,14 @@
+#ifndef STOCK_QUANTITY_H
+#define STOCK_QUANTITY_H
+
+#include "stock.h"
+
+// Internal hooks for the ordered quantity index. It exists only after the first
+// ordered query; until then the hooks do nothing. Changes to an item's stock or
+// reorder level are bracketed by a remove with the old values and an insert
+// with the new ones.
+void QuantityIndexInsert(StockManager* manager, const StockItem* item);
+void QuantityIndexRemove(StockManager* manager, const StockItem* item);
+void DropQuantityIndex(StockManager* manager);  // Rebuilt by the next query
+
+#endif // STOCK_QUANTITY_H
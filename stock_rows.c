@@ -0,0 +1,208 @@
+#include "stock_internal.h"
+
+// Row model behind the owner-data list view. Row r shows item r, so the view
+// reads rows straight from the items: only rows on screen are decoded (after a
+// mapped load) and formatted, however large the inventory. The rows of the last
+// cache hint keep their formatted text. Change notifications from the manager
+// mark rows stale and dirty, and the view redraws just the dirty range. A hint also
+// warms the display string cache, so wide text for those rows is ready.
+
+static void MarkRowsDirty(StockRowModel* model, int first, int last)
+{
+    if (first > last) return;
+    
+    if (model->dirtyFirst < 0 || first < model->dirtyFirst) model->dirtyFirst = first;
+    if (last > model->dirtyLast) model->dirtyLast = last;
+}
+
+static StockRowCacheEntry* CachedRow(StockRowModel* model, int row)
+{
+    if (row < model->cacheFirst || row >= model->cacheFirst + model->cacheCount) return NULL;
+    
+    return &model->cache[row - model->cacheFirst];
+}
+
+static void StaleRow(StockRowModel* model, int row)
+{
+    StockRowCacheEntry* entry = CachedRow(model, row);
+    if (entry != NULL) entry->id = 0;
+}
+
+static void FillRowEntry(StockRowCacheEntry* entry, const StockItem* item)
+{
+    entry->id = item->id;
+    snprintf(entry->quantity, sizeof(entry->quantity), "%d", item->stock);
+}
+
+// Inserted and updated items dirty the row now holding them. A removal needs
+// nothing more: the item moved into the freed row reports its new position, and
+// the last row goes away with the row count.
+static void OnStockRowChanges(StockManager* manager, const StockChange* changes, int count, void* context)
+{
+    StockRowModel* model = (StockRowModel*)context;
+    (void)manager;
+    
+    for (int i = 0; i < count; i++)
+    {
+        if (changes[i].kind == STOCK_CHANGE_RELOADED)
+        {
+            ResetStockRows(model);
+        }
+        else if (changes[i].index >= 0)
+        {
+            StaleRow(model, changes[i].index);
+            MarkRowsDirty(model, changes[i].index, changes[i].index);
+        }
+    }
+}
+
+void InitStockRowModel(StockRowModel* model, StockManager* manager)
+{
+    if (model == NULL) return;
+    
+    memset(model, 0, sizeof(StockRowModel));
+    model->manager = manager;
+    model->dirtyFirst = -1;
+    model->dirtyLast = -1;
+    model->subscription = SubscribeStockChanges(manager, OnStockRowChanges, model);
+    ResetStockRows(model);
+}
+
+void FreeStockRowModel(StockRowModel* model)
+{
+    if (model == NULL) return;
+    
+    UnsubscribeStockChanges(model->manager, model->subscription);
+    model->subscription = 0;
+}
+
+void HintStockRows(StockRowModel* model, int first, int last)
+{
+    if (model == NULL || model->manager == NULL) return;
+    
+    if (first < 0) first = 0;
+    if (last >= model->manager->itemCount) last = model->manager->itemCount - 1;
+    if (last - first + 1 > STOCK_ROW_CACHE_SIZE) last = first + STOCK_ROW_CACHE_SIZE - 1;
+    
+    model->cacheFirst = first;
+    model->cacheCount = last >= first ? last - first + 1 : 0;
+    
+    for (int row = first; row <= last; row++)
+    {
+        // Decodes mapped items now rather than one text request at a time
+        StockItem* item = GetStockItem(model->manager, row);
+        
+        if (item != NULL)
+        {
+            StockDisplayText text;
+            FillRowEntry(&model->cache[row - first], item);
+            GetStockDisplayText(model->manager, row, &text);
+        }
+        else
+        {
+            model->cache[row - first].id = 0;
+        }
+    }
+}
+
+const char* GetStockRowText(StockRowModel* model, int row, int column)
+{
+    if (model == NULL) return "";
+    
+    StockItem* item = GetStockItem(model->manager, row);
+    if (item == NULL) return "";
+    
+    switch (column)
+    {
+        case STOCK_COLUMN_NAME:
+            return item->name;
+        
+        case STOCK_COLUMN_CATEGORY:
+            return GetStockItemCategory(model->manager, item);
+        
+        case STOCK_COLUMN_QUANTITY:
+        {
+            StockRowCacheEntry* entry = CachedRow(model, row);
+            if (entry == NULL)
+            {
+                snprintf(model->scratch, sizeof(model->scratch), "%d", item->stock);
+                return model->scratch;
+            }
+            
+            if (entry->id != item->id) FillRowEntry(entry, item);
+            return entry->quantity;
+        }
+    }
+    
+    return "";
+}
+
+const StockWideChar* GetStockRowDisplayText(StockRowModel* model, int row, int column)
+{
+    static const StockWideChar empty[1] = { 0 };
+    StockDisplayText text;
+    
+    if (model == NULL || !GetStockDisplayText(model->manager, row, &text)) return empty;
+    
+    switch (column)
+    {
+        case STOCK_COLUMN_NAME:
+            return text.name;
+        
+        case STOCK_COLUMN_CATEGORY:
+            return text.category;
+        
+        case STOCK_COLUMN_QUANTITY:
+            return text.quantity;
+    }
+    
+    return empty;
+}
+
+int GetStockRowItemId(StockRowModel* model, int row)
+{
+    if (model == NULL) return 0;
+    
+    StockItem* item = GetStockItem(model->manager, row);
+    return item != NULL ? item->id : 0;
+}
+
+int FindStockRowById(StockRowModel* model, int id)
+{
+    if (model == NULL) return -1;
+    
+    return FindStockItemById(model->manager, id);
+}
+
+void ResetStockRows(StockRowModel* model)
+{
+    if (model == NULL || model->manager == NULL) return;
+    
+    int rows = model->rowCount > model->manager->itemCount ? model->rowCount : model->manager->itemCount;
+    
+    model->cacheCount = 0;
+    MarkRowsDirty(model, 0, rows - 1);
+}
+
+int TakeStockRowUpdate(StockRowModel* model, int* first, int* last)
+{
+    if (model == NULL || model->manager == NULL) return 0;
+    
+    int count = model->manager->itemCount;
+    int dirtyFirst = model->dirtyFirst;
+    int dirtyLast = model->dirtyLast < count ? model->dirtyLast : count - 1;
+    
+    // Rows past the new count disappear with the count change itself
+    if (dirtyFirst < 0 || dirtyFirst > dirtyLast)
+    {
+        dirtyFirst = -1;
+        dirtyLast = -1;
+    }
+    if (first != NULL) *first = dirtyFirst;
+    if (last != NULL) *last = dirtyLast;
+    
+    model->rowCount = count;
+    model->dirtyFirst = -1;
+    model->dirtyLast = -1;
+    return count;
+}
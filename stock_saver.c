@@ -0,0 +1,229 @@
+#include "stock_internal.h"
+#include "stock_journal.h"
+#include "stock_platform.h"
+
+// Background saver. The owning thread hands over a packed copy of the
+// inventory (so the saver never touches the live manager); the saver thread
+// expands and serializes it through SaveStockToFile, which writes a synced
+// temporary file and renames it over the target. Waiting copies are queued one
+// per file: a newer request for the same file replaces the waiting one, and a
+// request for another file waits behind it.
+
+typedef struct {
+    StockSnapshot* snapshot;
+    char* filename;
+    long long journalMark;      // JournalSaveMark for the copy, or -1
+} StockSaveJob;
+
+struct StockSaver {
+    StockLock* lock;
+    StockThread* thread;
+    StockSaveJob* pending;      // Oldest first, at most one per file
+    int pendingCount;
+    int pendingCapacity;
+    int busy;                   // A job is being written
+    int stopping;
+    int finished;               // Finished since the last poll
+    int lastResult;             // 0 if any save finished since the last poll failed
+    long long journalMark;      // Mark of the latest finished journal snapshot
+    int journalSaves;           // Journal snapshots finished since the last poll
+    int journalResult;
+    StockSaveCallback callback;
+    void* context;
+};
+
+static void FreeSaveJob(StockSaveJob* job)
+{
+    FreeStockSnapshot(job->snapshot);
+    free(job->filename);
+    
+    job->snapshot = NULL;
+    job->filename = NULL;
+}
+
+static void RunStockSaver(void* argument)
+{
+    struct StockSaver* saver = (struct StockSaver*)argument;
+    
+    AcquireStockLock(saver->lock);
+    for (;;)
+    {
+        while (saver->pendingCount == 0 && !saver->stopping) WaitStockLock(saver->lock);
+        if (saver->pendingCount == 0) break;
+        
+        StockSaveJob job = saver->pending[0];
+        saver->pendingCount--;
+        memmove(saver->pending, saver->pending + 1, saver->pendingCount * sizeof(StockSaveJob));
+        saver->busy = 1;
+        ReleaseStockLock(saver->lock);
+        
+        StockManager* copy = RestoreStockSnapshot(job.snapshot);
+        int result = copy != NULL && SaveStockToFile(copy, job.filename);
+        
+        if (copy != NULL)
+        {
+            FreeStockManager(copy);
+            free(copy);
+        }
+        FreeSaveJob(&job);
+        
+        AcquireStockLock(saver->lock);
+        saver->busy = 0;
+        saver->lastResult = saver->finished ? saver->lastResult && result : result;
+        saver->finished = 1;
+        if (job.journalMark >= 0)
+        {
+            saver->journalMark = job.journalMark;
+            saver->journalSaves++;
+            saver->journalResult = result;
+        }
+        SignalStockLock(saver->lock);
+        ReleaseStockLock(saver->lock);
+        
+        // Only now will a poll from the callback see this save
+        if (saver->callback != NULL) saver->callback(result, saver->context);
+        AcquireStockLock(saver->lock);
+    }
+    ReleaseStockLock(saver->lock);
+}
+
+int StartStockSaver(StockManager* manager, StockSaveCallback callback, void* context)
+{
+    if (manager == NULL) return 0;
+    if (manager->saver != NULL) return 1;
+    
+    struct StockSaver* saver = (struct StockSaver*)calloc(1, sizeof(struct StockSaver));
+    if (saver == NULL) return 0;
+    
+    saver->lastResult = 1;
+    saver->callback = callback;
+    saver->context = context;
+    saver->lock = CreateStockLock();
+    if (saver->lock != NULL) saver->thread = StartStockThread(RunStockSaver, saver);
+    
+    if (saver->thread == NULL)
+    {
+        DestroyStockLock(saver->lock);
+        free(saver);
+        return 0;
+    }
+    
+    manager->saver = saver;
+    return 1;
+}
+
+int RequestStockSave(StockManager* manager, const char* filename)
+{
+    if (manager == NULL || manager->saver == NULL || filename == NULL) return 0;
+    
+    StockSaveJob job;
+    job.snapshot = CaptureStockSnapshot(manager);
+    job.filename = (char*)malloc(strlen(filename) + 1);
+    job.journalMark = -1;
+    
+    if (job.snapshot == NULL || job.filename == NULL)
+    {
+        FreeSaveJob(&job);
+        return 0;
+    }
+    strcpy(job.filename, filename);
+    job.journalMark = JournalSaveMark(manager, filename);
+    
+    struct StockSaver* saver = manager->saver;
+    StockSaveJob replaced = { NULL, NULL, -1 };
+    int queued = 1;
+    
+    // Coalesce: the newer copy supersedes one for the same file that has not started yet
+    AcquireStockLock(saver->lock);
+    int slot = 0;
+    while (slot < saver->pendingCount && strcmp(saver->pending[slot].filename, filename) != 0) slot++;
+    
+    if (slot == saver->pendingCapacity)
+    {
+        int capacity = saver->pendingCapacity > 0 ? saver->pendingCapacity * 2 : 4;
+        StockSaveJob* grown = (StockSaveJob*)realloc(saver->pending, capacity * sizeof(StockSaveJob));
+        if (grown != NULL)
+        {
+            saver->pending = grown;
+            saver->pendingCapacity = capacity;
+        }
+        else
+        {
+            queued = 0;
+        }
+    }
+    if (queued)
+    {
+        if (slot < saver->pendingCount) replaced = saver->pending[slot];
+        else saver->pendingCount++;
+        
+        saver->pending[slot] = job;
+        SignalStockLock(saver->lock);
+    }
+    ReleaseStockLock(saver->lock);
+    
+    // A copy that will not be written settles its journal mark as unsaved
+    if (!queued) replaced = job;
+    FinishJournalSave(manager, replaced.journalMark, 0);
+    FreeSaveJob(&replaced);
+    return queued;
+}
+
+int PollStockSave(StockManager* manager)
+{
+    if (manager == NULL || manager->saver == NULL) return STOCK_SAVE_NONE;
+    
+    struct StockSaver* saver = manager->saver;
+    int result = STOCK_SAVE_NONE;
+    
+    AcquireStockLock(saver->lock);
+    if (saver->finished) result = saver->lastResult;
+    long long mark = saver->journalMark;
+    int journalSaves = saver->journalSaves;
+    int journalResult = saver->journalResult;
+    saver->finished = 0;
+    saver->journalSaves = 0;
+    ReleaseStockLock(saver->lock);
+    
+    // Journal bookkeeping happens here, on the thread that owns the manager.
+    // Every finished snapshot settles its mark; only the latest can empty the journal.
+    for (int i = 1; i < journalSaves; i++) FinishJournalSave(manager, mark, 0);
+    if (journalSaves > 0) FinishJournalSave(manager, mark, journalResult);
+    return result;
+}
+
+int WaitStockSave(StockManager* manager)
+{
+    if (manager == NULL || manager->saver == NULL) return 0;
+    
+    struct StockSaver* saver = manager->saver;
+    
+    AcquireStockLock(saver->lock);
+    while (saver->pendingCount > 0 || saver->busy) WaitStockLock(saver->lock);
+    int result = saver->lastResult;
+    ReleaseStockLock(saver->lock);
+    
+    PollStockSave(manager);
+    return result;
+}
+
+void StopStockSaver(StockManager* manager)
+{
+    if (manager == NULL || manager->saver == NULL) return;
+    
+    struct StockSaver* saver = manager->saver;
+    
+    AcquireStockLock(saver->lock);
+    saver->stopping = 1;
+    SignalStockLock(saver->lock);
+    ReleaseStockLock(saver->lock);
+    
+    // The thread drains the waiting job before it exits
+    JoinStockThread(saver->thread);
+    PollStockSave(manager);
+    
+    DestroyStockLock(saver->lock);
+    free(saver->pending);
+    free(saver);
+    manager->saver = NULL;
+}
@@ -0,0 +1,294 @@
+#include "stock_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STOCK_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Kernels for the packed columns. The substring kernels compare a block of
+// candidate start positions against the term's first byte and, shifted by the
+// term length, its last byte; only positions passing both get a full compare.
+// The filter kernels compare a block of integers at once and compress the lanes
+// that pass into an index list through a table of lane positions per mask.
+// Vector kernels are compiled for their instruction set and chosen at run time.
+
+typedef size_t (*StockScanFunction)(const char* text, size_t length, const char* term, size_t termLength);
+typedef int (*StockRangeFunction)(const int* values, int count, int low, int high, int* indices);
+typedef int (*StockThresholdFunction)(const int* values, const int* keys, const int* thresholds, int count, int* indices);
+
+static int g_lanePositions[256][8];     // Set lanes of each 8-bit mask, in order
+
+static size_t ScanScalar(const char* text, size_t length, const char* term, size_t termLength)
+{
+    if (termLength > length) return length;
+    
+    const char* end = text + length - termLength + 1;
+    
+    for (const char* cursor = text; cursor < end; cursor++)
+    {
+        cursor = (const char*)memchr(cursor, term[0], end - cursor);
+        if (cursor == NULL) break;
+        if (memcmp(cursor + 1, term + 1, termLength - 1) == 0) return cursor - text;
+    }
+    
+    return length;
+}
+
+// Branch-free compress: every position is written, only passing ones are kept
+static int RangeScalar(const int* values, int count, int low, int high, int* indices)
+{
+    int found = 0;
+    
+    for (int i = 0; i < count; i++)
+    {
+        indices[found] = i;
+        found += values[i] >= low && values[i] <= high;
+    }
+    
+    return found;
+}
+
+static int ThresholdScalar(const int* values, const int* keys, const int* thresholds, int count, int* indices)
+{
+    int found = 0;
+    
+    for (int i = 0; i < count; i++)
+    {
+        indices[found] = i;
+        found += values[i] <= thresholds[keys[i]];
+    }
+    
+    return found;
+}
+
+#ifdef STOCK_SCAN_X86
+__attribute__((target("sse2")))
+static size_t ScanSSE2(const char* text, size_t length, const char* term, size_t termLength)
+{
+    const __m128i first = _mm_set1_epi8(term[0]);
+    const __m128i last = _mm_set1_epi8(term[termLength - 1]);
+    size_t i = 0;
+    
+    for (; i + termLength - 1 + 16 <= length; i += 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i*)(text + i + termLength - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                                  _mm_cmpeq_epi8(blockLast, last)));
+        
+        while (mask != 0)
+        {
+            size_t position = i + (size_t)__builtin_ctz(mask);
+            if (termLength <= 2 || memcmp(text + position + 1, term + 1, termLength - 2) == 0) return position;
+            mask &= mask - 1;
+        }
+    }
+    
+    size_t rest = ScanScalar(text + i, length - i, term, termLength);
+    return rest < length - i ? i + rest : length;
+}
+
+__attribute__((target("avx2")))
+static size_t ScanAVX2(const char* text, size_t length, const char* term, size_t termLength)
+{
+    const __m256i first = _mm256_set1_epi8(term[0]);
+    const __m256i last = _mm256_set1_epi8(term[termLength - 1]);
+    size_t i = 0;
+    
+    for (; i + termLength - 1 + 32 <= length; i += 32)
+    {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i*)(text + i + termLength - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+                                                                        _mm256_cmpeq_epi8(blockLast, last)));
+        
+        while (mask != 0)
+        {
+            size_t position = i + (size_t)__builtin_ctz(mask);
+            if (termLength <= 2 || memcmp(text + position + 1, term + 1, termLength - 2) == 0) return position;
+            mask &= mask - 1;
+        }
+    }
+    
+    size_t rest = ScanScalar(text + i, length - i, term, termLength);
+    return rest < length - i ? i + rest : length;
+}
+
+__attribute__((target("sse2")))
+static int RangeSSE2(const int* values, int count, int low, int high, int* indices)
+{
+    const __m128i below = _mm_set1_epi32(low);
+    const __m128i above = _mm_set1_epi32(high);
+    int found = 0;
+    int i = 0;
+    
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(below, block), _mm_cmpgt_epi32(block, above));
+        unsigned mask = ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+        
+        __m128i positions = _mm_loadu_si128((const __m128i*)g_lanePositions[mask]);
+        _mm_storeu_si128((__m128i*)(indices + found), _mm_add_epi32(positions, _mm_set1_epi32(i)));
+        found += __builtin_popcount(mask);
+    }
+    
+    int rest = RangeScalar(values + i, count - i, low, high, indices + found);
+    for (int j = 0; j < rest; j++) indices[found + j] += i;
+    return found + rest;
+}
+
+__attribute__((target("sse2")))
+static int ThresholdSSE2(const int* values, const int* keys, const int* thresholds, int count, int* indices)
+{
+    int found = 0;
+    int i = 0;
+    
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i limits = _mm_setr_epi32(thresholds[keys[i]], thresholds[keys[i + 1]],
+                                        thresholds[keys[i + 2]], thresholds[keys[i + 3]]);
+        unsigned mask = ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, limits))) & 0xF;
+        
+        __m128i positions = _mm_loadu_si128((const __m128i*)g_lanePositions[mask]);
+        _mm_storeu_si128((__m128i*)(indices + found), _mm_add_epi32(positions, _mm_set1_epi32(i)));
+        found += __builtin_popcount(mask);
+    }
+    
+    int rest = ThresholdScalar(values + i, keys + i, thresholds, count - i, indices + found);
+    for (int j = 0; j < rest; j++) indices[found + j] += i;
+    return found + rest;
+}
+
+__attribute__((target("avx2")))
+static int RangeAVX2(const int* values, int count, int low, int high, int* indices)
+{
+    const __m256i below = _mm256_set1_epi32(low);
+    const __m256i above = _mm256_set1_epi32(high);
+    int found = 0;
+    int i = 0;
+    
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(values + i));
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(below, block), _mm256_cmpgt_epi32(block, above));
+        unsigned mask = ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;
+        
+        __m256i positions = _mm256_loadu_si256((const __m256i*)g_lanePositions[mask]);
+        _mm256_storeu_si256((__m256i*)(indices + found), _mm256_add_epi32(positions, _mm256_set1_epi32(i)));
+        found += __builtin_popcount(mask);
+    }
+    
+    int rest = RangeScalar(values + i, count - i, low, high, indices + found);
+    for (int j = 0; j < rest; j++) indices[found + j] += i;
+    return found + rest;
+}
+
+__attribute__((target("avx2")))
+static int ThresholdAVX2(const int* values, const int* keys, const int* thresholds, int count, int* indices)
+{
+    int found = 0;
+    int i = 0;
+    
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(values + i));
+        __m256i limits = _mm256_i32gather_epi32(thresholds, _mm256_loadu_si256((const __m256i*)(keys + i)), 4);
+        unsigned mask = ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(block, limits))) & 0xFF;
+        
+        __m256i positions = _mm256_loadu_si256((const __m256i*)g_lanePositions[mask]);
+        _mm256_storeu_si256((__m256i*)(indices + found), _mm256_add_epi32(positions, _mm256_set1_epi32(i)));
+        found += __builtin_popcount(mask);
+    }
+    
+    int rest = ThresholdScalar(values + i, keys + i, thresholds, count - i, indices + found);
+    for (int j = 0; j < rest; j++) indices[found + j] += i;
+    return found + rest;
+}
+#endif
+
+static int g_scanKernel = -1;   // STOCK_SCAN_*, or -1 before the first use
+static StockScanFunction g_scanFunction = ScanScalar;
+static StockRangeFunction g_rangeFunction = RangeScalar;
+static StockThresholdFunction g_thresholdFunction = ThresholdScalar;
+
+static int BestScanKernel(void)
+{
+#ifdef STOCK_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return STOCK_SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2")) return STOCK_SCAN_SSE2;
+#endif
+    return STOCK_SCAN_SCALAR;
+}
+
+int SetStockScanKernel(int kernel)
+{
+    int best = BestScanKernel();
+    
+    // Never pick an instruction set the processor lacks
+    if (kernel == STOCK_SCAN_AUTO || kernel > best) kernel = best;
+    if (kernel < STOCK_SCAN_SCALAR) kernel = STOCK_SCAN_SCALAR;
+    
+    for (int mask = 0; mask < 256; mask++)
+    {
+        int lanes = 0;
+        for (int lane = 0; lane < 8; lane++)
+        {
+            if (mask & (1 << lane)) g_lanePositions[mask][lanes++] = lane;
+        }
+    }
+    
+    g_scanFunction = ScanScalar;
+    g_rangeFunction = RangeScalar;
+    g_thresholdFunction = ThresholdScalar;
+#ifdef STOCK_SCAN_X86
+    if (kernel == STOCK_SCAN_SSE2)
+    {
+        g_scanFunction = ScanSSE2;
+        g_rangeFunction = RangeSSE2;
+        g_thresholdFunction = ThresholdSSE2;
+    }
+    if (kernel == STOCK_SCAN_AVX2)
+    {
+        g_scanFunction = ScanAVX2;
+        g_rangeFunction = RangeAVX2;
+        g_thresholdFunction = ThresholdAVX2;
+    }
+#endif
+    g_scanKernel = kernel;
+    return kernel;
+}
+
+int GetStockScanKernel(void)
+{
+    if (g_scanKernel < 0) SetStockScanKernel(STOCK_SCAN_AUTO);
+    
+    return g_scanKernel;
+}
+
+size_t FindStockText(const char* text, size_t length, const char* term, size_t termLength)
+{
+    if (termLength == 0) return 0;
+    if (termLength > length) return length;
+    if (g_scanKernel < 0) SetStockScanKernel(STOCK_SCAN_AUTO);
+    
+    return g_scanFunction(text, length, term, termLength);
+}
+
+int FilterStockRange(const int* values, int count, int low, int high, int* indices)
+{
+    if (count <= 0) return 0;
+    if (g_scanKernel < 0) SetStockScanKernel(STOCK_SCAN_AUTO);
+    
+    return g_rangeFunction(values, count, low, high, indices);
+}
+
+int FilterStockThresholds(const int* values, const int* keys, const int* thresholds, int count, int* indices)
+{
+    if (count <= 0) return 0;
+    if (g_scanKernel < 0) SetStockScanKernel(STOCK_SCAN_AUTO);
+    
+    return g_thresholdFunction(values, keys, thresholds, count, indices);
+}
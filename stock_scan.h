@@ -0,0 +1,20 @@
+#ifndef STOCK_SCAN_H
+#define STOCK_SCAN_H
+
+#include "stock.h"
+
+// Internal substring kernel over packed text: offset of the first occurrence of
+// `term` in text[0, length), or `length` if there is none. Uses the kernel chosen
+// with SetStockScanKernel (the best one the processor supports by default).
+size_t FindStockText(const char* text, size_t length, const char* term, size_t termLength);
+
+// Internal compare-and-compress kernels over integer columns. They store the
+// ascending positions that pass and return how many; `indices` needs room for
+// count + STOCK_FILTER_SLACK entries because whole vectors are written.
+#define STOCK_FILTER_SLACK 8
+
+int FilterStockRange(const int* values, int count, int low, int high, int* indices);  // low <= value <= high
+int FilterStockThresholds(const int* values, const int* keys, const int* thresholds,
+                          int count, int* indices);                                 // value <= thresholds[key]
+
+#endif // STOCK_SCAN_H
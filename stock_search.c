@@ -0,0 +1,800 @@
+#include "stock_internal.h"
+#include "stock_index.h"
+#include "stock_search.h"
+#include "stock_scan.h"
+#include "stock_pool.h"
+
+// Substring search. Each item slot has its name and its folded search key
+// (FoldStockText) in two packed text columns, filled when the name is set.
+//
+// Every byte trigram of a key maps to a posting list holding the ids of the items
+// whose key contains it. Folding works code point by code point, so a name that
+// contains a term exactly also contains it folded, and one index serves both match
+// modes. Postings are keyed by id rather than slot so swap-remove never touches
+// them; a removed or renamed item leaves stale ids behind, which verification
+// filters out until they make up half the index and it is rebuilt.
+//
+// Terms the index cannot answer are found by scanning a whole column, one kernel
+// call per hit (stock_scan.c). Categories are interned, so they are matched once
+// per distinct category through the dictionary instead.
+
+#define SEARCH_KEYS_MIN_COMPACT 4096 // Replaced key bytes tolerated before compacting
+#define TRIGRAM_MIN_QUERY 3         // Shorter terms are answered by scanning
+#define TRIGRAM_MAX_QUERY_GRAMS 64  // Trigrams of a longer term beyond this are left to verification
+#define TRIGRAM_TAIL_LIMIT 32       // Out-of-order ids kept before they are merged in,
+#define TRIGRAM_TAIL_SHARE 8        // or this fraction of the list once it is longer
+#define TRIGRAM_SKIP_FACTOR 16      // Postings this much longer than the candidates are not intersected
+
+typedef struct {
+    unsigned key;           // Trigram bytes + 1 (0 marks an empty slot)
+    int count;              // Ids encoded in data
+    int lastId;             // Largest id in data
+    int length;
+    int capacity;
+    unsigned char* data;    // Ascending ids as varint deltas
+    int* tail;              // Ids that arrived out of order, unsorted
+    int tailCount;
+    int tailCapacity;
+} TrigramPosting;
+
+struct StockTrigramIndex {
+    TrigramPosting* postings;   // Open-addressing table
+    int capacity;               // Power of two
+    int count;                  // Trigrams in use
+    long long entries;          // Ids in all postings, stale ones included
+    long long staleEntries;
+};
+
+static unsigned TrigramKey(const char* text)
+{
+    const unsigned char* bytes = (const unsigned char*)text;
+    
+    return ((unsigned)bytes[0] | ((unsigned)bytes[1] << 8) | ((unsigned)bytes[2] << 16)) + 1;
+}
+
+static int TrigramSlot(const struct StockTrigramIndex* index, unsigned key)
+{
+    unsigned mask = (unsigned)index->capacity - 1;
+    unsigned slot = (key * 2654435761u) & mask;
+    
+    while (index->postings[slot].key != 0 && index->postings[slot].key != key)
+    {
+        slot = (slot + 1) & mask;
+    }
+    
+    return (int)slot;
+}
+
+static TrigramPosting* FindPosting(const struct StockTrigramIndex* index, unsigned key)
+{
+    TrigramPosting* posting = &index->postings[TrigramSlot(index, key)];
+    
+    return posting->key != 0 ? posting : NULL;
+}
+
+static int GrowTrigramTable(struct StockTrigramIndex* index)
+{
+    int oldCapacity = index->capacity;
+    TrigramPosting* old = index->postings;
+    int capacity = oldCapacity > 0 ? oldCapacity * 2 : 1024;
+    
+    index->postings = (TrigramPosting*)calloc(capacity, sizeof(TrigramPosting));
+    if (index->postings == NULL)
+    {
+        index->postings = old;
+        return 0;
+    }
+    index->capacity = capacity;
+    
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].key != 0) index->postings[TrigramSlot(index, old[i].key)] = old[i];
+    }
+    
+    free(old);
+    return 1;
+}
+
+static TrigramPosting* InsertPosting(struct StockTrigramIndex* index, unsigned key)
+{
+    // Keep the table at most half full
+    if ((index->count + 1) * 2 > index->capacity && !GrowTrigramTable(index)) return NULL;
+    
+    TrigramPosting* posting = &index->postings[TrigramSlot(index, key)];
+    if (posting->key == 0)
+    {
+        posting->key = key;
+        index->count++;
+    }
+    
+    return posting;
+}
+
+static int CompareIds(const void* a, const void* b)
+{
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    
+    return (left > right) - (left < right);
+}
+
+static int EncodePostingId(TrigramPosting* posting, int id)
+{
+    if (posting->length + 5 > posting->capacity)
+    {
+        int capacity = posting->capacity > 0 ? posting->capacity * 2 : 16;
+        unsigned char* data = (unsigned char*)realloc(posting->data, capacity);
+        if (data == NULL) return 0;
+        
+        posting->data = data;
+        posting->capacity = capacity;
+    }
+    
+    unsigned delta = posting->count > 0 ? (unsigned)(id - posting->lastId) : (unsigned)id;
+    posting->length += (int)EncodeStockVarint(posting->data + posting->length, delta);
+    posting->lastId = id;
+    posting->count++;
+    return 1;
+}
+
+static int DecodePosting(const TrigramPosting* posting, int* ids)
+{
+    const unsigned char* cursor = posting->data;
+    const unsigned char* end = posting->data + posting->length;
+    unsigned id = 0;
+    
+    for (int i = 0; i < posting->count; i++)
+    {
+        unsigned delta = 0;
+        DecodeStockVarint(&cursor, end, &delta);
+        id += delta;
+        ids[i] = (int)id;
+    }
+    
+    return posting->count;
+}
+
+// Fold the out-of-order tail into the encoded list
+static int MergePostingTail(TrigramPosting* posting)
+{
+    if (posting->tailCount == 0) return 1;
+    
+    int total = posting->count + posting->tailCount;
+    int* ids = (int*)malloc(total * sizeof(int));
+    if (ids == NULL) return 0;
+    
+    DecodePosting(posting, ids);
+    memcpy(ids + posting->count, posting->tail, posting->tailCount * sizeof(int));
+    qsort(ids, total, sizeof(int), CompareIds);
+    
+    // Re-encode without duplicates; the buffer only shrinks or grows by the tail
+    posting->count = 0;
+    posting->length = 0;
+    posting->tailCount = 0;
+    for (int i = 0; i < total; i++)
+    {
+        if (i > 0 && ids[i] == ids[i - 1]) continue;
+        if (!EncodePostingId(posting, ids[i]))
+        {
+            free(ids);
+            return 0;
+        }
+    }
+    
+    free(ids);
+    return 1;
+}
+
+static int AddPostingId(TrigramPosting* posting, int id)
+{
+    if (posting->tailCount == 0 && (posting->count == 0 || id > posting->lastId))
+    {
+        return EncodePostingId(posting, id);
+    }
+    if (posting->tailCount == 0 && id == posting->lastId) return 1;
+    
+    if (posting->tailCount == posting->tailCapacity)
+    {
+        int capacity = posting->tailCapacity > 0 ? posting->tailCapacity * 2 : 4;
+        int* tail = (int*)realloc(posting->tail, capacity * sizeof(int));
+        if (tail == NULL) return 0;
+        
+        posting->tail = tail;
+        posting->tailCapacity = capacity;
+    }
+    posting->tail[posting->tailCount++] = id;
+    
+    // Merging re-encodes the whole list, so let the tail grow with it
+    int limit = posting->count / TRIGRAM_TAIL_SHARE;
+    if (limit < TRIGRAM_TAIL_LIMIT) limit = TRIGRAM_TAIL_LIMIT;
+    return posting->tailCount < limit || MergePostingTail(posting);
+}
+
+static int AddNameTrigrams(struct StockTrigramIndex* index, int id, const char* name)
+{
+    size_t length = strlen(name);
+    
+    for (size_t i = 0; i + 3 <= length; i++)
+    {
+        TrigramPosting* posting = InsertPosting(index, TrigramKey(name + i));
+        if (posting == NULL || !AddPostingId(posting, id)) return 0;
+        index->entries++;
+    }
+    
+    return 1;
+}
+
+static void FreeTrigramIndex(struct StockTrigramIndex* index)
+{
+    if (index == NULL) return;
+    
+    for (int i = 0; i < index->capacity; i++)
+    {
+        free(index->postings[i].data);
+        free(index->postings[i].tail);
+    }
+    free(index->postings);
+    free(index);
+}
+
+static const char* ColumnText(const StockTextColumn* column, int slot)
+{
+    return column->text + column->offsets[slot];
+}
+
+static const char* SearchKeyAt(const StockManager* manager, int index)
+{
+    return ColumnText(&manager->searchKeys.folded, index);
+}
+
+static struct StockTrigramIndex* BuildTrigramIndex(StockManager* manager)
+{
+    struct StockTrigramIndex* index = (struct StockTrigramIndex*)calloc(1, sizeof(struct StockTrigramIndex));
+    if (index == NULL) return NULL;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        StockItem* item = StockItemAt(manager, i);
+        if (!AddNameTrigrams(index, item->id, SearchKeyAt(manager, i)))
+        {
+            FreeTrigramIndex(index);
+            return NULL;
+        }
+    }
+    
+    return index;
+}
+
+static void DropTrigramIndex(StockManager* manager)
+{
+    FreeTrigramIndex(manager->trigrams);
+    manager->trigrams = NULL;
+}
+
+static void FreeTextColumn(StockTextColumn* column)
+{
+    free(column->text);
+    free(column->offsets);
+    free(column->entries);
+    memset(column, 0, sizeof(StockTextColumn));
+}
+
+void DropSearchKeys(StockManager* manager)
+{
+    DropTrigramIndex(manager);
+    FreeTextColumn(&manager->searchKeys.names);
+    FreeTextColumn(&manager->searchKeys.folded);
+    manager->searchKeys.valid = 0;
+}
+
+// Store `text` as the string of `slot`, after everything already in the column
+static int AppendColumnText(StockTextColumn* column, int slot, const char* text, size_t length)
+{
+    if (slot >= column->offsetCapacity)
+    {
+        int capacity = column->offsetCapacity > 0 ? column->offsetCapacity : 1024;
+        while (capacity <= slot) capacity *= 2;
+        
+        size_t* offsets = (size_t*)realloc(column->offsets, capacity * sizeof(size_t));
+        if (offsets == NULL) return 0;
+        column->offsets = offsets;
+        column->offsetCapacity = capacity;
+    }
+    if (column->entryCount == column->entryCapacity)
+    {
+        int capacity = column->entryCapacity > 0 ? column->entryCapacity * 2 : 1024;
+        
+        StockTextEntry* entries = (StockTextEntry*)realloc(column->entries, capacity * sizeof(StockTextEntry));
+        if (entries == NULL) return 0;
+        column->entries = entries;
+        column->entryCapacity = capacity;
+    }
+    if (column->length + length + 1 > column->capacity)
+    {
+        size_t capacity = column->capacity > 0 ? column->capacity : 16384;
+        while (capacity < column->length + length + 1) capacity *= 2;
+        
+        char* grown = (char*)realloc(column->text, capacity);
+        if (grown == NULL) return 0;
+        column->text = grown;
+        column->capacity = capacity;
+    }
+    
+    memcpy(column->text + column->length, text, length);
+    column->text[column->length + length] = '\0';
+    column->offsets[slot] = column->length;
+    column->entries[column->entryCount].offset = column->length;
+    column->entries[column->entryCount].slot = slot;
+    column->entryCount++;
+    column->length += length + 1;
+    return 1;
+}
+
+// Entry of the string that contains byte `offset`
+static int FindColumnEntry(const StockTextColumn* column, size_t offset)
+{
+    int low = 0;
+    int high = column->entryCount - 1;
+    
+    while (low < high)
+    {
+        int middle = low + (high - low + 1) / 2;
+        
+        if (column->entries[middle].offset <= offset) low = middle;
+        else high = middle - 1;
+    }
+    
+    return low;
+}
+
+// The string of `slot` is no longer used; returns its length
+static size_t RetireColumnText(StockTextColumn* column, int slot)
+{
+    size_t length = strlen(ColumnText(column, slot));
+    
+    column->entries[FindColumnEntry(column, column->offsets[slot])].slot = -1;
+    column->garbage += length + 1;
+    return length;
+}
+
+// Swap-remove: the string of slot `from` now belongs to `to`
+static void MoveColumnText(StockTextColumn* column, int from, int to)
+{
+    column->offsets[to] = column->offsets[from];
+    column->entries[FindColumnEntry(column, column->offsets[to])].slot = to;
+}
+
+// Repack the strings of the first `itemCount` slots in slot order
+static int CompactTextColumn(StockTextColumn* column, int itemCount)
+{
+    size_t capacity = column->length - column->garbage;
+    char* text = (char*)malloc(capacity > 0 ? capacity : 1);
+    if (text == NULL) return 0;
+    
+    size_t length = 0;
+    for (int i = 0; i < itemCount; i++)
+    {
+        const char* source = ColumnText(column, i);
+        size_t size = strlen(source) + 1;
+        
+        memcpy(text + length, source, size);
+        column->offsets[i] = length;
+        column->entries[i].offset = length;
+        column->entries[i].slot = i;
+        length += size;
+    }
+    
+    free(column->text);
+    column->text = text;
+    column->length = length;
+    column->capacity = capacity;
+    column->garbage = 0;
+    column->entryCount = itemCount;
+    return 1;
+}
+
+// Strings of slots `itemCount` and up must already be retired or moved
+static void CompactSearchKeys(StockManager* manager, int itemCount)
+{
+    StockSearchKeys* keys = &manager->searchKeys;
+    StockTextColumn* columns[2] = { &keys->names, &keys->folded };
+    
+    for (int i = 0; i < 2; i++)
+    {
+        StockTextColumn* column = columns[i];
+        
+        // Compact once replaced strings take up half the buffer
+        if (column->garbage < SEARCH_KEYS_MIN_COMPACT || column->garbage * 2 < column->length) continue;
+        CompactTextColumn(column, itemCount);
+    }
+}
+
+// Append the name of the item in `index` and its folded key
+static int AppendSearchKeys(StockManager* manager, int index)
+{
+    const char* name = StockItemAt(manager, index)->name;
+    char folded[MAX_NAME_LENGTH];
+    size_t foldedLength = FoldStockText(name, folded, sizeof(folded));
+    
+    return AppendColumnText(&manager->searchKeys.names, index, name, strlen(name)) &&
+           AppendColumnText(&manager->searchKeys.folded, index, folded, foldedLength);
+}
+
+static int BuildSearchKeys(StockManager* manager)
+{
+    DropSearchKeys(manager);
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        if (!AppendSearchKeys(manager, i))
+        {
+            DropSearchKeys(manager);
+            return 0;
+        }
+    }
+    
+    manager->searchKeys.valid = 1;
+    return 1;
+}
+
+// Forget the strings of `index`: their bytes become garbage and the key's trigrams stale postings
+static void RetireSearchKeys(StockManager* manager, int index)
+{
+    RetireColumnText(&manager->searchKeys.names, index);
+    size_t length = RetireColumnText(&manager->searchKeys.folded, index);
+    
+    if (manager->trigrams != NULL && length >= 3) manager->trigrams->staleEntries += (long long)(length - 2);
+}
+
+// Key the item in `index` and index it; without memory the keys are rebuilt later
+static void AddSearchKeys(StockManager* manager, int index)
+{
+    if (!AppendSearchKeys(manager, index))
+    {
+        DropSearchKeys(manager);
+        return;
+    }
+    
+    // A partially indexed item would be missed by searches
+    if (manager->trigrams != NULL &&
+        !AddNameTrigrams(manager->trigrams, StockItemAt(manager, index)->id, SearchKeyAt(manager, index)))
+    {
+        DropTrigramIndex(manager);
+    }
+}
+
+void SearchKeysInsert(StockManager* manager, int index)
+{
+    if (!manager->searchKeys.valid) return;
+    
+    AddSearchKeys(manager, index);
+}
+
+void SearchKeysUpdate(StockManager* manager, int index)
+{
+    if (!manager->searchKeys.valid) return;
+    
+    RetireSearchKeys(manager, index);
+    AddSearchKeys(manager, index);
+    if (manager->searchKeys.valid) CompactSearchKeys(manager, manager->itemCount);
+}
+
+void SearchKeysRemove(StockManager* manager, int index)
+{
+    if (!manager->searchKeys.valid) return;
+    
+    int last = manager->itemCount - 1;
+    
+    RetireSearchKeys(manager, index);
+    if (index != last)
+    {
+        MoveColumnText(&manager->searchKeys.names, last, index);
+        MoveColumnText(&manager->searchKeys.folded, last, index);
+    }
+    CompactSearchKeys(manager, last);
+}
+
+// Slots of the strings in entries [firstEntry, endEntry) that contain `term`,
+// in buffer order. One pass of the scan kernel; after a hit it resumes at the
+// next string.
+static int ScanColumnEntries(const StockTextColumn* column, const char* term, size_t termLength,
+                             int firstEntry, int endEntry, int* slots)
+{
+    if (firstEntry >= endEntry) return 0;
+    
+    size_t position = column->entries[firstEntry].offset;
+    size_t end = endEntry < column->entryCount ? column->entries[endEntry].offset : column->length;
+    int count = 0;
+    
+    while (position < end)
+    {
+        size_t hit = FindStockText(column->text + position, end - position, term, termLength);
+        if (hit >= end - position) break;
+        
+        int entry = FindColumnEntry(column, position + hit);
+        int slot = column->entries[entry].slot;
+        if (slot >= 0) slots[count++] = slot;
+        
+        position = entry + 1 < column->entryCount ? column->entries[entry + 1].offset : column->length;
+    }
+    
+    return count;
+}
+
+// A scan split into shards of STOCK_SHARD_ITEMS strings
+typedef struct {
+    const StockTextColumn* column;
+    const char* term;
+    size_t termLength;
+    int* slots;             // A shard writes only to the range of its strings
+    int* found;             // Per shard
+} StockColumnScan;
+
+static void ScanColumnShard(void* context, int shard)
+{
+    StockColumnScan* scan = (StockColumnScan*)context;
+    int first = shard * STOCK_SHARD_ITEMS;
+    int end = scan->column->entryCount - first < STOCK_SHARD_ITEMS ? scan->column->entryCount : first + STOCK_SHARD_ITEMS;
+    
+    scan->found[shard] = ScanColumnEntries(scan->column, scan->term, scan->termLength, first, end, scan->slots + first);
+}
+
+// Slots whose string in `column` contains `term`, ascending. Large columns are
+// scanned in shards across the query threads and the hits joined in buffer order.
+static int ScanTextColumn(StockManager* manager, const StockTextColumn* column, const char* term, int* slots)
+{
+    size_t termLength = strlen(term);
+    int shards = CountStockShards(manager, column->entryCount);
+    int count = 0;
+    
+    StockColumnScan scan = { column, term, termLength, NULL, NULL };
+    if (shards > 0)
+    {
+        scan.slots = (int*)malloc(column->entryCount * sizeof(int));
+        scan.found = (int*)malloc(shards * sizeof(int));
+    }
+    
+    if (scan.slots != NULL && scan.found != NULL)
+    {
+        // Pick the kernel before the shards race to
+        GetStockScanKernel();
+        RunStockShards(manager, shards, ScanColumnShard, &scan);
+        
+        for (int shard = 0; shard < shards; shard++)
+        {
+            memcpy(slots + count, scan.slots + shard * STOCK_SHARD_ITEMS, scan.found[shard] * sizeof(int));
+            count += scan.found[shard];
+        }
+    }
+    else
+    {
+        count = ScanColumnEntries(column, term, termLength, 0, column->entryCount, slots);
+    }
+    free(scan.slots);
+    free(scan.found);
+    
+    // Strings appended by edits sit out of slot order until the next compaction
+    int sorted = 1;
+    for (int i = 1; i < count && sorted; i++) sorted = slots[i - 1] < slots[i];
+    if (!sorted) qsort(slots, count, sizeof(int), CompareIds);
+    return count;
+}
+
+// Narrow the candidates (ascending ids) to those also in `posting`
+static int IntersectPosting(int* candidates, int count, const TrigramPosting* posting)
+{
+    const unsigned char* cursor = posting->data;
+    const unsigned char* end = posting->data + posting->length;
+    unsigned id = 0;
+    int kept = 0;
+    int next = 0;
+    
+    for (int i = 0; i < posting->count && next < count; i++)
+    {
+        unsigned delta = 0;
+        DecodeStockVarint(&cursor, end, &delta);
+        id += delta;
+        
+        while (next < count && candidates[next] < (int)id) next++;
+        if (next < count && candidates[next] == (int)id) candidates[kept++] = candidates[next++];
+    }
+    
+    return kept;
+}
+
+// Item indices whose name contains `term` (exactly, or folded when `folded` is
+// the folded term), ascending; -1 when the index is unavailable
+static int FindIndexedNameMatches(StockManager* manager, const char* term, const char* folded, int mode, int** matches)
+{
+    *matches = NULL;
+    
+    struct StockTrigramIndex* index = manager->trigrams;
+    if (index != NULL && index->staleEntries * 2 > index->entries)
+    {
+        DropTrigramIndex(manager);
+        index = NULL;
+    }
+    if (index == NULL)
+    {
+        index = BuildTrigramIndex(manager);
+        if (index == NULL) return -1;
+        manager->trigrams = index;
+    }
+    
+    // Postings of the term's distinct trigrams, shortest first
+    TrigramPosting* postings[TRIGRAM_MAX_QUERY_GRAMS];
+    int postingCount = 0;
+    size_t length = strlen(folded);
+    
+    for (size_t i = 0; i + 3 <= length && postingCount < TRIGRAM_MAX_QUERY_GRAMS; i++)
+    {
+        TrigramPosting* posting = FindPosting(index, TrigramKey(folded + i));
+        if (posting == NULL) return 0;
+        if (!MergePostingTail(posting)) return -1;
+        
+        int seen = 0;
+        for (int p = 0; p < postingCount; p++) seen |= postings[p] == posting;
+        if (seen) continue;
+        
+        int at = postingCount++;
+        while (at > 0 && postings[at - 1]->count > posting->count)
+        {
+            postings[at] = postings[at - 1];
+            at--;
+        }
+        postings[at] = posting;
+    }
+    
+    int* candidates = (int*)malloc((postings[0]->count > 0 ? postings[0]->count : 1) * sizeof(int));
+    if (candidates == NULL) return -1;
+    
+    int count = DecodePosting(postings[0], candidates);
+    
+    // Long postings cost more to decode than verifying the few candidates left
+    for (int p = 1; p < postingCount && count > 0; p++)
+    {
+        if (postings[p]->count / TRIGRAM_SKIP_FACTOR > count) break;
+        count = IntersectPosting(candidates, count, postings[p]);
+    }
+    
+    // Verify: drop stale ids and trigrams that matched out of order
+    int found = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int itemIndex = IdIndexFind(manager, candidates[i]);
+        if (itemIndex < 0) continue;
+        
+        const char* text = mode == STOCK_SEARCH_FOLDED ? SearchKeyAt(manager, itemIndex) : StockItemAt(manager, itemIndex)->name;
+        if (strstr(text, mode == STOCK_SEARCH_FOLDED ? folded : term) != NULL)
+        {
+            candidates[found++] = itemIndex;
+        }
+    }
+    qsort(candidates, found, sizeof(int), CompareIds);
+    
+    *matches = candidates;
+    return found;
+}
+
+int VisitSearchResults(StockManager* manager, const char* searchTerm, int mode, int offset, int limit,
+                       StockItemVisitor visitor, void* context)
+{
+    if (manager == NULL || searchTerm == NULL || visitor == NULL) return 0;
+    
+    int matching = mode & ~STOCK_SEARCH_SCAN;
+    if (matching != STOCK_SEARCH_EXACT && matching != STOCK_SEARCH_FOLDED) return 0;
+    if (!EnsureStockResident(manager)) return 0;
+    
+    // Exact matching still works from the items alone if the keys cannot be built
+    int keysReady = manager->searchKeys.valid || BuildSearchKeys(manager);
+    if (!keysReady && matching == STOCK_SEARCH_FOLDED) return 0;
+    
+    size_t termLength = strlen(searchTerm);
+    char* folded = (char*)malloc(termLength + 1);
+    StockCategoryDict* dict = &manager->categories;
+    unsigned char* categoryMatches = (unsigned char*)calloc(dict->codeCount > 0 ? dict->codeCount : 1, 1);
+    if (folded == NULL || categoryMatches == NULL)
+    {
+        free(folded);
+        free(categoryMatches);
+        return 0;
+    }
+    size_t foldedLength = FoldStockText(searchTerm, folded, termLength + 1);
+    const char* pattern = matching == STOCK_SEARCH_FOLDED ? folded : searchTerm;
+    
+    // Match each distinct category once; items then only need a lookup
+    int anyCategory = 0;
+    for (int code = 0; code < dict->codeCount; code++)
+    {
+        const StockCategory* category = &dict->entries[code];
+        
+        categoryMatches[code] = category->text != NULL &&
+                                strstr(matching == STOCK_SEARCH_FOLDED ? category->folded : category->text, pattern) != NULL;
+        anyCategory |= categoryMatches[code];
+    }
+    
+    // Without a category hit only names can match, which the index answers.
+    // An exact term has to be valid UTF-8 for its folded form to be a filter.
+    int* hits = NULL;
+    int hitCount = -1;
+    
+    if (!(mode & STOCK_SEARCH_SCAN) && !anyCategory && keysReady && foldedLength >= TRIGRAM_MIN_QUERY &&
+        (matching == STOCK_SEARCH_FOLDED || IsValidUTF8(searchTerm)))
+    {
+        hitCount = FindIndexedNameMatches(manager, searchTerm, folded, matching, &hits);
+    }
+    
+    // Otherwise scan the packed name column in one pass
+    if (hitCount < 0 && keysReady)
+    {
+        hits = (int*)malloc((manager->itemCount > 0 ? manager->itemCount : 1) * sizeof(int));
+        if (hits != NULL)
+        {
+            const StockSearchKeys* keys = &manager->searchKeys;
+            hitCount = ScanTextColumn(manager, matching == STOCK_SEARCH_FOLDED ? &keys->folded : &keys->names, pattern, hits);
+        }
+    }
+    
+    StockVisit visit;
+    BeginStockVisit(&visit, visitor, context, offset, limit);
+    
+    if (hitCount >= 0 && !anyCategory)
+    {
+        for (int i = 0; i < hitCount; i++)
+        {
+            if (!DeliverStockMatch(manager, &visit, hits[i])) break;
+        }
+    }
+    else
+    {
+        // Merge the name hits (ascending) with the category matches
+        int next = 0;
+        
+        for (int i = 0; i < manager->itemCount; i++)
+        {
+            StockItem* item = StockItemAt(manager, i);
+            int nameMatch;
+            
+            if (hitCount >= 0)
+            {
+                nameMatch = next < hitCount && hits[next] == i;
+                next += nameMatch;
+            }
+            else
+            {
+                nameMatch = strstr(item->name, pattern) != NULL;
+            }
+            
+            if ((nameMatch || categoryMatches[item->categoryId]) && !DeliverStockMatch(manager, &visit, i)) break;
+        }
+    }
+    
+    free(hits);
+    free(categoryMatches);
+    free(folded);
+    return visit.delivered;
+}
+
+int SearchStockItemIndices(StockManager* manager, const char* searchTerm, int mode, int offset,
+                           int* indices, int maxIndices)
+{
+    if (indices == NULL || maxIndices <= 0) return 0;
+    
+    StockIndexList list = { indices, 0, maxIndices };
+    return VisitSearchResults(manager, searchTerm, mode, offset, maxIndices, AppendStockIndex, &list);
+}
+
+
+void SearchStockItems(StockManager* manager, const char* searchTerm, StockItem* results, int* resultCount)
+{
+    SearchStockItemsMode(manager, searchTerm, STOCK_SEARCH_EXACT, results, resultCount);
+}
+
+void SearchStockItemsMode(StockManager* manager, const char* searchTerm, int mode, StockItem* results, int* resultCount)
+{
+    if (manager == NULL || searchTerm == NULL || results == NULL || resultCount == NULL) return;
+    
+    StockItemCopies copies = { results, 0 };
+    *resultCount = 0;
+    *resultCount = VisitSearchResults(manager, searchTerm, mode, 0, 0, CopyStockItemMatch, &copies);
+}
@@ -0,0 +1,13 @@
+#ifndef STOCK_SEARCH_H
+#define STOCK_SEARCH_H
+
+#include "stock.h"
+
+// Internal hooks that keep the search keys and their trigram index in step with
+// the items. Both exist only after the first search; until then the hooks do nothing.
+void SearchKeysInsert(StockManager* manager, int index);   // Item stored in a new slot
+void SearchKeysUpdate(StockManager* manager, int index);   // After the name changed
+void SearchKeysRemove(StockManager* manager, int index);   // Before the last item moves into `index`
+void DropSearchKeys(StockManager* manager);  // Rebuilt by the next search
+
+#endif // STOCK_SEARCH_H
@@ -0,0 +1,243 @@
+#include "stock_sort.h"
+#include "stock_category.h"
+
+// Sorting never moves items. It produces a permutation of item indices
+// with a stable bottom-up merge sort and keeps a few permutations cached
+// per key list, dropping a cached one only when a field it orders by changes.
+
+#define SORT_INSERTION_RUN 16
+
+typedef struct {
+    const StockManager* manager;
+    const StockSortKey* keys;
+    int keyCount;
+    const int* categoryRanks;   // Alphabetical rank per category code
+} SortContext;
+
+static unsigned SortFieldMask(int field)
+{
+    switch (field)
+    {
+        case STOCK_SORT_NAME: return STOCK_FIELD_NAME;
+        case STOCK_SORT_STOCK: return STOCK_FIELD_STOCK;
+        case STOCK_SORT_CATEGORY: return STOCK_FIELD_CATEGORY;
+        case STOCK_SORT_ID: return STOCK_FIELD_ID;
+    }
+    return 0;
+}
+
+static int CompareItems(const SortContext* context, int left, int right)
+{
+    const StockItem* a = StockItemAt(context->manager, left);
+    const StockItem* b = StockItemAt(context->manager, right);
+    
+    for (int k = 0; k < context->keyCount; k++)
+    {
+        int result = 0;
+        
+        switch (context->keys[k].field)
+        {
+            case STOCK_SORT_NAME:
+                result = strcmp(a->name, b->name);
+                break;
+            case STOCK_SORT_STOCK:
+                result = (a->stock > b->stock) - (a->stock < b->stock);
+                break;
+            case STOCK_SORT_CATEGORY:
+                result = context->categoryRanks[a->categoryId] - context->categoryRanks[b->categoryId];
+                break;
+            case STOCK_SORT_ID:
+                result = (a->id > b->id) - (a->id < b->id);
+                break;
+        }
+        
+        if (result != 0) return context->keys[k].descending ? -result : result;
+    }
+    
+    return 0;
+}
+
+// Stable sort of order[0..count) using scratch space of the same size
+static void MergeSortIndices(const SortContext* context, int* order, int* scratch, int count)
+{
+    // Insertion sort short runs
+    for (int start = 0; start < count; start += SORT_INSERTION_RUN)
+    {
+        int end = start + SORT_INSERTION_RUN < count ? start + SORT_INSERTION_RUN : count;
+        
+        for (int i = start + 1; i < end; i++)
+        {
+            int value = order[i];
+            int j = i - 1;
+            
+            while (j >= start && CompareItems(context, order[j], value) > 0)
+            {
+                order[j + 1] = order[j];
+                j--;
+            }
+            order[j + 1] = value;
+        }
+    }
+    
+    // Merge runs pairwise, ping-ponging between the two buffers
+    int* from = order;
+    int* to = scratch;
+    
+    for (int width = SORT_INSERTION_RUN; width < count; width *= 2)
+    {
+        for (int left = 0; left < count; left += 2 * width)
+        {
+            int mid = left + width < count ? left + width : count;
+            int right = left + 2 * width < count ? left + 2 * width : count;
+            int i = left, j = mid, out = left;
+            
+            // Already ordered runs are copied as-is
+            if (mid < right && CompareItems(context, from[mid - 1], from[mid]) <= 0)
+            {
+                memcpy(&to[left], &from[left], (right - left) * sizeof(int));
+                continue;
+            }
+            
+            while (i < mid && j < right)
+            {
+                to[out++] = CompareItems(context, from[i], from[j]) <= 0 ? from[i++] : from[j++];
+            }
+            while (i < mid) to[out++] = from[i++];
+            while (j < right) to[out++] = from[j++];
+        }
+        
+        int* swap = from;
+        from = to;
+        to = swap;
+    }
+    
+    if (from != order) memcpy(order, from, count * sizeof(int));
+}
+
+static int SameKeys(const StockSortCacheEntry* entry, const StockSortKey* keys, int keyCount)
+{
+    if (entry->keyCount != keyCount) return 0;
+    
+    for (int k = 0; k < keyCount; k++)
+    {
+        if (entry->keys[k].field != keys[k].field || entry->keys[k].descending != keys[k].descending)
+            return 0;
+    }
+    return 1;
+}
+
+void InitSortCache(StockManager* manager)
+{
+    memset(manager->sortCache, 0, sizeof(manager->sortCache));
+    manager->sortClock = 0;
+    manager->activeSort.keyCount = 0;
+}
+
+void FreeSortCache(StockManager* manager)
+{
+    for (int i = 0; i < STOCK_SORT_CACHE_SIZE; i++)
+    {
+        free(manager->sortCache[i].order);
+    }
+    InitSortCache(manager);
+}
+
+void InvalidateSortCache(StockManager* manager, unsigned changedFields)
+{
+    for (int i = 0; i < STOCK_SORT_CACHE_SIZE; i++)
+    {
+        StockSortCacheEntry* entry = &manager->sortCache[i];
+        
+        if (entry->valid && (entry->fieldMask & changedFields))
+            entry->valid = 0;
+    }
+}
+
+const int* SortStockItemsBy(StockManager* manager, const StockSortKey* keys, int keyCount)
+{
+    if (manager == NULL || keys == NULL || keyCount <= 0 || keyCount > STOCK_SORT_MAX_KEYS) return NULL;
+    if (!EnsureStockResident(manager)) return NULL;
+    
+    // Reuse a cached permutation for the same keys, or evict the least recently used one
+    StockSortCacheEntry* entry = NULL;
+    StockSortCacheEntry* victim = &manager->sortCache[0];
+    
+    for (int i = 0; i < STOCK_SORT_CACHE_SIZE; i++)
+    {
+        StockSortCacheEntry* candidate = &manager->sortCache[i];
+        
+        if (candidate->keyCount > 0 && SameKeys(candidate, keys, keyCount))
+        {
+            entry = candidate;
+            break;
+        }
+        if (candidate->lastUse < victim->lastUse) victim = candidate;
+    }
+    
+    if (entry == NULL)
+    {
+        entry = victim;
+        entry->valid = 0;
+        entry->keyCount = keyCount;
+        entry->fieldMask = STOCK_FIELD_MEMBERSHIP;
+        
+        for (int k = 0; k < keyCount; k++)
+        {
+            entry->keys[k] = keys[k];
+            entry->fieldMask |= SortFieldMask(keys[k].field);
+        }
+    }
+    
+    entry->lastUse = ++manager->sortClock;
+    if (entry->valid) return entry->order;
+    
+    // Rebuild the permutation (an empty inventory still gets an array, since NULL means failure)
+    int count = manager->itemCount;
+    if (count > entry->capacity || entry->order == NULL)
+    {
+        int capacity = count > 0 ? count : 1;
+        int* order = (int*)realloc(entry->order, capacity * sizeof(int));
+        if (order == NULL) return NULL;
+        entry->order = order;
+        entry->capacity = capacity;
+    }
+    
+    int* scratch = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    if (scratch == NULL) return NULL;
+    
+    for (int i = 0; i < count; i++)
+    {
+        entry->order[i] = i;
+    }
+    
+    SortContext context = { manager, entry->keys, entry->keyCount, GetCategoryRanks(&manager->categories) };
+    if (context.categoryRanks == NULL)
+    {
+        free(scratch);
+        return NULL;
+    }
+    
+    MergeSortIndices(&context, entry->order, scratch, count);
+    free(scratch);
+    
+    entry->valid = 1;
+    return entry->order;
+}
+
+void SortStockItems(StockManager* manager, int sortBy)
+{
+    if (manager == NULL || sortBy < STOCK_SORT_NAME || sortBy > STOCK_SORT_ID) return;
+    
+    manager->activeSort.keys[0].field = (unsigned char)sortBy;
+    manager->activeSort.keys[0].descending = 0;
+    manager->activeSort.keyCount = 1;
+    
+    SortStockItemsBy(manager, manager->activeSort.keys, 1);
+}
+
+const int* GetStockSortOrder(StockManager* manager)
+{
+    if (manager == NULL || manager->activeSort.keyCount == 0) return NULL;
+    
+    return SortStockItemsBy(manager, manager->activeSort.keys, manager->activeSort.keyCount);
+}
@@ -0,0 +1,11 @@
+#ifndef STOCK_SORT_H
+#define STOCK_SORT_H
+
+#include "stock.h"
+
+// Internal helpers for the sort permutation cache
+void InitSortCache(StockManager* manager);
+void FreeSortCache(StockManager* manager);
+void InvalidateSortCache(StockManager* manager, unsigned changedFields);
+
+#endif // STOCK_SORT_H
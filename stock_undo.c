@@ -0,0 +1,626 @@
+#include "stock_internal.h"
+#include "stock_undo.h"
+
+// Undo and redo as two stacks of inverse operations. An ordinary change logs
+// its inverse on the undo stack and empties the redo stack. Undoing a step
+// applies its records newest first through the ordinary mutators, whose own
+// inverses land on the redo stack as one step; redoing works the other way
+// round. Records are packed bytes followed by their length, so a step can be
+// walked backwards, and consecutive inserts widen a single id range, so even a
+// bulk import of a million rows takes a few bytes to undo.
+
+#define UNDO_REMOVE_RANGE   1   // Inverse of inserting ids first..last in order
+#define UNDO_INSERT         2   // Inverse of a removal: the whole item
+#define UNDO_UPDATE         3   // Name, category and quantity before an update
+#define UNDO_STOCK          4   // Quantity before an adjustment
+#define UNDO_REORDER        5   // Reorder level before it was set
+
+// Kind, three varints, two length-prefixed strings and the length trailer
+#define UNDO_RECORD_MAX (1 + 3 * 5 + 2 * 5 + MAX_NAME_LENGTH + MAX_CATEGORY_LENGTH + 2)
+
+typedef struct {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+    size_t* starts;         // Offset of each step's first record
+    unsigned* serials;      // Step identity, kept as a step moves between the stacks
+    int count;
+    int stepCapacity;
+    int overflow;           // The open step outgrew the budget and stopped recording
+} UndoStack;
+
+typedef struct {
+    char name[STOCK_UNDO_NAME_LENGTH];  // Empty when the slot is free
+    long long depth;        // Undo steps taken (kept or dropped) at the mark
+    unsigned serial;        // Step just below the mark, 0 for none
+} UndoCheckpoint;
+
+struct StockUndoLog {
+    UndoStack undo;
+    UndoStack redo;
+    UndoStack* recording;   // Stack an undo or redo logs to, NULL for ordinary changes
+    size_t maxBytes;        // Budget of each stack
+    int groupDepth;
+    int stepOpen;           // The open group has started its step
+    unsigned nextSerial;
+    unsigned replaySerial;  // Serial of the step being undone or redone
+    long long dropped;      // Steps discarded from the bottom of the undo stack
+    unsigned droppedSerial; // The newest of them
+    UndoCheckpoint checkpoints[STOCK_UNDO_CHECKPOINTS];
+    int nextCheckpoint;     // Slot reused once all are taken
+};
+
+static void FreeUndoStack(UndoStack* stack)
+{
+    free(stack->data);
+    free(stack->starts);
+    free(stack->serials);
+    memset(stack, 0, sizeof(UndoStack));
+}
+
+static void ClearUndoStack(UndoStack* stack)
+{
+    stack->length = 0;
+    stack->count = 0;
+    stack->overflow = 0;
+}
+
+static inline UndoStack* RecordingStack(struct StockUndoLog* log)
+{
+    return log->recording != NULL ? log->recording : &log->undo;
+}
+
+static inline size_t UndoRecordLength(const unsigned char* end)
+{
+    return (size_t)end[-2] | ((size_t)end[-1] << 8);
+}
+
+// Latest record of the open step, or NULL if it has none yet
+static const unsigned char* LastUndoRecord(const struct StockUndoLog* log, const UndoStack* stack)
+{
+    if (!log->stepOpen || stack->overflow || stack->count == 0) return NULL;
+    if (stack->length == stack->starts[stack->count - 1]) return NULL;
+    
+    const unsigned char* end = stack->data + stack->length;
+    return end - 2 - UndoRecordLength(end);
+}
+
+// Discard the oldest `count` steps of a stack
+static void DropUndoSteps(struct StockUndoLog* log, UndoStack* stack, int count)
+{
+    if (count <= 0) return;
+    
+    if (stack == &log->undo)
+    {
+        log->dropped += count;
+        log->droppedSerial = stack->serials[count - 1];
+    }
+    
+    if (count >= stack->count)
+    {
+        ClearUndoStack(stack);
+        return;
+    }
+    
+    size_t offset = stack->starts[count];
+    memmove(stack->data, stack->data + offset, stack->length - offset);
+    stack->length -= offset;
+    
+    for (int i = count; i < stack->count; i++)
+    {
+        stack->starts[i - count] = stack->starts[i] - offset;
+        stack->serials[i - count] = stack->serials[i];
+    }
+    stack->count -= count;
+}
+
+// Make `room` more bytes fit the budget by dropping old steps (never the
+// newest), a quarter of the budget at a time
+static void TrimUndoStack(struct StockUndoLog* log, UndoStack* stack, size_t room)
+{
+    if (stack->length + room <= log->maxBytes) return;
+    
+    size_t keep = log->maxBytes - log->maxBytes / 4;
+    int drop = 0;
+    while (drop < stack->count - 1 && stack->length - stack->starts[drop] + room > keep) drop++;
+    
+    DropUndoSteps(log, stack, drop);
+}
+
+static void CloseUndoStep(struct StockUndoLog* log)
+{
+    if (!log->stepOpen) return;
+    
+    UndoStack* stack = RecordingStack(log);
+    log->stepOpen = 0;
+    
+    // The steps below an incomplete one would replay onto the wrong state
+    if (stack->overflow)
+    {
+        DropUndoSteps(log, stack, stack->count);
+        stack->overflow = 0;
+    }
+}
+
+// The stack a change logs to, with a step open; NULL if it goes unlogged
+static UndoStack* BeginUndoRecord(struct StockUndoLog* log)
+{
+    UndoStack* stack = RecordingStack(log);
+    
+    // A new change ends the redo history
+    if (log->recording == NULL && log->redo.count > 0) ClearUndoStack(&log->redo);
+    
+    if (log->stepOpen) return stack->overflow ? NULL : stack;
+    
+    log->stepOpen = 1;
+    if (stack->count == stack->stepCapacity)
+    {
+        int capacity = stack->stepCapacity > 0 ? stack->stepCapacity * 2 : 64;
+        size_t* starts = (size_t*)realloc(stack->starts, capacity * sizeof(size_t));
+        if (starts != NULL) stack->starts = starts;
+        unsigned* serials = (unsigned*)realloc(stack->serials, capacity * sizeof(unsigned));
+        if (serials != NULL) stack->serials = serials;
+        
+        if (starts == NULL || serials == NULL)
+        {
+            stack->overflow = 1;
+            return NULL;
+        }
+        stack->stepCapacity = capacity;
+    }
+    
+    stack->starts[stack->count] = stack->length;
+    stack->serials[stack->count] = log->recording != NULL ? log->replaySerial : ++log->nextSerial;
+    stack->count++;
+    return stack;
+}
+
+// Room for one record at the end of the open step, or NULL once it is over budget
+static unsigned char* ReserveUndoRecord(struct StockUndoLog* log, UndoStack* stack)
+{
+    if (stack->length - stack->starts[stack->count - 1] + UNDO_RECORD_MAX > log->maxBytes)
+    {
+        stack->overflow = 1;
+        return NULL;
+    }
+    
+    // The stack never outgrows the budget, so neither does its buffer
+    TrimUndoStack(log, stack, UNDO_RECORD_MAX);
+    if (stack->length + UNDO_RECORD_MAX > stack->capacity)
+    {
+        size_t capacity = stack->capacity > 0 ? stack->capacity * 2 : 4096;
+        while (capacity < stack->length + UNDO_RECORD_MAX) capacity *= 2;
+        if (capacity > log->maxBytes) capacity = log->maxBytes;
+        
+        unsigned char* data = (unsigned char*)realloc(stack->data, capacity);
+        if (data == NULL)
+        {
+            stack->overflow = 1;
+            return NULL;
+        }
+        stack->data = data;
+        stack->capacity = capacity;
+    }
+    return stack->data + stack->length;
+}
+
+static void CommitUndoRecord(UndoStack* stack, size_t length)
+{
+    unsigned char* trailer = stack->data + stack->length + length;
+    
+    trailer[0] = (unsigned char)length;
+    trailer[1] = (unsigned char)(length >> 8);
+    stack->length += length + 2;
+}
+
+static void EndUndoRecord(struct StockUndoLog* log)
+{
+    if (log->groupDepth == 0) CloseUndoStep(log);
+}
+
+// Undoing the open step already restores this field of the item when the step
+// inserted the item, or when its latest record restores the same field
+static int UndoAlreadyCovers(struct StockUndoLog* log, int kind, int id)
+{
+    const unsigned char* record = LastUndoRecord(log, RecordingStack(log));
+    if (record == NULL) return 0;
+    
+    if (record[0] == UNDO_REMOVE_RANGE)
+        return (unsigned)id >= ReadStockU32(record + 1) && (unsigned)id <= ReadStockU32(record + 5);
+    
+    const unsigned char* cursor = record + 1;
+    unsigned recordId;
+    return record[0] == kind && DecodeStockVarint(&cursor, cursor + 5, &recordId) && recordId == (unsigned)id;
+}
+
+static size_t PutUndoString(unsigned char* out, const char* text)
+{
+    size_t length = strlen(text);
+    size_t count = EncodeStockVarint(out, (unsigned)length);
+    
+    memcpy(out + count, text, length);
+    return count + length;
+}
+
+static void GetUndoString(const unsigned char** cursor, const unsigned char* end, char* text, size_t size)
+{
+    unsigned length = 0;
+    
+    if (!DecodeStockVarint(cursor, end, &length) || length >= size || length > (size_t)(end - *cursor)) length = 0;
+    memcpy(text, *cursor, length);
+    text[length] = '\0';
+    *cursor += length;
+}
+
+void RecordUndoInsert(StockManager* manager, int id)
+{
+    struct StockUndoLog* log = manager->undo;
+    UndoStack* stack = BeginUndoRecord(log);
+    
+    if (stack != NULL)
+    {
+        // An insert right after the range's last id widens the range in place
+        unsigned char* record = (unsigned char*)LastUndoRecord(log, stack);
+        if (record != NULL && record[0] == UNDO_REMOVE_RANGE && ReadStockU32(record + 5) + 1 == (unsigned)id)
+        {
+            StoreStockU32(record + 5, (unsigned)id);
+        }
+        else if ((record = ReserveUndoRecord(log, stack)) != NULL)
+        {
+            record[0] = UNDO_REMOVE_RANGE;
+            StoreStockU32(record + 1, (unsigned)id);
+            StoreStockU32(record + 5, (unsigned)id);
+            CommitUndoRecord(stack, 9);
+        }
+    }
+    EndUndoRecord(log);
+}
+
+void RecordUndoRemove(StockManager* manager, const StockItem* item)
+{
+    struct StockUndoLog* log = manager->undo;
+    UndoStack* stack = BeginUndoRecord(log);
+    unsigned char* out = stack != NULL ? ReserveUndoRecord(log, stack) : NULL;
+    
+    if (out != NULL)
+    {
+        size_t length = 0;
+        out[length++] = UNDO_INSERT;
+        length += EncodeStockVarint(out + length, (unsigned)item->id);
+        length += EncodeStockVarint(out + length, (unsigned)item->stock);
+        length += EncodeStockVarint(out + length, (unsigned)item->reorderLevel);
+        length += PutUndoString(out + length, item->name);
+        length += PutUndoString(out + length, GetStockItemCategory(manager, item));
+        CommitUndoRecord(stack, length);
+    }
+    EndUndoRecord(log);
+}
+
+void RecordUndoUpdate(StockManager* manager, const StockItem* item)
+{
+    struct StockUndoLog* log = manager->undo;
+    if (UndoAlreadyCovers(log, UNDO_UPDATE, item->id)) return;
+    
+    UndoStack* stack = BeginUndoRecord(log);
+    unsigned char* out = stack != NULL ? ReserveUndoRecord(log, stack) : NULL;
+    
+    if (out != NULL)
+    {
+        size_t length = 0;
+        out[length++] = UNDO_UPDATE;
+        length += EncodeStockVarint(out + length, (unsigned)item->id);
+        length += EncodeStockVarint(out + length, (unsigned)item->stock);
+        length += PutUndoString(out + length, item->name);
+        length += PutUndoString(out + length, GetStockItemCategory(manager, item));
+        CommitUndoRecord(stack, length);
+    }
+    EndUndoRecord(log);
+}
+
+static void RecordUndoValue(StockManager* manager, int kind, int id, int value)
+{
+    struct StockUndoLog* log = manager->undo;
+    if (UndoAlreadyCovers(log, kind, id)) return;
+    
+    UndoStack* stack = BeginUndoRecord(log);
+    unsigned char* out = stack != NULL ? ReserveUndoRecord(log, stack) : NULL;
+    
+    if (out != NULL)
+    {
+        size_t length = 0;
+        out[length++] = (unsigned char)kind;
+        length += EncodeStockVarint(out + length, (unsigned)id);
+        length += EncodeStockVarint(out + length, (unsigned)value);
+        CommitUndoRecord(stack, length);
+    }
+    EndUndoRecord(log);
+}
+
+void RecordUndoStock(StockManager* manager, int id, int stock)
+{
+    RecordUndoValue(manager, UNDO_STOCK, id, stock);
+}
+
+void RecordUndoReorder(StockManager* manager, int id, int level)
+{
+    RecordUndoValue(manager, UNDO_REORDER, id, level);
+}
+
+// Records that no longer fit the inventory (e.g. a name taken since) are skipped
+static void ApplyUndoRecord(StockManager* manager, const unsigned char* record, size_t length)
+{
+    const unsigned char* cursor = record + 1;
+    const unsigned char* end = record + length;
+    char name[MAX_NAME_LENGTH];
+    char category[MAX_CATEGORY_LENGTH];
+    unsigned id = 0, stock = 0, level = 0;
+    
+    if (record[0] == UNDO_REMOVE_RANGE)
+    {
+        // Newest first: items still at the end leave without moving others
+        unsigned first = ReadStockU32(record + 1);
+        for (unsigned last = ReadStockU32(record + 5) + 1; last-- > first;)
+        {
+            RemoveStockItemById(manager, (int)last);
+        }
+        return;
+    }
+    
+    DecodeStockVarint(&cursor, end, &id);
+    int index = FindStockItemById(manager, (int)id);
+    
+    switch (record[0])
+    {
+        case UNDO_INSERT:
+            DecodeStockVarint(&cursor, end, &stock);
+            DecodeStockVarint(&cursor, end, &level);
+            GetUndoString(&cursor, end, name, MAX_NAME_LENGTH);
+            GetUndoString(&cursor, end, category, MAX_CATEGORY_LENGTH);
+            if (index < 0 && InsertStockItem(manager, name, category, (int)stock, (int)id) && level > 0)
+            {
+                SetStockReorderLevel(manager, manager->itemCount - 1, (int)level);
+            }
+            break;
+        
+        case UNDO_UPDATE:
+            DecodeStockVarint(&cursor, end, &stock);
+            GetUndoString(&cursor, end, name, MAX_NAME_LENGTH);
+            GetUndoString(&cursor, end, category, MAX_CATEGORY_LENGTH);
+            if (index >= 0) UpdateStockItem(manager, index, name, category, (int)stock);
+            break;
+        
+        case UNDO_STOCK:
+        {
+            StockItem* item = GetStockItem(manager, index);
+            if (item != NULL && DecodeStockVarint(&cursor, end, &stock))
+            {
+                AdjustStockItem(manager, index, (int)stock - item->stock);
+            }
+            break;
+        }
+        
+        case UNDO_REORDER:
+            if (index >= 0 && DecodeStockVarint(&cursor, end, &level))
+            {
+                SetStockReorderLevel(manager, index, (int)level);
+            }
+            break;
+    }
+}
+
+// Apply the newest step of `from`, logging its inverse on `to` as one step
+static int ReplayUndoStep(StockManager* manager, UndoStack* from, UndoStack* to)
+{
+    struct StockUndoLog* log = manager->undo;
+    if (log->groupDepth > 0 || log->recording != NULL || from->count == 0) return 0;
+    
+    int step = from->count - 1;
+    size_t start = from->starts[step];
+    size_t end = from->length;
+    
+    log->recording = to;
+    log->replaySerial = from->serials[step];
+    log->groupDepth++;
+    
+    // Subscribers get the whole step as one change set
+    BeginStockBatch(manager);
+    while (end > start)
+    {
+        size_t length = UndoRecordLength(from->data + end);
+        end -= length + 2;
+        ApplyUndoRecord(manager, from->data + end, length);
+    }
+    EndStockBatch(manager);
+    
+    log->groupDepth--;
+    CloseUndoStep(log);
+    log->recording = NULL;
+    
+    // Unless the replay reloaded the inventory and cleared the log
+    if (from->count > step)
+    {
+        from->count = step;
+        from->length = start;
+    }
+    return 1;
+}
+
+// Fit a stack to a lowered budget
+static void ShrinkUndoStack(struct StockUndoLog* log, UndoStack* stack)
+{
+    TrimUndoStack(log, stack, 0);
+    if (stack->length > log->maxBytes) DropUndoSteps(log, stack, stack->count);
+    if (stack->capacity <= log->maxBytes) return;
+    
+    unsigned char* data = (unsigned char*)realloc(stack->data, log->maxBytes);
+    if (data == NULL) return;
+    
+    stack->data = data;
+    stack->capacity = log->maxBytes;
+}
+
+int EnableStockUndo(StockManager* manager, size_t maxBytes)
+{
+    if (manager == NULL) return 0;
+    
+    if (maxBytes == 0)
+    {
+        FreeStockUndo(manager);
+        return 1;
+    }
+    
+    if (manager->undo == NULL)
+    {
+        manager->undo = (struct StockUndoLog*)calloc(1, sizeof(struct StockUndoLog));
+        if (manager->undo == NULL) return 0;
+    }
+    
+    // Every step must fit at least a few records
+    struct StockUndoLog* log = manager->undo;
+    log->maxBytes = maxBytes > 4 * UNDO_RECORD_MAX ? maxBytes : 4 * UNDO_RECORD_MAX;
+    ShrinkUndoStack(log, &log->undo);
+    ShrinkUndoStack(log, &log->redo);
+    return 1;
+}
+
+void BeginStockUndoGroup(StockManager* manager)
+{
+    if (manager == NULL || manager->undo == NULL) return;
+    
+    manager->undo->groupDepth++;
+}
+
+void EndStockUndoGroup(StockManager* manager)
+{
+    if (manager == NULL || manager->undo == NULL || manager->undo->groupDepth == 0) return;
+    
+    if (--manager->undo->groupDepth == 0) CloseUndoStep(manager->undo);
+}
+
+int UndoStockChange(StockManager* manager)
+{
+    if (manager == NULL || manager->undo == NULL) return 0;
+    
+    return ReplayUndoStep(manager, &manager->undo->undo, &manager->undo->redo);
+}
+
+int RedoStockChange(StockManager* manager)
+{
+    if (manager == NULL || manager->undo == NULL) return 0;
+    
+    return ReplayUndoStep(manager, &manager->undo->redo, &manager->undo->undo);
+}
+
+int CanUndoStockChange(const StockManager* manager)
+{
+    return manager != NULL && manager->undo != NULL && manager->undo->undo.count > 0;
+}
+
+int CanRedoStockChange(const StockManager* manager)
+{
+    return manager != NULL && manager->undo != NULL && manager->undo->redo.count > 0;
+}
+
+static UndoCheckpoint* FindUndoCheckpoint(struct StockUndoLog* log, const char* name)
+{
+    char key[STOCK_UNDO_NAME_LENGTH];
+    SafeUTF8Copy(key, name, STOCK_UNDO_NAME_LENGTH);
+    
+    for (int i = 0; i < STOCK_UNDO_CHECKPOINTS; i++)
+    {
+        if (log->checkpoints[i].name[0] != '\0' && strcmp(log->checkpoints[i].name, key) == 0)
+            return &log->checkpoints[i];
+    }
+    return NULL;
+}
+
+int MarkStockCheckpoint(StockManager* manager, const char* name)
+{
+    if (manager == NULL || manager->undo == NULL || name == NULL || name[0] == '\0') return 0;
+    
+    // A step half taken is no position to return to
+    struct StockUndoLog* log = manager->undo;
+    if (log->stepOpen || log->recording != NULL) return 0;
+    
+    UndoCheckpoint* checkpoint = FindUndoCheckpoint(log, name);
+    for (int i = 0; i < STOCK_UNDO_CHECKPOINTS && checkpoint == NULL; i++)
+    {
+        if (log->checkpoints[i].name[0] == '\0') checkpoint = &log->checkpoints[i];
+    }
+    
+    // All slots taken: reuse them in turn
+    if (checkpoint == NULL)
+    {
+        checkpoint = &log->checkpoints[log->nextCheckpoint];
+        log->nextCheckpoint = (log->nextCheckpoint + 1) % STOCK_UNDO_CHECKPOINTS;
+    }
+    
+    SafeUTF8Copy(checkpoint->name, name, STOCK_UNDO_NAME_LENGTH);
+    checkpoint->depth = log->dropped + log->undo.count;
+    checkpoint->serial = log->undo.count > 0 ? log->undo.serials[log->undo.count - 1] : log->droppedSerial;
+    return 1;
+}
+
+int RollbackStockCheckpoint(StockManager* manager, const char* name)
+{
+    if (manager == NULL || manager->undo == NULL || name == NULL) return 0;
+    
+    struct StockUndoLog* log = manager->undo;
+    UndoCheckpoint* checkpoint = FindUndoCheckpoint(log, name);
+    if (checkpoint == NULL) return 0;
+    
+    // The step below the mark must still be the one that was there: not
+    // dropped for the budget, and not undone and replaced by other changes
+    long long depth = log->dropped + log->undo.count;
+    if (checkpoint->depth > depth || checkpoint->depth < log->dropped) return 0;
+    
+    int below = (int)(checkpoint->depth - log->dropped);
+    unsigned serial = below > 0 ? log->undo.serials[below - 1] : log->droppedSerial;
+    if (serial != checkpoint->serial) return 0;
+    
+    while (log->dropped + log->undo.count > checkpoint->depth)
+    {
+        if (!UndoStockChange(manager)) return 0;
+    }
+    return 1;
+}
+
+void GetStockUndoStats(const StockManager* manager, StockUndoStats* stats)
+{
+    if (stats == NULL) return;
+    
+    memset(stats, 0, sizeof(StockUndoStats));
+    if (manager == NULL || manager->undo == NULL) return;
+    
+    const struct StockUndoLog* log = manager->undo;
+    stats->undoSteps = log->undo.count;
+    stats->redoSteps = log->redo.count;
+    stats->undoBytes = log->undo.length;
+    stats->redoBytes = log->redo.length;
+    stats->allocatedBytes = sizeof(struct StockUndoLog) + log->undo.capacity + log->redo.capacity +
+                            (size_t)(log->undo.stepCapacity + log->redo.stepCapacity) * (sizeof(size_t) + sizeof(unsigned));
+    stats->droppedSteps = log->dropped;
+}
+
+void ClearStockUndo(StockManager* manager)
+{
+    if (manager->undo == NULL) return;
+    
+    struct StockUndoLog* log = manager->undo;
+    ClearUndoStack(&log->undo);
+    ClearUndoStack(&log->redo);
+    log->stepOpen = 0;
+    log->dropped = 0;
+    log->droppedSerial = 0;
+    memset(log->checkpoints, 0, sizeof(log->checkpoints));
+}
+
+void FreeStockUndo(StockManager* manager)
+{
+    if (manager->undo == NULL) return;
+    
+    FreeUndoStack(&manager->undo->undo);
+    FreeUndoStack(&manager->undo->redo);
+    free(manager->undo);
+    manager->undo = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef STOCK_UNDO_H
+#define STOCK_UNDO_H
+
+#include "stock.h"
+
+// Internal hooks that log the inverse of each change before it is applied.
+// Callers check manager->undo first, so with undo off a change costs one test.
+void RecordUndoInsert(StockManager* manager, int id);
+void RecordUndoRemove(StockManager* manager, const StockItem* item);
+void RecordUndoUpdate(StockManager* manager, const StockItem* item);    // Item as it was
+void RecordUndoStock(StockManager* manager, int id, int stock);
+void RecordUndoReorder(StockManager* manager, int id, int level);
+void ClearStockUndo(StockManager* manager);     // The inventory was replaced or renumbered
+void FreeStockUndo(StockManager* manager);
+
+#endif // STOCK_UNDO_H
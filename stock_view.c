@@ -0,0 +1,437 @@
+#include "stock_internal.h"
+#include "stock_platform.h"
+#include "stock_view.h"
+
+// Immutable versions for reader threads. A version is a two-level tree: inner
+// nodes of 256 leaf pointers, leaves of 64 items with their text packed behind
+// them. The owner thread subscribes to the inventory's changes, marks the
+// leaves they touched and, when a change or batch is complete, publishes a new
+// version: copies of the touched leaves and of the inner nodes above them, and
+// shared pointers to everything else. The nodes a version replaces stay
+// reachable from older versions only, so they are retired with the version
+// they replaced.
+//
+// Readers pin a version by announcing the current epoch in their slot and
+// then loading the version pointer. A version replaced while the epoch was E
+// is freed (with its retired nodes) once every active reader announced a later
+// epoch: the epoch moves on after the pointer swap, so such a reader can only
+// have loaded a newer version.
+
+#define VIEW_LEAF_SHIFT 6
+#define VIEW_LEAF_SIZE (1 << VIEW_LEAF_SHIFT)
+#define VIEW_INNER_SHIFT 8
+#define VIEW_INNER_SIZE (1 << VIEW_INNER_SHIFT)
+#define VIEW_INNER_ITEMS_SHIFT (VIEW_LEAF_SHIFT + VIEW_INNER_SHIFT)
+#define VIEW_INNER_ITEMS (1 << VIEW_INNER_ITEMS_SHIFT)
+
+typedef struct {
+    StockViewItem items[VIEW_LEAF_SIZE];
+    char text[];                    // Names and categories of the items, back to back
+} StockViewLeaf;
+
+typedef struct {
+    StockViewLeaf* leaves[VIEW_INNER_SIZE];     // NULL past the end of the inventory
+} StockViewInner;
+
+struct StockView {
+    unsigned long long version;
+    unsigned long long retired;     // Epoch it was replaced in
+    struct StockView* nextRetired;
+    void** garbage;                 // Nodes the next version replaced
+    int garbageCount;
+    int itemCount;
+    int innerCount;
+    StockViewInner* inners[];
+};
+
+// One cache line per reader, so announcing an epoch does not slow the others
+typedef struct {
+    volatile unsigned long long epoch;  // Epoch announced by the open read, 0 when idle
+    volatile long used;
+    char padding[64 - sizeof(unsigned long long) - sizeof(long)];
+} StockReaderSlot;
+
+struct StockViews {
+    StockReaderSlot readers[STOCK_MAX_READERS];
+    void* volatile current;         // Latest StockView
+    volatile unsigned long long epoch;
+    
+    // Owner thread only
+    struct StockView* latest;
+    struct StockView* retiredHead;  // Oldest first
+    struct StockView* retiredTail;
+    unsigned char* dirty;           // One bit per leaf touched since the last publish
+    int dirtyCapacity;              // Leaves covered by dirty
+    int allDirty;
+    int subscription;
+};
+
+static void FreeRetiredView(struct StockView* view)
+{
+    for (int i = 0; i < view->garbageCount; i++) free(view->garbage[i]);
+    free(view->garbage);
+    free(view);
+}
+
+// Free a version together with every node it uses
+static void FreeViewTree(struct StockView* view)
+{
+    for (int j = 0; j < view->innerCount; j++)
+    {
+        for (int l = 0; l < VIEW_INNER_SIZE; l++) free(view->inners[j]->leaves[l]);
+        free(view->inners[j]);
+    }
+    free(view);
+}
+
+static void MarkViewLeaf(struct StockViews* views, int leaf)
+{
+    if (leaf >= views->dirtyCapacity)
+    {
+        int capacity = views->dirtyCapacity > 0 ? views->dirtyCapacity : VIEW_INNER_SIZE;
+        while (capacity <= leaf) capacity *= 2;
+        
+        unsigned char* dirty = (unsigned char*)realloc(views->dirty, (size_t)capacity / 8);
+        if (dirty == NULL)
+        {
+            views->allDirty = 1;
+            return;
+        }
+        memset(dirty + views->dirtyCapacity / 8, 0, (size_t)(capacity - views->dirtyCapacity) / 8);
+        views->dirty = dirty;
+        views->dirtyCapacity = capacity;
+    }
+    views->dirty[leaf >> 3] |= (unsigned char)(1u << (leaf & 7));
+}
+
+static int IsViewLeafDirty(const struct StockViews* views, int leaf)
+{
+    if (views->allDirty) return 1;
+    return leaf < views->dirtyCapacity && (views->dirty[leaf >> 3] & (1u << (leaf & 7)));
+}
+
+// Whether inner node `j` differs between item counts `previousCount` and `count`
+static int IsViewInnerChanged(const struct StockViews* views, int j, int count, int previousCount)
+{
+    int first = j << VIEW_INNER_ITEMS_SHIFT;
+    int end = count - first < VIEW_INNER_ITEMS ? count - first : VIEW_INNER_ITEMS;
+    int previousEnd = previousCount - first < VIEW_INNER_ITEMS ? previousCount - first : VIEW_INNER_ITEMS;
+    
+    if (views->allDirty || end != previousEnd) return 1;
+    
+    // The dirty bits of the node's leaves fill 32 whole bytes
+    int byte = j << (VIEW_INNER_SHIFT - 3);
+    for (int i = 0; i < VIEW_INNER_SIZE / 8 && byte + i < views->dirtyCapacity / 8; i++)
+    {
+        if (views->dirty[byte + i] != 0) return 1;
+    }
+    return 0;
+}
+
+// Copy items [first, first + count) with their text packed behind them
+static StockViewLeaf* BuildViewLeaf(StockManager* manager, int first, int count)
+{
+    size_t textLength = 0;
+    for (int i = 0; i < count; i++)
+    {
+        StockItem* item = ResidentStockItem(manager, first + i);
+        if (item == NULL) return NULL;
+        
+        textLength += strlen(item->name) + strlen(GetStockItemCategory(manager, item)) + 2;
+    }
+    
+    StockViewLeaf* leaf = (StockViewLeaf*)malloc(sizeof(StockViewLeaf) + textLength);
+    if (leaf == NULL) return NULL;
+    
+    char* text = leaf->text;
+    for (int i = 0; i < count; i++)
+    {
+        const StockItem* item = StockItemAt(manager, first + i);
+        const char* category = GetStockItemCategory(manager, item);
+        StockViewItem* copy = &leaf->items[i];
+        size_t nameLength = strlen(item->name) + 1;
+        size_t categoryLength = strlen(category) + 1;
+        
+        copy->id = item->id;
+        copy->stock = item->stock;
+        copy->reorderLevel = item->reorderLevel;
+        copy->name = text;
+        memcpy(text, item->name, nameLength);
+        text += nameLength;
+        copy->category = text;
+        memcpy(text, category, categoryLength);
+        text += categoryLength;
+    }
+    return leaf;
+}
+
+// Undo a publish that ran out of memory: free the nodes it created
+static void DiscardViewDraft(struct StockView* view, const struct StockView* previous, void** garbage)
+{
+    for (int j = 0; j < view->innerCount; j++)
+    {
+        StockViewInner* old = previous != NULL && j < previous->innerCount ? previous->inners[j] : NULL;
+        StockViewInner* inner = view->inners[j];
+        if (inner == old) continue;
+        
+        for (int l = 0; l < VIEW_INNER_SIZE; l++)
+        {
+            if (old == NULL || inner->leaves[l] != old->leaves[l]) free(inner->leaves[l]);
+        }
+        free(inner);
+    }
+    free(garbage);
+    free(view);
+}
+
+// Free the retired versions no active reader can hold
+static void ReclaimStockViews(struct StockViews* views)
+{
+    unsigned long long oldest = ~0ULL;
+    
+    for (int i = 0; i < STOCK_MAX_READERS; i++)
+    {
+        unsigned long long epoch = LoadStockCounter(&views->readers[i].epoch);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    
+    while (views->retiredHead != NULL && views->retiredHead->retired < oldest)
+    {
+        struct StockView* view = views->retiredHead;
+        views->retiredHead = view->nextRetired;
+        FreeRetiredView(view);
+    }
+    if (views->retiredHead == NULL) views->retiredTail = NULL;
+}
+
+static int PublishStockView(StockManager* manager, struct StockViews* views)
+{
+    struct StockView* previous = views->latest;
+    int count = manager->itemCount;
+    int innerCount = (count + VIEW_INNER_ITEMS - 1) >> VIEW_INNER_ITEMS_SHIFT;
+    int previousCount = previous != NULL ? previous->itemCount : 0;
+    int previousInners = previous != NULL ? previous->innerCount : 0;
+    int spanned = innerCount > previousInners ? innerCount : previousInners;
+    
+    // Room for every node the new version can replace: a changed inner node and all its leaves
+    size_t garbageLimit = 0;
+    for (int j = 0; j < previousInners; j++)
+    {
+        if (IsViewInnerChanged(views, j, count, previousCount)) garbageLimit += VIEW_INNER_SIZE + 1;
+    }
+    
+    void** garbage = NULL;
+    if (garbageLimit > 0)
+    {
+        garbage = (void**)malloc(garbageLimit * sizeof(void*));
+        if (garbage == NULL) return 0;
+    }
+    
+    struct StockView* view = (struct StockView*)malloc(sizeof(struct StockView) + (size_t)innerCount * sizeof(StockViewInner*));
+    if (view == NULL)
+    {
+        free(garbage);
+        return 0;
+    }
+    
+    view->version = previous != NULL ? previous->version + 1 : 1;
+    view->retired = 0;
+    view->nextRetired = NULL;
+    view->garbage = NULL;
+    view->garbageCount = 0;
+    view->itemCount = count;
+    view->innerCount = 0;
+    
+    int garbageCount = 0;
+    for (int j = 0; j < spanned; j++)
+    {
+        StockViewInner* old = j < previousInners ? previous->inners[j] : NULL;
+        
+        // Nodes past the end of a shrunken inventory are simply dropped
+        if (j >= innerCount)
+        {
+            for (int l = 0; l < VIEW_INNER_SIZE; l++)
+            {
+                if (old->leaves[l] != NULL) garbage[garbageCount++] = old->leaves[l];
+            }
+            garbage[garbageCount++] = old;
+            continue;
+        }
+        
+        if (old != NULL && !IsViewInnerChanged(views, j, count, previousCount))
+        {
+            view->inners[view->innerCount++] = old;
+            continue;
+        }
+        
+        StockViewInner* inner = (StockViewInner*)calloc(1, sizeof(StockViewInner));
+        if (inner == NULL)
+        {
+            DiscardViewDraft(view, previous, garbage);
+            return 0;
+        }
+        view->inners[view->innerCount++] = inner;
+        
+        for (int l = 0; l < VIEW_INNER_SIZE; l++)
+        {
+            StockViewLeaf* oldLeaf = old != NULL ? old->leaves[l] : NULL;
+            int first = (j << VIEW_INNER_ITEMS_SHIFT) + (l << VIEW_LEAF_SHIFT);
+            int items = count - first < VIEW_LEAF_SIZE ? count - first : VIEW_LEAF_SIZE;
+            
+            // A leaf is reused unless touched, or grown past what it holds
+            if (items <= 0)
+            {
+                inner->leaves[l] = NULL;
+            }
+            else if (oldLeaf != NULL && !IsViewLeafDirty(views, first >> VIEW_LEAF_SHIFT) && first + items <= previousCount)
+            {
+                inner->leaves[l] = oldLeaf;
+                continue;
+            }
+            else
+            {
+                inner->leaves[l] = BuildViewLeaf(manager, first, items);
+                if (inner->leaves[l] == NULL)
+                {
+                    // Readers keep the previous version; the marks stay for the next try
+                    DiscardViewDraft(view, previous, garbage);
+                    return 0;
+                }
+            }
+            if (oldLeaf != NULL) garbage[garbageCount++] = oldLeaf;
+        }
+        if (old != NULL) garbage[garbageCount++] = old;
+    }
+    
+    // Swap first, then move the epoch on: a reader announcing the new epoch
+    // is certain to load the new version
+    StoreStockPointer(&views->current, view);
+    views->latest = view;
+    
+    if (previous != NULL)
+    {
+        previous->garbage = garbage;
+        previous->garbageCount = garbageCount;
+        previous->retired = LoadStockCounter(&views->epoch);
+        if (views->retiredTail != NULL)
+            views->retiredTail->nextRetired = previous;
+        else
+            views->retiredHead = previous;
+        views->retiredTail = previous;
+    }
+    StoreStockCounter(&views->epoch, LoadStockCounter(&views->epoch) + 1);
+    
+    if (views->dirty != NULL) memset(views->dirty, 0, (size_t)views->dirtyCapacity / 8);
+    views->allDirty = 0;
+    ReclaimStockViews(views);
+    return 1;
+}
+
+// Runs on the owner thread once a change or batch is complete
+static void StockViewsChanged(StockManager* manager, const StockChange* changes, int count, void* context)
+{
+    struct StockViews* views = (struct StockViews*)context;
+    
+    for (int i = 0; i < count && !views->allDirty; i++)
+    {
+        if (changes[i].kind == STOCK_CHANGE_RELOADED)
+            views->allDirty = 1;
+        else if (changes[i].index >= 0)
+            MarkViewLeaf(views, changes[i].index >> VIEW_LEAF_SHIFT);
+    }
+    
+    PublishStockView(manager, views);
+}
+
+StockViews* EnableStockViews(StockManager* manager)
+{
+    if (manager == NULL) return NULL;
+    if (manager->views != NULL) return manager->views;
+    
+    struct StockViews* views = (struct StockViews*)calloc(1, sizeof(struct StockViews));
+    if (views == NULL) return NULL;
+    
+    views->epoch = 1;
+    views->subscription = SubscribeStockChanges(manager, StockViewsChanged, views);
+    if (views->subscription == 0 || !PublishStockView(manager, views))
+    {
+        UnsubscribeStockChanges(manager, views->subscription);
+        free(views->dirty);
+        free(views);
+        return NULL;
+    }
+    
+    manager->views = views;
+    return views;
+}
+
+int OpenStockReader(StockViews* views)
+{
+    if (views == NULL) return -1;
+    
+    for (int i = 0; i < STOCK_MAX_READERS; i++)
+    {
+        if (ClaimStockFlag(&views->readers[i].used)) return i;
+    }
+    return -1;
+}
+
+void CloseStockReader(StockViews* views, int reader)
+{
+    if (views == NULL || reader < 0 || reader >= STOCK_MAX_READERS) return;
+    
+    StoreStockCounter(&views->readers[reader].epoch, 0);
+    ClearStockFlag(&views->readers[reader].used);
+}
+
+const StockView* BeginStockRead(StockViews* views, int reader)
+{
+    if (views == NULL || reader < 0 || reader >= STOCK_MAX_READERS) return NULL;
+    
+    StoreStockCounter(&views->readers[reader].epoch, LoadStockCounter(&views->epoch));
+    return (const StockView*)LoadStockPointer(&views->current);
+}
+
+void EndStockRead(StockViews* views, int reader)
+{
+    if (views == NULL || reader < 0 || reader >= STOCK_MAX_READERS) return;
+    
+    StoreStockCounter(&views->readers[reader].epoch, 0);
+}
+
+int GetStockViewCount(const StockView* view)
+{
+    return view != NULL ? view->itemCount : 0;
+}
+
+const StockViewItem* GetStockViewItem(const StockView* view, int index)
+{
+    if (view == NULL || index < 0 || index >= view->itemCount) return NULL;
+    
+    const StockViewLeaf* leaf = view->inners[index >> VIEW_INNER_ITEMS_SHIFT]->leaves[(index >> VIEW_LEAF_SHIFT) & (VIEW_INNER_SIZE - 1)];
+    return &leaf->items[index & (VIEW_LEAF_SIZE - 1)];
+}
+
+unsigned long long GetStockViewVersion(const StockView* view)
+{
+    return view != NULL ? view->version : 0;
+}
+
+void FreeStockViews(StockManager* manager)
+{
+    struct StockViews* views = manager->views;
+    if (views == NULL) return;
+    
+    UnsubscribeStockChanges(manager, views->subscription);
+    while (views->retiredHead != NULL)
+    {
+        struct StockView* view = views->retiredHead;
+        views->retiredHead = view->nextRetired;
+        FreeRetiredView(view);
+    }
+    if (views->latest != NULL) FreeViewTree(views->latest);
+    
+    free(views->dirty);
+    free(views);
+    manager->views = NULL;
+}
@@ -0,0 +1,9 @@
+#ifndef STOCK_VIEW_H
+#define STOCK_VIEW_H
+
+#include "stock.h"
+
+// Internal side of the reader views. Readers must be done before the manager is freed.
+void FreeStockViews(StockManager* manager);
+
+#endif // STOCK_VIEW_H
@@ -0,0 +1,204 @@
+// Concurrency stress for the portable core: view readers, the query pool and
+// the background saver all run while the owner keeps editing one inventory.
+// `make stress` builds it with ThreadSanitizer; it exits nonzero if a reader,
+// a parallel scan or a save sees an inventory that never existed.
+#include "stock.h"
+#include "stock_platform.h"
+
+#define STRESS_ITEMS (5 * STOCK_SHARD_ITEMS)    // Large enough for sharded scans
+#define STRESS_READERS 3
+#define STRESS_ROUNDS 200
+#define STRESS_MOVES 50                         // Batched stock moves per round
+#define STRESS_FILE "stress_check.dat"
+
+typedef struct {
+    StockViews* views;
+    volatile unsigned long long* stop;
+    int expectedCount;
+    long long expectedTotal;
+    long long reads;
+    long long inconsistent;     // Wrong count, total or item, or an older version than before
+} StressReader;
+
+static volatile unsigned long long g_failedSaves = 0;
+
+// Every version must hold all items and the same total: the owner only moves stock
+static void ReadViews(void* context)
+{
+    StressReader* state = (StressReader*)context;
+    int reader = OpenStockReader(state->views);
+    unsigned long long lastVersion = 0;
+    
+    if (reader < 0) state->inconsistent++;
+    while (reader >= 0 && !LoadStockCounter(state->stop))
+    {
+        const StockView* view = BeginStockRead(state->views, reader);
+        int count = GetStockViewCount(view);
+        long long total = 0;
+        
+        for (int i = 0; i < count; i++)
+        {
+            const StockViewItem* item = GetStockViewItem(view, i);
+            if (item->id <= 0 || item->stock < 0 || item->name == NULL || item->category == NULL) state->inconsistent++;
+            total += item->stock;
+        }
+        if (count != state->expectedCount || total != state->expectedTotal || GetStockViewVersion(view) < lastVersion)
+            state->inconsistent++;
+        
+        lastVersion = GetStockViewVersion(view);
+        EndStockRead(state->views, reader);
+        state->reads++;
+    }
+    CloseStockReader(state->views, reader);
+}
+
+static void CountSave(int result, void* context)
+{
+    (void)context;
+    
+    for (;;)
+    {
+        unsigned long long failed = LoadStockCounter(&g_failedSaves);
+        if (result || SwapStockCounter(&g_failedSaves, failed, failed + 1)) break;
+    }
+}
+
+// Parallel scans must return what a plain loop over the items finds, in item order
+static int CheckScans(StockManager* manager, int* indices, int minStock, int maxStock, const char* term)
+{
+    int found = GetStockItemsInRange(manager, minStock, maxStock, indices, manager->itemCount);
+    int expected = 0;
+    int same = 1;
+    
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        int stock = GetStockItem(manager, i)->stock;
+        if (stock < minStock || stock > maxStock) continue;
+        
+        if (expected >= found || indices[expected] != i) same = 0;
+        expected++;
+    }
+    if (found != expected) same = 0;
+    
+    found = SearchStockItemIndices(manager, term, STOCK_SEARCH_EXACT | STOCK_SEARCH_SCAN, 0, indices, manager->itemCount);
+    expected = 0;
+    for (int i = 0; i < manager->itemCount; i++)
+    {
+        if (strstr(GetStockItem(manager, i)->name, term) == NULL) continue;
+        
+        if (expected >= found || indices[expected] != i) same = 0;
+        expected++;
+    }
+    if (found != expected) same = 0;
+    
+    return same;
+}
+
+// The last save must read back as the inventory it was taken from
+static int CheckSavedCopy(StockManager* manager)
+{
+    StockManager saved;
+    InitStockManager(&saved);
+    int same = LoadStockFromFile(&saved, STRESS_FILE) && saved.itemCount == manager->itemCount;
+    
+    for (int i = 0; same && i < manager->itemCount; i++)
+    {
+        const StockItem* item = GetStockItem(manager, i);
+        const StockItem* other = GetStockItemById(&saved, item->id);
+        
+        same = other != NULL && other->stock == item->stock && strcmp(other->name, item->name) == 0;
+    }
+    
+    FreeStockManager(&saved);
+    return same;
+}
+
+int main(void)
+{
+    char name[64];
+    char category[32];
+    StockManager manager;
+    
+    InitStockManager(&manager);
+    ReserveStockItems(&manager, STRESS_ITEMS);
+    for (int i = 0; i < STRESS_ITEMS; i++)
+    {
+        snprintf(name, sizeof(name), "Product %d", i);
+        snprintf(category, sizeof(category), "Category %d", i % 40);
+        AddStockItem(&manager, name, category, i % 100);
+    }
+    
+    long long total = 0;
+    for (int i = 0; i < STRESS_ITEMS; i++) total += GetStockItem(&manager, i)->stock;
+    
+    int* indices = (int*)malloc(STRESS_ITEMS * sizeof(int));
+    StockViews* views = EnableStockViews(&manager);
+    int threads = SetStockQueryThreads(&manager, 4);
+    int saverStarted = StartStockSaver(&manager, CountSave, NULL);
+    if (indices == NULL || views == NULL || threads < 2 || !saverStarted)
+    {
+        fprintf(stderr, "stress: setup failed\n");
+        return 1;
+    }
+    
+    volatile unsigned long long stop = 0;
+    StressReader readers[STRESS_READERS];
+    StockThread* readerThreads[STRESS_READERS];
+    for (int r = 0; r < STRESS_READERS; r++)
+    {
+        readers[r].views = views;
+        readers[r].stop = &stop;
+        readers[r].expectedCount = STRESS_ITEMS;
+        readers[r].expectedTotal = total;
+        readers[r].reads = readers[r].inconsistent = 0;
+        readerThreads[r] = StartStockThread(ReadViews, &readers[r]);
+    }
+    
+    unsigned state = 7;
+    int badScans = 0;
+    for (int round = 0; round < STRESS_ROUNDS; round++)
+    {
+        for (int move = 0; move < STRESS_MOVES; move++)
+        {
+            state = state * 1103515245u + 12345u;
+            int from = (int)((state >> 8) % STRESS_ITEMS);
+            state = state * 1103515245u + 12345u;
+            int to = (int)((state >> 8) % STRESS_ITEMS);
+            
+            BeginStockBatch(&manager);
+            if (AdjustStockItem(&manager, from, -1)) AdjustStockItem(&manager, to, 1);
+            EndStockBatch(&manager);
+        }
+        
+        // Renames change the scanned name column without touching quantities
+        StockItem* item = GetStockItem(&manager, (int)(state % STRESS_ITEMS));
+        snprintf(name, sizeof(name), "Product %d r%d", item->id, round);
+        snprintf(category, sizeof(category), "%s", GetStockItemCategory(&manager, item));
+        UpdateStockItem(&manager, (int)(state % STRESS_ITEMS), name, category, item->stock);
+        
+        if (!CheckScans(&manager, indices, round % 100, round % 100 + 5, round % 2 ? "Product 12" : " r")) badScans++;
+        if (round % 10 == 0) RequestStockSave(&manager, STRESS_FILE);
+    }
+    
+    RequestStockSave(&manager, STRESS_FILE);
+    int saved = WaitStockSave(&manager) && CheckSavedCopy(&manager);
+    StopStockSaver(&manager);
+    
+    StoreStockCounter(&stop, 1);
+    long long reads = 0, inconsistent = 0;
+    for (int r = 0; r < STRESS_READERS; r++)
+    {
+        JoinStockThread(readerThreads[r]);
+        reads += readers[r].reads;
+        inconsistent += readers[r].inconsistent;
+    }
+    
+    unsigned long long failedSaves = LoadStockCounter(&g_failedSaves);
+    printf("stress: items=%d readers=%d query threads=%d reads=%lld inconsistent=%lld bad scans=%d failed saves=%llu last save %s\n",
+           STRESS_ITEMS, STRESS_READERS, threads, reads, inconsistent, badScans, failedSaves, saved ? "matches" : "differs");
+    
+    FreeStockManager(&manager);
+    free(indices);
+    remove(STRESS_FILE);
+    return inconsistent == 0 && badScans == 0 && failedSaves == 0 && saved ? 0 : 1;
+}